@@ -0,0 +1,85 @@
+#include "bench_alloc.h"
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+// Only one simulated node runs at a time, but the event loop allocates from the main thread,
+// so the counters are updated atomically.
+static uint64_t allocs;
+static uint64_t frees;
+static size_t live_bytes;
+static size_t peak_bytes;
+
+static void bench_alloc_note(void *ptr)
+{
+    size_t live = __atomic_add_fetch(&live_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&peak_bytes, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void bench_alloc_forget(void *ptr)
+{
+    __atomic_sub_fetch(&live_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&frees, 1, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    if (ptr) {
+        bench_alloc_note(ptr);
+    }
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __real_calloc(count, size);
+    if (ptr) {
+        bench_alloc_note(ptr);
+    }
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void *out = __real_realloc(ptr, size);
+    if (out) {
+        // Counted as a fresh allocation replacing the old block.
+        __atomic_sub_fetch(&live_bytes, old, __ATOMIC_RELAXED);
+        bench_alloc_note(out);
+    } else if (size == 0 && ptr) {
+        bench_alloc_forget(ptr);
+    }
+    return out;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr) {
+        bench_alloc_forget(ptr);
+    }
+    __real_free(ptr);
+}
+
+void bench_alloc_get(bench_alloc_stats_t *out)
+{
+    out->allocs = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+    out->frees = __atomic_load_n(&frees, __ATOMIC_RELAXED);
+    out->live_bytes = __atomic_load_n(&live_bytes, __ATOMIC_RELAXED);
+    out->peak_bytes = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+}
+
+void bench_alloc_reset_peak(void)
+{
+    __atomic_store_n(&peak_bytes, __atomic_load_n(&live_bytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,22 @@
+#ifndef BENCH_ALLOC_H
+#define BENCH_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Heap accounting for the benchmarks. The bench executables link with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free, so every allocation made by
+// firmware code lands here; allocations libc makes for itself are not seen.
+
+typedef struct {
+    uint64_t allocs;            // malloc, calloc and realloc calls that returned memory
+    uint64_t frees;
+    size_t live_bytes;          // Usable size of everything currently allocated
+    size_t peak_bytes;          // Highest live_bytes since the last bench_alloc_reset_peak()
+} bench_alloc_stats_t;
+
+void bench_alloc_get(bench_alloc_stats_t *out);
+// Restart peak tracking from the current live size.
+void bench_alloc_reset_peak(void);
+
+#endif // BENCH_ALLOC_H
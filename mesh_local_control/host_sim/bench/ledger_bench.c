@@ -0,0 +1,357 @@
+#include "sim.h"
+#include "bench_alloc.h"
+#include "blockchain.h"
+#include "mem_track.h"
+#include "esp_log.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Microbenchmarks for the ledger primitives in blockchain.c, run on one simulated node so the
+// firmware's locks and node-local state behave as they do in the simulator. Each result is
+// one JSON object per line on stdout:
+//   {"op":..., "records":R, "chain":N, "ops":..., "ns_per_op":..., "allocs_per_op":...,
+//    "peak_heap_bytes":..., "chain_heap_bytes":...}
+// `records` is the sensor records per block and `chain` the chain length the op ran against
+// (0 when the op does not touch the chain). peak_heap_bytes is the heap high-water mark
+// during the timed loop above what was live when it started; chain_heap_bytes is what the
+// chain itself holds. Times are wall-clock, so compare runs on the same machine.
+
+#define BENCH_CHAIN_RECORDS     MAX_NODES   // Records per block in the chain-length sweep
+#define BENCH_INSERT_MAX        64          // Blocks back-filled per insert measurement
+#define BENCH_LOOKUPS           100000      // Lookups per get_* batch
+
+typedef struct {
+    uint32_t max_records;
+    uint32_t max_chain;
+    uint32_t min_time_ms;
+} bench_args_t;
+
+typedef struct {
+    struct timespec start;
+    bench_alloc_stats_t alloc;
+    double elapsed_ns;
+    uint64_t allocs;
+    size_t peak;
+} bench_timer_t;
+
+static bench_args_t args = {.max_records = 256, .max_chain = 100000, .min_time_ms = 200};
+
+static void bench_start(bench_timer_t *t)
+{
+    bench_alloc_reset_peak();
+    bench_alloc_get(&t->alloc);
+    clock_gettime(CLOCK_MONOTONIC, &t->start);
+}
+
+// Add the time, allocations and heap high-water mark since bench_start() to the totals.
+static void bench_stop(bench_timer_t *t)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bench_alloc_stats_t now;
+    bench_alloc_get(&now);
+    t->elapsed_ns += (end.tv_sec - t->start.tv_sec) * 1e9 + (end.tv_nsec - t->start.tv_nsec);
+    t->allocs += now.allocs - t->alloc.allocs;
+    size_t peak = now.peak_bytes - t->alloc.live_bytes;
+    if (peak > t->peak) {
+        t->peak = peak;
+    }
+}
+
+static void bench_report(const char *op, uint32_t records, uint32_t chain, uint64_t ops,
+                         const bench_timer_t *t, size_t chain_bytes)
+{
+    printf("{\"op\":\"%s\",\"records\":%u,\"chain\":%u,\"ops\":%llu,\"ns_per_op\":%.1f,"
+           "\"allocs_per_op\":%.3f,\"peak_heap_bytes\":%zu,\"chain_heap_bytes\":%zu}\n",
+           op, records, chain, (unsigned long long)ops, ops ? t->elapsed_ns / ops : 0.0,
+           ops ? (double)t->allocs / ops : 0.0, t->peak, chain_bytes);
+}
+
+static bool bench_done(const bench_timer_t *t)
+{
+    return t->elapsed_ns >= args.min_time_ms * 1e6;
+}
+
+static size_t bench_live_bytes(void)
+{
+    bench_alloc_stats_t stats;
+    bench_alloc_get(&stats);
+    return stats.live_bytes;
+}
+
+// A hashed block with `records` sensor records, linked to `prev_hash`. Contents depend only
+// on the arguments, so runs are comparable. Allocated through mem_track, as the chain frees
+// the blocks it takes.
+static block_t *bench_make_block(uint32_t num, const uint8_t *prev_hash, uint32_t records)
+{
+    block_t *block = mem_track_calloc(MEM_TAG_LEDGER, 1, sizeof(block_t));
+    if (!block) {
+        return NULL;
+    }
+    block->block_num = num;
+    block->timestamp = 1700000000 + num * 30;
+    if (prev_hash) {
+        memcpy(block->prev_hash, prev_hash, sizeof(block->prev_hash));
+    }
+    snprintf(block->pop_proof, sizeof(block->pop_proof), "PoP:%u", (unsigned)num);
+    sensor_record_t **tail = &block->node_data;
+    for (uint32_t i = 0; i < records; i++) {
+        sensor_record_t *rec = mem_track_calloc(MEM_TAG_LEDGER, 1, sizeof(sensor_record_t));
+        if (!rec) {
+            break;
+        }
+        rec->mac[0] = 0x02;
+        rec->mac[4] = (uint8_t)(i >> 8);
+        rec->mac[5] = (uint8_t)i;
+        rec->timestamp = block->timestamp;
+        rec->temperature = 20.0f + (float)((num + i) % 100) / 10.0f;
+        rec->humidity = 40.0f + (float)(i % 50);
+        for (int j = 0; j < MAX_NEIGHBORS; j++) {
+            rec->rssi[j] = (int8_t)(-40 - (int)((i + j) % 50));
+        }
+        *tail = rec;
+        tail = &rec->next;
+        block->num_sensor_readings++;
+    }
+    calculate_block_hash(block);
+    return block;
+}
+
+// `count` linked blocks numbered from `first`, each with `records` records.
+static block_t **bench_make_chain(uint32_t first, uint32_t count, uint32_t records)
+{
+    block_t **blocks = malloc(count * sizeof(block_t *));
+    if (!blocks) {
+        return NULL;
+    }
+    const uint8_t *prev_hash = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        blocks[i] = bench_make_block(first + i, prev_hash, records);
+        if (!blocks[i]) {
+            fprintf(stderr, "ledger_bench: out of memory building a %u-block chain\n", count);
+            exit(1);
+        }
+        prev_hash = blocks[i]->hash;
+    }
+    return blocks;
+}
+
+// ---- Per-block operations, swept over records per block ----
+
+static void bench_hash(uint32_t records)
+{
+    block_t *block = bench_make_block(1, NULL, records);
+    bench_timer_t t = {0};
+    uint64_t ops = 0;
+    for (uint32_t batch = 16; !bench_done(&t); batch *= 2) {
+        bench_start(&t);
+        for (uint32_t i = 0; i < batch; i++) {
+            calculate_block_hash(block);
+        }
+        bench_stop(&t);
+        ops += batch;
+    }
+    bench_report("calculate_block_hash", records, 0, ops, &t, 0);
+    blockchain_free_block(block);
+}
+
+static void bench_serialize(uint32_t records)
+{
+    block_t *block = bench_make_block(1, NULL, records);
+    bench_timer_t t = {0};
+    uint64_t ops = 0;
+    for (uint32_t batch = 16; !bench_done(&t); batch *= 2) {
+        bench_start(&t);
+        for (uint32_t i = 0; i < batch; i++) {
+            uint8_t *buf = NULL;
+            if (blockchain_serialize_block(block, &buf) > 0) {
+                mem_track_free(buf);
+            }
+        }
+        bench_stop(&t);
+        ops += batch;
+    }
+    bench_report("blockchain_serialize_block", records, 0, ops, &t, 0);
+    blockchain_free_block(block);
+}
+
+static void bench_parse(uint32_t records)
+{
+    block_t *block = bench_make_block(1, NULL, records);
+    uint8_t *buf = NULL;
+    size_t len = blockchain_serialize_block(block, &buf);
+    bench_timer_t t = {0};
+    uint64_t ops = 0;
+    for (uint32_t batch = 16; len > 0 && !bench_done(&t); batch *= 2) {
+        bench_start(&t);
+        for (uint32_t i = 0; i < batch; i++) {
+            block_t *parsed = blockchain_parse_received_serialized_block(buf, (int)len);
+            if (parsed) {
+                blockchain_free_block(parsed);
+            }
+        }
+        bench_stop(&t);
+        ops += batch;
+    }
+    bench_report("blockchain_parse_received_serialized_block", records, 0, ops, &t, 0);
+    mem_track_free(buf);
+    blockchain_free_block(block);
+}
+
+// ---- Chain operations, swept over chain length ----
+
+// Append `length` prepared blocks to an empty chain. Leaves the chain built for the lookups.
+static void bench_add(uint32_t length)
+{
+    bench_timer_t t = {0};
+    uint64_t ops = 0;
+    size_t chain_bytes = 0;
+    do {
+        blockchain_deinit();
+        size_t before = bench_live_bytes();
+        block_t **blocks = bench_make_chain(0, length, BENCH_CHAIN_RECORDS);
+        bench_start(&t);
+        for (uint32_t i = 0; i < length; i++) {
+            if (blockchain_add_block(blocks[i]) != BLOCKCHAIN_ADD_CHAINED) {
+                fprintf(stderr, "ledger_bench: block %u was not chained\n", i);
+                exit(1);
+            }
+        }
+        bench_stop(&t);
+        ops += length;
+        free(blocks);
+        chain_bytes = bench_live_bytes() - before;
+    } while (!bench_done(&t));
+    bench_report("blockchain_add_block", BENCH_CHAIN_RECORDS, length, ops, &t, chain_bytes);
+}
+
+// There is no separate insert call: a block below the lowest one held goes through
+// blockchain_add_block's gap-filling path, which copies the chunk it lands in and the chunk
+// index. This is what block_sync and checkpoint bootstrap hit when they back-fill a chain
+// anchored higher up.
+static void bench_insert(uint32_t length)
+{
+    uint32_t fill = length < BENCH_INSERT_MAX ? length : BENCH_INSERT_MAX;
+    bench_timer_t t = {0};
+    uint64_t ops = 0;
+    size_t chain_bytes = 0;
+    do {
+        blockchain_deinit();
+        size_t before = bench_live_bytes();
+        block_t **blocks = bench_make_chain(0, length + fill, BENCH_CHAIN_RECORDS);
+        for (uint32_t i = fill; i < length + fill; i++) {
+            blockchain_add_block(blocks[i]);
+        }
+        bench_start(&t);
+        for (uint32_t i = fill; i-- > 0;) {
+            if (blockchain_add_block(blocks[i]) != BLOCKCHAIN_ADD_CHAINED) {
+                fprintf(stderr, "ledger_bench: block %u was not inserted\n", i);
+                exit(1);
+            }
+        }
+        bench_stop(&t);
+        ops += fill;
+        free(blocks);
+        chain_bytes = bench_live_bytes() - before;
+    } while (!bench_done(&t));
+    bench_report("blockchain_insert_block", BENCH_CHAIN_RECORDS, length, ops, &t, chain_bytes);
+}
+
+// Run against the chain bench_add() left behind.
+static void bench_lookups(uint32_t length)
+{
+    block_t out;
+    bench_timer_t t = {0};
+    uint64_t ops = 0;
+    uint32_t state = 1;
+    do {
+        bench_start(&t);
+        for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+            state = state * 1103515245u + 12345u;
+            if (!blockchain_get_block_by_number((state >> 8) % length, &out)) {
+                fprintf(stderr, "ledger_bench: lookup missed\n");
+                exit(1);
+            }
+        }
+        bench_stop(&t);
+        ops += BENCH_LOOKUPS;
+    } while (!bench_done(&t));
+    bench_report("blockchain_get_block_by_number", BENCH_CHAIN_RECORDS, length, ops, &t, 0);
+
+    memset(&t, 0, sizeof(t));
+    ops = 0;
+    do {
+        bench_start(&t);
+        for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+            blockchain_get_last_block(&out);
+        }
+        bench_stop(&t);
+        ops += BENCH_LOOKUPS;
+    } while (!bench_done(&t));
+    bench_report("blockchain_get_last_block", BENCH_CHAIN_RECORDS, length, ops, &t, 0);
+}
+
+static void bench_main(void *arg)
+{
+    blockchain_init();
+    for (uint32_t records = 1; records <= args.max_records; records *= 2) {
+        bench_hash(records);
+        bench_serialize(records);
+        bench_parse(records);
+    }
+    for (uint32_t length = 10; length <= args.max_chain; length *= 10) {
+        bench_insert(length);
+        bench_add(length);
+        bench_lookups(length);
+    }
+    blockchain_deinit();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --max-records R      largest records-per-block in the sweep from 1 (default 256)\n"
+            "  --max-chain N        longest chain in the sweep from 10 (default 100000)\n"
+            "  --min-time-ms MS     minimum timed run per measurement (default 200)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"max-records", required_argument, NULL, 'r'},
+        {"max-chain", required_argument, NULL, 'c'},
+        {"min-time-ms", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'r': args.max_records = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'c': args.max_chain = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 't': args.min_time_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sim_config_t cfg;
+    sim_config_defaults(&cfg);
+    cfg.log_level = ESP_LOG_NONE;
+    sim_init(&cfg);
+    int node = sim_node_add();
+    // Let the node finish booting its modules, well before it starts the mesh task.
+    sim_run_until(100 * 1000);
+    if (!sim_node_call(node, bench_main, NULL)) {
+        fprintf(stderr, "ledger_bench: benchmark blocked on the node\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "sim.h"
+#include "scenarios.h"
+#include "esp_log.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// End-to-end round benchmark: runs the rounds scenario (full sensor_blockchain_task cycle,
+// then a leader kill) over a grid of mesh sizes and loss rates, one simulator process per
+// point. Every figure is in virtual time, so the output depends only on the arguments and the
+// firmware; diff two versions' outputs directly. One JSON object per line on stdout.
+
+#define ROUND_BENCH_MAX_POINTS  32
+
+static int parse_list(const char *arg, double *out)
+{
+    char *copy = strdup(arg);
+    int n = 0;
+    for (char *tok = strtok(copy, ","); tok && n < ROUND_BENCH_MAX_POINTS; tok = strtok(NULL, ",")) {
+        out[n++] = atof(tok);
+    }
+    free(copy);
+    return n;
+}
+
+static void round_bench_point(const sim_config_t *cfg, int nodes, int64_t duration_us)
+{
+    sim_init(cfg);
+    for (int i = 0; i < nodes; i++) {
+        sim_node_add();
+    }
+    scenario_args_t args = {.nodes = nodes, .duration_us = duration_us};
+    scenario_rounds_report_t r;
+    int rc = scenario_rounds_measure(&args, &r);
+    printf("{\"nodes\":%d,\"loss\":%.3f,\"seed\":%u,\"duration_s\":%.0f,\"window_s\":%.1f,"
+           "\"rounds\":%u,\"completed\":%u,\"blocks_per_min\":%.2f,"
+           "\"latency_p50_ms\":%.1f,\"latency_p90_ms\":%.1f,\"latency_p99_ms\":%.1f,\"latency_max_ms\":%.1f,"
+           "\"readings_expected\":%.2f,\"readings_lost\":%.2f,\"propagated\":%.3f,\"not_chained\":%u,"
+           "\"converge_ms\":%.1f,\"resume_ms\":%.1f,\"agreement\":%d,\"alive\":%d,\"tip\":%u,\"pass\":%s}\n",
+           nodes, cfg->loss, cfg->seed, duration_us / 1e6, r.window_s,
+           r.rounds, r.completed, r.blocks_per_min,
+           r.latency_p50_ms, r.latency_p90_ms, r.latency_p99_ms, r.latency_max_ms,
+           r.readings_expected, r.readings_lost, r.propagated, r.not_chained,
+           r.converge_ms, r.resume_ms, r.agreement, r.alive, r.tip, rc == 0 ? "true" : "false");
+    fflush(stdout);
+    exit(rc);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --nodes LIST         mesh sizes, comma separated (default 3,8,16,32,64,128,256)\n"
+            "  --loss LIST          loss probabilities, comma separated (default 0,0.1,0.2,0.3)\n"
+            "  --seed S             random seed for every point (default 1)\n"
+            "  --duration SEC       virtual seconds per point (default 300)\n"
+            "  --latency-us US      per-frame delay (default 2000)\n"
+            "  --jitter-us US       extra uniform delay (default 1000)\n"
+            "  --bitrate-kbps K     PHY rate for airtime; 0 disables it (default 1000)\n"
+            "  --fanout F           children per node in the mesh-lite tree (default 6)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"nodes", required_argument, NULL, 'n'},
+        {"loss", required_argument, NULL, 'p'},
+        {"seed", required_argument, NULL, 's'},
+        {"duration", required_argument, NULL, 'd'},
+        {"latency-us", required_argument, NULL, 'l'},
+        {"jitter-us", required_argument, NULL, 'j'},
+        {"bitrate-kbps", required_argument, NULL, 'b'},
+        {"fanout", required_argument, NULL, 'f'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    sim_config_t cfg;
+    sim_config_defaults(&cfg);
+    cfg.log_level = ESP_LOG_NONE;
+    double nodes[ROUND_BENCH_MAX_POINTS];
+    double losses[ROUND_BENCH_MAX_POINTS];
+    int n_nodes = parse_list("3,8,16,32,64,128,256", nodes);
+    int n_losses = parse_list("0,0.1,0.2,0.3", losses);
+    int64_t duration_us = 300LL * 1000000;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n': n_nodes = parse_list(optarg, nodes); break;
+        case 'p': n_losses = parse_list(optarg, losses); break;
+        case 's': cfg.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'd': duration_us = (int64_t)(atof(optarg) * 1e6); break;
+        case 'l': cfg.latency_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'j': cfg.jitter_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'b': cfg.bitrate_kbps = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'f': cfg.fanout = (uint32_t)strtoul(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    // The simulator cannot be torn down in-process, so each point gets a fresh child.
+    int failed = 0;
+    for (int i = 0; i < n_nodes; i++) {
+        int count = (int)nodes[i];
+        if (count < 1 || count > SIM_MAX_NODES) {
+            fprintf(stderr, "round_bench: %d nodes is out of range\n", count);
+            return 2;
+        }
+        for (int j = 0; j < n_losses; j++) {
+            cfg.loss = losses[j];
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("round_bench: fork");
+                return 1;
+            }
+            if (pid == 0) {
+                round_bench_point(&cfg, count, duration_us);
+            }
+            int status = 0;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status)) {
+                printf("{\"nodes\":%d,\"loss\":%.3f,\"seed\":%u,\"crashed\":true}\n", count, cfg.loss, cfg.seed);
+                failed++;
+            } else if (WEXITSTATUS(status) != 0) {
+                failed++;
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "node_local.h"
+#include "sim_internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Logging, clocks and randomness for simulated nodes. The libc time() and rand() the firmware
+// calls are redirected here by the linker (--wrap), so they follow virtual time and keep
+// per-node state, like separate boards would.
+
+#define SIM_LOG_TAG_LEVELS      16
+
+typedef struct {
+    const char *tag;
+    esp_log_level_t level;
+} sim_tag_level_t;
+
+static NODE_LOCAL bool log_levels_set = false;
+static NODE_LOCAL esp_log_level_t log_default_level;
+static NODE_LOCAL sim_tag_level_t log_tag_levels[SIM_LOG_TAG_LEVELS];
+static NODE_LOCAL uint64_t random_state = 0;
+static NODE_LOCAL uint64_t rand_state = 1;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_WIFI_NOT_CONNECT: return "ESP_ERR_WIFI_NOT_CONNECT";
+    case ESP_ERR_ESPNOW_NOT_INIT: return "ESP_ERR_ESPNOW_NOT_INIT";
+    case ESP_ERR_ESPNOW_ARG: return "ESP_ERR_ESPNOW_ARG";
+    case ESP_ERR_ESPNOW_NO_MEM: return "ESP_ERR_ESPNOW_NO_MEM";
+    case ESP_ERR_ESPNOW_FULL: return "ESP_ERR_ESPNOW_FULL";
+    case ESP_ERR_ESPNOW_NOT_FOUND: return "ESP_ERR_ESPNOW_NOT_FOUND";
+    case ESP_ERR_ESPNOW_INTERNAL: return "ESP_ERR_ESPNOW_INTERNAL";
+    case ESP_ERR_ESPNOW_EXIST: return "ESP_ERR_ESPNOW_EXIST";
+    case ESP_ERR_ESPNOW_IF: return "ESP_ERR_ESPNOW_IF";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+// ---- Logging ----
+
+static void sim_log_levels_init(void)
+{
+    if (!log_levels_set) {
+        log_default_level = (esp_log_level_t)sim_config()->log_level;
+        log_levels_set = true;
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    if (!sim_self) {
+        return;
+    }
+    sim_log_levels_init();
+    if (strcmp(tag, "*") == 0) {
+        log_default_level = level;
+        memset(log_tag_levels, 0, sizeof(log_tag_levels));
+        return;
+    }
+    for (int i = 0; i < SIM_LOG_TAG_LEVELS; i++) {
+        if (!log_tag_levels[i].tag || strcmp(log_tag_levels[i].tag, tag) == 0) {
+            log_tag_levels[i].tag = tag;
+            log_tag_levels[i].level = level;
+            return;
+        }
+    }
+}
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    if (!sim_self) {
+        return (esp_log_level_t)sim_config()->log_level;
+    }
+    sim_log_levels_init();
+    for (int i = 0; i < SIM_LOG_TAG_LEVELS && log_tag_levels[i].tag; i++) {
+        if (strcmp(log_tag_levels[i].tag, tag) == 0) {
+            return log_tag_levels[i].level;
+        }
+    }
+    return log_default_level;
+}
+
+static void sim_log_prefix(esp_log_level_t level, const char *tag)
+{
+    static const char letters[] = "NEWIDV";
+    int node = sim_self ? sim_self->index : -1;
+    printf("%c (%10.3f) n%02d %s: ", letters[level], sim_now_us() / 1e3, node, tag);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    sim_log_prefix(level, tag);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+}
+
+void esp_log_buffer_hex_internal(const char *tag, const void *buffer, uint16_t len, esp_log_level_t level)
+{
+    const uint8_t *bytes = buffer;
+    for (uint16_t offset = 0; offset < len; offset += 16) {
+        sim_log_prefix(level, tag);
+        for (uint16_t i = offset; i < len && i < offset + 16; i++) {
+            printf("%02x ", bytes[i]);
+        }
+        putchar('\n');
+    }
+}
+
+// ---- Clocks ----
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_now_us() - (sim_self ? sim_self->boot_us : 0);
+}
+
+// Wall clock: every node agrees on it, as if they had synced over SNTP.
+#define SIM_EPOCH               1700000000
+
+time_t __wrap_time(time_t *out)
+{
+    time_t now = (time_t)(SIM_EPOCH + sim_now_us() / 1000000);
+    if (out) {
+        *out = now;
+    }
+    return now;
+}
+
+// ---- Randomness ----
+
+uint32_t esp_random(void)
+{
+    if (!sim_self) {
+        return sim_rand();
+    }
+    if (random_state == 0) {
+        random_state = ((uint64_t)sim_config()->seed << 32) ^ (0xA5A5ULL + sim_self->index) ^
+                       ((uint64_t)sim_self->generation << 16) ^ 0x9E3779B97F4A7C15ULL;
+    }
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return (uint32_t)((random_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+int __real_rand(void);
+void __real_srand(unsigned int seed);
+
+void __wrap_srand(unsigned int seed)
+{
+    if (!sim_self) {
+        __real_srand(seed);
+        return;
+    }
+    rand_state = seed;
+}
+
+// newlib's rand(), state per node. Boards that never call srand() all start from 1, so
+// nodes drawing from identical node lists pick identical leaders, exactly as on hardware.
+int __wrap_rand(void)
+{
+    if (!sim_self) {
+        return __real_rand();
+    }
+    rand_state = rand_state * 6364136223846793005ULL + 1;
+    return (int)((rand_state >> 32) & 0x7fffffff);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 200 * 1024;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return esp_get_free_heap_size();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return esp_get_free_heap_size();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return esp_get_free_heap_size();
+}
@@ -0,0 +1,421 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "node_local.h"
+#include "sim_internal.h"
+#include <stdio.h>
+
+// FreeRTOS API over the simulator's cooperative tasks. Queues carry sender and receiver wait
+// lists; semaphores and mutexes are item-less queues, as in the real kernel. There is no
+// priority inheritance, which the firmware does not rely on.
+
+struct sim_queue {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    sim_waitq_t senders;
+    sim_waitq_t receivers;
+};
+
+struct sim_timer {
+    struct sim_timer *next;
+    TimerCallbackFunction_t callback;
+    void *id;
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    int64_t expiry_us;
+};
+
+static NODE_LOCAL struct sim_timer *timers = NULL;
+static NODE_LOCAL sim_waitq_t timer_wait;
+
+static sim_task_t *sim_running_task(void)
+{
+    if (!sim_self || !sim_self->current) {
+        fprintf(stderr, "sim: FreeRTOS call outside a simulated task\n");
+        abort();
+    }
+    return sim_self->current;
+}
+
+// Wait on `q` until woken or until `ticks` after `start_us` have passed. Returns false on timeout.
+static bool sim_wait_until(sim_waitq_t *q, TickType_t ticks, int64_t start_us)
+{
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        sim_task_block(q, portMAX_DELAY);
+        return true;
+    }
+    int64_t tick_us = (int64_t)sim_tick_us();
+    int64_t left = start_us + (int64_t)ticks * tick_us - sim_now_us();
+    if (left <= 0) {
+        return false;
+    }
+    return sim_task_block(q, (TickType_t)((left + tick_us - 1) / tick_us));
+}
+
+// ---- Tasks ----
+
+static BaseType_t sim_create_task(TaskFunction_t fn, const char *name, void *arg, UBaseType_t priority,
+                                  TaskHandle_t *created)
+{
+    sim_running_task();
+    sim_task_t *task = sim_task_create(sim_self, fn, name, arg, priority);
+    if (created) {
+        *created = task;
+    }
+    return task ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created)
+{
+    (void)stack_depth;
+    return sim_create_task(fn, name, arg, priority, created);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core)
+{
+    // Both "cores" share the node's thread; pinning only matters for real parallelism.
+    (void)stack_depth;
+    (void)core;
+    return sim_create_task(fn, name, arg, priority, created);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    sim_task_delete(task ? task : sim_running_task());
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_running_task();
+    if (ticks == 0) {
+        sim_task_yield();
+    } else {
+        sim_task_block(NULL, ticks);
+    }
+}
+
+// Wake `increment` ticks after the last wake rather than after now, as FreeRTOS does; a
+// deadline already passed returns at once.
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    TickType_t wake = *previous_wake + increment;
+    TickType_t now = xTaskGetTickCount();
+    *previous_wake = wake;
+    if ((int32_t)(wake - now) <= 0) {
+        vTaskDelay(0);
+        return pdFALSE;
+    }
+    vTaskDelay(wake - now);
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    int64_t boot_us = sim_self ? sim_self->boot_us : 0;
+    return (TickType_t)((sim_now_us() - boot_us) / (int64_t)sim_tick_us());
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return sim_running_task();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    if (!task || task->state == SIM_TASK_DEAD) {
+        return pdFAIL;
+    }
+    task->notify_value++;
+    if (task->notify_waiting) {
+        sim_task_wake(task);
+    }
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    sim_task_t *task = sim_running_task();
+    if (task->notify_value == 0 && ticks != 0) {
+        task->notify_waiting = true;
+        sim_task_block(NULL, ticks);
+        task->notify_waiting = false;
+    }
+    uint32_t value = task->notify_value;
+    if (value > 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+// ---- Queues and semaphores ----
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    if (length == 0) {
+        return NULL;
+    }
+    struct sim_queue *queue = calloc(1, sizeof(*queue));
+    if (!queue) {
+        return NULL;
+    }
+    if (item_size > 0) {
+        queue->storage = malloc((size_t)length * item_size);
+        if (!queue->storage) {
+            free(queue);
+            return NULL;
+        }
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue) {
+        free(queue->storage);
+        free(queue);
+    }
+}
+
+static BaseType_t sim_queue_send(QueueHandle_t queue, const void *item, TickType_t ticks, bool front)
+{
+    int64_t start_us = sim_now_us();
+    while (queue->count == queue->length) {
+        if (!sim_wait_until(&queue->senders, ticks, start_us)) {
+            return errQUEUE_FULL;
+        }
+    }
+    if (queue->item_size > 0) {
+        UBaseType_t slot;
+        if (front) {
+            queue->head = (queue->head + queue->length - 1) % queue->length;
+            slot = queue->head;
+        } else {
+            slot = (queue->head + queue->count) % queue->length;
+        }
+        // Semaphores give no item; only their zero-size queues should see a NULL one.
+        if (item) {
+            memcpy(queue->storage + (size_t)slot * queue->item_size, item, queue->item_size);
+        }
+    }
+    queue->count++;
+    sim_waitq_wake_one(&queue->receivers);
+    return pdPASS;
+}
+
+static BaseType_t sim_queue_receive(QueueHandle_t queue, void *item, TickType_t ticks, bool peek)
+{
+    int64_t start_us = sim_now_us();
+    while (queue->count == 0) {
+        if (!sim_wait_until(&queue->receivers, ticks, start_us)) {
+            return errQUEUE_EMPTY;
+        }
+    }
+    if (queue->item_size > 0 && item) {
+        memcpy(item, queue->storage + (size_t)queue->head * queue->item_size, queue->item_size);
+    }
+    if (peek) {
+        // Let the next receiver see the item too.
+        sim_waitq_wake_one(&queue->receivers);
+        return pdPASS;
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    sim_waitq_wake_one(&queue->senders);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return sim_queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return sim_queue_send(queue, item, ticks, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return sim_queue_receive(queue, item, ticks, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return sim_queue_receive(queue, item, ticks, true);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    queue->count = 0;
+    queue->head = 0;
+    while (queue->senders.head) {
+        sim_waitq_wake_one(&queue->senders);
+    }
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    return queue->length - queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    if (sem) {
+        sem->count = 1;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max_count, 0);
+    if (sem) {
+        sem->count = initial_count > max_count ? max_count : initial_count;
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return sim_queue_receive(sem, NULL, ticks, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return sim_queue_send(sem, NULL, 0, false);
+}
+
+// ---- Software timers ----
+
+static void sim_timer_arm(struct sim_timer *timer)
+{
+    timer->active = true;
+    timer->expiry_us = sim_now_us() + (int64_t)timer->period * (int64_t)sim_tick_us();
+    sim_waitq_wake_one(&timer_wait);
+}
+
+void sim_timer_service_task(void *arg)
+{
+    while (1) {
+        struct sim_timer *next = NULL;
+        for (struct sim_timer *t = timers; t; t = t->next) {
+            if (t->active && (!next || t->expiry_us < next->expiry_us)) {
+                next = t;
+            }
+        }
+        if (!next) {
+            sim_task_block(&timer_wait, portMAX_DELAY);
+            continue;
+        }
+        int64_t wait_us = next->expiry_us - sim_now_us();
+        if (wait_us > 0) {
+            int64_t tick_us = (int64_t)sim_tick_us();
+            sim_task_block(&timer_wait, (TickType_t)((wait_us + tick_us - 1) / tick_us));
+            continue;
+        }
+        if (next->auto_reload) {
+            next->expiry_us += (int64_t)next->period * (int64_t)sim_tick_us();
+        } else {
+            next->active = false;
+        }
+        next->callback(next);
+    }
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    (void)name;
+    if (period == 0 || !callback) {
+        return NULL;
+    }
+    struct sim_timer *timer = calloc(1, sizeof(*timer));
+    if (!timer) {
+        return NULL;
+    }
+    timer->callback = callback;
+    timer->id = id;
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->next = timers;
+    timers = timer;
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks)
+{
+    (void)ticks;
+    sim_timer_arm(timer);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks)
+{
+    return xTimerStart(timer, ticks);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks)
+{
+    (void)ticks;
+    timer->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks)
+{
+    (void)ticks;
+    if (period == 0) {
+        return pdFAIL;
+    }
+    timer->period = period;
+    sim_timer_arm(timer);
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks)
+{
+    (void)ticks;
+    for (struct sim_timer **link = &timers; *link; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            free(timer);
+            return pdPASS;
+        }
+    }
+    return pdFAIL;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return timer->active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
@@ -0,0 +1,6 @@
+#ifndef SIM_DRIVER_UART_H
+#define SIM_DRIVER_UART_H
+
+// The simulated modules do not touch the UART; the header only has to exist.
+
+#endif // SIM_DRIVER_UART_H
@@ -0,0 +1,6 @@
+#ifndef SIM_ESP_BRIDGE_H
+#define SIM_ESP_BRIDGE_H
+
+// Nothing in the simulated modules bridges netifs; the header only has to exist.
+
+#endif // SIM_ESP_BRIDGE_H
@@ -0,0 +1,46 @@
+#ifndef SIM_ESP_ERR_H
+#define SIM_ESP_ERR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_NO_MEM                  0x101
+#define ESP_ERR_INVALID_ARG             0x102
+#define ESP_ERR_INVALID_STATE           0x103
+#define ESP_ERR_INVALID_SIZE            0x104
+#define ESP_ERR_NOT_FOUND               0x105
+#define ESP_ERR_NOT_SUPPORTED           0x106
+#define ESP_ERR_TIMEOUT                 0x107
+
+#define ESP_ERR_WIFI_BASE               0x3000
+#define ESP_ERR_WIFI_NOT_CONNECT        (ESP_ERR_WIFI_BASE + 15)
+#define ESP_ERR_ESPNOW_BASE             (ESP_ERR_WIFI_BASE + 100)
+#define ESP_ERR_ESPNOW_NOT_INIT         (ESP_ERR_ESPNOW_BASE + 1)
+#define ESP_ERR_ESPNOW_ARG              (ESP_ERR_ESPNOW_BASE + 2)
+#define ESP_ERR_ESPNOW_NO_MEM           (ESP_ERR_ESPNOW_BASE + 3)
+#define ESP_ERR_ESPNOW_FULL             (ESP_ERR_ESPNOW_BASE + 4)
+#define ESP_ERR_ESPNOW_NOT_FOUND        (ESP_ERR_ESPNOW_BASE + 5)
+#define ESP_ERR_ESPNOW_INTERNAL         (ESP_ERR_ESPNOW_BASE + 6)
+#define ESP_ERR_ESPNOW_EXIST            (ESP_ERR_ESPNOW_BASE + 7)
+#define ESP_ERR_ESPNOW_IF               (ESP_ERR_ESPNOW_BASE + 8)
+
+#define ESP_ERR_NVS_BASE                0x1100
+#define ESP_ERR_NVS_NO_FREE_PAGES       (ESP_ERR_NVS_BASE + 0x0d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND   (ESP_ERR_NVS_BASE + 0x10)
+
+const char *esp_err_to_name(esp_err_t code);
+
+#define ESP_ERROR_CHECK(x) do {                                                     \
+        esp_err_t err_rc_ = (x);                                                    \
+        if (err_rc_ != ESP_OK) {                                                    \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: %s at %s:%d\n",                \
+                    esp_err_to_name(err_rc_), __FILE__, __LINE__);                  \
+            abort();                                                                \
+        }                                                                           \
+    } while (0)
+
+#endif // SIM_ESP_ERR_H
@@ -0,0 +1,15 @@
+#ifndef SIM_ESP_HEAP_CAPS_H
+#define SIM_ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_DEFAULT      (1 << 12)
+
+// A simulated node reports the same fixed, unfragmented heap as esp_get_free_heap_size().
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif // SIM_ESP_HEAP_CAPS_H
@@ -0,0 +1,50 @@
+#ifndef SIM_ESP_LOG_H
+#define SIM_ESP_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL         ESP_LOG_VERBOSE
+#endif
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+esp_log_level_t esp_log_level_get(const char *tag);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void esp_log_buffer_hex_internal(const char *tag, const void *buffer, uint16_t len, esp_log_level_t level);
+
+// Every line is prefixed with the simulated time and node, so the tag is all the macro adds.
+#define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...) do {                           \
+        if (LOG_LOCAL_LEVEL >= (level) && esp_log_level_get(tag) >= (level)) {      \
+            esp_log_write((level), (tag), format, ##__VA_ARGS__);                   \
+        }                                                                           \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, len, level) do {                      \
+        if (LOG_LOCAL_LEVEL >= (level) && esp_log_level_get(tag) >= (level)) {      \
+            esp_log_buffer_hex_internal((tag), (buffer), (len), (level));           \
+        }                                                                           \
+    } while (0)
+#define ESP_LOG_BUFFER_HEX(tag, buffer, len)    ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, len, ESP_LOG_INFO)
+
+#endif // SIM_ESP_LOG_H
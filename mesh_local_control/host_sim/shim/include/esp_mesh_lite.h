@@ -0,0 +1,57 @@
+#ifndef SIM_ESP_MESH_LITE_H
+#define SIM_ESP_MESH_LITE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "esp_mac.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+
+typedef enum {
+    ESPNOW_DATA_TYPE_ACK = 0,
+    ESPNOW_DATA_TYPE_FORWARD,
+    ESPNOW_DATA_TYPE_GROUP,
+    ESPNOW_DATA_TYPE_PROV,
+    ESPNOW_DATA_TYPE_CONTROL_BIND,
+    ESPNOW_DATA_TYPE_CONTROL_DATA,
+    ESPNOW_DATA_TYPE_OTA_STATUS,
+    ESPNOW_DATA_TYPE_OTA_DATA,
+    ESPNOW_DATA_TYPE_DEBUG_LOG,
+    ESPNOW_DATA_TYPE_DEBUG_COMMAND,
+    ESPNOW_DATA_TYPE_DATA,
+    ESPNOW_DATA_TYPE_SECURITY_STATUS,
+    ESPNOW_DATA_TYPE_SECURITY,
+    ESPNOW_DATA_TYPE_SECURITY_DATA,
+    ESPNOW_DATA_TYPE_RESERVE,
+    ESPNOW_DATA_TYPE_MAX,
+} espnow_data_type_t;
+
+typedef struct {
+    uint8_t level;
+    uint8_t mac_addr[6];
+    uint32_t ip_addr;
+} esp_mesh_lite_node_info_t;
+
+typedef struct node_info_list {
+    esp_mesh_lite_node_info_t *node;
+    uint32_t ttl;
+    struct node_info_list *next;
+} node_info_list_t;
+
+// Level in the simulated mesh-lite tree (1 = root); 0 until the node has joined.
+uint8_t esp_mesh_lite_get_level(void);
+// Every node currently in the mesh, ourselves included; empty until we have joined.
+node_info_list_t *esp_mesh_lite_get_nodes_list(uint32_t *size);
+uint32_t esp_mesh_lite_get_child_node_number(void);
+esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *dest_addr, const uint8_t *data, size_t len);
+esp_err_t esp_mesh_lite_espnow_recv_cb_register(espnow_data_type_t type,
+                                                void (*recv_cb)(const uint8_t *mac_addr, const uint8_t *data, int len));
+
+#endif // SIM_ESP_MESH_LITE_H
@@ -0,0 +1,40 @@
+#ifndef SIM_ESP_NOW_H
+#define SIM_ESP_NOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define ESP_NOW_ETH_ALEN                6
+#define ESP_NOW_KEY_LEN                 16
+#define ESP_NOW_MAX_TOTAL_PEER_NUM      20
+#define ESP_NOW_MAX_ENCRYPT_PEER_NUM    6
+#define ESP_NOW_MAX_DATA_LEN            250
+
+typedef enum {
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef struct {
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t lmk[ESP_NOW_KEY_LEN];
+    uint8_t channel;
+    wifi_interface_t ifidx;
+    bool encrypt;
+    void *priv;
+} esp_now_peer_info_t;
+
+typedef enum {
+    ESP_NOW_SEND_SUCCESS = 0,
+    ESP_NOW_SEND_FAIL,
+} esp_now_send_status_t;
+
+typedef void (*esp_now_send_cb_t)(const uint8_t *mac_addr, esp_now_send_status_t status);
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr);
+bool esp_now_is_peer_exist(const uint8_t *peer_addr);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+
+#endif // SIM_ESP_NOW_H
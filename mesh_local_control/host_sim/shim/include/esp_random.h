@@ -0,0 +1,9 @@
+#ifndef SIM_ESP_RANDOM_H
+#define SIM_ESP_RANDOM_H
+
+#include <stdint.h>
+
+// Per-node stream derived from the simulation seed, so runs repeat exactly.
+uint32_t esp_random(void);
+
+#endif // SIM_ESP_RANDOM_H
@@ -0,0 +1,37 @@
+#ifndef SIM_ESP_WIFI_H
+#define SIM_ESP_WIFI_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+typedef enum {
+    ESP_IF_WIFI_STA = 0,
+    ESP_IF_WIFI_AP,
+} wifi_interface_id_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+} wifi_ap_record_t;
+
+typedef struct {
+    uint8_t mac[6];
+    int8_t rssi;
+} wifi_sta_info_t;
+
+typedef struct {
+    wifi_sta_info_t sta[15];
+    int num;
+} wifi_sta_list_t;
+
+typedef int wifi_second_chan_t;
+
+// Station MAC of the running node; the softAP MAC is one above it, as on the device.
+esp_err_t esp_wifi_get_mac(wifi_interface_id_t ifx, uint8_t mac[6]);
+// Our mesh-lite parent's softAP; fails on the root.
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+
+#endif // SIM_ESP_WIFI_H
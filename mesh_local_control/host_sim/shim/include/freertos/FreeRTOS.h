@@ -0,0 +1,47 @@
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+// FreeRTOS as seen by the firmware, implemented over the simulator's cooperative tasks.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_FULL           0
+#define errQUEUE_EMPTY          0
+
+#ifndef configTICK_RATE_HZ
+#define configTICK_RATE_HZ      100     // ESP-IDF default (CONFIG_FREERTOS_HZ)
+#endif
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portNUM_PROCESSORS      2
+#define configASSERT(x)         assert(x)
+#define configMAX_PRIORITIES    25
+
+// Per-core state all lands on core 0: a node's tasks share one simulator thread.
+static inline BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+// Simulated tasks never preempt each other, so code between blocking calls is already atomic.
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    {0}
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+
+#endif // SIM_FREERTOS_H
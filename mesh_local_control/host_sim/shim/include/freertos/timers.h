@@ -0,0 +1,20 @@
+#ifndef SIM_FREERTOS_TIMERS_H
+#define SIM_FREERTOS_TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+// Callbacks run on the node's timer service task, as on the device.
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks);
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+#endif // SIM_FREERTOS_TIMERS_H
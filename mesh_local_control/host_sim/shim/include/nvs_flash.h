@@ -0,0 +1,8 @@
+#ifndef SIM_NVS_FLASH_H
+#define SIM_NVS_FLASH_H
+
+#include "esp_err.h"
+
+// Simulated nodes keep nothing across restarts; the header only has to exist.
+
+#endif // SIM_NVS_FLASH_H
@@ -0,0 +1,40 @@
+#include "temperature_probe.h"
+#include "node_local.h"
+#include "esp_random.h"
+
+// Stand-in for the SHT45 driver: each node's readings drift on a small random walk around a
+// per-node baseline, one step per measurement. Measurement takes the same 10 ms the sensor
+// needs.
+
+static NODE_LOCAL bool started = false;
+static NODE_LOCAL float sim_temperature = 0.0f;
+static NODE_LOCAL float sim_humidity = 0.0f;
+
+static float sensor_step(float scale)
+{
+    return ((float)(esp_random() % 2001) / 1000.0f - 1.0f) * scale;
+}
+
+bool temperature_probe_measure(float *temperature, float *humidity)
+{
+    vTaskDelay(pdMS_TO_TICKS(10));
+    if (!started) {
+        sim_temperature = 20.0f + (float)(esp_random() % 60) / 10.0f;
+        sim_humidity = 40.0f + (float)(esp_random() % 200) / 10.0f;
+        started = true;
+    }
+    sim_temperature += sensor_step(0.05f);
+    sim_humidity += sensor_step(0.2f);
+    if (sim_humidity < 0.0f) {
+        sim_humidity = 0.0f;
+    } else if (sim_humidity > 100.0f) {
+        sim_humidity = 100.0f;
+    }
+    *temperature = sim_temperature;
+    *humidity = sim_humidity;
+    return true;
+}
+
+void temperature_probe_init()
+{
+}
@@ -0,0 +1,155 @@
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "esp_mesh_lite.h"
+#include "node_local.h"
+#include "sim_internal.h"
+#include <string.h>
+
+// Wi-Fi, ESP-NOW and the slice of mesh-lite the firmware uses. Frames and send results reach
+// the firmware on the node's Wi-Fi task, which calls the registered callbacks like the real one.
+
+static NODE_LOCAL uint8_t peers[ESP_NOW_MAX_TOTAL_PEER_NUM][ESP_NOW_ETH_ALEN];
+static NODE_LOCAL int peer_count = 0;
+static NODE_LOCAL esp_now_send_cb_t send_cb = NULL;
+static NODE_LOCAL void (*recv_cbs[ESPNOW_DATA_TYPE_MAX])(const uint8_t *mac_addr, const uint8_t *data, int len);
+
+void sim_wifi_task(void *arg)
+{
+    sim_node_t *node = sim_self;
+    while (1) {
+        sim_rx_item_t *item = node->rx_head;
+        if (!item) {
+            sim_task_block(&node->wifi_wait, portMAX_DELAY);
+            continue;
+        }
+        node->rx_head = item->next;
+        if (!node->rx_head) {
+            node->rx_tail = NULL;
+        }
+        node->rx_len--;
+        if (item->is_status) {
+            if (send_cb) {
+                send_cb(item->mac, item->status);
+            }
+        } else if (item->type < ESPNOW_DATA_TYPE_MAX && recv_cbs[item->type]) {
+            recv_cbs[item->type](item->mac, item->data, item->len);
+        }
+        free(item);
+    }
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_id_t ifx, uint8_t mac[6])
+{
+    if (!sim_self) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memcpy(mac, sim_self->mac, ESP_NOW_ETH_ALEN);
+    if (ifx == ESP_IF_WIFI_AP) {
+        mac[5]++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    sim_node_t *parent = sim_node_get(sim_self->parent);
+    if (!sim_self->listed || !parent) {
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, parent->mac, ESP_NOW_ETH_ALEN);
+    ap_info->bssid[5]++;
+    ap_info->rssi = sim_radio_rssi(sim_self, parent);
+    return ESP_OK;
+}
+
+static int sim_peer_find(const uint8_t *mac)
+{
+    for (int i = 0; i < peer_count; i++) {
+        if (memcmp(peers[i], mac, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (!peer) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (sim_peer_find(peer->peer_addr) >= 0) {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+    if (peer_count >= ESP_NOW_MAX_TOTAL_PEER_NUM) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    memcpy(peers[peer_count++], peer->peer_addr, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    int i = sim_peer_find(peer_addr);
+    if (i < 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    memmove(peers[i], peers[i + 1], (size_t)(peer_count - i - 1) * ESP_NOW_ETH_ALEN);
+    peer_count--;
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    return sim_peer_find(peer_addr) >= 0;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    send_cb = cb;
+    return ESP_OK;
+}
+
+uint8_t esp_mesh_lite_get_level(void)
+{
+    return sim_self->listed ? sim_self->level : 0;
+}
+
+node_info_list_t *esp_mesh_lite_get_nodes_list(uint32_t *size)
+{
+    return sim_radio_nodes_list(sim_self, size);
+}
+
+uint32_t esp_mesh_lite_get_child_node_number(void)
+{
+    uint32_t children = 0;
+    for (int i = 0; i < sim_node_count(); i++) {
+        sim_node_t *node = sim_node_get(i);
+        if (node->listed && node->parent == sim_self->index) {
+            children++;
+        }
+    }
+    return children;
+}
+
+esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *dest_addr, const uint8_t *data, size_t len)
+{
+    if (!dest_addr || !data || len == 0 || len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    // ESP-NOW only sends to registered peers; the broadcast address is one too.
+    if (sim_peer_find(dest_addr) < 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    return sim_radio_send(sim_self, type, dest_addr, data, len);
+}
+
+esp_err_t esp_mesh_lite_espnow_recv_cb_register(espnow_data_type_t type,
+                                                void (*recv_cb)(const uint8_t *mac_addr, const uint8_t *data, int len))
+{
+    if (type >= ESPNOW_DATA_TYPE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    recv_cbs[type] = recv_cb;
+    return ESP_OK;
+}
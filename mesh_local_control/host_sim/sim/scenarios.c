@@ -0,0 +1,655 @@
+#include "scenarios.h"
+#include "sim.h"
+#include "sim_probe.h"
+#include "aggregation.h"
+#include "command_set.h"
+#include "mesh_frame.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEC_US                  1000000LL
+#define SETTLE_LIMIT_S          10      // Time allowed at the end for a block in flight to reach everyone
+#define FAILOVER_WARMUP_S       30      // Mesh formation; the first election falls in the false-positive count
+#define FAILOVER_LIMIT_S        60      // Give up on detection or recovery after this long
+#define FAILOVER_POLL_MS        100
+#define SHARD_TARGET_BLOCKS     40
+#define SHARD_SETTLE_S          90      // Rebalance time after the chain reaches the target, and after kills
+#define SHARD_AVG_SLACK         0.5     // Average holders may exceed SHARD_REPLICAS by this much
+#define ROUNDS_WARMUP_S         60      // Mesh formation and the first election, not measured
+#define ROUNDS_KILL_LIMIT_S     60      // Run left after the leader kill to measure convergence
+#define ROUNDS_MAX              4096    // Rounds recorded per run
+#define PARTITION_BASE_BLOCKS   4       // Common chain before the first split
+#define PARTITION_SPLIT_S       40      // Each side extends its own chain, well short of BLOCKCHAIN_FORK_POOL blocks
+#define PARTITION_HEAL_LIMIT_S  120     // Allowed after each heal for one leader and one chain
+#define PARTITION_QUIET_S       30      // Whole mesh running between a heal and the next split
+#define PARTITION_CYCLES        10      // Later heals meet pools still holding earlier losers
+#define PARTITION_REORG_SLACK   2       // Blocks a losing side may add after the heal, before it switches
+
+static int scenario_alive(void)
+{
+    int alive = 0;
+    for (int i = 0; i < sim_node_count(); i++) {
+        alive += sim_node_alive(i) ? 1 : 0;
+    }
+    return alive;
+}
+
+void scenario_print_summary(void)
+{
+    printf("\n%-4s %-17s %-6s %-8s %-10s %-8s %-8s %-8s\n",
+           "node", "mac", "state", "tip", "tip hash", "beacons", "suspect", "revived");
+    for (int i = 0; i < sim_node_count(); i++) {
+        sim_probe_t p;
+        const uint8_t *mac = sim_node_mac(i);
+        char mac_str[18];
+        snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        if (!sim_probe_node(i, &p)) {
+            printf("%-4d %-17s %-6s\n", i, mac_str, p.alive ? "busy" : "down");
+            continue;
+        }
+        char tip[12] = "-";
+        char hash[12] = "-";
+        if (p.has_tip) {
+            snprintf(tip, sizeof(tip), "%u", p.tip);
+            snprintf(hash, sizeof(hash), "%02x%02x%02x%02x", p.tip_hash[0], p.tip_hash[1], p.tip_hash[2], p.tip_hash[3]);
+        }
+        printf("%-4d %-17s %-6s %-8s %-10s %-8u %-8u %-8u\n", i, mac_str, "up", tip, hash,
+               p.heartbeat.beacons_sent, p.heartbeat.suspicions, p.heartbeat.suspects_revived);
+    }
+    uint32_t tip = 0;
+    int agree = sim_probe_agreement(&tip);
+    int alive = scenario_alive();
+    sim_radio_stats_t radio;
+    sim_radio_get_stats(&radio);
+    printf("\nagreement: %d/%d live nodes on tip %u\n", agree, alive, tip);
+    printf("radio: %llu frames (%llu broadcast, %llu bytes), %llu delivered, %llu lost, %llu retries, "
+           "%llu send failures, %llu out of range, %llu rx overflow\n",
+           (unsigned long long)radio.frames_sent, (unsigned long long)radio.broadcasts,
+           (unsigned long long)radio.bytes_sent, (unsigned long long)radio.delivered,
+           (unsigned long long)radio.lost, (unsigned long long)radio.retries,
+           (unsigned long long)radio.send_failures, (unsigned long long)radio.out_of_range,
+           (unsigned long long)radio.rx_overflow);
+}
+
+// Run for up to `limit_s` until every live node is on one tip past genesis; returns how many
+// live nodes agree on the most common tip, *tip.
+static int scenario_settle(int limit_s, uint32_t *tip)
+{
+    int64_t limit_us = sim_now_us() + limit_s * SEC_US;
+    int agree = sim_probe_agreement(tip);
+    while ((agree < scenario_alive() || *tip == 0) && sim_now_us() < limit_us) {
+        sim_run_until(sim_now_us() + FAILOVER_POLL_MS * 1000LL);
+        agree = sim_probe_agreement(tip);
+    }
+    return agree;
+}
+
+// Every live node on one tip past genesis, within `limit_s`. A run usually ends with the latest
+// block still on its way, so allow it SETTLE_LIMIT_S to arrive.
+static bool scenario_converged(const char *name, int limit_s)
+{
+    uint32_t tip = 0;
+    int agree = scenario_settle(limit_s, &tip);
+    if (agree < scenario_alive() || tip == 0) {
+        printf("%s: only %d/%d live nodes agree, on tip %u\n", name, agree, scenario_alive(), tip);
+        return false;
+    }
+    return true;
+}
+
+int scenario_run(const scenario_args_t *args)
+{
+    sim_run_until(args->duration_us);
+    return scenario_converged("run", SETTLE_LIMIT_S) ? 0 : 1;
+}
+
+// ---- Leader failover (heartbeat failure detector) ----
+
+static uint32_t scenario_sum_suspicions(void)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < sim_node_count(); i++) {
+        sim_probe_t p;
+        if (sim_probe_node(i, &p)) {
+            total += p.heartbeat.suspicions;
+        }
+    }
+    return total;
+}
+
+// The node currently beaconing: whose beacons_sent moves over two beacon periods.
+static int scenario_find_leader(void)
+{
+    uint32_t before[SIM_MAX_NODES] = {0};
+    sim_probe_t p;
+    for (int i = 0; i < sim_node_count(); i++) {
+        before[i] = sim_probe_node(i, &p) ? p.heartbeat.beacons_sent : 0;
+    }
+    sim_run_until(sim_now_us() + 2 * HEARTBEAT_INTERVAL_MS * 1000LL + 100000);
+    for (int i = 0; i < sim_node_count(); i++) {
+        if (sim_probe_node(i, &p) && p.heartbeat.beacons_sent > before[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int scenario_failover(const scenario_args_t *args)
+{
+    sim_run_until(FAILOVER_WARMUP_S * SEC_US);
+    int64_t steady_start = sim_now_us();
+    uint32_t susp_start = scenario_sum_suspicions();
+    // Watch the healthy mesh for false positives until there is just enough run left for the kill.
+    if (args->duration_us - FAILOVER_LIMIT_S * SEC_US > steady_start) {
+        sim_run_until(args->duration_us - FAILOVER_LIMIT_S * SEC_US);
+    }
+
+    int leader = -1;
+    int64_t search_start = sim_now_us();
+    while (leader < 0 && sim_now_us() < search_start + FAILOVER_LIMIT_S * SEC_US) {
+        leader = scenario_find_leader();
+    }
+    if (leader < 0) {
+        printf("failover: no node is beaconing at %.0f s\n", sim_now_us() / 1e6);
+        return 1;
+    }
+    int64_t kill_us = sim_now_us();
+    uint32_t susp_before = scenario_sum_suspicions();
+    uint32_t tip_before = 0;
+    sim_probe_agreement(&tip_before);
+    uint32_t beacons_before[SIM_MAX_NODES] = {0};
+    for (int i = 0; i < sim_node_count(); i++) {
+        sim_probe_t p;
+        beacons_before[i] = sim_probe_node(i, &p) ? p.heartbeat.beacons_sent : 0;
+    }
+    printf("failover: killing leader n%02d at %.3f s (tip %u)\n", leader, kill_us / 1e6, tip_before);
+    sim_node_kill(leader);
+
+    int64_t detect_us = -1;
+    int64_t recover_us = -1;
+    int new_leader = -1;
+    while ((detect_us < 0 || recover_us < 0) && sim_now_us() < kill_us + FAILOVER_LIMIT_S * SEC_US) {
+        sim_run_until(sim_now_us() + FAILOVER_POLL_MS * 1000LL);
+        if (detect_us < 0 && scenario_sum_suspicions() > susp_before) {
+            detect_us = sim_now_us() - kill_us;
+        }
+        for (int i = 0; i < sim_node_count(); i++) {
+            sim_probe_t p;
+            if (!sim_probe_node(i, &p)) {
+                continue;
+            }
+            if (recover_us < 0 && (p.heartbeat.beacons_sent > beacons_before[i] ||
+                                   (p.has_tip && p.tip > tip_before))) {
+                recover_us = sim_now_us() - kill_us;
+                new_leader = i;
+            }
+        }
+    }
+    // No node had failed before the kill, so every suspicion since the warm-up, leader
+    // discovery included, was a false positive, whether or not the suspect was heard again.
+    double node_hours = 0.0;
+    for (int i = 0; i < sim_node_count(); i++) {
+        node_hours += (i == leader || sim_node_alive(i)) ? (kill_us - steady_start) / 3600e6 : 0.0;
+    }
+    uint32_t false_positives = susp_before - susp_start;
+    printf("failover: detection ");
+    if (detect_us >= 0) {
+        printf("%.1f ms", detect_us / 1e3);
+    } else {
+        printf("none");
+    }
+    printf(", recovery ");
+    if (recover_us >= 0) {
+        printf("%.1f ms (n%02d beaconing or extending the chain)", recover_us / 1e3, new_leader);
+    } else {
+        printf("none");
+    }
+    printf("\nfailover: %.1f s before the kill, from %.0f s: %u suspicion(s), all false positives = %.2f per node-hour\n",
+           (kill_us - steady_start) / 1e6, steady_start / 1e6, false_positives,
+           node_hours > 0 ? false_positives / node_hours : 0.0);
+
+    // Let the new leader settle the chain for the rest of the run.
+    if (sim_now_us() < args->duration_us) {
+        sim_run_until(args->duration_us);
+    }
+    bool converged = scenario_converged("failover", SETTLE_LIMIT_S);
+    return (detect_us >= 0 && recover_us >= 0 && converged) ? 0 : 1;
+}
+
+// ---- Shard replication ----
+
+typedef struct {
+    uint32_t checked;
+    uint32_t under;                 // Blocks with fewer than SHARD_REPLICAS live holders
+    uint32_t min;
+    uint32_t max;
+    double avg;
+} shard_report_t;
+
+static void scenario_shard_measure(uint32_t tip, shard_report_t *out)
+{
+    uint32_t count = tip + 1;
+    uint32_t *holders = calloc(count, sizeof(*holders));
+    bool *full = calloc(count, sizeof(*full));
+    memset(out, 0, sizeof(*out));
+    if (!holders || !full) {
+        free(holders);
+        free(full);
+        return;
+    }
+    printf("shard: bodies held per node:");
+    for (int i = 0; i < sim_node_count(); i++) {
+        if (!sim_node_alive(i)) {
+            continue;
+        }
+        uint32_t held = sim_probe_bodies(i, full, count);
+        printf(" n%02d=%.0f%%", i, 100.0 * held / count);
+        for (uint32_t num = 0; num < count; num++) {
+            holders[num] += full[num] ? 1 : 0;
+        }
+    }
+    printf("\n");
+    // The newest blocks are kept everywhere on purpose; judge only the sharded history.
+    uint32_t sharded = count > SHARD_RECENT_BLOCKS ? count - SHARD_RECENT_BLOCKS : 0;
+    out->min = UINT32_MAX;
+    uint64_t sum = 0;
+    for (uint32_t num = 0; num < sharded; num++) {
+        out->min = holders[num] < out->min ? holders[num] : out->min;
+        out->max = holders[num] > out->max ? holders[num] : out->max;
+        out->under += holders[num] < SHARD_REPLICAS ? 1 : 0;
+        sum += holders[num];
+    }
+    out->checked = sharded;
+    out->avg = sharded ? (double)sum / sharded : 0.0;
+    if (sharded == 0) {
+        out->min = 0;
+    }
+    free(holders);
+    free(full);
+}
+
+// Every block kept by SHARD_REPLICAS nodes: none under, and on average not many over, which
+// would mean nodes disagree on the membership and each keeps what it thinks is its share.
+static bool scenario_shard_print(const char *when, const shard_report_t *r)
+{
+    printf("shard: %s: %u sharded blocks, holders min %u avg %.2f max %u, %u under %d replicas\n",
+           when, r->checked, r->min, r->avg, r->max, r->under, SHARD_REPLICAS);
+    return r->checked > 0 && r->under == 0 && r->avg <= SHARD_REPLICAS + SHARD_AVG_SLACK;
+}
+
+int scenario_shard(const scenario_args_t *args)
+{
+    if (args->nodes <= SHARD_REPLICAS + 2) {
+        printf("shard: needs more than %d nodes to shard and survive two failures\n", SHARD_REPLICAS + 2);
+        return 1;
+    }
+    uint32_t tip = 0;
+    while (sim_now_us() < args->duration_us) {
+        sim_run_until(sim_now_us() + 10 * SEC_US);
+        sim_probe_agreement(&tip);
+        if (tip >= SHARD_TARGET_BLOCKS) {
+            break;
+        }
+    }
+    printf("shard: chain at block %u after %.0f s\n", tip, sim_now_us() / 1e6);
+    sim_run_until(sim_now_us() + SHARD_SETTLE_S * SEC_US);
+    sim_probe_agreement(&tip);
+    shard_report_t before;
+    scenario_shard_measure(tip, &before);
+    bool ok = scenario_shard_print("steady state", &before);
+
+    // Two nodes that are not beaconing, so the failure under test is storage, not leadership.
+    int killed = 0;
+    for (int i = sim_node_count() - 1; i >= 0 && killed < 2; i--) {
+        sim_probe_t p1;
+        if (!sim_probe_node(i, &p1)) {
+            continue;
+        }
+        sim_run_until(sim_now_us() + 2 * HEARTBEAT_INTERVAL_MS * 1000LL);
+        sim_probe_t p2;
+        if (sim_probe_node(i, &p2) && p2.heartbeat.beacons_sent == p1.heartbeat.beacons_sent) {
+            printf("shard: killing n%02d at %.3f s\n", i, sim_now_us() / 1e6);
+            sim_node_kill(i);
+            killed++;
+        }
+    }
+    sim_run_until(sim_now_us() + SHARD_SETTLE_S * SEC_US);
+    sim_probe_agreement(&tip);
+    shard_report_t after;
+    scenario_shard_measure(tip, &after);
+    ok = scenario_shard_print("after two failures", &after) && ok;
+    ok = scenario_converged("shard", SETTLE_LIMIT_S) && ok;
+    return ok ? 0 : 1;
+}
+
+// ---- Round throughput and leader convergence ----
+
+typedef struct {
+    uint32_t block_num;
+    int leader;
+    int expected;                   // Live nodes when the pulse went out
+    int64_t pulse_us;
+    int64_t block_us;               // First fragment of the block from the same leader; -1 if none
+} round_sample_t;
+
+typedef struct {
+    bool recording;                 // Inside the steady window
+    round_sample_t *samples;
+    int count;
+    int last_pulse_from;            // Most recent leader pulse, recorded or not
+    int killed;                     // Leader killed at kill_us; -1 before the kill
+    int64_t kill_us;
+    int64_t converge_us;
+    int64_t resume_us;
+    int successor;                  // First survivor to pulse, and for which round
+    uint32_t successor_round;
+} round_tap_t;
+
+static void scenario_round_tap(int from, const uint8_t *dest, const uint8_t *frame, size_t len, void *arg)
+{
+    round_tap_t *tap = arg;
+    if (len < MESH_FRAME_HEADER_LEN + 1 + sizeof(uint32_t)) {
+        return;
+    }
+    const uint8_t *msg = frame + MESH_FRAME_HEADER_LEN;
+    uint32_t num;
+    memcpy(&num, msg + 1, sizeof(num));
+    int64_t now = sim_now_us();
+    if (msg[0] == CMD_PULSE && len >= MESH_FRAME_HEADER_LEN + AGG_PULSE_LEN) {
+        // Relays forward the leader's pulse; only the leader's own counts.
+        if (memcmp(msg + 1 + sizeof(uint32_t), sim_node_mac(from), ESP_NOW_ETH_ALEN) != 0) {
+            return;
+        }
+        tap->last_pulse_from = from;
+        if (tap->killed >= 0 && tap->converge_us < 0) {
+            tap->converge_us = now - tap->kill_us;
+            tap->successor = from;
+            tap->successor_round = num;
+        }
+        if (!tap->recording || tap->count >= ROUNDS_MAX) {
+            return;
+        }
+        round_sample_t *s = &tap->samples[tap->count++];
+        s->block_num = num;
+        s->leader = from;
+        s->pulse_us = now;
+        s->block_us = -1;
+        s->expected = 0;
+        for (int i = 0; i < sim_node_count(); i++) {
+            s->expected += sim_node_alive(i) ? 1 : 0;
+        }
+    } else if (msg[0] == CMD_BLOCK_FRAGMENT) {
+        // Repairs re-send old blocks from any holder; only the successor's own block counts.
+        if (tap->converge_us >= 0 && tap->resume_us < 0 && from == tap->successor && num >= tap->successor_round) {
+            tap->resume_us = now - tap->kill_us;
+        }
+        for (int i = tap->count - 1; i >= 0; i--) {
+            round_sample_t *s = &tap->samples[i];
+            if (s->block_num == num && s->leader == from) {
+                if (s->block_us < 0) {
+                    s->block_us = now;
+                }
+                break;
+            }
+        }
+    }
+}
+
+static int scenario_cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double scenario_percentile_ms(const int64_t *sorted, uint32_t count, double pct)
+{
+    if (count == 0) {
+        return 0.0;
+    }
+    uint32_t rank = (uint32_t)(pct / 100.0 * (count - 1) + 0.5);
+    return sorted[rank] / 1e3;
+}
+
+// A live node on the agreed tip, to read the final chain from; -1 if none.
+static int scenario_reference_node(uint32_t tip)
+{
+    for (int i = 0; i < sim_node_count(); i++) {
+        sim_probe_t p;
+        if (sim_probe_node(i, &p) && p.has_tip && p.tip == tip) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int scenario_rounds_measure(const scenario_args_t *args, scenario_rounds_report_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    round_tap_t tap = {.last_pulse_from = -1, .killed = -1, .converge_us = -1, .resume_us = -1, .successor = -1};
+    tap.samples = calloc(ROUNDS_MAX, sizeof(*tap.samples));
+    if (!tap.samples) {
+        return 1;
+    }
+    sim_radio_set_tap(scenario_round_tap, &tap);
+
+    sim_run_until(ROUNDS_WARMUP_S * SEC_US);
+    int64_t window_start = sim_now_us();
+    int64_t window_end = args->duration_us - ROUNDS_KILL_LIMIT_S * SEC_US;
+    tap.recording = true;
+    if (window_end > window_start) {
+        sim_run_until(window_end);
+    }
+    tap.recording = false;
+    out->window_s = (sim_now_us() - window_start) / 1e6;
+
+    // Kill the node holding the lead right now (it may have handed over since its last pulse)
+    // and watch a successor take over.
+    int leader = scenario_find_leader();
+    if (leader < 0) {
+        leader = tap.last_pulse_from;
+    }
+    if (leader >= 0 && sim_node_alive(leader)) {
+        tap.kill_us = sim_now_us();
+        tap.killed = leader;
+        sim_node_kill(leader);
+        while ((tap.converge_us < 0 || tap.resume_us < 0) &&
+               sim_now_us() < tap.kill_us + ROUNDS_KILL_LIMIT_S * SEC_US) {
+            sim_run_until(sim_now_us() + FAILOVER_POLL_MS * 1000LL);
+        }
+    }
+    if (sim_now_us() < args->duration_us) {
+        sim_run_until(args->duration_us);
+    }
+    sim_radio_set_tap(NULL, NULL);
+    out->converge_ms = tap.converge_us >= 0 ? tap.converge_us / 1e3 : -1.0;
+    out->resume_ms = tap.resume_us >= 0 ? tap.resume_us / 1e3 : -1.0;
+
+    out->agreement = scenario_settle(SETTLE_LIMIT_S, &out->tip);
+    out->alive = scenario_alive();
+    uint32_t *readings = calloc(out->tip + 1, sizeof(*readings));
+    uint32_t *held = calloc(out->tip + 1, sizeof(*held));
+    uint32_t *node_readings = calloc(out->tip + 1, sizeof(*node_readings));
+    int64_t *latency = calloc(ROUNDS_MAX, sizeof(*latency));
+    int ref = scenario_reference_node(out->tip);
+    if (readings && ref >= 0) {
+        sim_probe_readings(ref, readings, out->tip + 1);
+    } else if (readings) {
+        memset(readings, 0xFF, (out->tip + 1) * sizeof(*readings));
+    }
+    // How far each block got: live nodes holding its number. With every node on one tip that
+    // is the reference node's block.
+    for (int i = 0; i < sim_node_count() && held && node_readings; i++) {
+        if (!sim_node_alive(i)) {
+            continue;
+        }
+        sim_probe_readings(i, node_readings, out->tip + 1);
+        for (uint32_t num = 0; num <= out->tip; num++) {
+            held[num] += node_readings[num] != UINT32_MAX ? 1 : 0;
+        }
+    }
+
+    uint64_t expected = 0;
+    uint64_t lost = 0;
+    double propagated = 0.0;
+    out->rounds = (uint32_t)tap.count;
+    for (int i = 0; i < tap.count && latency; i++) {
+        const round_sample_t *s = &tap.samples[i];
+        if (s->block_us < 0) {
+            continue;
+        }
+        latency[out->completed++] = s->block_us - s->pulse_us;
+        expected += s->expected;
+        if (held && s->block_num <= out->tip && out->alive > 0) {
+            propagated += (double)held[s->block_num] / out->alive;
+        }
+        if (!readings || s->block_num > out->tip || readings[s->block_num] == UINT32_MAX) {
+            out->not_chained++;
+            lost += s->expected;
+        } else if (readings[s->block_num] < (uint32_t)s->expected) {
+            lost += s->expected - readings[s->block_num];
+        }
+    }
+    if (latency && out->completed > 0) {
+        qsort(latency, out->completed, sizeof(*latency), scenario_cmp_i64);
+        out->latency_p50_ms = scenario_percentile_ms(latency, out->completed, 50);
+        out->latency_p90_ms = scenario_percentile_ms(latency, out->completed, 90);
+        out->latency_p99_ms = scenario_percentile_ms(latency, out->completed, 99);
+        out->latency_max_ms = latency[out->completed - 1] / 1e3;
+        out->readings_expected = (double)expected / out->completed;
+        out->readings_lost = (double)lost / out->completed;
+        out->propagated = propagated / out->completed;
+    }
+    out->blocks_per_min = out->window_s > 0 ? out->completed * 60.0 / out->window_s : 0.0;
+    free(readings);
+    free(held);
+    free(node_readings);
+    free(latency);
+    free(tap.samples);
+    return (out->completed > 0 && out->converge_ms >= 0 && out->tip > 0 && out->agreement == out->alive) ? 0 : 1;
+}
+
+int scenario_rounds(const scenario_args_t *args)
+{
+    scenario_rounds_report_t r;
+    int rc = scenario_rounds_measure(args, &r);
+    printf("rounds: %.0f s window: %u rounds, %u completed, %.2f blocks/min\n",
+           r.window_s, r.rounds, r.completed, r.blocks_per_min);
+    printf("rounds: pulse to block p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           r.latency_p50_ms, r.latency_p90_ms, r.latency_p99_ms, r.latency_max_ms);
+    printf("rounds: %.2f readings expected, %.2f lost per round; blocks reached %.1f%% of live nodes, "
+           "%u not in the final chain\n", r.readings_expected, r.readings_lost, 100.0 * r.propagated, r.not_chained);
+    if (r.agreement < r.alive) {
+        printf("rounds: only %d/%d live nodes agree, on tip %u\n", r.agreement, r.alive, r.tip);
+    }
+    printf("rounds: after the leader kill, first pulse by a survivor ");
+    if (r.converge_ms >= 0) {
+        printf("%.1f ms", r.converge_ms);
+    } else {
+        printf("none");
+    }
+    printf(", first block ");
+    if (r.resume_ms >= 0) {
+        printf("%.1f ms\n", r.resume_ms);
+    } else {
+        printf("none\n");
+    }
+    return rc;
+}
+
+// ---- Partition and heal (fork choice and reorg) ----
+
+static void scenario_chain_totals(blockchain_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < sim_node_count(); i++) {
+        sim_probe_t p;
+        if (!sim_probe_node(i, &p)) {
+            continue;
+        }
+        out->reorgs += p.chain.reorgs;
+        out->deepest_reorg = p.chain.deepest_reorg > out->deepest_reorg ? p.chain.deepest_reorg : out->deepest_reorg;
+        out->fork_evictions += p.chain.fork_evictions;
+        out->chunk_splits += p.chain.chunk_splits;
+    }
+}
+
+int scenario_partition(const scenario_args_t *args)
+{
+    int n = sim_node_count();
+    if (n < 3) {
+        printf("partition: needs at least 3 nodes to split\n");
+        return 1;
+    }
+    uint32_t tip = 0;
+    while (tip < PARTITION_BASE_BLOCKS && sim_now_us() < args->duration_us) {
+        sim_run_until(sim_now_us() + 10 * SEC_US);
+        sim_probe_agreement(&tip);
+    }
+    bool ok = scenario_converged("partition: before the first split", SETTLE_LIMIT_S);
+    blockchain_stats_t before;
+    scenario_chain_totals(&before);
+
+    // A third of the mesh is cut off each time, the tail and the head in turn. The head holds
+    // the leader chosen at discovery, so both a majority and a minority have to elect one.
+    // Losers keep their displaced branch pooled, so later heals find the pools filling up.
+    uint32_t longest_branch = 0;
+    for (int cycle = 0; cycle < PARTITION_CYCLES; cycle++) {
+        int first = (cycle % 2 == 0) ? n - n / 3 : 0;
+        int last = first + n / 3;
+        sim_probe_agreement(&tip);
+        printf("partition: isolating n%02d-n%02d at %.0f s (tip %u)\n", first, last - 1, sim_now_us() / 1e6, tip);
+        for (int i = first; i < last; i++) {
+            sim_node_set_partition(i, 1);
+        }
+        sim_run_until(sim_now_us() + PARTITION_SPLIT_S * SEC_US);
+
+        uint32_t tips[2] = {0, 0};
+        for (int i = 0; i < n; i++) {
+            sim_probe_t p;
+            int side = (i >= first && i < last) ? 1 : 0;
+            if (sim_probe_node(i, &p) && p.tip > tips[side]) {
+                tips[side] = p.tip;
+            }
+        }
+        printf("partition: healing at %.0f s; majority at block %u, minority at %u\n",
+               sim_now_us() / 1e6, tips[0], tips[1]);
+        for (int side = 0; side < 2; side++) {
+            if (tips[side] > tip && tips[side] - tip > longest_branch) {
+                longest_branch = tips[side] - tip;
+            }
+        }
+        for (int i = first; i < last; i++) {
+            sim_node_set_partition(i, 0);
+        }
+        int64_t heal_us = sim_now_us();
+        if (scenario_converged("partition: after the heal", PARTITION_HEAL_LIMIT_S)) {
+            printf("partition: converged %.1f s after the heal\n", (sim_now_us() - heal_us) / 1e6);
+        } else {
+            ok = false;
+        }
+        sim_run_until(sim_now_us() + PARTITION_QUIET_S * SEC_US);
+    }
+    // The cycles may run past --duration; settle either way so the summary is not a snapshot
+    // of the latest block half propagated. Heals leave leadership contested for a while, so a
+    // fork race can still be open here and gets the same time as a heal to resolve.
+    if (sim_now_us() < args->duration_us) {
+        sim_run_until(args->duration_us);
+    }
+    ok = scenario_converged("partition", PARTITION_HEAL_LIMIT_S) && ok;
+
+    blockchain_stats_t after;
+    scenario_chain_totals(&after);
+    uint32_t reorgs = after.reorgs - before.reorgs;
+    printf("partition: %u reorg(s), deepest %u block(s) for branches up to %u; %u fork pool eviction(s), "
+           "%u chunk split(s)\n", reorgs, after.deepest_reorg, longest_branch,
+           after.fork_evictions - before.fork_evictions, after.chunk_splits - before.chunk_splits);
+    // A node should only ever drop what one side grew while split, not chase a deeper fork.
+    if (after.deepest_reorg > longest_branch + PARTITION_REORG_SLACK) {
+        printf("partition: a reorg dropped more than the longest branch grown while split\n");
+        ok = false;
+    }
+    return (ok && reorgs > 0) ? 0 : 1;
+}
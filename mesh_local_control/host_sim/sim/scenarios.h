@@ -0,0 +1,47 @@
+#ifndef SCENARIOS_H
+#define SCENARIOS_H
+
+#include <stdint.h>
+
+// Scenarios run on an initialised simulator with `nodes` nodes already added. Each prints its
+// measurements and returns 0 if the firmware met the expectation under test.
+typedef struct {
+    int nodes;
+    int64_t duration_us;
+} scenario_args_t;
+
+int scenario_run(const scenario_args_t *args);
+int scenario_failover(const scenario_args_t *args);
+int scenario_shard(const scenario_args_t *args);
+int scenario_rounds(const scenario_args_t *args);
+int scenario_partition(const scenario_args_t *args);
+
+// What scenario_rounds measures. Round figures cover the steady window between the warm-up and
+// the leader kill; times are virtual, so a report depends only on the configuration and seed.
+typedef struct {
+    double window_s;                // Steady window length
+    uint32_t rounds;                // Pulses sent by a leader in the window
+    uint32_t completed;             // ... whose block its leader then broadcast
+    double blocks_per_min;
+    double latency_p50_ms;          // Pulse to the first fragment of the round's block
+    double latency_p90_ms;
+    double latency_p99_ms;
+    double latency_max_ms;
+    double readings_expected;       // Per completed round: live nodes at the pulse
+    double readings_lost;           // ... minus the readings in the block as finally chained
+    double propagated;              // ... share of live nodes holding its block number at the end
+    uint32_t not_chained;           // Completed rounds whose block number the agreed chain lacks
+    double converge_ms;             // Leader kill to the first pulse by a survivor; -1 if none
+    double resume_ms;               // Leader kill to a survivor broadcasting a block; -1 if none
+    int agreement;                  // Live nodes on the common tip at the end; the run fails below `alive`
+    int alive;
+    uint32_t tip;
+} scenario_rounds_report_t;
+
+// scenario_rounds without the printing; returns what scenario_rounds would.
+int scenario_rounds_measure(const scenario_args_t *args, scenario_rounds_report_t *out);
+
+// Tips, agreement and radio totals for every node.
+void scenario_print_summary(void);
+
+#endif // SCENARIOS_H
@@ -0,0 +1,88 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Host-side mesh simulator. Every virtual node runs the unmodified firmware modules on its own
+// OS thread (so NODE_LOCAL state is per node), with the node's FreeRTOS tasks as cooperative
+// coroutines on that thread. Only one node runs at a time, driven by a discrete-event loop over
+// virtual microseconds, so a run is fully determined by its configuration and seed.
+
+#define SIM_MAX_NODES           512
+#define SIM_MAC_RETRIES         3       // Unicast retransmissions before the send callback reports failure
+
+typedef struct {
+    uint32_t seed;
+    // Radio
+    uint32_t latency_us;                // Fixed propagation + stack delay per frame
+    uint32_t jitter_us;                 // Uniform extra delay in [0, jitter_us]
+    double loss;                        // Per-receiver, per-transmission frame loss probability
+    uint32_t bitrate_kbps;              // Airtime per frame is len * 8 / bitrate; 0 disables airtime
+    double range;                       // Nodes sit on a unit grid; 0 means everyone hears everyone
+    // Mesh-lite topology
+    uint32_t fanout;                    // Children per node in the simulated mesh-lite tree
+    uint32_t membership_delay_ms;       // Until joins and departures show in everyone's node list
+    uint32_t rx_queue_len;              // Frames a node's Wi-Fi task buffers before dropping
+    int log_level;                      // esp_log_level_t applied to every tag at boot
+    bool modules_only;                  // Boot the modules but never start mesh_networking_task
+} sim_config_t;
+
+typedef struct {
+    uint64_t frames_sent;               // Successful esp_mesh_lite_espnow_send calls
+    uint64_t broadcasts;
+    uint64_t bytes_sent;
+    uint64_t delivered;
+    uint64_t lost;                      // Dropped by the loss model, retries included
+    uint64_t out_of_range;
+    uint64_t retries;
+    uint64_t rx_overflow;               // Dropped because a receiver's Wi-Fi queue was full
+    uint64_t send_failures;             // Unicasts reported ESP_NOW_SEND_FAIL
+} sim_radio_stats_t;
+
+void sim_config_defaults(sim_config_t *cfg);
+void sim_init(const sim_config_t *cfg);
+const sim_config_t *sim_config(void);
+
+// Virtual time since sim_init().
+int64_t sim_now_us(void);
+
+// Boot a node running the firmware; returns its index, or -1 when SIM_MAX_NODES are in use.
+int sim_node_add(void);
+// Same, with a given station MAC instead of the next simulated one.
+int sim_node_add_mac(const uint8_t *mac);
+// Power a node off. It stops receiving at once and leaves the node lists after the membership delay.
+void sim_node_kill(int index);
+// Boot a fresh instance of a killed node, with the same MAC and an empty chain.
+void sim_node_restart(int index);
+bool sim_node_alive(int index);
+// Move a node to radio island `partition` (all start in 0). Frames only cross between nodes on
+// the same island, and each island forms its own mesh-lite tree after the membership delay;
+// putting everyone back on one island heals the mesh.
+void sim_node_set_partition(int index, int partition);
+int sim_node_count(void);
+const uint8_t *sim_node_mac(int index);
+int sim_node_find(const uint8_t *mac);
+
+// Advance virtual time, running every node, until `until_us`.
+void sim_run_until(int64_t until_us);
+
+// Run fn(arg) as a short task on a live node, so it can read that node's module state through
+// the firmware's own API. Returns false if the node is dead or fn blocked without finishing.
+bool sim_node_call(int index, void (*fn)(void *arg), void *arg);
+
+void sim_radio_get_stats(sim_radio_stats_t *out);
+
+// Observer for every frame a node puts on the air, before loss or range is applied. `frame`
+// is the ESP-NOW payload as sent, mesh_frame header included. Runs on the sending node's
+// thread while the rest of the simulation is stopped: it may read scenario and simulator state
+// (sim_now_us, sim_node_alive) but must not advance time or call into a node. NULL removes it.
+typedef void (*sim_radio_tap_t)(int from, const uint8_t *dest, const uint8_t *frame, size_t len, void *arg);
+void sim_radio_set_tap(sim_radio_tap_t tap, void *arg);
+
+// Deterministic simulator-side randomness (radio model, scenarios); separate from the nodes'.
+uint32_t sim_rand(void);
+double sim_rand_unit(void);
+
+#endif // SIM_H
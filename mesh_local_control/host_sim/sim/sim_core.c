@@ -0,0 +1,680 @@
+#include "sim_internal.h"
+#include "blockchain.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+_Static_assert(SIM_MAX_NODES <= MESH_MAX_NODES, "the firmware must be sized for every node the simulator can run");
+
+// Discrete-event core. The main thread owns virtual time and pops events in (time, sequence)
+// order; each event hands the baton to one node's thread, which runs that node's ready tasks
+// until all of them block again and then hands it back. Nothing else ever runs concurrently.
+
+typedef enum {
+    SIM_EV_RESUME,                      // Run whatever is ready on the node
+    SIM_EV_TIMEOUT,                     // A blocked task's timeout expired
+    SIM_EV_RX,                          // A frame or send status reaches the node's Wi-Fi task
+    SIM_EV_MEMBERSHIP,                  // Mesh-lite node lists catch up with joins and departures
+} sim_event_kind_t;
+
+typedef struct {
+    int64_t at_us;
+    uint64_t seq;
+    sim_event_kind_t kind;
+    sim_node_t *node;
+    uint32_t generation;
+    sim_task_t *task;
+    uint64_t wait_gen;
+    sim_rx_item_t *item;
+} sim_event_t;
+
+__thread sim_node_t *sim_self = NULL;
+
+static sim_config_t config;
+static int64_t now_us = 0;
+static uint64_t next_seq = 0;
+static sim_event_t *events = NULL;
+static size_t event_count = 0;
+static size_t event_cap = 0;
+static sim_node_t nodes[SIM_MAX_NODES];
+static int node_count = 0;
+static sem_t baton_returned;
+static uint64_t rng_state = 0;
+
+void sim_config_defaults(sim_config_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->seed = 1;
+    cfg->latency_us = 2000;
+    cfg->jitter_us = 1000;
+    cfg->loss = 0.0;
+    cfg->bitrate_kbps = 1000;           // ESP-NOW's default 1 Mbps PHY rate
+    cfg->range = 0.0;
+    cfg->fanout = 6;
+    cfg->membership_delay_ms = 2000;
+    cfg->rx_queue_len = 64;
+    cfg->log_level = ESP_LOG_WARN;
+}
+
+const sim_config_t *sim_config(void)
+{
+    return &config;
+}
+
+int64_t sim_now_us(void)
+{
+    return now_us;
+}
+
+uint64_t sim_tick_us(void)
+{
+    return 1000000ULL / configTICK_RATE_HZ;
+}
+
+uint32_t sim_rand(void)
+{
+    // xorshift64*: cheap, and independent of the libc rand() the firmware uses.
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+double sim_rand_unit(void)
+{
+    return sim_rand() / 4294967296.0;
+}
+
+// ---- Event queue: binary min-heap on (at_us, seq) ----
+
+static bool sim_event_before(const sim_event_t *a, const sim_event_t *b)
+{
+    return a->at_us < b->at_us || (a->at_us == b->at_us && a->seq < b->seq);
+}
+
+static void sim_event_push(sim_event_t ev)
+{
+    if (event_count == event_cap) {
+        event_cap = event_cap ? event_cap * 2 : 1024;
+        events = realloc(events, event_cap * sizeof(*events));
+        if (!events) {
+            fprintf(stderr, "sim: out of memory for events\n");
+            abort();
+        }
+    }
+    ev.seq = next_seq++;
+    size_t i = event_count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!sim_event_before(&ev, &events[parent])) {
+            break;
+        }
+        events[i] = events[parent];
+        i = parent;
+    }
+    events[i] = ev;
+}
+
+static sim_event_t sim_event_pop(void)
+{
+    sim_event_t top = events[0];
+    sim_event_t last = events[--event_count];
+    size_t i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= event_count) {
+            break;
+        }
+        if (child + 1 < event_count && sim_event_before(&events[child + 1], &events[child])) {
+            child++;
+        }
+        if (!sim_event_before(&events[child], &last)) {
+            break;
+        }
+        events[i] = events[child];
+        i = child;
+    }
+    if (event_count > 0) {
+        events[i] = last;
+    }
+    return top;
+}
+
+static void sim_post(sim_event_kind_t kind, sim_node_t *node, int64_t at_us)
+{
+    sim_event_t ev = {
+        .at_us = at_us < now_us ? now_us : at_us,
+        .kind = kind,
+        .node = node,
+        .generation = node ? node->generation : 0,
+    };
+    sim_event_push(ev);
+}
+
+void sim_post_rx(sim_node_t *node, int64_t at_us, sim_rx_item_t *item)
+{
+    sim_event_t ev = {
+        .at_us = at_us < now_us ? now_us : at_us,
+        .kind = SIM_EV_RX,
+        .node = node,
+        .generation = node->generation,
+        .item = item,
+    };
+    sim_event_push(ev);
+}
+
+void sim_post_membership(int64_t at_us)
+{
+    sim_post(SIM_EV_MEMBERSHIP, NULL, at_us);
+}
+
+// ---- Tasks ----
+
+static void sim_ready_push(sim_task_t *task)
+{
+    sim_node_t *node = task->node;
+    task->state = SIM_TASK_READY;
+    task->ready_next = NULL;
+    // Highest priority first, FIFO within a priority, like the FreeRTOS ready lists.
+    sim_task_t **link = &node->ready_head;
+    while (*link && (*link)->priority >= task->priority) {
+        link = &(*link)->ready_next;
+    }
+    task->ready_next = *link;
+    *link = task;
+}
+
+static void sim_ready_remove(sim_task_t *task)
+{
+    for (sim_task_t **link = &task->node->ready_head; *link; link = &(*link)->ready_next) {
+        if (*link == task) {
+            *link = task->ready_next;
+            task->ready_next = NULL;
+            return;
+        }
+    }
+}
+
+static void sim_waitq_remove(sim_waitq_t *q, sim_task_t *task)
+{
+    sim_task_t *prev = NULL;
+    for (sim_task_t *cur = q->head; cur; prev = cur, cur = cur->wait_next) {
+        if (cur != task) {
+            continue;
+        }
+        if (prev) {
+            prev->wait_next = cur->wait_next;
+        } else {
+            q->head = cur->wait_next;
+        }
+        if (q->tail == cur) {
+            q->tail = prev;
+        }
+        cur->wait_next = NULL;
+        return;
+    }
+}
+
+static void sim_task_entry(void)
+{
+    sim_task_t *task = sim_self->current;
+    task->fn(task->arg);
+    // FreeRTOS tasks must not return; treat it as vTaskDelete(NULL).
+    sim_task_delete(task);
+}
+
+static void sim_task_release_stack(sim_task_t *task)
+{
+    if (task->stack) {
+        munmap(task->stack, SIM_TASK_STACK);
+        task->stack = NULL;
+    }
+}
+
+// getcontext() returns twice in principle, so it sits in its own frame where nothing the caller
+// keeps in registers can be clobbered.
+static void sim_task_make_context(ucontext_t *ctx, void *stack)
+{
+    getcontext(ctx);
+    ctx->uc_stack.ss_sp = stack;
+    ctx->uc_stack.ss_size = SIM_TASK_STACK;
+    ctx->uc_link = NULL;
+    makecontext(ctx, sim_task_entry, 0);
+}
+
+sim_task_t *sim_task_create(sim_node_t *node, TaskFunction_t fn, const char *name, void *arg,
+                            UBaseType_t priority)
+{
+    sim_task_t *task = calloc(1, sizeof(*task));
+    if (!task) {
+        return NULL;
+    }
+    task->stack = mmap(NULL, SIM_TASK_STACK, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (task->stack == MAP_FAILED) {
+        free(task);
+        return NULL;
+    }
+    task->node = node;
+    task->fn = fn;
+    task->arg = arg;
+    task->priority = priority >= configMAX_PRIORITIES ? configMAX_PRIORITIES - 1 : priority;
+    snprintf(task->name, sizeof(task->name), "%s", name ? name : "");
+    sim_task_make_context(&task->ctx, task->stack);
+    task->all_next = node->all_tasks;
+    node->all_tasks = task;
+    sim_ready_push(task);
+    return task;
+}
+
+void sim_task_delete(sim_task_t *task)
+{
+    sim_node_t *node = task->node;
+    if (task->state == SIM_TASK_DEAD) {
+        return;
+    }
+    if (task == node->current) {
+        task->state = SIM_TASK_DEAD;
+        swapcontext(&task->ctx, &node->sched_ctx);
+        abort();                        // A dead task is never resumed
+    }
+    if (task->state == SIM_TASK_BLOCKED && task->waitq) {
+        sim_waitq_remove(task->waitq, task);
+    } else if (task->state == SIM_TASK_READY) {
+        sim_ready_remove(task);
+    }
+    task->state = SIM_TASK_DEAD;
+    sim_task_release_stack(task);
+}
+
+bool sim_task_block(sim_waitq_t *q, TickType_t ticks)
+{
+    sim_node_t *node = sim_self;
+    sim_task_t *task = node ? node->current : NULL;
+    if (!task) {
+        fprintf(stderr, "sim: blocking call outside a simulated task\n");
+        abort();
+    }
+    if (ticks == 0) {
+        return false;
+    }
+    task->state = SIM_TASK_BLOCKED;
+    task->timed_out = false;
+    task->waitq = q;
+    if (q) {
+        task->wait_next = NULL;
+        if (q->tail) {
+            q->tail->wait_next = task;
+        } else {
+            q->head = task;
+        }
+        q->tail = task;
+    }
+    if (ticks != portMAX_DELAY) {
+        sim_event_t ev = {
+            .at_us = now_us + (int64_t)ticks * (int64_t)sim_tick_us(),
+            .kind = SIM_EV_TIMEOUT,
+            .node = node,
+            .generation = node->generation,
+            .task = task,
+            .wait_gen = task->wait_gen,
+        };
+        sim_event_push(ev);
+    }
+    swapcontext(&task->ctx, &node->sched_ctx);
+    return !task->timed_out;
+}
+
+void sim_task_wake(sim_task_t *task)
+{
+    if (task->state != SIM_TASK_BLOCKED) {
+        return;
+    }
+    if (task->waitq) {
+        sim_waitq_remove(task->waitq, task);
+        task->waitq = NULL;
+    }
+    task->wait_gen++;
+    sim_ready_push(task);
+}
+
+void sim_waitq_wake_one(sim_waitq_t *q)
+{
+    if (q->head) {
+        sim_task_wake(q->head);
+    }
+}
+
+void sim_task_yield(void)
+{
+    sim_node_t *node = sim_self;
+    sim_task_t *task = node->current;
+    sim_ready_push(task);
+    swapcontext(&task->ctx, &node->sched_ctx);
+}
+
+// ---- Nodes ----
+
+static void sim_node_run(sim_node_t *node)
+{
+    sim_task_t *task;
+    while ((task = node->ready_head) != NULL) {
+        node->ready_head = task->ready_next;
+        task->ready_next = NULL;
+        task->state = SIM_TASK_RUNNING;
+        node->current = task;
+        swapcontext(&node->sched_ctx, &task->ctx);
+        node->current = NULL;
+        if (task->state == SIM_TASK_DEAD) {
+            sim_task_release_stack(task);
+        }
+        if (++node->switches > SIM_RUNAWAY_SWITCHES) {
+            fprintf(stderr, "sim: node %d task '%s' never blocks at t=%.3f s\n",
+                    node->index, task->name, now_us / 1e6);
+            abort();
+        }
+    }
+}
+
+static volatile bool node_exiting[SIM_MAX_NODES];
+
+static void *sim_node_thread(void *arg)
+{
+    sim_node_t *node = arg;
+    sim_self = node;
+    while (1) {
+        sem_wait(&node->go);
+        if (node_exiting[node->index]) {
+            break;
+        }
+        sim_node_run(node);
+        sem_post(&baton_returned);
+    }
+    sem_post(&baton_returned);
+    return NULL;
+}
+
+static void sim_node_resume(sim_node_t *node)
+{
+    if (!node->ready_head) {
+        return;
+    }
+    sem_post(&node->go);
+    sem_wait(&baton_returned);
+}
+
+static void sim_node_boot(sim_node_t *node)
+{
+    node->alive = true;
+    node->boot_us = now_us;
+    node->generation++;
+    node->current = NULL;
+    node->ready_head = NULL;
+    node->all_tasks = NULL;
+    node->wifi_wait.head = node->wifi_wait.tail = NULL;
+    node->rx_head = node->rx_tail = NULL;
+    node->rx_len = 0;
+    node->switches = 0;
+    node->radio_free_us = now_us;
+    node_exiting[node->index] = false;
+    sem_init(&node->go, 0, 0);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SIM_THREAD_STACK);
+    if (pthread_create(&node->thread, &attr, sim_node_thread, node) != 0) {
+        fprintf(stderr, "sim: failed to start node thread\n");
+        abort();
+    }
+    pthread_attr_destroy(&attr);
+
+    // The Wi-Fi and timer service tasks exist before app_main, as on the device.
+    node->wifi_task = sim_task_create(node, sim_wifi_task, "wifi", NULL, 23);
+    sim_task_create(node, sim_timer_service_task, "Tmr Svc", NULL, 1);
+    sim_task_create(node, sim_firmware_main, "main", NULL, 1);
+    sim_radio_place(node);
+    sim_post(SIM_EV_RESUME, node, now_us);
+}
+
+static void sim_node_shutdown(sim_node_t *node)
+{
+    node->alive = false;
+    node->generation++;
+    node_exiting[node->index] = true;
+    sem_post(&node->go);
+    sem_wait(&baton_returned);
+    pthread_join(node->thread, NULL);
+    sem_destroy(&node->go);
+    // Whatever the firmware had allocated is abandoned with the node, like a power cut.
+    while (node->all_tasks) {
+        sim_task_t *task = node->all_tasks;
+        node->all_tasks = task->all_next;
+        sim_task_release_stack(task);
+        free(task);
+    }
+    while (node->rx_head) {
+        sim_rx_item_t *item = node->rx_head;
+        node->rx_head = item->next;
+        free(item);
+    }
+    node->rx_tail = NULL;
+    node->ready_head = NULL;
+    node->wifi_task = NULL;
+}
+
+void sim_init(const sim_config_t *cfg)
+{
+    config = *cfg;
+    if (config.fanout == 0) {
+        config.fanout = 1;
+    }
+    if (config.rx_queue_len == 0) {
+        config.rx_queue_len = 1;
+    }
+    now_us = 0;
+    next_seq = 0;
+    event_count = 0;
+    node_count = 0;
+    rng_state = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)config.seed << 1 | 1);
+    srand(config.seed);
+    sem_init(&baton_returned, 0, 0);
+    sim_radio_reset();
+}
+
+sim_node_t *sim_node_get(int index)
+{
+    return (index >= 0 && index < node_count) ? &nodes[index] : NULL;
+}
+
+int sim_node_add(void)
+{
+    // Locally administered, spaced so that no station MAC equals another node's softAP MAC (+1).
+    uint32_t id = 4 * (uint32_t)(node_count + 1);
+    uint8_t mac[ESP_NOW_ETH_ALEN] = {0x02, 0x4d, 0x53, 0x00, (uint8_t)(id >> 8), (uint8_t)id};
+    return sim_node_add_mac(mac);
+}
+
+int sim_node_add_mac(const uint8_t *mac)
+{
+    if (node_count >= SIM_MAX_NODES) {
+        return -1;
+    }
+    sim_node_t *node = &nodes[node_count];
+    memset(node, 0, sizeof(*node));
+    node->index = node_count;
+    memcpy(node->mac, mac, ESP_NOW_ETH_ALEN);
+    node->parent = -1;
+    node_count++;
+    sim_node_boot(node);
+    sim_post_membership(now_us + (int64_t)config.membership_delay_ms * 1000);
+    return node->index;
+}
+
+void sim_node_kill(int index)
+{
+    sim_node_t *node = sim_node_get(index);
+    if (!node || !node->alive) {
+        return;
+    }
+    sim_node_shutdown(node);
+    sim_post_membership(now_us + (int64_t)config.membership_delay_ms * 1000);
+}
+
+void sim_node_restart(int index)
+{
+    sim_node_t *node = sim_node_get(index);
+    if (!node || node->alive) {
+        return;
+    }
+    sim_node_boot(node);
+    sim_post_membership(now_us + (int64_t)config.membership_delay_ms * 1000);
+}
+
+void sim_node_set_partition(int index, int partition)
+{
+    sim_node_t *node = sim_node_get(index);
+    if (!node || node->partition == partition) {
+        return;
+    }
+    node->partition = partition;
+    sim_post_membership(now_us + (int64_t)config.membership_delay_ms * 1000);
+}
+
+bool sim_node_alive(int index)
+{
+    sim_node_t *node = sim_node_get(index);
+    return node && node->alive;
+}
+
+int sim_node_count(void)
+{
+    return node_count;
+}
+
+const uint8_t *sim_node_mac(int index)
+{
+    sim_node_t *node = sim_node_get(index);
+    return node ? node->mac : NULL;
+}
+
+int sim_node_find(const uint8_t *mac)
+{
+    for (int i = 0; i < node_count; i++) {
+        if (memcmp(nodes[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void sim_dispatch(const sim_event_t *ev)
+{
+    if (ev->kind == SIM_EV_MEMBERSHIP) {
+        sim_radio_membership_changed();
+        return;
+    }
+    sim_node_t *node = ev->node;
+    if (!node->alive || node->generation != ev->generation) {
+        free(ev->item);
+        return;
+    }
+    switch (ev->kind) {
+    case SIM_EV_TIMEOUT:
+        if (ev->task->state != SIM_TASK_BLOCKED || ev->task->wait_gen != ev->wait_gen) {
+            return;
+        }
+        ev->task->timed_out = true;
+        sim_task_wake(ev->task);
+        break;
+    case SIM_EV_RX:
+        // Send results always get through; only received frames can overflow the queue.
+        if (!ev->item->is_status && node->rx_len >= config.rx_queue_len) {
+            sim_radio_counters.rx_overflow++;
+            free(ev->item);
+            return;
+        }
+        ev->item->next = NULL;
+        if (node->rx_tail) {
+            node->rx_tail->next = ev->item;
+        } else {
+            node->rx_head = ev->item;
+        }
+        node->rx_tail = ev->item;
+        node->rx_len++;
+        sim_waitq_wake_one(&node->wifi_wait);
+        break;
+    default:
+        break;
+    }
+    sim_node_resume(node);
+}
+
+void sim_run_until(int64_t until_us)
+{
+    int64_t last_us = now_us;
+    while (event_count > 0 && events[0].at_us <= until_us) {
+        sim_event_t ev = sim_event_pop();
+        now_us = ev.at_us;
+        if (now_us != last_us) {
+            for (int i = 0; i < node_count; i++) {
+                nodes[i].switches = 0;
+            }
+            last_us = now_us;
+        }
+        sim_dispatch(&ev);
+    }
+    if (now_us < until_us) {
+        now_us = until_us;
+    }
+}
+
+typedef struct {
+    void (*fn)(void *arg);
+    void *arg;
+    bool done;
+    bool abandoned;
+} sim_call_t;
+
+static void sim_call_task(void *arg)
+{
+    sim_call_t *call = arg;
+    if (!call->abandoned) {
+        call->fn(call->arg);
+        call->done = true;
+    }
+    if (call->abandoned) {
+        free(call);
+    }
+    vTaskDelete(NULL);
+}
+
+bool sim_node_call(int index, void (*fn)(void *arg), void *arg)
+{
+    sim_node_t *node = sim_node_get(index);
+    if (!node || !node->alive) {
+        return false;
+    }
+    sim_call_t *call = calloc(1, sizeof(*call));
+    if (!call) {
+        return false;
+    }
+    call->fn = fn;
+    call->arg = arg;
+    if (!sim_task_create(node, sim_call_task, "sim_call", call, configMAX_PRIORITIES - 1)) {
+        free(call);
+        return false;
+    }
+    sim_node_resume(node);
+    bool done = call->done;
+    if (done) {
+        free(call);
+    } else {
+        // Blocked on something the rest of the node holds; it frees the call when it resumes.
+        call->abandoned = true;
+    }
+    return done;
+}
@@ -0,0 +1,129 @@
+#ifndef SIM_INTERNAL_H
+#define SIM_INTERNAL_H
+
+#include "sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_now.h"
+#include "esp_log.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <ucontext.h>
+
+#define SIM_TASK_STACK          (256 * 1024)    // Host stacks are generous; firmware sizes are ignored
+#define SIM_THREAD_STACK        (256 * 1024)
+#define SIM_RUNAWAY_SWITCHES    10000000        // Task switches without time advancing before we abort
+
+typedef struct sim_task sim_task_t;
+typedef struct sim_node sim_node_t;
+
+typedef struct {
+    sim_task_t *head;
+    sim_task_t *tail;
+} sim_waitq_t;
+
+typedef enum {
+    SIM_TASK_READY,
+    SIM_TASK_RUNNING,
+    SIM_TASK_BLOCKED,
+    SIM_TASK_DEAD,
+} sim_task_state_t;
+
+struct sim_task {
+    sim_node_t *node;
+    ucontext_t ctx;
+    void *stack;
+    TaskFunction_t fn;
+    void *arg;
+    char name[16];
+    UBaseType_t priority;
+    sim_task_state_t state;
+    uint64_t wait_gen;                  // Bumped on every wake-up so stale timeouts are ignored
+    bool timed_out;
+    sim_waitq_t *waitq;                 // Wait queue we are blocked on, if any
+    sim_task_t *wait_next;
+    sim_task_t *ready_next;
+    sim_task_t *all_next;
+    uint32_t notify_value;
+    bool notify_waiting;
+};
+
+// A received frame, or a send status, waiting for the node's Wi-Fi task.
+typedef struct sim_rx_item {
+    struct sim_rx_item *next;
+    bool is_status;
+    uint8_t mac[ESP_NOW_ETH_ALEN];      // Source of a frame, destination of a send status
+    uint8_t type;
+    esp_now_send_status_t status;
+    int len;
+    uint8_t data[];
+} sim_rx_item_t;
+
+struct sim_node {
+    int index;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool alive;
+    int64_t boot_us;                    // Device clocks (ticks, esp_timer) count from here
+    uint32_t generation;                // Incremented per boot, so frames for a dead instance are dropped
+    // Simulated mesh-lite membership, maintained by sim_radio.c.
+    bool listed;
+    int join_order;
+    uint8_t level;
+    int parent;
+    int partition;                      // Radio island: frames and node lists stay within it
+    int list_start;                     // Our island's first entry in the node list
+    double x, y;
+    int64_t radio_free_us;              // When our transmitter finishes its current frame
+    // Scheduler
+    pthread_t thread;
+    sem_t go;
+    ucontext_t sched_ctx;
+    sim_task_t *current;
+    sim_task_t *ready_head;
+    sim_task_t *all_tasks;
+    uint64_t switches;
+    // Wi-Fi task input
+    sim_task_t *wifi_task;
+    sim_waitq_t wifi_wait;
+    sim_rx_item_t *rx_head;
+    sim_rx_item_t *rx_tail;
+    uint32_t rx_len;
+};
+
+extern __thread sim_node_t *sim_self;   // Node whose thread we are on; NULL on the main thread
+
+sim_node_t *sim_node_get(int index);
+uint64_t sim_tick_us(void);
+
+// Scheduling, only from a node's own tasks unless noted.
+sim_task_t *sim_task_create(sim_node_t *node, TaskFunction_t fn, const char *name, void *arg,
+                            UBaseType_t priority);     // Also from the main thread while the node is idle
+void sim_task_delete(sim_task_t *task);
+// Block the running task on `q` (may be NULL) for up to `ticks`; false on timeout.
+bool sim_task_block(sim_waitq_t *q, TickType_t ticks);
+void sim_task_wake(sim_task_t *task);
+void sim_task_yield(void);
+void sim_waitq_wake_one(sim_waitq_t *q);
+
+// Deliver work to a node at `at_us` (main thread, or a node thread while it holds the baton).
+void sim_post_rx(sim_node_t *node, int64_t at_us, sim_rx_item_t *item);
+void sim_post_membership(int64_t at_us);
+
+// Radio and membership (sim_radio.c).
+extern sim_radio_stats_t sim_radio_counters;
+void sim_radio_reset(void);
+void sim_radio_place(sim_node_t *node);
+void sim_radio_membership_changed(void);
+esp_err_t sim_radio_send(sim_node_t *from, uint8_t type, const uint8_t *dest, const uint8_t *data, size_t len);
+int8_t sim_radio_rssi(const sim_node_t *a, const sim_node_t *b);
+// Shared mesh-lite node list, as every joined node sees it; NULL and 0 before `node` joins.
+struct node_info_list *sim_radio_nodes_list(const sim_node_t *node, uint32_t *size);
+
+// Per-node shim hooks.
+void sim_wifi_task(void *arg);
+void sim_timer_service_task(void *arg);
+
+// Firmware boot sequence (sim_node.c).
+void sim_firmware_main(void *arg);
+
+#endif // SIM_INTERNAL_H
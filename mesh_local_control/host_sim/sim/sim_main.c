@@ -0,0 +1,237 @@
+#include "sim.h"
+#include "scenarios.h"
+#include "frame_trace.h"
+#include "metrics.h"
+#include "round_profile.h"
+#include "mem_track.h"
+#include "event_trace.h"
+#include "esp_log.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --scenario NAME      run (default), failover, shard, rounds or partition\n"
+            "  --nodes N            virtual nodes to boot (default 8)\n"
+            "  --seed S             random seed (default 1)\n"
+            "  --duration SEC       virtual seconds to simulate (default 300)\n"
+            "  --latency-us US      per-frame delay (default 2000)\n"
+            "  --jitter-us US       extra uniform delay (default 1000)\n"
+            "  --loss P             per-receiver frame loss probability (default 0)\n"
+            "  --bitrate-kbps K     PHY rate for airtime; 0 disables it (default 1000)\n"
+            "  --range R            radio range in grid units; 0 = everyone hears everyone (default 0)\n"
+            "  --fanout F           children per node in the mesh-lite tree (default 6)\n"
+            "  --membership-ms MS   delay before node lists reflect joins and departures (default 2000)\n"
+            "  --log-level L        none, error, warn, info, debug or verbose (default warn)\n"
+            "  --trace-node N       capture node N's ESP-NOW frames from boot (see frame_trace.h)\n"
+            "  --trace-out FILE     where to dump that capture at the end (default trace.bin)\n"
+            "  --metrics-node N     print node N's metrics (Prometheus text) at the end\n"
+            "  --profile-node N     print node N's round profile (rounds it led) at the end\n"
+            "  --mem-node N         print node N's heap use per subsystem at the end\n"
+            "  --events-node N      dump node N's event rings at the end (see event_trace.h)\n"
+            "  --events-out FILE    where to write that dump (default events.bin)\n",
+            prog);
+}
+
+static int parse_level(const char *arg)
+{
+    static const char *names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcasecmp(arg, names[i]) == 0) {
+            return i;
+        }
+    }
+    return atoi(arg);
+}
+
+static void trace_start_fn(void *arg)
+{
+    frame_trace_set_enabled(true);
+}
+
+static bool trace_write(void *ctx, const uint8_t *data, size_t len)
+{
+    return fwrite(data, 1, len, ctx) == len;
+}
+
+static void trace_dump_fn(void *arg)
+{
+    frame_trace_dump(trace_write, arg);
+}
+
+static void events_dump_fn(void *arg)
+{
+    event_trace_dump(trace_write, arg);
+}
+
+static void metrics_dump_fn(void *arg)
+{
+    metrics_write_text(trace_write, arg);
+}
+
+static void profile_dump_fn(void *arg)
+{
+    round_profile_write_text(trace_write, arg);
+}
+
+static void mem_dump_fn(void *arg)
+{
+    mem_track_write_text(trace_write, arg);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"scenario", required_argument, NULL, 'S'},
+        {"nodes", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 's'},
+        {"duration", required_argument, NULL, 'd'},
+        {"latency-us", required_argument, NULL, 'l'},
+        {"jitter-us", required_argument, NULL, 'j'},
+        {"loss", required_argument, NULL, 'p'},
+        {"bitrate-kbps", required_argument, NULL, 'b'},
+        {"range", required_argument, NULL, 'r'},
+        {"fanout", required_argument, NULL, 'f'},
+        {"membership-ms", required_argument, NULL, 'm'},
+        {"log-level", required_argument, NULL, 'v'},
+        {"trace-node", required_argument, NULL, 't'},
+        {"trace-out", required_argument, NULL, 'o'},
+        {"metrics-node", required_argument, NULL, 'M'},
+        {"profile-node", required_argument, NULL, 'P'},
+        {"mem-node", required_argument, NULL, 'H'},
+        {"events-node", required_argument, NULL, 'E'},
+        {"events-out", required_argument, NULL, 'O'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    sim_config_t cfg;
+    sim_config_defaults(&cfg);
+    scenario_args_t args = {.nodes = 8, .duration_us = 300LL * 1000000};
+    const char *scenario = "run";
+    int trace_node = -1;
+    const char *trace_out = "trace.bin";
+    int metrics_node = -1;
+    int profile_node = -1;
+    int mem_node = -1;
+    int events_node = -1;
+    const char *events_out = "events.bin";
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'S': scenario = optarg; break;
+        case 'n': args.nodes = atoi(optarg); break;
+        case 's': cfg.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'd': args.duration_us = (int64_t)(atof(optarg) * 1e6); break;
+        case 'l': cfg.latency_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'j': cfg.jitter_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'p': cfg.loss = atof(optarg); break;
+        case 'b': cfg.bitrate_kbps = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'r': cfg.range = atof(optarg); break;
+        case 'f': cfg.fanout = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'm': cfg.membership_delay_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'v': cfg.log_level = parse_level(optarg); break;
+        case 't': trace_node = atoi(optarg); break;
+        case 'o': trace_out = optarg; break;
+        case 'M': metrics_node = atoi(optarg); break;
+        case 'P': profile_node = atoi(optarg); break;
+        case 'H': mem_node = atoi(optarg); break;
+        case 'E': events_node = atoi(optarg); break;
+        case 'O': events_out = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    int (*run)(const scenario_args_t *) = NULL;
+    if (strcmp(scenario, "run") == 0) {
+        run = scenario_run;
+    } else if (strcmp(scenario, "failover") == 0) {
+        run = scenario_failover;
+    } else if (strcmp(scenario, "shard") == 0) {
+        run = scenario_shard;
+    } else if (strcmp(scenario, "rounds") == 0) {
+        run = scenario_rounds;
+    } else if (strcmp(scenario, "partition") == 0) {
+        run = scenario_partition;
+    }
+    if (!run || args.nodes < 1 || args.nodes > SIM_MAX_NODES) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sim_init(&cfg);
+    for (int i = 0; i < args.nodes; i++) {
+        sim_node_add();
+    }
+    if (trace_node >= 0) {
+        sim_node_call(trace_node, trace_start_fn, NULL);
+    }
+    printf("sim: %d nodes, seed %u, scenario %s, loss %.3f, latency %u+%u us, %u kbps, range %.1f, fanout %u\n",
+           args.nodes, cfg.seed, scenario, cfg.loss, cfg.latency_us, cfg.jitter_us, cfg.bitrate_kbps,
+           cfg.range, cfg.fanout);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = run(&args);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    scenario_print_summary();
+    if (trace_node >= 0) {
+        FILE *f = fopen(trace_out, "wb");
+        if (!f || !sim_node_alive(trace_node)) {
+            fprintf(stderr, "sim: cannot dump the trace of n%02d to %s\n", trace_node, trace_out);
+        } else {
+            sim_node_call(trace_node, trace_dump_fn, f);
+            printf("sim: n%02d frame trace written to %s\n", trace_node, trace_out);
+        }
+        if (f) {
+            fclose(f);
+        }
+    }
+    if (events_node >= 0) {
+        FILE *f = fopen(events_out, "wb");
+        if (!f || !sim_node_alive(events_node)) {
+            fprintf(stderr, "sim: cannot dump the events of n%02d to %s\n", events_node, events_out);
+        } else {
+            sim_node_call(events_node, events_dump_fn, f);
+            printf("sim: n%02d event rings written to %s\n", events_node, events_out);
+        }
+        if (f) {
+            fclose(f);
+        }
+    }
+    if (metrics_node >= 0) {
+        if (sim_node_alive(metrics_node)) {
+            sim_node_call(metrics_node, metrics_dump_fn, stdout);
+        } else {
+            fprintf(stderr, "sim: n%02d is not running; no metrics\n", metrics_node);
+        }
+    }
+    if (profile_node >= 0) {
+        if (sim_node_alive(profile_node)) {
+            sim_node_call(profile_node, profile_dump_fn, stdout);
+        } else {
+            fprintf(stderr, "sim: n%02d is not running; no round profile\n", profile_node);
+        }
+    }
+    if (mem_node >= 0) {
+        if (sim_node_alive(mem_node)) {
+            sim_node_call(mem_node, mem_dump_fn, stdout);
+        } else {
+            fprintf(stderr, "sim: n%02d is not running; no memory report\n", mem_node);
+        }
+    }
+    printf("sim: %.1f virtual s in %.2f wall s (%.0fx)\n", sim_now_us() / 1e6, wall,
+           wall > 0 ? sim_now_us() / 1e6 / wall : 0.0);
+    printf("RESULT: %s\n", rc == 0 ? "PASS" : "FAIL");
+    return rc;
+}
@@ -0,0 +1,56 @@
+#include "sim_internal.h"
+#include "mesh_networking.h"
+#include "temperature_probe.h"
+#include "sensor_sampler.h"
+#include "node_response.h"
+#include "election_response.h"
+#include "aggregation.h"
+#include "peer_cache.h"
+#include "espnow_tx.h"
+#include "frame_trace.h"
+#include "metrics.h"
+#include "event_trace.h"
+#include "deferred_log.h"
+#include "round_profile.h"
+#include "mesh_frame.h"
+#include "block_cache.h"
+#include "block_sync.h"
+#include "block_broadcast.h"
+#include "verifier.h"
+#include "checkpoint.h"
+#include "light_node.h"
+#include "shard.h"
+
+// What app_main() does once Wi-Fi and mesh-lite are up, minus the I2C bus, the system info
+// timer and the external interfaces. Keep the order in step with main.c.
+void sim_firmware_main(void *arg)
+{
+    deferred_log_init();
+    temperature_probe_init();
+    sensor_sampler_init();
+    node_response_init();
+    election_response_init();
+    aggregation_init();
+    peer_cache_init();
+    mesh_frame_init();
+    espnow_tx_init();
+    frame_trace_init();
+    metrics_init();
+    event_trace_init();
+    round_profile_init();
+    block_cache_init();
+    light_node_init();
+    block_sync_init();
+    block_broadcast_init();
+    checkpoint_init();
+    verifier_init();
+    shard_init();
+
+    if (sim_config()->modules_only) {
+        vTaskDelete(NULL);
+    }
+    vTaskDelay(3000 / portTICK_PERIOD_MS);
+
+    xTaskCreate(mesh_networking_task, "mesh_networking_task", 4096, NULL, 5, NULL);
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,110 @@
+#include "sim_probe.h"
+#include "sim.h"
+#include "blockchain.h"
+#include <string.h>
+
+static void sim_probe_fn(void *arg)
+{
+    sim_probe_t *out = arg;
+    const block_t *tip = blockchain_acquire_tip();
+    if (tip) {
+        out->has_tip = true;
+        out->tip = tip->block_num;
+        memcpy(out->tip_hash, tip->hash, sizeof(out->tip_hash));
+        blockchain_release_block(tip);
+    }
+    blockchain_get_stats(&out->chain);
+    heartbeat_get_stats(&out->heartbeat);
+    shard_get_stats(&out->shard);
+    verifier_get_stats(&out->verifier);
+}
+
+bool sim_probe_node(int index, sim_probe_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->alive = sim_node_alive(index);
+    return out->alive && sim_node_call(index, sim_probe_fn, out);
+}
+
+typedef struct {
+    bool *full;
+    uint32_t count;
+    uint32_t held;
+} sim_bodies_t;
+
+static void sim_bodies_fn(void *arg)
+{
+    sim_bodies_t *req = arg;
+    for (uint32_t num = 0; num < req->count; num++) {
+        const block_t *block = blockchain_acquire_block(num);
+        req->full[num] = block && !block->body_pruned;
+        req->held += req->full[num] ? 1 : 0;
+        blockchain_release_block(block);
+    }
+}
+
+uint32_t sim_probe_bodies(int index, bool *full, uint32_t count)
+{
+    sim_bodies_t req = {.full = full, .count = count};
+    memset(full, 0, count * sizeof(*full));
+    if (!sim_node_call(index, sim_bodies_fn, &req)) {
+        return 0;
+    }
+    return req.held;
+}
+
+typedef struct {
+    uint32_t *readings;
+    uint32_t count;
+    uint32_t held;
+} sim_readings_t;
+
+static void sim_readings_fn(void *arg)
+{
+    sim_readings_t *req = arg;
+    for (uint32_t num = 0; num < req->count; num++) {
+        const block_t *block = blockchain_acquire_block(num);
+        req->readings[num] = block ? block->num_sensor_readings : UINT32_MAX;
+        req->held += block ? 1 : 0;
+        blockchain_release_block(block);
+    }
+}
+
+uint32_t sim_probe_readings(int index, uint32_t *readings, uint32_t count)
+{
+    sim_readings_t req = {.readings = readings, .count = count};
+    for (uint32_t num = 0; num < count; num++) {
+        readings[num] = UINT32_MAX;
+    }
+    if (!sim_node_call(index, sim_readings_fn, &req)) {
+        return 0;
+    }
+    return req.held;
+}
+
+int sim_probe_agreement(uint32_t *tip)
+{
+    sim_probe_t probes[SIM_MAX_NODES];
+    int n = sim_node_count();
+    for (int i = 0; i < n; i++) {
+        sim_probe_node(i, &probes[i]);
+    }
+    int best = 0;
+    *tip = 0;
+    for (int i = 0; i < n; i++) {
+        if (!probes[i].has_tip) {
+            continue;
+        }
+        int same = 0;
+        for (int j = 0; j < n; j++) {
+            if (probes[j].has_tip && memcmp(probes[i].tip_hash, probes[j].tip_hash, 32) == 0) {
+                same++;
+            }
+        }
+        if (same > best || (same == best && probes[i].tip > *tip)) {
+            best = same;
+            *tip = probes[i].tip;
+        }
+    }
+    return best;
+}
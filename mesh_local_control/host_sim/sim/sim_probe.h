@@ -0,0 +1,36 @@
+#ifndef SIM_PROBE_H
+#define SIM_PROBE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blockchain.h"
+#include "heartbeat.h"
+#include "shard.h"
+#include "verifier.h"
+
+// A node's externally interesting state, read through the firmware's own API on that node.
+typedef struct {
+    bool alive;
+    bool has_tip;
+    uint32_t tip;
+    uint8_t tip_hash[32];
+    blockchain_stats_t chain;
+    heartbeat_stats_t heartbeat;
+    shard_stats_t shard;
+    verifier_stats_t verifier;
+} sim_probe_t;
+
+bool sim_probe_node(int index, sim_probe_t *out);
+
+// Mark in `full` (indexed by block number, `count` entries) which blocks the node holds with
+// their body; returns how many it does.
+uint32_t sim_probe_bodies(int index, bool *full, uint32_t count);
+
+// Fill readings[num] with num_sensor_readings of each block the node holds, for block numbers
+// below `count`, and UINT32_MAX where it holds none. Returns how many blocks it holds.
+uint32_t sim_probe_readings(int index, uint32_t *readings, uint32_t count);
+
+// Nodes whose tip matches the most common tip hash among live nodes; *tip gets that tip.
+int sim_probe_agreement(uint32_t *tip);
+
+#endif // SIM_PROBE_H
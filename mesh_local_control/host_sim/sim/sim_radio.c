@@ -0,0 +1,236 @@
+#include "sim_internal.h"
+#include "esp_mesh_lite.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Shared medium and mesh-lite membership. Each sender transmits one frame at a time at the
+// configured bitrate; every receiver draws its own loss and jitter. Unicasts are retried like
+// MAC-layer retransmissions and report their outcome through the sender's send callback.
+
+#define SIM_GRID_COLUMNS        16      // Node i sits at (i % 16, i / 16) in range units
+#define SIM_PHY_OVERHEAD_US     100     // Preamble and MAC header per transmission
+#define SIM_TX_BACKLOG_US       20000   // Transmit backlog after which sends fail with NO_MEM
+
+sim_radio_stats_t sim_radio_counters;
+
+static esp_mesh_lite_node_info_t list_info[SIM_MAX_NODES];
+static node_info_list_t list_links[SIM_MAX_NODES];
+static uint32_t list_sizes[SIM_MAX_NODES];         // Island list length, at its first entry
+static int next_join_order = 0;
+static sim_radio_tap_t tap_fn = NULL;
+static void *tap_arg = NULL;
+
+static const uint8_t broadcast_addr[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+void sim_radio_reset(void)
+{
+    memset(&sim_radio_counters, 0, sizeof(sim_radio_counters));
+    next_join_order = 0;
+}
+
+void sim_radio_get_stats(sim_radio_stats_t *out)
+{
+    *out = sim_radio_counters;
+}
+
+void sim_radio_set_tap(sim_radio_tap_t tap, void *arg)
+{
+    tap_fn = tap;
+    tap_arg = arg;
+}
+
+void sim_radio_place(sim_node_t *node)
+{
+    node->x = node->index % SIM_GRID_COLUMNS;
+    node->y = node->index / SIM_GRID_COLUMNS;
+}
+
+static double sim_radio_distance(const sim_node_t *a, const sim_node_t *b)
+{
+    return hypot(a->x - b->x, a->y - b->y);
+}
+
+static bool sim_radio_in_range(const sim_node_t *a, const sim_node_t *b)
+{
+    double range = sim_config()->range;
+    return a->partition == b->partition && (range <= 0.0 || sim_radio_distance(a, b) <= range);
+}
+
+int8_t sim_radio_rssi(const sim_node_t *a, const sim_node_t *b)
+{
+    double rssi = -35.0 - 8.0 * sim_radio_distance(a, b);
+    return (int8_t)(rssi < -95.0 ? -95.0 : rssi);
+}
+
+// Node list order: by island, then by when the node joined.
+static bool sim_radio_joined_before(const sim_node_t *a, const sim_node_t *b)
+{
+    if (a->partition != b->partition) {
+        return a->partition < b->partition;
+    }
+    return a->join_order < b->join_order;
+}
+
+// Rebuild the node lists and trees from the nodes that are up, one per radio island: the
+// first to join is root (level 1) and the k-th joins under the ((k - 1) / fanout)-th, so a
+// departure re-parents its children the way mesh-lite's repair eventually would.
+void sim_radio_membership_changed(void)
+{
+    int order[SIM_MAX_NODES];
+    int count = 0;
+    for (int i = 0; i < sim_node_count(); i++) {
+        sim_node_t *node = sim_node_get(i);
+        if (!node->alive) {
+            node->listed = false;
+            node->parent = -1;
+            node->level = 0;
+            continue;
+        }
+        if (!node->listed) {
+            node->listed = true;
+            node->join_order = next_join_order++;
+        }
+        order[count++] = i;
+    }
+    for (int a = 1; a < count; a++) {
+        for (int b = a; b > 0 && sim_radio_joined_before(sim_node_get(order[b]), sim_node_get(order[b - 1])); b--) {
+            int tmp = order[b];
+            order[b] = order[b - 1];
+            order[b - 1] = tmp;
+        }
+    }
+    uint32_t fanout = sim_config()->fanout;
+    int start = 0;
+    for (int k = 0; k < count; k++) {
+        sim_node_t *node = sim_node_get(order[k]);
+        if (k > 0 && node->partition != sim_node_get(order[k - 1])->partition) {
+            start = k;
+        }
+        node->list_start = start;
+        if (k == start) {
+            node->parent = -1;
+            node->level = 1;
+        } else {
+            sim_node_t *parent = sim_node_get(order[start + (k - start - 1) / fanout]);
+            node->parent = parent->index;
+            node->level = parent->level + 1;
+        }
+        bool last = k + 1 == count || sim_node_get(order[k + 1])->partition != node->partition;
+        list_info[k].level = node->level;
+        memcpy(list_info[k].mac_addr, node->mac, ESP_NOW_ETH_ALEN);
+        list_info[k].ip_addr = 0x0104a8c0u + ((uint32_t)(k - start) << 24);     // 192.168.4.x
+        list_links[k].node = &list_info[k];
+        list_links[k].ttl = 0;
+        list_links[k].next = last ? NULL : &list_links[k + 1];
+        list_sizes[start] = (uint32_t)(k - start + 1);
+    }
+}
+
+node_info_list_t *sim_radio_nodes_list(const sim_node_t *node, uint32_t *size)
+{
+    if (!node->listed) {
+        *size = 0;
+        return NULL;
+    }
+    *size = list_sizes[node->list_start];
+    return &list_links[node->list_start];
+}
+
+static void sim_radio_deliver(sim_node_t *from, sim_node_t *to, uint8_t type, const uint8_t *data,
+                              size_t len, int64_t tx_end_us)
+{
+    sim_rx_item_t *item = malloc(sizeof(*item) + len);
+    if (!item) {
+        return;
+    }
+    memset(item, 0, sizeof(*item));
+    memcpy(item->mac, from->mac, ESP_NOW_ETH_ALEN);
+    item->type = type;
+    item->len = (int)len;
+    memcpy(item->data, data, len);
+    const sim_config_t *cfg = sim_config();
+    int64_t delay = cfg->latency_us + (cfg->jitter_us ? sim_rand() % (cfg->jitter_us + 1) : 0);
+    sim_radio_counters.delivered++;
+    sim_post_rx(to, tx_end_us + delay, item);
+}
+
+static void sim_radio_report(sim_node_t *from, const uint8_t *dest, esp_now_send_status_t status, int64_t at_us)
+{
+    sim_rx_item_t *item = calloc(1, sizeof(*item));
+    if (!item) {
+        return;
+    }
+    item->is_status = true;
+    memcpy(item->mac, dest, ESP_NOW_ETH_ALEN);
+    item->status = status;
+    sim_post_rx(from, at_us, item);
+}
+
+esp_err_t sim_radio_send(sim_node_t *from, uint8_t type, const uint8_t *dest, const uint8_t *data, size_t len)
+{
+    const sim_config_t *cfg = sim_config();
+    int64_t now = sim_now_us();
+    if (from->radio_free_us - now > SIM_TX_BACKLOG_US) {
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    int64_t start = from->radio_free_us > now ? from->radio_free_us : now;
+    int64_t airtime = cfg->bitrate_kbps ? (int64_t)len * 8 * 1000 / cfg->bitrate_kbps + SIM_PHY_OVERHEAD_US : 0;
+    sim_radio_counters.frames_sent++;
+    sim_radio_counters.bytes_sent += len;
+    if (tap_fn) {
+        tap_fn(from->index, dest, data, len, tap_arg);
+    }
+
+    if (memcmp(dest, broadcast_addr, ESP_NOW_ETH_ALEN) == 0) {
+        int64_t tx_end = start + airtime;
+        sim_radio_counters.broadcasts++;
+        for (int i = 0; i < sim_node_count(); i++) {
+            sim_node_t *to = sim_node_get(i);
+            if (to == from || !to->alive) {
+                continue;
+            }
+            if (!sim_radio_in_range(from, to)) {
+                sim_radio_counters.out_of_range++;
+            } else if (sim_rand_unit() < cfg->loss) {
+                sim_radio_counters.lost++;
+            } else {
+                sim_radio_deliver(from, to, type, data, len, tx_end);
+            }
+        }
+        from->radio_free_us = tx_end;
+        sim_radio_report(from, dest, ESP_NOW_SEND_SUCCESS, tx_end);
+        return ESP_OK;
+    }
+
+    int index = sim_node_find(dest);
+    sim_node_t *to = (index >= 0 && index != from->index) ? sim_node_get(index) : NULL;
+    bool reachable = to && to->alive && sim_radio_in_range(from, to);
+    if (to && !sim_radio_in_range(from, to)) {
+        sim_radio_counters.out_of_range++;
+    }
+    int64_t tx_end = start;
+    esp_now_send_status_t status = ESP_NOW_SEND_FAIL;
+    for (int attempt = 0; attempt <= SIM_MAC_RETRIES; attempt++) {
+        tx_end += airtime;
+        if (attempt > 0) {
+            sim_radio_counters.retries++;
+        }
+        if (!reachable) {
+            continue;
+        }
+        if (sim_rand_unit() < cfg->loss) {
+            sim_radio_counters.lost++;
+            continue;
+        }
+        sim_radio_deliver(from, to, type, data, len, tx_end);
+        status = ESP_NOW_SEND_SUCCESS;
+        break;
+    }
+    if (status != ESP_NOW_SEND_SUCCESS) {
+        sim_radio_counters.send_failures++;
+    }
+    from->radio_free_us = tx_end;
+    sim_radio_report(from, dest, status, tx_end);
+    return ESP_OK;
+}
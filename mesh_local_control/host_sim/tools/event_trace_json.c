@@ -0,0 +1,129 @@
+#include "event_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Convert event trace dumps (see event_trace.h) into Chrome trace JSON for chrome://tracing or
+// Perfetto. Each dump becomes one process per core and each task one thread, so spans from
+// tasks that preempt each other stay apart. Several dumps (one per node) can go into one file.
+
+typedef struct {
+    const char *name;
+    event_trace_phase_t phase;
+    const char *arg_a;
+    const char *arg_b;
+} event_desc_t;
+
+#define EVENT_DESC(id, name, phase, a, b) [id] = {name, phase, a, b},
+static const event_desc_t events[EVENT_TRACE_EVENT_COUNT] = {
+    EVENT_TRACE_EVENTS(EVENT_DESC)
+};
+#undef EVENT_DESC
+
+static bool first_event = true;
+
+static void emit_separator(void)
+{
+    printf(first_event ? "\n" : ",\n");
+    first_event = false;
+}
+
+// Arguments carrying a MAC tail print as one.
+static void emit_arg(const char *name, uint32_t value, bool *first)
+{
+    if (!name) {
+        return;
+    }
+    printf("%s\"%s\":", *first ? "" : ",", name);
+    *first = false;
+    if (strcmp(name, "from") == 0 || strcmp(name, "leader") == 0) {
+        printf("\"%02x:%02x:%02x:%02x\"", value >> 24, (value >> 16) & 0xff, (value >> 8) & 0xff, value & 0xff);
+    } else {
+        printf("%u", value);
+    }
+}
+
+static int convert(const char *path, int pid_base)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    uint8_t hdr[EVENT_TRACE_HEADER_LEN];
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, EVENT_TRACE_MAGIC, 4) != 0 ||
+        hdr[4] != EVENT_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d event trace\n", path, EVENT_TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    int cores = hdr[5];
+    uint16_t per_core;
+    int64_t dump_us;
+    memcpy(&per_core, hdr + 6, sizeof(per_core));
+    memcpy(&dump_us, hdr + 6 + sizeof(per_core), sizeof(dump_us));
+
+    for (int core = 0; core < cores; core++) {
+        uint32_t recorded;
+        if (fread(&recorded, sizeof(recorded), 1, f) != 1) {
+            fprintf(stderr, "%s: truncated at core %d\n", path, core);
+            break;
+        }
+        int pid = pid_base + core;
+        emit_separator();
+        printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s core %d\"}}",
+               pid, path, core);
+        uint32_t count = recorded < per_core ? recorded : per_core;
+        for (uint32_t i = 0; i < count; i++) {
+            event_trace_record_t e;
+            if (fread(&e, sizeof(e), 1, f) != 1) {
+                fprintf(stderr, "%s: truncated in core %d\n", path, core);
+                fclose(f);
+                return cores;
+            }
+            // The truncated stamp is at most 2^32 us before the dump.
+            int64_t ts = dump_us - (uint32_t)((uint32_t)dump_us - e.time_us);
+            const event_desc_t *d = e.id < EVENT_TRACE_EVENT_COUNT ? &events[e.id] : NULL;
+            const char *ph = !d || d->phase == EVENT_TRACE_INSTANT ? "i" : (d->phase == EVENT_TRACE_BEGIN ? "B" : "E");
+            emit_separator();
+            if (d) {
+                printf("{\"name\":\"%s\"", d->name);
+            } else {
+                printf("{\"name\":\"event_%u\"", e.id);
+            }
+            printf(",\"ph\":\"%s\",\"ts\":%lld,\"pid\":%d,\"tid\":%u", ph, (long long)ts, pid, e.task);
+            if (ph[0] == 'i') {
+                printf(",\"s\":\"t\"");
+            }
+            bool first = true;
+            printf(",\"args\":{");
+            emit_arg(d ? d->arg_a : "a", e.a, &first);
+            emit_arg(d ? d->arg_b : "b", e.b, &first);
+            printf("}}");
+        }
+        fprintf(stderr, "%s: core %d: %u event(s), %u overwritten\n", path, core, count, recorded - count);
+    }
+    fclose(f);
+    return cores;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || strcmp(argv[1], "--help") == 0) {
+        fprintf(stderr, "usage: %s DUMP... > trace.json\n", argv[0]);
+        return 2;
+    }
+    printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    int pid = 0;
+    int rc = 0;
+    for (int i = 1; i < argc; i++) {
+        int cores = convert(argv[i], pid);
+        if (cores < 0) {
+            rc = 1;
+            continue;
+        }
+        pid += cores;
+    }
+    printf("\n]}\n");
+    return rc;
+}
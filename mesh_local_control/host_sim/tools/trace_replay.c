@@ -0,0 +1,293 @@
+#include "sim.h"
+#include "frame_trace.h"
+#include "mesh_networking.h"
+#include "heartbeat.h"
+#include "command_set.h"
+#include "mesh_frame.h"
+#include "esp_log.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// Feed a frame trace (see frame_trace.h) back through espnow_recv_cb on a simulated node that
+// carries the recording node's MAC. Every other MAC in the trace joins the mesh as a passive
+// node (modules booted, no round engine), so membership looks as it did in the field.
+//
+//   timed (default): each received frame is delivered at its recorded offset in virtual time,
+//                    with the node's tasks and timers running in between; runs are deterministic.
+//   --fast:          frames are delivered back to back without advancing time, and the wall
+//                    time spent in espnow_recv_cb is reported as receive-path throughput.
+
+#define REPLAY_SETTLE_US        (5 * 1000000LL)     // Virtual time left after the last frame
+#define REPLAY_MAX_PEERS        (SIM_MAX_NODES - 1)
+
+typedef struct {
+    int64_t time_us;
+    uint8_t dir;
+    uint8_t peer[ESP_NOW_ETH_ALEN];
+    uint16_t len;
+    const uint8_t *frame;
+} replay_record_t;
+
+typedef struct {
+    uint8_t own_mac[ESP_NOW_ETH_ALEN];
+    uint32_t overwritten;
+    replay_record_t *records;
+    uint32_t count;
+    uint8_t *bytes;
+} replay_trace_t;
+
+typedef struct {
+    const replay_record_t *record;
+    double elapsed_ns;
+} replay_call_t;
+
+static const uint8_t broadcast_addr[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static bool replay_load(const char *path, replay_trace_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out->bytes = malloc(size > 0 ? size : 1);
+    if (!out->bytes || fread(out->bytes, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    const uint8_t *p = out->bytes;
+    if ((size_t)size < FRAME_TRACE_HEADER_LEN || memcmp(p, FRAME_TRACE_MAGIC, 4) != 0 ||
+        p[4] != FRAME_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d frame trace\n", path, FRAME_TRACE_VERSION);
+        return false;
+    }
+    uint32_t count;
+    memcpy(out->own_mac, p + 6, ESP_NOW_ETH_ALEN);
+    memcpy(&count, p + 6 + ESP_NOW_ETH_ALEN, sizeof(count));
+    memcpy(&out->overwritten, p + 6 + ESP_NOW_ETH_ALEN + sizeof(count), sizeof(out->overwritten));
+    out->records = calloc(count ? count : 1, sizeof(*out->records));
+    if (!out->records) {
+        return false;
+    }
+    size_t offset = FRAME_TRACE_HEADER_LEN;
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset + FRAME_TRACE_RECORD_LEN > (size_t)size) {
+            break;
+        }
+        replay_record_t *r = &out->records[out->count];
+        memcpy(&r->time_us, p + offset, sizeof(r->time_us));
+        r->dir = p[offset + sizeof(r->time_us)];
+        memcpy(r->peer, p + offset + sizeof(r->time_us) + 1, ESP_NOW_ETH_ALEN);
+        memcpy(&r->len, p + offset + FRAME_TRACE_RECORD_LEN - sizeof(r->len), sizeof(r->len));
+        offset += FRAME_TRACE_RECORD_LEN;
+        if (offset + r->len > (size_t)size) {
+            break;
+        }
+        r->frame = p + offset;
+        offset += r->len;
+        out->count++;
+    }
+    if (out->count < count) {
+        fprintf(stderr, "%s: truncated after %u of %u records\n", path, out->count, count);
+    }
+    return true;
+}
+
+// What sensor_blockchain_task does before its first round, minus the receive callback:
+// replay calls espnow_recv_cb itself.
+static void replay_setup_fn(void *arg)
+{
+    blockchain_init();
+    consensus_init();
+    heartbeat_init();
+}
+
+static void replay_deliver_fn(void *arg)
+{
+    replay_call_t *call = arg;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    espnow_recv_cb(call->record->peer, call->record->frame, call->record->len);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    call->elapsed_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+typedef struct {
+    bool has_tip;
+    uint32_t tip;
+} replay_result_t;
+
+static void replay_result_fn(void *arg)
+{
+    replay_result_t *out = arg;
+    block_t tip;
+    out->has_tip = blockchain_get_last_block(&tip);
+    out->tip = out->has_tip ? tip.block_num : 0;
+}
+
+// Every distinct peer the node heard from or unicast to, except itself.
+static int replay_add_peers(const replay_trace_t *trace)
+{
+    uint8_t seen[REPLAY_MAX_PEERS][ESP_NOW_ETH_ALEN];
+    int count = 0;
+    for (uint32_t i = 0; i < trace->count && count < REPLAY_MAX_PEERS; i++) {
+        const uint8_t *mac = trace->records[i].peer;
+        if (memcmp(mac, broadcast_addr, ESP_NOW_ETH_ALEN) == 0 ||
+            memcmp(mac, trace->own_mac, ESP_NOW_ETH_ALEN) == 0) {
+            continue;
+        }
+        bool known = false;
+        for (int j = 0; j < count && !known; j++) {
+            known = memcmp(seen[j], mac, ESP_NOW_ETH_ALEN) == 0;
+        }
+        if (!known) {
+            memcpy(seen[count++], mac, ESP_NOW_ETH_ALEN);
+            sim_node_add_mac(mac);
+        }
+    }
+    return count;
+}
+
+static int parse_level(const char *arg)
+{
+    static const char *names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcasecmp(arg, names[i]) == 0) {
+            return i;
+        }
+    }
+    return atoi(arg);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] TRACE\n"
+            "  --fast               deliver frames back to back and report receive-path throughput\n"
+            "  --seed S             random seed (default 1)\n"
+            "  --log-level L        none, error, warn, info, debug or verbose (default warn; none with --fast)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"fast", no_argument, NULL, 'F'},
+        {"seed", required_argument, NULL, 's'},
+        {"log-level", required_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    sim_config_t cfg;
+    sim_config_defaults(&cfg);
+    cfg.modules_only = true;
+    bool fast = false;
+    int log_level = -1;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'F': fast = true; break;
+        case 's': cfg.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'v': log_level = parse_level(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    replay_trace_t trace;
+    if (!replay_load(argv[optind], &trace)) {
+        return 1;
+    }
+    cfg.log_level = log_level >= 0 ? log_level : (fast ? ESP_LOG_NONE : ESP_LOG_WARN);
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sim_init(&cfg);
+    int node = sim_node_add_mac(trace.own_mac);
+    int peers = replay_add_peers(&trace);
+    // Boot, then let the peers show up in the node list before the first frame.
+    sim_run_until((int64_t)cfg.membership_delay_ms * 1000 + 100000);
+    sim_node_call(node, replay_setup_fn, NULL);
+    printf("replay: %u records (%u overwritten before the dump) as %02x:%02x:%02x:%02x:%02x:%02x, %d peer(s), %s\n",
+           trace.count, trace.overwritten, trace.own_mac[0], trace.own_mac[1], trace.own_mac[2],
+           trace.own_mac[3], trace.own_mac[4], trace.own_mac[5], peers, fast ? "fast" : "timed");
+
+    uint32_t per_cmd[256] = {0};
+    uint32_t delivered = 0;
+    uint32_t blocked = 0;
+    uint64_t bytes = 0;
+    double busy_ns = 0.0;
+    int64_t start_us = sim_now_us();
+    int64_t first_us = trace.count ? trace.records[0].time_us : 0;
+    for (uint32_t i = 0; i < trace.count; i++) {
+        const replay_record_t *r = &trace.records[i];
+        if (r->dir != FRAME_TRACE_RX) {
+            continue;
+        }
+        if (!fast) {
+            int64_t at = start_us + (r->time_us - first_us);
+            if (at > sim_now_us()) {
+                sim_run_until(at);
+            }
+        }
+        if (r->len > MESH_FRAME_HEADER_LEN) {
+            per_cmd[r->frame[MESH_FRAME_HEADER_LEN]]++;
+        }
+        // The call is abandoned, not lost, when the handler blocks (a pulse takes a sensor
+        // reading, for one): it finishes once the node runs again, and its time is not counted.
+        replay_call_t *call = calloc(1, sizeof(*call));
+        if (!call) {
+            fprintf(stderr, "replay: out of memory\n");
+            return 1;
+        }
+        call->record = r;
+        if (!sim_node_call(node, replay_deliver_fn, call)) {
+            blocked++;
+            continue;
+        }
+        delivered++;
+        bytes += r->len;
+        busy_ns += call->elapsed_ns;
+        free(call);
+    }
+    if (!fast) {
+        sim_run_until(sim_now_us() + REPLAY_SETTLE_US);
+    }
+
+    replay_result_t result = {0};
+    sim_node_call(node, replay_result_fn, &result);
+    printf("replay: %u frame(s) handled, %u more blocked in the handler and finished later, %.3f virtual s\n",
+           delivered, blocked, (sim_now_us() - start_us) / 1e6);
+    printf("replay: by command:");
+    for (int cmd = 0; cmd < 256; cmd++) {
+        if (per_cmd[cmd]) {
+            printf(" 0x%02x=%u", cmd, per_cmd[cmd]);
+        }
+    }
+    printf("\n");
+    if (result.has_tip) {
+        printf("replay: chain tip after replay: block %u\n", result.tip);
+    } else {
+        printf("replay: chain empty after replay\n");
+    }
+    if (fast && delivered > 0) {
+        printf("replay: receive path %.0f ns/frame (handled frames only), %.0f frames/s, %.2f MB/s\n", busy_ns / delivered,
+               delivered / (busy_ns / 1e9), bytes / (busy_ns / 1e9) / 1e6);
+    }
+    // Blocked calls may still hold their record, so the trace stays allocated.
+    return 0;
+}
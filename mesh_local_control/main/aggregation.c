@@ -0,0 +1,315 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_AGGREGATION
+#include "aggregation.h"
+#include "node_local.h"
+#include "blockchain.h"
+#include "mesh_networking.h"
+#include "node_response.h"
+#include "peer_cache.h"
+#include "sensor_sampler.h"
+#include "command_set.h"
+#include "deferred_log.h"
+#include "esp_log.h"
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+static const char *TAG = "aggregation";
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t timestamp;
+    float temperature;
+    float humidity;
+} agg_record_t;
+
+static NODE_LOCAL SemaphoreHandle_t agg_mutex = NULL;
+static NODE_LOCAL TimerHandle_t flush_timer = NULL;
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+
+// State of the round currently being aggregated for our subtree.
+static NODE_LOCAL uint32_t agg_round = 0;
+static NODE_LOCAL uint8_t agg_leader[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL bool agg_active = false;
+static NODE_LOCAL agg_record_t agg_records[AGG_MAX_RECORDS];
+static NODE_LOCAL uint32_t agg_count = 0;
+
+static size_t aggregation_pack_record(uint8_t *out, const agg_record_t *rec)
+{
+    size_t offset = 0;
+    memcpy(out + offset, rec->mac, ESP_NOW_ETH_ALEN);
+    offset += ESP_NOW_ETH_ALEN;
+    memcpy(out + offset, &rec->timestamp, sizeof(rec->timestamp));
+    offset += sizeof(rec->timestamp);
+    memcpy(out + offset, &rec->temperature, sizeof(rec->temperature));
+    offset += sizeof(rec->temperature);
+    memcpy(out + offset, &rec->humidity, sizeof(rec->humidity));
+    offset += sizeof(rec->humidity);
+    return offset;
+}
+
+static size_t aggregation_unpack_record(const uint8_t *in, agg_record_t *rec)
+{
+    size_t offset = 0;
+    memcpy(rec->mac, in + offset, ESP_NOW_ETH_ALEN);
+    offset += ESP_NOW_ETH_ALEN;
+    memcpy(&rec->timestamp, in + offset, sizeof(rec->timestamp));
+    offset += sizeof(rec->timestamp);
+    memcpy(&rec->temperature, in + offset, sizeof(rec->temperature));
+    offset += sizeof(rec->temperature);
+    memcpy(&rec->humidity, in + offset, sizeof(rec->humidity));
+    offset += sizeof(rec->humidity);
+    return offset;
+}
+
+static bool aggregation_is_mesh_node(const uint8_t *mac)
+{
+    uint32_t node_count = 0;
+    const node_info_list_t *list = esp_mesh_lite_get_nodes_list(&node_count);
+    while (list) {
+        if (memcmp(list->node->mac_addr, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return true;
+        }
+        list = list->next;
+    }
+    return false;
+}
+
+// Next hop towards the leader: our mesh-lite parent, or the leader itself for root-level
+// nodes. The parent's station MAC is derived from its softAP BSSID (softAP = station + 1
+// in the default ESP MAC scheme) and only trusted if that node is in the mesh list.
+static void aggregation_next_hop(const uint8_t *leader_mac, uint8_t *out)
+{
+    memcpy(out, leader_mac, ESP_NOW_ETH_ALEN);
+    if (esp_mesh_lite_get_level() <= 1) {
+        return;
+    }
+    wifi_ap_record_t ap_info = {0};
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+    uint8_t parent[ESP_NOW_ETH_ALEN];
+    memcpy(parent, ap_info.bssid, ESP_NOW_ETH_ALEN);
+    for (int i = ESP_NOW_ETH_ALEN - 1; i >= 0; i--) {
+        if (parent[i]-- != 0) {
+            break;
+        }
+    }
+    if (aggregation_is_mesh_node(parent)) {
+        memcpy(out, parent, ESP_NOW_ETH_ALEN);
+    }
+}
+
+static void aggregation_send_records(uint32_t round, const uint8_t *leader_mac,
+                                     const agg_record_t *records, uint32_t count)
+{
+    uint8_t dest[ESP_NOW_ETH_ALEN];
+    aggregation_next_hop(leader_mac, dest);
+
+    uint32_t sent = 0;
+    while (sent < count) {
+        uint8_t chunk = (count - sent > AGG_RECORDS_PER_FRAME) ? AGG_RECORDS_PER_FRAME : (uint8_t)(count - sent);
+        uint8_t frame[AGG_DATA_HEADER_LEN + AGG_RECORDS_PER_FRAME * AGG_RECORD_SIZE];
+        size_t offset = 0;
+        frame[offset++] = CMD_AGG_DATA;
+        memcpy(frame + offset, &round, sizeof(round));
+        offset += sizeof(round);
+        memcpy(frame + offset, leader_mac, ESP_NOW_ETH_ALEN);
+        offset += ESP_NOW_ETH_ALEN;
+        frame[offset++] = chunk;
+        for (uint8_t i = 0; i < chunk; i++) {
+            offset += aggregation_pack_record(frame + offset, &records[sent + i]);
+        }
+        esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, dest, frame, offset);
+        if (ret != ESP_OK) {
+            DEFERRED_LOG(DLOG_AGG_SEND_FAILED, dest, ret, 0, 0);
+        }
+        sent += chunk;
+    }
+    DEFERRED_LOG(DLOG_AGG_FORWARDED, dest, round, count, 0);
+}
+
+// Fires once our slot comes up: everything gathered from the subtree goes upstream together.
+static void aggregation_flush_timercb(TimerHandle_t timer)
+{
+    static NODE_LOCAL agg_record_t outgoing[AGG_MAX_RECORDS];
+    uint8_t leader_mac[ESP_NOW_ETH_ALEN];
+    uint32_t round, count;
+
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    if (!agg_active) {
+        xSemaphoreGive(agg_mutex);
+        return;
+    }
+    round = agg_round;
+    count = agg_count;
+    memcpy(leader_mac, agg_leader, ESP_NOW_ETH_ALEN);
+    memcpy(outgoing, agg_records, count * sizeof(agg_record_t));
+    agg_active = false;
+    xSemaphoreGive(agg_mutex);
+
+    aggregation_send_records(round, leader_mac, outgoing, count);
+}
+
+static bool aggregation_append_locked(const agg_record_t *rec)
+{
+    for (uint32_t i = 0; i < agg_count; i++) {
+        if (memcmp(agg_records[i].mac, rec->mac, ESP_NOW_ETH_ALEN) == 0) {
+            return true;
+        }
+    }
+    if (agg_count >= AGG_MAX_RECORDS) {
+        return false;
+    }
+    agg_records[agg_count++] = *rec;
+    return true;
+}
+
+void aggregation_init(void)
+{
+    if (agg_mutex) {
+        return;
+    }
+    agg_mutex = xSemaphoreCreateMutex();
+    flush_timer = xTimerCreate("agg_flush", pdMS_TO_TICKS(AGG_SLOT_MS), pdFALSE, NULL,
+                               aggregation_flush_timercb);
+    if (!agg_mutex || !flush_timer) {
+        ESP_LOGE(TAG, "Failed to create aggregation mutex/timer");
+        return;
+    }
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+}
+
+void aggregation_begin_round(uint32_t round, const uint8_t *leader_mac)
+{
+    if (!agg_mutex) return;
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    agg_round = round;
+    memcpy(agg_leader, leader_mac, ESP_NOW_ETH_ALEN);
+    agg_active = false;
+    agg_count = 0;
+    xSemaphoreGive(agg_mutex);
+}
+
+size_t aggregation_build_pulse(uint8_t *out, uint32_t round, const uint8_t *leader_mac)
+{
+    size_t offset = 0;
+    out[offset++] = CMD_PULSE;
+    memcpy(out + offset, &round, sizeof(round));
+    offset += sizeof(round);
+    memcpy(out + offset, leader_mac, ESP_NOW_ETH_ALEN);
+    offset += ESP_NOW_ETH_ALEN;
+    return offset;
+}
+
+void aggregation_on_pulse(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!agg_mutex || len < (int)AGG_PULSE_LEN) {
+        DEFERRED_LOG(DLOG_PULSE_INVALID, src_mac, 0, 0, 0);
+        return;
+    }
+    uint32_t round;
+    uint8_t leader_mac[ESP_NOW_ETH_ALEN];
+    memcpy(&round, data + 1, sizeof(round));
+    memcpy(leader_mac, data + 1 + sizeof(round), ESP_NOW_ETH_ALEN);
+    if (memcmp(leader_mac, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+        return;
+    }
+
+    // Our own reading comes from the sample ring, so this callback never waits on I2C. It is
+    // stamped with the pulse time; without a recent sample we report only our children.
+    agg_record_t own = {0};
+    sensor_sample_t sample = {0};
+    bool have_own = sensor_sampler_latest(&sample);
+    memcpy(own.mac, my_mac, ESP_NOW_ETH_ALEN);
+    own.temperature = sample.temperature;
+    own.humidity = sample.humidity;
+    own.timestamp = (uint32_t)time(NULL);
+
+    // Register the peer we will report to before our flush slot comes up.
+    uint8_t next_hop[1][ESP_NOW_ETH_ALEN];
+    aggregation_next_hop(leader_mac, next_hop[0]);
+    peer_cache_prefetch(next_hop, 1);
+
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    agg_round = round;
+    memcpy(agg_leader, leader_mac, ESP_NOW_ETH_ALEN);
+    agg_count = 0;
+    agg_active = true;
+    if (have_own) {
+        aggregation_append_locked(&own);
+    }
+    xSemaphoreGive(agg_mutex);
+
+    // Deeper nodes flush first so each parent has its children's readings in hand
+    // by the time its own slot comes up.
+    uint8_t level = esp_mesh_lite_get_level();
+    if (level < 1) level = 1;
+    if (level > AGG_MAX_DEPTH) level = AGG_MAX_DEPTH;
+    TickType_t delay = pdMS_TO_TICKS((AGG_MAX_DEPTH - level) * AGG_SLOT_MS);
+    if (delay == 0) delay = 1;
+    xTimerChangePeriod(flush_timer, delay, 0);
+}
+
+void aggregation_on_data(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!agg_mutex || len < (int)AGG_DATA_HEADER_LEN) {
+        DEFERRED_LOG(DLOG_AGG_SHORT, src_mac, 0, 0, 0);
+        return;
+    }
+    size_t offset = 1;
+    uint32_t round;
+    uint8_t leader_mac[ESP_NOW_ETH_ALEN];
+    memcpy(&round, data + offset, sizeof(round));
+    offset += sizeof(round);
+    memcpy(leader_mac, data + offset, ESP_NOW_ETH_ALEN);
+    offset += ESP_NOW_ETH_ALEN;
+    uint8_t count = data[offset++];
+    if ((size_t)len != AGG_DATA_HEADER_LEN + count * AGG_RECORD_SIZE) {
+        DEFERRED_LOG(DLOG_AGG_SIZE_MISMATCH, src_mac, 0, 0, 0);
+        return;
+    }
+
+    if (memcmp(leader_mac, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+        // We lead this round: hand every reading to the collector.
+        xSemaphoreTake(agg_mutex, portMAX_DELAY);
+        uint32_t current_round = agg_round;
+        xSemaphoreGive(agg_mutex);
+        if (round != current_round) {
+            DEFERRED_LOG(DLOG_AGG_STALE, NULL, round, 0, 0);
+            return;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            agg_record_t rec;
+            offset += aggregation_unpack_record(data + offset, &rec);
+            sensor_record_t sensor = {0};
+            memcpy(sensor.mac, rec.mac, ESP_NOW_ETH_ALEN);
+            sensor.timestamp = rec.timestamp;
+            sensor.temperature = rec.temperature;
+            sensor.humidity = rec.humidity;
+            node_response_push(rec.mac, &sensor);
+        }
+        return;
+    }
+
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    bool merged = agg_active && round == agg_round;
+    if (merged) {
+        for (uint8_t i = 0; i < count; i++) {
+            agg_record_t rec;
+            offset += aggregation_unpack_record(data + offset, &rec);
+            if (!aggregation_append_locked(&rec)) {
+                merged = false;
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(agg_mutex);
+
+    if (!merged) {
+        // Our slot already passed (or we never saw the pulse): pass it straight on.
+        uint8_t dest[ESP_NOW_ETH_ALEN];
+        aggregation_next_hop(leader_mac, dest);
+        espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, dest, data, len);
+    }
+}
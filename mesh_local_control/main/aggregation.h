@@ -0,0 +1,36 @@
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_mesh_lite.h"
+#include "blockchain.h"
+
+#define AGG_MAX_DEPTH           6       // Deepest mesh level we schedule a flush slot for
+#define AGG_SLOT_MS             150     // Per-level flush offset; deeper levels report first
+#define AGG_COLLECT_TIMEOUT_MS  ((AGG_MAX_DEPTH + 4) * AGG_SLOT_MS + 1500)
+#define AGG_MAX_RECORDS         MESH_MAX_NODES  // Readings buffered for one subtree per round: one per node
+#define AGG_RECORD_SIZE         (ESP_NOW_ETH_ALEN + sizeof(uint32_t) + sizeof(float) * 2)
+#define AGG_RECORDS_PER_FRAME   12
+
+// Pulse:      [CMD_PULSE][uint32_t round][leader MAC]
+// Aggregate:  [CMD_AGG_DATA][uint32_t round][leader MAC][uint8_t count][count * record]
+// Record:     [MAC][uint32_t timestamp][float temperature][float humidity]
+#define AGG_PULSE_LEN           (1 + sizeof(uint32_t) + ESP_NOW_ETH_ALEN)
+#define AGG_DATA_HEADER_LEN     (1 + sizeof(uint32_t) + ESP_NOW_ETH_ALEN + 1)
+
+// Must be called once at startup.
+void aggregation_init(void);
+
+// Leader side: mark the round we are collecting for, so aggregates addressed to us
+// are handed to node_response.
+void aggregation_begin_round(uint32_t round, const uint8_t *leader_mac);
+
+// Build a pulse frame into out (AGG_PULSE_LEN bytes).
+size_t aggregation_build_pulse(uint8_t *out, uint32_t round, const uint8_t *leader_mac);
+
+// Receive-path handlers for CMD_PULSE and CMD_AGG_DATA.
+void aggregation_on_pulse(const uint8_t *src_mac, const uint8_t *data, int len);
+void aggregation_on_data(const uint8_t *src_mac, const uint8_t *data, int len);
+
+#endif // AGGREGATION_H
@@ -0,0 +1,590 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_BLOCK_BROADCAST
+#include "block_broadcast.h"
+#include "node_local.h"
+#include "block_sync.h"
+#include "block_cache.h"
+#include "mesh_frame.h"
+#include "mesh_networking.h"
+#include "command_set.h"
+#include "deferred_log.h"
+#include "mem_track.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_mesh_lite.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "block_broadcast";
+
+_Static_assert(BLOCK_BCAST_MAX_FRAGMENTS <= UINT8_MAX, "fragment index and count travel in one byte");
+_Static_assert(BLOCK_SERIALIZED_MAX_LEN <= UINT16_MAX, "a block's length travels in 16 bits");
+_Static_assert(BLOCK_BCAST_NACK_LEN <= MESH_FRAME_MAX_MESSAGE, "a NACK must fit one frame");
+
+// One bit per fragment.
+typedef struct {
+    uint32_t words[BLOCK_BCAST_MASK_WORDS];
+} frag_mask_t;
+
+typedef struct {
+    bool in_use;
+    uint32_t block_num;
+    uint8_t frag_count;         // 0 until the first fragment arrives (heartbeat-only slot)
+    uint16_t total_len;
+    frag_mask_t have;
+    uint8_t *buf;
+    uint8_t src_mac[ESP_NOW_ETH_ALEN];
+    int64_t created_us;
+    int64_t nack_at_us;
+    uint8_t nacks_sent;
+    bool reply;                 // Some fragment came as a reply: file it as a historical block
+} rx_slot_t;
+
+typedef struct {
+    bool in_use;
+    uint32_t block_num;
+    frag_mask_t mask;           // Fragments still owed
+    int64_t fire_at_us;
+} repair_t;
+
+typedef struct {
+    uint32_t block_num;
+    frag_mask_t mask;
+} pending_send_t;
+
+static uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+
+static NODE_LOCAL SemaphoreHandle_t bcast_mutex = NULL;
+static NODE_LOCAL rx_slot_t slots[BLOCK_BCAST_RX_SLOTS];
+static NODE_LOCAL repair_t repairs[BLOCK_BCAST_MAX_REPAIRS];
+static NODE_LOCAL block_broadcast_stats_t stats = {0};
+
+static int64_t block_broadcast_jitter_us(uint32_t max_ms)
+{
+    return (int64_t)(esp_random() % (max_ms + 1)) * 1000;
+}
+
+static bool block_broadcast_mask_test(const frag_mask_t *mask, uint32_t idx)
+{
+    return (mask->words[idx / 32] >> (idx % 32)) & 1u;
+}
+
+static void block_broadcast_mask_set(frag_mask_t *mask, uint32_t idx)
+{
+    mask->words[idx / 32] |= 1u << (idx % 32);
+}
+
+// Fragments [0, count); every fragment when `count` is 0, i.e. unknown.
+static void block_broadcast_mask_fill(frag_mask_t *mask, uint32_t count)
+{
+    for (uint32_t w = 0; w < BLOCK_BCAST_MASK_WORDS; w++) {
+        uint32_t bits = (count == 0 || count >= (w + 1) * 32) ? 32 : (count > w * 32 ? count - w * 32 : 0);
+        mask->words[w] = (bits == 32) ? UINT32_MAX : ((1u << bits) - 1);
+    }
+}
+
+// `mask` &= ~`clear`; true if anything is left.
+static bool block_broadcast_mask_clear(frag_mask_t *mask, const frag_mask_t *clear)
+{
+    uint32_t left = 0;
+    for (uint32_t w = 0; w < BLOCK_BCAST_MASK_WORDS; w++) {
+        mask->words[w] &= ~clear->words[w];
+        left |= mask->words[w];
+    }
+    return left != 0;
+}
+
+static void block_broadcast_mask_merge(frag_mask_t *mask, const frag_mask_t *add)
+{
+    for (uint32_t w = 0; w < BLOCK_BCAST_MASK_WORDS; w++) {
+        mask->words[w] |= add->words[w];
+    }
+}
+
+static uint32_t block_broadcast_mask_count(const frag_mask_t *mask)
+{
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < BLOCK_BCAST_MASK_WORDS; w++) {
+        count += (uint32_t)__builtin_popcount(mask->words[w]);
+    }
+    return count;
+}
+
+// A serialized block of `len` bytes must fit BLOCK_BCAST_MAX_FRAGMENTS fragments.
+static bool block_broadcast_fits(uint32_t block_num, size_t len)
+{
+    if (len > (size_t)BLOCK_BCAST_MAX_FRAGMENTS * BLOCK_BCAST_FRAG_PAYLOAD) {
+        ESP_LOGE(TAG, "Block %" PRIu32 " is too large to fragment (%d bytes)", block_num, (int)len);
+        return false;
+    }
+    return true;
+}
+
+// A light node or a shard non-holder keeps the header only: it still wants the body and
+// cannot repair from it.
+static bool block_broadcast_have_body(uint32_t block_num)
+{
+    block_t block;
+    return blockchain_get_block_by_number(block_num, &block) && !block.body_pruned;
+}
+
+static esp_err_t block_broadcast_send_msg(const uint8_t *dest, const uint8_t *msg, size_t len)
+{
+    esp_err_t ret = ESP_FAIL;
+    for (int attempt = 0; attempt < BLOCK_SYNC_SEND_ATTEMPTS; attempt++) {
+        ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, dest, msg, len);
+        if (ret != ESP_ERR_NO_MEM) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(BLOCK_SYNC_SEND_RETRY_MS));
+    }
+    return ret;
+}
+
+// Send the fragments of `serialized` selected by `mask` to `dest` as `cmd` fragments.
+// Returns how many went out.
+static uint32_t block_broadcast_send_fragments(const uint8_t *dest, uint8_t cmd, uint32_t block_num,
+                                               const uint8_t *serialized, size_t len, const frag_mask_t *mask)
+{
+    uint8_t count = (uint8_t)((len + BLOCK_BCAST_FRAG_PAYLOAD - 1) / BLOCK_BCAST_FRAG_PAYLOAD);
+    uint16_t total_len = (uint16_t)len;
+    uint8_t frame[BLOCK_BCAST_FRAG_HEADER_LEN + BLOCK_BCAST_FRAG_PAYLOAD];
+    uint32_t sent = 0;
+    for (uint8_t idx = 0; idx < count; idx++) {
+        if (!block_broadcast_mask_test(mask, idx)) {
+            continue;
+        }
+        size_t offset = (size_t)idx * BLOCK_BCAST_FRAG_PAYLOAD;
+        size_t chunk = len - offset;
+        if (chunk > BLOCK_BCAST_FRAG_PAYLOAD) {
+            chunk = BLOCK_BCAST_FRAG_PAYLOAD;
+        }
+        size_t pos = 0;
+        frame[pos++] = cmd;
+        memcpy(frame + pos, &block_num, sizeof(block_num));
+        pos += sizeof(block_num);
+        memcpy(frame + pos, &total_len, sizeof(total_len));
+        pos += sizeof(total_len);
+        frame[pos++] = idx;
+        frame[pos++] = count;
+        memcpy(frame + pos, serialized + offset, chunk);
+        esp_err_t ret = block_broadcast_send_msg(dest, frame, pos + chunk);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send fragment %u of block %" PRIu32 ": %s",
+                     idx, block_num, esp_err_to_name(ret));
+            continue;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+static uint32_t block_broadcast_repair(uint32_t block_num, const frag_mask_t *mask)
+{
+    block_cache_entry_t *cached = block_cache_acquire(block_num);
+    if (!cached) {
+        return 0;
+    }
+    size_t msg_len;
+    const uint8_t *msg = block_cache_message(cached, &msg_len);
+    // Skip the command byte: fragments carry the bare serialized block.
+    uint32_t sent = 0;
+    if (block_broadcast_fits(block_num, msg_len - 1)) {
+        sent = block_broadcast_send_fragments(broadcast_mac, CMD_BLOCK_FRAGMENT, block_num,
+                                              msg + 1, msg_len - 1, mask);
+    }
+    block_cache_release(cached);
+    DEFERRED_LOG(DLOG_BLOCK_REPAIRED, NULL, block_num, sent, 0);
+    return sent;
+}
+
+static void block_broadcast_send_nack(uint32_t block_num, const frag_mask_t *missing)
+{
+    uint8_t msg[BLOCK_BCAST_NACK_LEN];
+    uint8_t level = esp_mesh_lite_get_level();
+    size_t pos = 0;
+    msg[pos++] = CMD_BLOCK_NACK;
+    memcpy(msg + pos, &block_num, sizeof(block_num));
+    pos += sizeof(block_num);
+    msg[pos++] = level;
+    memcpy(msg + pos, missing->words, sizeof(missing->words));
+    pos += sizeof(missing->words);
+    DEFERRED_LOG(DLOG_NACK_SENT, NULL, block_num, block_broadcast_mask_count(missing), 0);
+    esp_err_t ret = block_broadcast_send_msg(broadcast_mac, msg, pos);
+    if (ret != ESP_OK) {
+        DEFERRED_LOG(DLOG_NACK_FAILED, NULL, ret, 0, 0);
+    }
+}
+
+static void block_broadcast_free_slot_locked(rx_slot_t *slot)
+{
+    mem_track_free(slot->buf);
+    memset(slot, 0, sizeof(*slot));
+}
+
+static rx_slot_t *block_broadcast_find_slot_locked(uint32_t block_num)
+{
+    for (int i = 0; i < BLOCK_BCAST_RX_SLOTS; i++) {
+        if (slots[i].in_use && slots[i].block_num == block_num) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Find or open a reassembly slot, evicting the oldest one if all are busy.
+static rx_slot_t *block_broadcast_open_slot_locked(uint32_t block_num, const uint8_t *src, int64_t now)
+{
+    rx_slot_t *slot = block_broadcast_find_slot_locked(block_num);
+    if (slot) {
+        return slot;
+    }
+    slot = &slots[0];
+    for (int i = 0; i < BLOCK_BCAST_RX_SLOTS; i++) {
+        if (!slots[i].in_use) {
+            slot = &slots[i];
+            break;
+        }
+        if (slots[i].created_us < slot->created_us) {
+            slot = &slots[i];
+        }
+    }
+    if (slot->in_use) {
+        ESP_LOGW(TAG, "Abandoning reassembly of block %" PRIu32, slot->block_num);
+        block_broadcast_free_slot_locked(slot);
+    }
+    slot->in_use = true;
+    slot->block_num = block_num;
+    memcpy(slot->src_mac, src, ESP_NOW_ETH_ALEN);
+    slot->created_us = now;
+    slot->nack_at_us = now + (int64_t)BLOCK_BCAST_NACK_DELAY_MS * 1000 +
+                       block_broadcast_jitter_us(BLOCK_BCAST_NACK_JITTER_MS);
+    return slot;
+}
+
+// Fragments the slot still lacks; all of them before the first one arrives. False if none.
+static bool block_broadcast_missing_locked(const rx_slot_t *slot, frag_mask_t *out)
+{
+    block_broadcast_mask_fill(out, slot->frag_count);
+    return block_broadcast_mask_clear(out, &slot->have);
+}
+
+static void block_broadcast_task(void *arg)
+{
+    pending_send_t nacks[BLOCK_BCAST_RX_SLOTS];
+    pending_send_t due[BLOCK_BCAST_MAX_REPAIRS];
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(BLOCK_BCAST_TICK_MS));
+        int nack_count = 0;
+        int due_count = 0;
+        int64_t now = esp_timer_get_time();
+
+        xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+        for (int i = 0; i < BLOCK_BCAST_RX_SLOTS; i++) {
+            rx_slot_t *slot = &slots[i];
+            if (!slot->in_use || now < slot->nack_at_us) {
+                continue;
+            }
+            if (slot->nacks_sent >= BLOCK_BCAST_MAX_NACKS) {
+                // Leave it to the range-based sync, which retries on its own schedule.
+                stats.gave_up++;
+                ESP_LOGW(TAG, "Giving up on block %" PRIu32 " after %d NACKs",
+                         slot->block_num, BLOCK_BCAST_MAX_NACKS);
+                block_broadcast_free_slot_locked(slot);
+                continue;
+            }
+            nacks[nack_count].block_num = slot->block_num;
+            block_broadcast_missing_locked(slot, &nacks[nack_count].mask);
+            nack_count++;
+            slot->nacks_sent++;
+            slot->nack_at_us = now + (int64_t)BLOCK_BCAST_NACK_BACKOFF_MS * 1000 +
+                               block_broadcast_jitter_us(BLOCK_BCAST_NACK_JITTER_MS);
+            stats.nacks_sent++;
+        }
+        for (int i = 0; i < BLOCK_BCAST_MAX_REPAIRS; i++) {
+            if (repairs[i].in_use && now >= repairs[i].fire_at_us) {
+                due[due_count].block_num = repairs[i].block_num;
+                due[due_count].mask = repairs[i].mask;
+                due_count++;
+                repairs[i].in_use = false;
+            }
+        }
+        xSemaphoreGive(bcast_mutex);
+
+        for (int i = 0; i < nack_count; i++) {
+            block_broadcast_send_nack(nacks[i].block_num, &nacks[i].mask);
+        }
+        for (int i = 0; i < due_count; i++) {
+            uint32_t sent = block_broadcast_repair(due[i].block_num, &due[i].mask);
+            xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+            stats.repairs_sent += sent;
+            xSemaphoreGive(bcast_mutex);
+        }
+    }
+}
+
+void block_broadcast_init(void)
+{
+    if (bcast_mutex) {
+        return;
+    }
+    bcast_mutex = xSemaphoreCreateMutex();
+    if (!bcast_mutex) {
+        ESP_LOGE(TAG, "Failed to create block broadcast mutex");
+        return;
+    }
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+    memset(slots, 0, sizeof(slots));
+    memset(repairs, 0, sizeof(repairs));
+    xTaskCreate(block_broadcast_task, "block_bcast_task", 4096, NULL, 5, NULL);
+}
+
+esp_err_t block_broadcast_send(const block_t *block)
+{
+    // The block is already in our chain; serializing it through the cache means the
+    // repairs and sync requests that follow are served from the same bytes.
+    block_cache_entry_t *cached = block_cache_acquire(block->block_num);
+    if (!cached) {
+        return ESP_FAIL;
+    }
+    size_t msg_len;
+    const uint8_t *msg = block_cache_message(cached, &msg_len);
+    size_t len = msg_len - 1;
+    if (!block_broadcast_fits(block->block_num, len)) {
+        block_cache_release(cached);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    frag_mask_t all;
+    block_broadcast_mask_fill(&all, 0);
+    uint32_t sent = block_broadcast_send_fragments(broadcast_mac, CMD_BLOCK_FRAGMENT, block->block_num,
+                                                   msg + 1, len, &all);
+    block_cache_release(cached);
+    if (bcast_mutex) {
+        xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+        stats.blocks_sent++;
+        xSemaphoreGive(bcast_mutex);
+    }
+    return sent > 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t block_broadcast_send_reply(const uint8_t *dest, uint32_t block_num)
+{
+    block_cache_entry_t *cached = block_cache_acquire(block_num);
+    if (!cached) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t msg_len;
+    const uint8_t *msg = block_cache_message(cached, &msg_len);
+    size_t len = msg_len - 1;
+    esp_err_t ret;
+    bool fragmented = msg_len > MESH_FRAME_MAX_MESSAGE;
+    if (!fragmented) {
+        ret = block_broadcast_send_msg(dest, msg, msg_len);
+    } else if (!block_broadcast_fits(block_num, len)) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else {
+        uint32_t count = (len + BLOCK_BCAST_FRAG_PAYLOAD - 1) / BLOCK_BCAST_FRAG_PAYLOAD;
+        frag_mask_t all;
+        block_broadcast_mask_fill(&all, 0);
+        uint32_t sent = block_broadcast_send_fragments(dest, CMD_BLOCK_REPLY_FRAGMENT, block_num,
+                                                       msg + 1, len, &all);
+        // The receiver NACKs whatever is missing; a partial send is still worth reporting.
+        ret = sent == count ? ESP_OK : ESP_FAIL;
+    }
+    block_cache_release(cached);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send block %" PRIu32 " to " MACSTR ": %s",
+                 block_num, MAC2STR(dest), esp_err_to_name(ret));
+    } else if (bcast_mutex) {
+        xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+        stats.replies_sent++;
+        stats.replies_fragmented += fragmented ? 1 : 0;
+        xSemaphoreGive(bcast_mutex);
+    }
+    return ret;
+}
+
+void block_broadcast_on_fragment(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!bcast_mutex || len <= (int)BLOCK_BCAST_FRAG_HEADER_LEN) {
+        return;
+    }
+    uint32_t block_num;
+    uint16_t total_len;
+    size_t pos = 1;
+    memcpy(&block_num, data + pos, sizeof(block_num));
+    pos += sizeof(block_num);
+    memcpy(&total_len, data + pos, sizeof(total_len));
+    pos += sizeof(total_len);
+    uint8_t idx = data[pos++];
+    uint8_t count = data[pos++];
+    size_t chunk = (size_t)len - pos;
+    size_t offset = (size_t)idx * BLOCK_BCAST_FRAG_PAYLOAD;
+    size_t expect = (idx + 1 == count) ? total_len - offset : BLOCK_BCAST_FRAG_PAYLOAD;
+    if (count == 0 || count > BLOCK_BCAST_MAX_FRAGMENTS || idx >= count || total_len == 0 ||
+        total_len > (size_t)count * BLOCK_BCAST_FRAG_PAYLOAD ||
+        total_len <= (size_t)(count - 1) * BLOCK_BCAST_FRAG_PAYLOAD || chunk != expect) {
+        DEFERRED_LOG(DLOG_FRAGMENT_MALFORMED, src_mac, 0, 0, 0);
+        return;
+    }
+    bool reply = data[0] == CMD_BLOCK_REPLY_FRAGMENT;
+    // A reply to our range request may be a competing block with a number we hold (a fork's
+    // ancestors), so it is reassembled whatever we have. Other copies of bodies we hold, such
+    // as replicas pushed after a membership change, would only crowd out the slots.
+    bool have = block_broadcast_have_body(block_num) && !(reply && block_sync_range_requested(block_num));
+    int64_t now = esp_timer_get_time();
+    uint8_t *complete = NULL;
+    bool complete_reply = false;
+    uint8_t origin[ESP_NOW_ETH_ALEN];
+
+    frag_mask_t covered;
+    memset(&covered, 0, sizeof(covered));
+    block_broadcast_mask_set(&covered, idx);
+    frag_mask_t beyond;
+    block_broadcast_mask_fill(&beyond, 0);
+    frag_mask_t fragments;
+    block_broadcast_mask_fill(&fragments, count);
+    block_broadcast_mask_clear(&beyond, &fragments);
+
+    xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+    stats.fragments_received++;
+    // Someone else is already answering this NACK; drop what they covered from our own repair.
+    for (int i = 0; i < BLOCK_BCAST_MAX_REPAIRS; i++) {
+        if (repairs[i].in_use && repairs[i].block_num == block_num) {
+            block_broadcast_mask_clear(&repairs[i].mask, &covered);
+            // Bits past the block's last fragment (an unknown-count NACK) are owed to nobody.
+            if (!block_broadcast_mask_clear(&repairs[i].mask, &beyond)) {
+                repairs[i].in_use = false;
+                stats.repairs_cancelled++;
+            }
+        }
+    }
+    if (!have) {
+        rx_slot_t *slot = block_broadcast_open_slot_locked(block_num, src_mac, now);
+        if (slot->frag_count == 0) {
+            slot->buf = mem_track_malloc(MEM_TAG_RX, total_len);
+            if (slot->buf) {
+                slot->frag_count = count;
+                slot->total_len = total_len;
+            }
+        }
+        if (slot->buf && slot->frag_count == count && slot->total_len == total_len &&
+            !block_broadcast_mask_test(&slot->have, idx)) {
+            memcpy(slot->buf + offset, data + pos, chunk);
+            block_broadcast_mask_set(&slot->have, idx);
+            slot->reply |= reply;
+        }
+        // Restart the quiet timer: more fragments are probably on their way.
+        slot->nack_at_us = now + (int64_t)BLOCK_BCAST_NACK_DELAY_MS * 1000 +
+                           block_broadcast_jitter_us(BLOCK_BCAST_NACK_JITTER_MS);
+        frag_mask_t missing;
+        if (slot->frag_count && !block_broadcast_missing_locked(slot, &missing)) {
+            complete = slot->buf;
+            complete_reply = slot->reply;
+            slot->buf = NULL;
+            memcpy(origin, slot->src_mac, ESP_NOW_ETH_ALEN);
+            block_broadcast_free_slot_locked(slot);
+            stats.blocks_completed++;
+        }
+    }
+    xSemaphoreGive(bcast_mutex);
+
+    if (complete) {
+        if (complete_reply) {
+            mesh_networking_accept_historical_block(origin, complete, total_len);
+        } else {
+            mesh_networking_accept_block(origin, complete, total_len);
+        }
+        mem_track_free(complete);
+    }
+}
+
+void block_broadcast_on_nack(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!bcast_mutex || len < (int)BLOCK_BCAST_NACK_LEN || memcmp(src_mac, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+        return;
+    }
+    uint32_t block_num;
+    frag_mask_t mask;
+    memcpy(&block_num, data + 1, sizeof(block_num));
+    uint8_t their_level = data[1 + sizeof(block_num)];
+    memcpy(mask.words, data + 2 + sizeof(block_num), sizeof(mask.words));
+    bool have = block_broadcast_have_body(block_num);
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+    rx_slot_t *slot = block_broadcast_find_slot_locked(block_num);
+    frag_mask_t missing;
+    if (slot && (!block_broadcast_missing_locked(slot, &missing) || !block_broadcast_mask_clear(&missing, &mask))) {
+        // Their repair will cover us too; hold our own NACK back.
+        int64_t deferred = now + (int64_t)BLOCK_BCAST_NACK_BACKOFF_MS * 1000;
+        if (slot->nack_at_us < deferred) {
+            slot->nack_at_us = deferred;
+        }
+        stats.nacks_suppressed++;
+    }
+    if (have) {
+        repair_t *repair = NULL;
+        repair_t *free_repair = NULL;
+        for (int i = 0; i < BLOCK_BCAST_MAX_REPAIRS; i++) {
+            if (repairs[i].in_use && repairs[i].block_num == block_num) {
+                repair = &repairs[i];
+            } else if (!repairs[i].in_use && !free_repair) {
+                free_repair = &repairs[i];
+            }
+        }
+        if (repair) {
+            block_broadcast_mask_merge(&repair->mask, &mask);
+        } else if (free_repair) {
+            // Nodes closer to the requester in the tree answer first; the rest usually
+            // overhear that repair and cancel theirs.
+            uint8_t my_level = esp_mesh_lite_get_level();
+            uint32_t distance = (my_level > their_level) ? my_level - their_level : their_level - my_level;
+            free_repair->in_use = true;
+            free_repair->block_num = block_num;
+            free_repair->mask = mask;
+            free_repair->fire_at_us = now + (int64_t)BLOCK_BCAST_REPAIR_SLOT_MS * 1000 * (1 + distance) +
+                                      block_broadcast_jitter_us(BLOCK_BCAST_REPAIR_JITTER_MS);
+        }
+    }
+    xSemaphoreGive(bcast_mutex);
+}
+
+void block_broadcast_note_tip(const uint8_t *leader_mac, uint32_t tip)
+{
+    if (!bcast_mutex) {
+        return;
+    }
+    block_t last;
+    bool have_any = blockchain_get_last_block(&last);
+    if (have_any && tip <= last.block_num) {
+        return;
+    }
+    uint32_t next = have_any ? last.block_num + 1 : 0;
+    if (tip > next) {
+        // More than one block behind: a single range request is cheaper than NACKs.
+        block_sync_request_missing(leader_mac, tip);
+        return;
+    }
+    xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+    block_broadcast_open_slot_locked(tip, leader_mac, esp_timer_get_time());
+    xSemaphoreGive(bcast_mutex);
+}
+
+void block_broadcast_get_stats(block_broadcast_stats_t *out)
+{
+    if (!bcast_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(bcast_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(bcast_mutex);
+}
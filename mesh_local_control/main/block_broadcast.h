@@ -0,0 +1,73 @@
+#ifndef BLOCK_BROADCAST_H
+#define BLOCK_BROADCAST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "blockchain.h"
+
+// New blocks are broadcast as fragments. Receivers NACK missing fragments (or a whole block
+// they learned about from the leader's heartbeat), and any node holding the block repairs,
+// nearest first. Overheard NACKs and repairs suppress duplicates on both sides.
+//
+// Blocks sent in answer to a request (range sync, body fetch, shard re-replication) that do
+// not fit one frame travel the same way under CMD_BLOCK_REPLY_FRAGMENT, usually unicast. The
+// receiver reassembles and NACKs them like any other block but files the result as a
+// historical block, and takes it even when it holds the header alone.
+#define BLOCK_BCAST_FRAG_PAYLOAD        200
+// Enough for the largest block, one reading from each of MESH_MAX_NODES nodes.
+#define BLOCK_BCAST_MAX_FRAGMENTS       ((BLOCK_SERIALIZED_MAX_LEN + BLOCK_BCAST_FRAG_PAYLOAD - 1) / BLOCK_BCAST_FRAG_PAYLOAD)
+#define BLOCK_BCAST_MASK_WORDS          ((BLOCK_BCAST_MAX_FRAGMENTS + 31) / 32)
+
+#define BLOCK_BCAST_RX_SLOTS            4       // Blocks being reassembled at once
+#define BLOCK_BCAST_MAX_REPAIRS         4       // Repairs scheduled at once
+#define BLOCK_BCAST_TICK_MS             50
+#define BLOCK_BCAST_NACK_DELAY_MS       200     // Quiet time after the last fragment before NACKing
+#define BLOCK_BCAST_NACK_JITTER_MS      150     // Random spread so receivers do not NACK in lockstep
+#define BLOCK_BCAST_NACK_BACKOFF_MS     600     // Time allowed for a repair after a NACK is sent or overheard
+#define BLOCK_BCAST_MAX_NACKS           5       // After this, the gap is left to block_sync
+#define BLOCK_BCAST_REPAIR_SLOT_MS      40      // Repair delay per mesh level between holder and requester
+#define BLOCK_BCAST_REPAIR_JITTER_MS    40
+
+// Fragment: [CMD_BLOCK_FRAGMENT or CMD_BLOCK_REPLY_FRAGMENT][u32 block_num][u16 total_len]
+//           [u8 index][u8 count][data]
+#define BLOCK_BCAST_FRAG_HEADER_LEN     (1 + sizeof(uint32_t) + sizeof(uint16_t) + 2)
+// NACK:     [CMD_BLOCK_NACK][u32 block_num][u8 mesh level][u32 x BLOCK_BCAST_MASK_WORDS missing]
+//           Fragment i is bit i % 32 of word i / 32; all bits set when the count is unknown.
+#define BLOCK_BCAST_NACK_LEN            (1 + sizeof(uint32_t) + 1 + BLOCK_BCAST_MASK_WORDS * sizeof(uint32_t))
+
+typedef struct {
+    uint32_t blocks_sent;
+    uint32_t fragments_received;
+    uint32_t blocks_completed;
+    uint32_t nacks_sent;
+    uint32_t nacks_suppressed;      // Our NACK was deferred because another node asked first
+    uint32_t repairs_sent;          // Fragments re-broadcast in answer to a NACK
+    uint32_t repairs_cancelled;     // Scheduled repairs dropped because someone nearer answered
+    uint32_t gave_up;               // Blocks left to block_sync after BLOCK_BCAST_MAX_NACKS
+    uint32_t replies_sent;          // Requested blocks sent, in one frame or as reply fragments
+    uint32_t replies_fragmented;
+} block_broadcast_stats_t;
+
+// Start the NACK / repair timer task.
+void block_broadcast_init(void);
+
+// Fragment and broadcast a block we just created and added to our chain.
+esp_err_t block_broadcast_send(const block_t *block);
+
+// Send a block we hold to `dest` (unicast, or the broadcast address) in answer to a request:
+// one [CMD_HISTORICAL_BLOCK][serialized] frame when it fits, reply fragments otherwise. Waits
+// out a full bulk queue, so call it from a task, never the receive path. ESP_ERR_NOT_FOUND if
+// we do not hold the block (a light node then fetches the body in the background).
+esp_err_t block_broadcast_send_reply(const uint8_t *dest, uint32_t block_num);
+
+// Called from the receive path, for CMD_BLOCK_FRAGMENT and CMD_BLOCK_REPLY_FRAGMENT.
+void block_broadcast_on_fragment(const uint8_t *src_mac, const uint8_t *data, int len);
+void block_broadcast_on_nack(const uint8_t *src_mac, const uint8_t *data, int len);
+
+// Called with the tip advertised in the leader's heartbeat; NACKs a block we never saw.
+void block_broadcast_note_tip(const uint8_t *leader_mac, uint32_t tip);
+
+void block_broadcast_get_stats(block_broadcast_stats_t *out);
+
+#endif // BLOCK_BROADCAST_H
@@ -0,0 +1,248 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_BLOCK_CACHE
+#include "block_cache.h"
+#include "mem_track.h"
+#include "node_local.h"
+#include "blockchain.h"
+#include "light_node.h"
+#include "command_set.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+static const char *TAG = "block_cache";
+
+struct block_cache_entry {
+    uint32_t block_num;
+    uint32_t refs;              // Table reference plus one per acquire
+    uint32_t last_used;
+    size_t len;
+    uint8_t data[];             // [CMD_HISTORICAL_BLOCK][serialized block]
+};
+
+static NODE_LOCAL SemaphoreHandle_t cache_mutex = NULL;
+static NODE_LOCAL block_cache_entry_t *table[BLOCK_CACHE_ENTRIES];
+static NODE_LOCAL uint32_t use_clock = 0;
+static NODE_LOCAL block_cache_stats_t stats = {0};
+
+static block_cache_entry_t *block_cache_alloc(uint32_t block_num, const uint8_t *serialized, size_t len)
+{
+    block_cache_entry_t *entry = mem_track_malloc(MEM_TAG_BLOCK_CACHE, sizeof(*entry) + 1 + len);
+    if (!entry) {
+        return NULL;
+    }
+    entry->block_num = block_num;
+    entry->refs = 0;
+    entry->last_used = 0;
+    entry->len = 1 + len;
+    entry->data[0] = CMD_HISTORICAL_BLOCK;
+    memcpy(entry->data + 1, serialized, len);
+    return entry;
+}
+
+static void block_cache_unref_locked(block_cache_entry_t *entry)
+{
+    if (--entry->refs == 0) {
+        mem_track_free(entry);
+    }
+}
+
+static void block_cache_remove_locked(int slot)
+{
+    block_cache_entry_t *entry = table[slot];
+    table[slot] = NULL;
+    stats.bytes -= entry->len;
+    block_cache_unref_locked(entry);
+}
+
+static int block_cache_find_locked(uint32_t block_num)
+{
+    for (int i = 0; i < BLOCK_CACHE_ENTRIES; i++) {
+        if (table[i] && table[i]->block_num == block_num) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Insert `entry`, evicting least recently used blocks until it fits. Entries still held by
+// a reader are only unlinked here and freed on their last release.
+static void block_cache_insert_locked(block_cache_entry_t *entry)
+{
+    while (1) {
+        int free_slot = -1;
+        int victim = -1;
+        for (int i = 0; i < BLOCK_CACHE_ENTRIES; i++) {
+            if (!table[i]) {
+                if (free_slot < 0) free_slot = i;
+            } else if (victim < 0 || (int32_t)(table[i]->last_used - table[victim]->last_used) < 0) {
+                victim = i;
+            }
+        }
+        if (free_slot >= 0 && stats.bytes + entry->len <= BLOCK_CACHE_MAX_BYTES) {
+            table[free_slot] = entry;
+            break;
+        }
+        if (victim < 0) {
+            // Larger than the whole byte budget; keep it anyway, alone.
+            table[free_slot] = entry;
+            break;
+        }
+        block_cache_remove_locked(victim);
+        stats.evictions++;
+    }
+    entry->refs++;
+    entry->last_used = ++use_clock;
+    stats.bytes += entry->len;
+}
+
+void block_cache_init(void)
+{
+    if (cache_mutex) {
+        return;
+    }
+    cache_mutex = xSemaphoreCreateMutex();
+    if (!cache_mutex) {
+        ESP_LOGE(TAG, "Failed to create block cache mutex");
+        return;
+    }
+    memset(table, 0, sizeof(table));
+    ESP_LOGI(TAG, "Block cache initialized (%d entries, %d bytes)", BLOCK_CACHE_ENTRIES, BLOCK_CACHE_MAX_BYTES);
+}
+
+block_cache_entry_t *block_cache_acquire(uint32_t block_num)
+{
+    if (!cache_mutex) {
+        return NULL;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    int slot = block_cache_find_locked(block_num);
+    if (slot >= 0) {
+        block_cache_entry_t *entry = table[slot];
+        entry->refs++;
+        entry->last_used = ++use_clock;
+        stats.hits++;
+        xSemaphoreGive(cache_mutex);
+        return entry;
+    }
+    stats.misses++;
+    xSemaphoreGive(cache_mutex);
+
+    // Serialize outside the lock, straight from the committed block; the handle keeps it
+    // alive even if the chain is reset meanwhile.
+    const block_t *block = blockchain_acquire_block(block_num);
+    if (!block) {
+        return NULL;
+    }
+    if (block->body_pruned) {
+        // Light node: fetch the body in the background; the caller's retry finds it here.
+        blockchain_release_block(block);
+        light_node_fetch_body(block_num);
+        return NULL;
+    }
+    uint8_t *serialized = NULL;
+    size_t len = blockchain_serialize_block(block, &serialized);
+    blockchain_release_block(block);
+    if (len == 0) {
+        return NULL;
+    }
+    block_cache_entry_t *fresh = block_cache_alloc(block_num, serialized, len);
+    mem_track_free(serialized);
+    if (!fresh) {
+        ESP_LOGE(TAG, "Failed to allocate cache entry for block %" PRIu32, block_num);
+        return NULL;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    block_cache_entry_t *entry;
+    slot = block_cache_find_locked(block_num);
+    if (slot >= 0) {
+        // Another task filled it while we were serializing.
+        mem_track_free(fresh);
+        entry = table[slot];
+    } else {
+        block_cache_insert_locked(fresh);
+        entry = fresh;
+    }
+    entry->refs++;
+    entry->last_used = ++use_clock;
+    xSemaphoreGive(cache_mutex);
+    return entry;
+}
+
+void block_cache_release(block_cache_entry_t *entry)
+{
+    if (!entry || !cache_mutex) {
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    block_cache_unref_locked(entry);
+    xSemaphoreGive(cache_mutex);
+}
+
+const uint8_t *block_cache_message(const block_cache_entry_t *entry, size_t *len)
+{
+    *len = entry->len;
+    return entry->data;
+}
+
+void block_cache_put(uint32_t block_num, const uint8_t *serialized, size_t len)
+{
+    if (!cache_mutex || len == 0) {
+        return;
+    }
+    block_cache_entry_t *fresh = block_cache_alloc(block_num, serialized, len);
+    if (!fresh) {
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    int slot = block_cache_find_locked(block_num);
+    if (slot >= 0) {
+        block_cache_remove_locked(slot);
+    }
+    block_cache_insert_locked(fresh);
+    stats.inserts++;
+    xSemaphoreGive(cache_mutex);
+}
+
+void block_cache_invalidate(uint32_t block_num)
+{
+    if (!cache_mutex) {
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    int slot = block_cache_find_locked(block_num);
+    if (slot >= 0) {
+        block_cache_remove_locked(slot);
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+void block_cache_clear(void)
+{
+    if (!cache_mutex) {
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    for (int i = 0; i < BLOCK_CACHE_ENTRIES; i++) {
+        if (table[i]) {
+            block_cache_remove_locked(i);
+        }
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+void block_cache_get_stats(block_cache_stats_t *out)
+{
+    if (!cache_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(cache_mutex);
+}
@@ -0,0 +1,44 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// LRU cache of serialized blocks, ready to send. Each entry holds the complete
+// [CMD_HISTORICAL_BLOCK][serialized block] message so serving a block costs no
+// serialization and no copy beyond the one into the transmit queue.
+#define BLOCK_CACHE_ENTRIES     8
+#define BLOCK_CACHE_MAX_BYTES   4096
+
+typedef struct block_cache_entry block_cache_entry_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;            // Had to serialize from the chain
+    uint32_t inserts;           // Filled from bytes we already had (received or just built)
+    uint32_t evictions;
+    uint32_t bytes;             // Currently cached
+} block_cache_stats_t;
+
+void block_cache_init(void);
+
+// Look up a block, serializing it from the chain on a miss. Returns NULL if the block is
+// not in the chain, or if this is a light node without the block's body; the body is then
+// fetched in the background. Every successful call must be paired with block_cache_release().
+block_cache_entry_t *block_cache_acquire(uint32_t block_num);
+void block_cache_release(block_cache_entry_t *entry);
+
+// The cached [CMD_HISTORICAL_BLOCK][serialized block] message. The serialized block alone
+// starts one byte in.
+const uint8_t *block_cache_message(const block_cache_entry_t *entry, size_t *len);
+
+// Seed the cache with serialized bytes we already hold, e.g. a block just received.
+void block_cache_put(uint32_t block_num, const uint8_t *serialized, size_t len);
+
+// Drop one block (its contents changed) or everything (the chain was reset).
+void block_cache_invalidate(uint32_t block_num);
+void block_cache_clear(void);
+
+void block_cache_get_stats(block_cache_stats_t *out);
+
+#endif // BLOCK_CACHE_H
@@ -0,0 +1,286 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_BLOCK_SYNC
+#include "block_sync.h"
+#include "node_local.h"
+#include "mesh_networking.h"
+#include "block_broadcast.h"
+#include "verifier.h"
+#include "checkpoint.h"
+#include "command_set.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "block_sync";
+
+typedef struct {
+    uint8_t requester[ESP_NOW_ETH_ALEN];
+    uint8_t count;
+    block_range_t ranges[BLOCK_SYNC_MAX_RANGES];
+} sync_request_t;
+
+static NODE_LOCAL SemaphoreHandle_t sync_mutex = NULL;
+static NODE_LOCAL QueueHandle_t serve_queue = NULL;
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+
+// Requester side: one request in flight at a time.
+static NODE_LOCAL bool request_active = false;
+static NODE_LOCAL int64_t last_request_us = 0;
+static NODE_LOCAL int64_t last_progress_us = 0;
+static NODE_LOCAL block_range_t last_range = {0};     // Last explicit range request, for de-duplication
+static NODE_LOCAL int64_t last_range_us = 0;
+static NODE_LOCAL block_sync_stats_t stats = {0};
+
+static void block_sync_send_request(const uint8_t *peer, const block_range_t *ranges, size_t count)
+{
+    uint8_t msg[BLOCK_SYNC_REQUEST_LEN(BLOCK_SYNC_MAX_RANGES)];
+    size_t offset = 0;
+    msg[offset++] = CMD_REQUEST_BLOCK_SET;
+    msg[offset++] = (uint8_t)count;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(msg + offset, &ranges[i].first, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        memcpy(msg + offset, &ranges[i].last, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    }
+    esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, peer, msg, offset);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send block set request: %s", esp_err_to_name(ret));
+    }
+}
+
+static void block_sync_serve_task(void *arg)
+{
+    static NODE_LOCAL sync_request_t req;
+    while (1) {
+        if (xQueueReceive(serve_queue, &req, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        // Only numbers inside our chain are worth visiting; a range reaching past either end
+        // would otherwise walk up to four billion numbers we cannot hold.
+        uint32_t chain_first = 0, chain_tip = 0;
+        bool have_chain = blockchain_get_bounds(&chain_first, &chain_tip);
+        uint32_t served = 0;
+        uint32_t unavailable = 0;
+        uint32_t visited = 0;
+        for (uint8_t r = 0; r < req.count && served < BLOCK_SYNC_MAX_SERVE && visited < BLOCK_SYNC_MAX_VISIT; r++) {
+            block_range_t range = req.ranges[r];
+            if (range.first > range.last) {
+                continue;
+            }
+            if (!have_chain || range.first < chain_first) {
+                // History below our first block: count it once and fetch it if it is below
+                // our checkpoint anchor.
+                uint32_t below_last = (have_chain && range.last >= chain_first) ? chain_first - 1 : range.last;
+                if (unavailable == 0) {
+                    checkpoint_fetch_history(range.first);
+                }
+                unavailable += below_last - range.first + 1;
+                if (!have_chain || below_last == range.last) {
+                    continue;
+                }
+                range.first = chain_first;
+            }
+            if (range.first > chain_tip) {
+                continue;
+            }
+            if (range.last > chain_tip) {
+                range.last = chain_tip;
+            }
+            for (uint32_t num = range.first; served < BLOCK_SYNC_MAX_SERVE && visited < BLOCK_SYNC_MAX_VISIT; num++) {
+                visited++;
+                // Straight from the serialized block cache, fragmented when it needs more
+                // than one frame.
+                esp_err_t ret = block_broadcast_send_reply(req.requester, num);
+                if (ret == ESP_ERR_NOT_FOUND) {
+                    if (unavailable++ == 0) {
+                        checkpoint_fetch_history(num);
+                    }
+                } else if (ret == ESP_OK) {
+                    served++;
+                }
+                if (num == range.last) {
+                    break;
+                }
+            }
+        }
+        ESP_LOGI(TAG, "Served %" PRIu32 " blocks to " MACSTR " (%" PRIu32 " unavailable)",
+                 served, MAC2STR(req.requester), unavailable);
+        xSemaphoreTake(sync_mutex, portMAX_DELAY);
+        stats.requests_served++;
+        stats.blocks_served += served;
+        stats.blocks_unavailable += unavailable;
+        xSemaphoreGive(sync_mutex);
+    }
+}
+
+void block_sync_init(void)
+{
+    if (sync_mutex) {
+        return;
+    }
+    sync_mutex = xSemaphoreCreateMutex();
+    serve_queue = xQueueCreate(BLOCK_SYNC_QUEUE_LENGTH, sizeof(sync_request_t));
+    if (!sync_mutex || !serve_queue) {
+        ESP_LOGE(TAG, "Failed to create block sync queue");
+        return;
+    }
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+    xTaskCreate(block_sync_serve_task, "block_sync_task", 4096, NULL, 4, NULL);
+}
+
+void block_sync_note_progress(void)
+{
+    if (!sync_mutex) {
+        return;
+    }
+    xSemaphoreTake(sync_mutex, portMAX_DELAY);
+    last_progress_us = esp_timer_get_time();
+    xSemaphoreGive(sync_mutex);
+}
+
+void block_sync_request_missing(const uint8_t *peer, uint32_t up_to)
+{
+    if (!sync_mutex || memcmp(peer, my_mac, ESP_NOW_ETH_ALEN) == 0 || checkpoint_bootstrapping()) {
+        return;
+    }
+    uint32_t chain_first = 0, chain_tip = 0;
+    bool have_chain = blockchain_get_bounds(&chain_first, &chain_tip);
+    if (have_chain && chain_tip > up_to) {
+        up_to = chain_tip;
+    }
+    block_range_t ranges[BLOCK_SYNC_MAX_RANGES];
+    // Nodes that joined from a checkpoint only fill gaps above it.
+    size_t count = blockchain_get_missing_ranges(checkpoint_history_floor(), up_to, ranges, BLOCK_SYNC_MAX_RANGES);
+    // Blocks below our first one are held in the fork pool until the one next to the chain
+    // arrives and they can be linked down from it, so ask for no more than the pool holds.
+    if (count > 0 && have_chain && ranges[0].last + 1 == chain_first &&
+        ranges[0].last - ranges[0].first >= BLOCKCHAIN_FORK_POOL) {
+        ranges[0].first = ranges[0].last - (BLOCKCHAIN_FORK_POOL - 1);
+    }
+
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(sync_mutex, portMAX_DELAY);
+    if (count == 0) {
+        bool finished = request_active;
+        request_active = false;
+        xSemaphoreGive(sync_mutex);
+        if (finished) {
+            // Caught up: check the blocks we just pulled in.
+            verifier_request();
+        }
+        return;
+    }
+    int64_t last_activity = (last_progress_us > last_request_us) ? last_progress_us : last_request_us;
+    if (request_active && now - last_activity < (int64_t)BLOCK_SYNC_STALL_MS * 1000) {
+        stats.requests_suppressed++;
+        xSemaphoreGive(sync_mutex);
+        return;
+    }
+    request_active = true;
+    last_request_us = now;
+    stats.requests_sent++;
+    stats.ranges_requested += count;
+    xSemaphoreGive(sync_mutex);
+
+    ESP_LOGI(TAG, "Requesting %d gap range(s) up to block %" PRIu32 " (first %" PRIu32 "-%" PRIu32 ") from " MACSTR,
+             (int)count, up_to, ranges[0].first, ranges[0].last, MAC2STR(peer));
+    block_sync_send_request(peer, ranges, count);
+}
+
+void block_sync_request_range(const uint8_t *peer, block_range_t range)
+{
+    if (!sync_mutex || memcmp(peer, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+        return;
+    }
+    // Every block of an answered batch can report the same gap; ask once per stall period.
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(sync_mutex, portMAX_DELAY);
+    if (range.first == last_range.first && range.last == last_range.last &&
+        now - last_range_us < (int64_t)BLOCK_SYNC_STALL_MS * 1000) {
+        stats.requests_suppressed++;
+        xSemaphoreGive(sync_mutex);
+        return;
+    }
+    last_range = range;
+    last_range_us = now;
+    stats.requests_sent++;
+    stats.ranges_requested++;
+    xSemaphoreGive(sync_mutex);
+
+    ESP_LOGI(TAG, "Requesting blocks %" PRIu32 "-%" PRIu32 " from " MACSTR, range.first, range.last, MAC2STR(peer));
+    block_sync_send_request(peer, &range, 1);
+}
+
+bool block_sync_range_requested(uint32_t block_num)
+{
+    if (!sync_mutex) {
+        return false;
+    }
+    xSemaphoreTake(sync_mutex, portMAX_DELAY);
+    bool requested = last_range_us != 0 && block_num >= last_range.first && block_num <= last_range.last;
+    xSemaphoreGive(sync_mutex);
+    return requested;
+}
+
+void block_sync_on_request(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!serve_queue || len < 2) {
+        return;
+    }
+    uint8_t count = data[1];
+    if (count == 0 || count > BLOCK_SYNC_MAX_RANGES || (size_t)len != BLOCK_SYNC_REQUEST_LEN(count)) {
+        ESP_LOGE(TAG, "Malformed block set request from " MACSTR, MAC2STR(src_mac));
+        return;
+    }
+    sync_request_t req;
+    memcpy(req.requester, src_mac, ESP_NOW_ETH_ALEN);
+    req.count = 0;
+    size_t offset = 2;
+    for (uint8_t i = 0; i < count; i++) {
+        block_range_t range;
+        memcpy(&range.first, data + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        memcpy(&range.last, data + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        if (range.first <= range.last) {
+            req.ranges[req.count++] = range;
+        }
+    }
+    if (req.count == 0) {
+        return;
+    }
+    if (xQueueSend(serve_queue, &req, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Serve queue full; dropping block set request from " MACSTR, MAC2STR(src_mac));
+    }
+}
+
+void block_sync_serve_range(const uint8_t *dest, block_range_t range)
+{
+    if (!serve_queue || range.first > range.last) {
+        return;
+    }
+    sync_request_t req;
+    memcpy(req.requester, dest, ESP_NOW_ETH_ALEN);
+    req.count = 1;
+    req.ranges[0] = range;
+    if (xQueueSend(serve_queue, &req, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Serve queue full; dropping request for blocks %" PRIu32 "-%" PRIu32, range.first, range.last);
+    }
+}
+
+void block_sync_get_stats(block_sync_stats_t *out)
+{
+    if (!sync_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(sync_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(sync_mutex);
+}
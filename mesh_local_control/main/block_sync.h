@@ -0,0 +1,55 @@
+#ifndef BLOCK_SYNC_H
+#define BLOCK_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blockchain.h"
+
+#define BLOCK_SYNC_MAX_RANGES       16      // Gap ranges carried by one request
+#define BLOCK_SYNC_STALL_MS         2000    // Re-request only after this long without progress
+#define BLOCK_SYNC_MAX_SERVE        64      // Blocks sent per request; the requester asks again for the rest
+#define BLOCK_SYNC_MAX_VISIT        (4 * BLOCK_SYNC_MAX_SERVE)  // Numbers looked up per request, served or not
+#define BLOCK_SYNC_QUEUE_LENGTH     4       // Requests waiting to be served
+#define BLOCK_SYNC_SEND_RETRY_MS    20      // Back-off while the bulk transmit queue is full
+#define BLOCK_SYNC_SEND_ATTEMPTS    50
+
+// Request payload: [CMD_REQUEST_BLOCK_SET][u8 count][count x (u32 first, u32 last)]
+#define BLOCK_SYNC_RANGE_SIZE       (2 * sizeof(uint32_t))
+#define BLOCK_SYNC_REQUEST_LEN(n)   (2 + (n) * BLOCK_SYNC_RANGE_SIZE)
+
+typedef struct {
+    uint32_t requests_sent;
+    uint32_t ranges_requested;
+    uint32_t requests_suppressed;   // Gap noticed while an earlier request was still making progress
+    uint32_t requests_served;
+    uint32_t blocks_served;
+    uint32_t blocks_unavailable;    // Requested blocks we did not have ourselves
+} block_sync_stats_t;
+
+// Start the task that answers block set requests.
+void block_sync_init(void);
+
+// Ask `peer` for every block missing in [checkpoint_history_floor(), up_to] with a single
+// request. Suppressed while an earlier request is still delivering blocks, and while we wait
+// for a checkpoint to join from.
+void block_sync_request_missing(const uint8_t *peer, uint32_t up_to);
+
+// Ask `peer` for one explicit range, e.g. the ancestors of a fork we hold. Repeats of the
+// same range are suppressed for BLOCK_SYNC_STALL_MS.
+void block_sync_request_range(const uint8_t *peer, block_range_t range);
+
+// True if `block_num` lies in the range last asked for with block_sync_request_range().
+bool block_sync_range_requested(uint32_t block_num);
+
+// Called whenever a historical block fills a gap, to keep the current request alive.
+void block_sync_note_progress(void);
+
+// Called from the receive path for every CMD_REQUEST_BLOCK_SET frame.
+void block_sync_on_request(const uint8_t *src_mac, const uint8_t *data, int len);
+
+// Queue `range` to be sent to `dest` (may be the broadcast address) by the serve task.
+void block_sync_serve_range(const uint8_t *dest, block_range_t range);
+
+void block_sync_get_stats(block_sync_stats_t *out);
+
+#endif // BLOCK_SYNC_H
@@ -1,7 +1,10 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_BLOCKCHAIN
 #include <time.h>
+#include "node_local.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "temperature_probe.h"
+#include "sensor_sampler.h"
 #include "blockchain.h"
 #include "consensus.h"
 #include "mesh_networking.h"
@@ -9,90 +12,97 @@
 #include "esp_log.h"
 #include "node_response.h"
 #include "election_response.h"
+#include "heartbeat.h"
+#include "aggregation.h"
+#include "block_broadcast.h"
+#include "block_cache.h"
+#include "light_node.h"
 #include "esp_mesh_lite.h"
 #include "mbedtls/sha256.h"
 #include "command_set.h"
+#include "metrics.h"
+#include "event_trace.h"
+#include "round_profile.h"
+#include "mem_track.h"
+#include "esp_timer.h"
 
-#define BLOCKCHAIN_BUFFER_SIZE 16  // Maximum blocks stored locally
+#define BLOCKCHAIN_CHUNK 64        // Block slots per chunk of the chain view
+#define BLOCKCHAIN_INDEX_SIZE 16   // Initial capacity of a chunk index; doubles as needed
+
+_Static_assert(BLOCKCHAIN_CHUNK >= BLOCKCHAIN_FORK_POOL, "a reorganized branch must fit in one chunk");
 
 static const char *TAG = "BLOCKCHAIN";
-static block_t *blockchain_head = NULL;    // Head of the linked list
-static uint32_t blockchain_count = 0;          // Number of blocks in the blockchain
-static SemaphoreHandle_t blockchain_mutex = NULL;
+static NODE_LOCAL SemaphoreHandle_t blockchain_mutex = NULL;  // Serializes writers; readers never take it
+
+/**
+ * Compute the commitment to a block's sensor records: SHA‑256 over the records serialized in
+ * list order. The block hash covers this instead of the records themselves, so a light node
+ * can check the hash chain with the records pruned.
+ */
+void blockchain_hash_records(block_t *block)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    for (const sensor_record_t *cur = block->node_data; cur; cur = cur->next) {
+        mbedtls_sha256_update(&ctx, cur->mac, sizeof(cur->mac));
+        mbedtls_sha256_update(&ctx, (const uint8_t *)&cur->timestamp, sizeof(cur->timestamp));
+        mbedtls_sha256_update(&ctx, (const uint8_t *)&cur->temperature, sizeof(cur->temperature));
+        mbedtls_sha256_update(&ctx, (const uint8_t *)&cur->humidity, sizeof(cur->humidity));
+        mbedtls_sha256_update(&ctx, (const uint8_t *)cur->rssi, MAX_NEIGHBORS * sizeof(int8_t));
+    }
+    mbedtls_sha256_finish(&ctx, block->records_hash);
+    mbedtls_sha256_free(&ctx);
+}
 
 /**
  * Compute the SHA‑256 hash for the given block.
- * (Temporarily zero out the hash field so it is not included in the hash calculation).
+ * (The hash field itself is not included in the hash calculation.)
+ * Covers block_num, timestamp, prev_hash, pop_proof, heatmap, num_sensor_readings and the
+ * records commitment, which is refreshed first unless the records have been pruned.
  */
 void calculate_block_hash(block_t *block) {
-    // New fixed fields: block_num, timestamp, prev_hash, pop_proof, heatmap, and num_sensor_readings.
-    size_t fixed_size = sizeof(block->block_num) + sizeof(block->timestamp) +
-                        sizeof(block->prev_hash) + sizeof(block->pop_proof) +
-                        sizeof(block->heatmap) + sizeof(block->num_sensor_readings);
-    // Total size = fixed fields + all sensor records.
-    size_t total_size = fixed_size + (block->num_sensor_readings * sensor_size);
-    
-    uint8_t *serial_buffer = malloc(total_size);
-    if (!serial_buffer) {
-        ESP_LOGE(TAG, "Failed to allocate serial buffer");
-        return;
+    int64_t start_us = esp_timer_get_time();
+    EVENT_TRACE(EV_HASH, block->block_num, block->num_sensor_readings);
+    if (!block->body_pruned) {
+        blockchain_hash_records(block);
     }
-    size_t offset = 0;
-    
-    // Serialize the new block member.
-    memcpy(serial_buffer + offset, &block->block_num, sizeof(block->block_num));
-    offset += sizeof(block->block_num);
-    memcpy(serial_buffer + offset, &block->timestamp, sizeof(block->timestamp));
-    offset += sizeof(block->timestamp);
-    memcpy(serial_buffer + offset, block->prev_hash, sizeof(block->prev_hash));
-    offset += sizeof(block->prev_hash);
-    memcpy(serial_buffer + offset, block->pop_proof, sizeof(block->pop_proof));
-    offset += sizeof(block->pop_proof);
-    memcpy(serial_buffer + offset, block->heatmap, sizeof(block->heatmap));
-    offset += sizeof(block->heatmap);
-    memcpy(serial_buffer + offset, &block->num_sensor_readings, sizeof(block->num_sensor_readings));
-    offset += sizeof(block->num_sensor_readings);
-    
-    // Serialize each sensor record from the linked list.
-    sensor_record_t *cur = block->node_data;
-    while (cur) {
-        memcpy(serial_buffer + offset, cur->mac, sizeof(cur->mac));
-        offset += sizeof(cur->mac);
-        memcpy(serial_buffer + offset, &cur->timestamp, sizeof(cur->timestamp));
-        offset += sizeof(cur->timestamp);
-        memcpy(serial_buffer + offset, &cur->temperature, sizeof(cur->temperature));
-        offset += sizeof(cur->temperature);
-        memcpy(serial_buffer + offset, &cur->humidity, sizeof(cur->humidity));
-        offset += sizeof(cur->humidity);
-        memcpy(serial_buffer + offset, cur->rssi, MAX_NEIGHBORS * sizeof(int8_t));
-        offset += MAX_NEIGHBORS * sizeof(int8_t);
-        
-        cur = cur->next;
-    }
-    
-    ESP_LOGI(TAG, "Block serialized for hash calculation, total bytes: %d", total_size);
-    // ESP_LOG_BUFFER_HEX_LEVEL(TAG, serial_buffer, total_size, ESP_LOG_INFO);
-    
     uint8_t computed_hash[32] = {0};
     mbedtls_sha256_context ctx;
     mbedtls_sha256_init(&ctx);
     if (mbedtls_sha256_starts(&ctx, 0) != 0) {
         ESP_LOGE(TAG, "SHA256 starts failed");
-        free(serial_buffer);
         mbedtls_sha256_free(&ctx);
+        EVENT_TRACE(EV_HASH_END, 0, 0);
         return;
     }
-    mbedtls_sha256_update(&ctx, serial_buffer, total_size);
+    mbedtls_sha256_update(&ctx, (const uint8_t *)&block->block_num, sizeof(block->block_num));
+    mbedtls_sha256_update(&ctx, (const uint8_t *)&block->timestamp, sizeof(block->timestamp));
+    mbedtls_sha256_update(&ctx, block->prev_hash, sizeof(block->prev_hash));
+    mbedtls_sha256_update(&ctx, (const uint8_t *)block->pop_proof, sizeof(block->pop_proof));
+    mbedtls_sha256_update(&ctx, block->heatmap, sizeof(block->heatmap));
+    mbedtls_sha256_update(&ctx, (const uint8_t *)&block->num_sensor_readings, sizeof(block->num_sensor_readings));
+    mbedtls_sha256_update(&ctx, block->records_hash, sizeof(block->records_hash));
     mbedtls_sha256_finish(&ctx, computed_hash);
     mbedtls_sha256_free(&ctx);
-    
-    free(serial_buffer);
+
     memcpy(block->hash, computed_hash, 32);
-    ESP_LOGI(TAG, "Block hash computed");
+    metrics_observe_us(METRICS_HIST_HASH, (uint32_t)(esp_timer_get_time() - start_us));
+    EVENT_TRACE(EV_HASH_END, 0, 0);
 }
 
+_Static_assert(BLOCK_SERIALIZED_HEADER_LEN == 3 * sizeof(uint32_t) + sizeof(((block_t *)0)->prev_hash) +
+               sizeof(((block_t *)0)->hash) + sizeof(((block_t *)0)->pop_proof) + sizeof(((block_t *)0)->heatmap),
+               "BLOCK_SERIALIZED_HEADER_LEN must match blockchain_serialize_block()");
+
 size_t blockchain_serialize_block(const block_t *block, uint8_t **out_buffer) {
-    ESP_LOGW(TAG, "Serializing block for transmission");
+    if (block->body_pruned) {
+        // Light mode keeps only our own records; the full block has to come from a full node.
+        ESP_LOGW(TAG, "Block %" PRIu32 " has no body here; not serializing", block->block_num);
+        return 0;
+    }
+    int64_t start_us = esp_timer_get_time();
+    EVENT_TRACE(EV_SERIALIZE, block->block_num, block->num_sensor_readings);
     size_t header_size = sizeof(block->block_num) + sizeof(block->timestamp) +
                          sizeof(block->prev_hash) + sizeof(block->hash) +
                          sizeof(block->pop_proof) + sizeof(block->heatmap) +
@@ -101,9 +111,10 @@ size_t blockchain_serialize_block(const block_t *block, uint8_t **out_buffer) {
     size_t sensors_size = block->num_sensor_readings * sensor_size;
     size_t total_size = header_size + sensors_size;
     
-    uint8_t *buffer = malloc(total_size);
+    uint8_t *buffer = mem_track_malloc(MEM_TAG_LEDGER, total_size);
     if (!buffer) {
         ESP_LOGE(TAG, "Failed to allocate serialization buffer");
+        EVENT_TRACE(EV_SERIALIZE_END, 0, 0);
         return 0;
     }
     size_t offset = 0;
@@ -139,10 +150,12 @@ size_t blockchain_serialize_block(const block_t *block, uint8_t **out_buffer) {
         cur = cur->next;
     }
     *out_buffer = buffer;
+    metrics_observe_us(METRICS_HIST_SERIALIZE, (uint32_t)(esp_timer_get_time() - start_us));
+    EVENT_TRACE(EV_SERIALIZE_END, total_size, 0);
     return total_size;
 }
 
-block_t *blockchain_parse_received_serialized_block(const uint8_t *serialized_data, int payload_len)
+static block_t *blockchain_parse_serialized(const uint8_t *serialized_data, int payload_len)
 {
     // New header: block_num, timestamp, prev_hash, hash, pop_proof, heatmap, num_sensor_readings.
     size_t header_size = sizeof(uint32_t) + sizeof(uint32_t) + 32 + 32 +
@@ -153,7 +166,7 @@ block_t *blockchain_parse_received_serialized_block(const uint8_t *serialized_da
         return NULL;
     }
     size_t offset = 0;
-    block_t *received_block = malloc(sizeof(block_t));
+    block_t *received_block = mem_track_malloc(MEM_TAG_RX, sizeof(block_t));
     if (!received_block) {
         ESP_LOGE(TAG, "Failed to allocate memory for received block");
         return NULL;
@@ -180,24 +193,24 @@ block_t *blockchain_parse_received_serialized_block(const uint8_t *serialized_da
     size_t expected_size = header_size + (received_block->num_sensor_readings * sensor_size);
     if ((size_t)payload_len != expected_size) {
         ESP_LOGE(TAG, "Received block size mismatch: expected %d, got %d", (int)expected_size, payload_len);
-        free(received_block);
+        mem_track_free(received_block);
         return NULL;
     }
     
     // Parse sensor records.
     sensor_record_t *head = NULL, *tail = NULL;
     for (uint32_t i = 0; i < received_block->num_sensor_readings; i++) {
-        sensor_record_t *rec = malloc(sizeof(sensor_record_t));
+        sensor_record_t *rec = mem_track_malloc(MEM_TAG_RX, sizeof(sensor_record_t));
         if (!rec) {
             ESP_LOGE(TAG, "Failed to allocate memory for sensor record");
             // Free already allocated sensor records.
             sensor_record_t *cur = head;
             while(cur) {
                 sensor_record_t *next = cur->next;
-                free(cur);
+                mem_track_free(cur);
                 cur = next;
             }
-            free(received_block);
+            mem_track_free(received_block);
             return NULL;
         }
         memset(rec, 0, sizeof(sensor_record_t));
@@ -221,129 +234,948 @@ block_t *blockchain_parse_received_serialized_block(const uint8_t *serialized_da
         }
     }
     received_block->node_data = head;
+    blockchain_hash_records(received_block);
     return received_block;
 }
 
+block_t *blockchain_parse_received_serialized_block(const uint8_t *serialized_data, int payload_len)
+{
+    int64_t start_us = esp_timer_get_time();
+    EVENT_TRACE(EV_PARSE, payload_len, 0);
+    block_t *block = blockchain_parse_serialized(serialized_data, payload_len);
+    if (block) {
+        metrics_observe_us(METRICS_HIST_PARSE, (uint32_t)(esp_timer_get_time() - start_us));
+        EVENT_TRACE(EV_PARSE_END, block->block_num, block->num_sensor_readings);
+    } else {
+        EVENT_TRACE(EV_PARSE_END, 0, 0);
+    }
+    return block;
+}
+
+// Committed blocks are published as an immutable, sorted view. Readers take a reference to
+// the current view under a spinlock held only for the pointer load and count bump, then read
+// without any lock; the writer builds the next view and swaps it in. A view is an index of
+// chunks of at most BLOCKCHAIN_CHUNK blocks, so a block inserted below the tip costs a copy
+// of the index and of one chunk rather than of the whole chain. Views share chunks and
+// indexes, and appending at the tip is amortized O(1). A block is freed once no chunk and no
+// reader handle refers to it, so a chain reset never frees memory a reader is still using.
+typedef struct {
+    uint32_t refs;              // Indexes listing this chunk
+    uint32_t used;              // Slots filled; each span sees a prefix
+    block_t *items[BLOCKCHAIN_CHUNK];   // Sorted by block_num; one block reference per slot
+} chain_chunk_t;
+
+typedef struct {
+    chain_chunk_t *chunk;
+    uint32_t start;             // View index of the chunk's first block
+    uint32_t first;             // Its block number, so searches stay in the index
+} chain_span_t;
+
+typedef struct {
+    uint32_t refs;              // Views using this index
+    uint32_t capacity;
+    uint32_t used;              // Spans filled; each view sees a prefix
+    chain_span_t spans[];       // In block order; one chunk reference per span
+} chain_index_t;
+
+typedef struct {
+    uint32_t refs;              // Publication reference plus one per reader
+    uint32_t count;             // Blocks
+    uint32_t spans;             // Spans of the index this view sees; none of them empty
+    chain_index_t *index;
+} chain_view_t;
+
+// Where blockchain_view_make_room() left space for a new block.
+typedef struct {
+    chain_chunk_t *chunk;
+    uint32_t slot;
+} chain_hole_t;
+
+static NODE_LOCAL chain_view_t *current_view = NULL;      // NULL while the chain is empty
+static NODE_LOCAL portMUX_TYPE view_lock = portMUX_INITIALIZER_UNLOCKED;
+static NODE_LOCAL blockchain_stats_t stats = {0};          // Under blockchain_mutex
+
+static void blockchain_block_ref(block_t *block)
+{
+    __atomic_add_fetch(&block->refs, 1, __ATOMIC_RELAXED);
+}
+
+void blockchain_free_block(block_t *block)
+{
+    sensor_record_t *s_record = block->node_data;
+    while (s_record) {
+        sensor_record_t *next_record = s_record->next;
+        mem_track_free(s_record);
+        s_record = next_record;
+    }
+    mem_track_free(block);
+}
+
+static void blockchain_block_unref(block_t *block)
+{
+    if (__atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    blockchain_free_block(block);
+}
+
+// The chain's accounting takes over a block it keeps, records included.
+static void blockchain_adopt(block_t *block)
+{
+    mem_track_retag(block, MEM_TAG_LEDGER);
+    for (sensor_record_t *cur = block->node_data; cur; cur = cur->next) {
+        mem_track_retag(cur, MEM_TAG_LEDGER);
+    }
+}
+
+static void blockchain_chunk_unref(chain_chunk_t *chunk)
+{
+    if (__atomic_sub_fetch(&chunk->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < chunk->used; i++) {
+        blockchain_block_unref(chunk->items[i]);
+    }
+    mem_track_free(chunk);
+}
+
+static void blockchain_index_unref(chain_index_t *index)
+{
+    if (__atomic_sub_fetch(&index->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < index->used; i++) {
+        blockchain_chunk_unref(index->spans[i].chunk);
+    }
+    mem_track_free(index);
+}
+
+static void blockchain_view_unref(chain_view_t *view)
+{
+    if (view && __atomic_sub_fetch(&view->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        blockchain_index_unref(view->index);
+        mem_track_free(view);
+    }
+}
+
+static chain_view_t *blockchain_view_acquire(void)
+{
+    portENTER_CRITICAL(&view_lock);
+    chain_view_t *view = current_view;
+    if (view) {
+        __atomic_add_fetch(&view->refs, 1, __ATOMIC_RELAXED);
+    }
+    portEXIT_CRITICAL(&view_lock);
+    return view;
+}
+
+// Swap in `view` (which carries its publication reference) and drop the previous one.
+// Caller holds blockchain_mutex.
+static void blockchain_publish(chain_view_t *view)
+{
+    portENTER_CRITICAL(&view_lock);
+    chain_view_t *old = current_view;
+    current_view = view;
+    portEXIT_CRITICAL(&view_lock);
+    blockchain_view_unref(old);
+}
+
+// Blocks of span `k` that `view` sees.
+static uint32_t blockchain_view_span_len(const chain_view_t *view, uint32_t k)
+{
+    uint32_t end = (k + 1 < view->spans) ? view->index->spans[k + 1].start : view->count;
+    return end - view->index->spans[k].start;
+}
+
+// Span holding view index `pos`; the last span for pos == count.
+static uint32_t blockchain_view_span(const chain_view_t *view, uint32_t pos)
+{
+    uint32_t lo = 0;
+    uint32_t hi = view->spans;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (view->index->spans[mid].start <= pos) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static block_t *blockchain_view_at(const chain_view_t *view, uint32_t pos)
+{
+    const chain_span_t *span = &view->index->spans[blockchain_view_span(view, pos)];
+    return span->chunk->items[pos - span->start];
+}
+
+// Span holding the first block with number >= block_num, and that block's offset in it; the
+// offset is the span's length when the block starts the next span or lies past the tip.
+static uint32_t blockchain_view_seek(const chain_view_t *view, uint32_t block_num, uint32_t *off)
+{
+    const chain_span_t *spans = view->index->spans;
+    uint32_t lo = 0;
+    uint32_t hi = view->spans;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (spans[mid].first <= block_num) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *off = 0;
+    if (lo == 0) {
+        return 0;
+    }
+    uint32_t k = lo - 1;
+    const chain_chunk_t *chunk = spans[k].chunk;
+    lo = 0;
+    hi = blockchain_view_span_len(view, k);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (chunk->items[mid]->block_num < block_num) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *off = lo;
+    return k;
+}
+
+// Index of the first block with number >= block_num.
+static uint32_t blockchain_view_lower_bound(const chain_view_t *view, uint32_t block_num)
+{
+    uint32_t off;
+    uint32_t k = blockchain_view_seek(view, block_num, &off);
+    return view->index->spans[k].start + off;
+}
+
+// Copy a block for callers that only need its header fields; the copy must not reach into
+// memory the chain owns.
+static void blockchain_copy_header(const block_t *block, block_t *out)
+{
+    memcpy(out, block, sizeof(block_t));
+    out->node_data = NULL;
+    out->refs = 0;
+}
+
+static chain_chunk_t *blockchain_chunk_new(void)
+{
+    chain_chunk_t *chunk = mem_track_malloc(MEM_TAG_LEDGER, sizeof(chain_chunk_t));
+    if (chunk) {
+        chunk->refs = 0;
+        chunk->used = 0;
+    }
+    return chunk;
+}
+
+// Append `len` blocks from `src` to a chunk under construction, taking a reference to each.
+static void blockchain_chunk_fill(chain_chunk_t *chunk, block_t *const *src, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        chunk->items[chunk->used++] = src[i];
+        blockchain_block_ref(src[i]);
+    }
+}
+
+// An empty index with room for `spans` spans.
+static chain_index_t *blockchain_index_new(uint32_t spans)
+{
+    uint32_t capacity = BLOCKCHAIN_INDEX_SIZE;
+    while (capacity < spans) {
+        capacity *= 2;
+    }
+    chain_index_t *index = mem_track_malloc(MEM_TAG_LEDGER, sizeof(chain_index_t) + capacity * sizeof(chain_span_t));
+    if (index) {
+        index->refs = 0;
+        index->capacity = capacity;
+        index->used = 0;
+    }
+    return index;
+}
+
+// Append a span to an index under construction; the index takes a chunk reference.
+static void blockchain_index_push(chain_index_t *index, chain_chunk_t *chunk, uint32_t start, uint32_t first)
+{
+    index->spans[index->used].chunk = chunk;
+    index->spans[index->used].start = start;
+    index->spans[index->used].first = first;
+    index->used++;
+    __atomic_add_fetch(&chunk->refs, 1, __ATOMIC_RELAXED);
+}
+
+// Copy spans [from, to) of `view` into an index under construction, moving each by `shift`.
+static void blockchain_index_copy(chain_index_t *index, const chain_view_t *view, uint32_t from, uint32_t to, uint32_t shift)
+{
+    for (uint32_t k = from; k < to; k++) {
+        const chain_span_t *span = &view->index->spans[k];
+        blockchain_index_push(index, span->chunk, span->start + shift, span->first);
+    }
+}
+
+static chain_view_t *blockchain_view_new(chain_index_t *index, uint32_t spans, uint32_t count)
+{
+    chain_view_t *view = mem_track_malloc(MEM_TAG_LEDGER, sizeof(chain_view_t));
+    if (view) {
+        view->refs = 1;
+        view->count = count;
+        view->spans = spans;
+        view->index = index;
+        __atomic_add_fetch(&index->refs, 1, __ATOMIC_RELAXED);
+    }
+    return view;
+}
+
+// Tip append: fill the last chunk in place while no other view has written past our end,
+// else start a chunk and list it in place while the index has room past our last span.
+// Slots and spans past a view's own are invisible to it, so every view can share them.
+static chain_view_t *blockchain_view_append(chain_view_t *view, uint32_t block_num, chain_hole_t *hole)
+{
+    uint32_t spans = view ? view->spans : 0;
+    uint32_t count = view ? view->count : 0;
+    if (view) {
+        chain_chunk_t *chunk = view->index->spans[spans - 1].chunk;
+        uint32_t len = blockchain_view_span_len(view, spans - 1);
+        if (len == chunk->used && len < BLOCKCHAIN_CHUNK) {
+            hole->chunk = chunk;
+            hole->slot = len;
+            return blockchain_view_new(view->index, spans, count + 1);
+        }
+    }
+    chain_index_t *index = view ? view->index : NULL;
+    bool shared = index && spans == index->used && index->used < index->capacity;
+    if (!shared) {
+        index = blockchain_index_new(spans + 1);
+    }
+    chain_chunk_t *fresh = blockchain_chunk_new();
+    chain_view_t *next = (index && fresh) ? blockchain_view_new(index, spans + 1, count + 1) : NULL;
+    if (!next) {
+        if (!shared) {
+            mem_track_free(index);
+        }
+        mem_track_free(fresh);
+        return NULL;
+    }
+    if (!shared && view) {
+        blockchain_index_copy(index, view, 0, spans, 0);
+    }
+    blockchain_index_push(index, fresh, count, block_num);
+    hole->chunk = fresh;
+    hole->slot = 0;
+    return next;
+}
+
+// Build a view one entry longer than `view` with room for block `block_num` in order;
+// nothing is published yet. Below the tip only the chunk the block falls in is copied, split
+// in two when full, along with the index. NULL without memory. Caller holds blockchain_mutex.
+static chain_view_t *blockchain_view_make_room(chain_view_t *view, uint32_t block_num, chain_hole_t *hole)
+{
+    uint32_t pos = view ? blockchain_view_lower_bound(view, block_num) : 0;
+    if (!view || pos == view->count) {
+        return blockchain_view_append(view, block_num, hole);
+    }
+    uint32_t k = blockchain_view_span(view, pos);
+    uint32_t start = view->index->spans[k].start;
+    uint32_t len = blockchain_view_span_len(view, k);
+    block_t *const *items = view->index->spans[k].chunk->items;
+    bool split = len == BLOCKCHAIN_CHUNK;
+    uint32_t off = pos - start;
+
+    chain_index_t *index = blockchain_index_new(view->spans + 1);
+    chain_chunk_t *low = blockchain_chunk_new();
+    chain_chunk_t *high = split ? blockchain_chunk_new() : NULL;
+    chain_view_t *next = NULL;
+    if (index && low && (high || !split)) {
+        next = blockchain_view_new(index, view->spans + (split ? 1 : 0), view->count + 1);
+    }
+    if (!next) {
+        mem_track_free(index);
+        mem_track_free(low);
+        mem_track_free(high);
+        return NULL;
+    }
+    if (split) {
+        stats.chunk_splits++;
+    }
+    blockchain_index_copy(index, view, 0, k, 0);
+    // The chunk's blocks and the hole go to `low`, or are split between `low` and `high`.
+    uint32_t half = split ? BLOCKCHAIN_CHUNK / 2 : len;
+    hole->chunk = (off <= half) ? low : high;
+    if (off <= half) {
+        blockchain_chunk_fill(low, items, off);
+        hole->slot = low->used++;
+        blockchain_chunk_fill(low, items + off, half - off);
+    } else {
+        blockchain_chunk_fill(low, items, half);
+    }
+    blockchain_index_push(index, low, start, off ? items[0]->block_num : block_num);
+    if (split) {
+        if (off > half) {
+            blockchain_chunk_fill(high, items + half, off - half);
+            hole->slot = high->used++;
+            blockchain_chunk_fill(high, items + off, len - off);
+        } else {
+            blockchain_chunk_fill(high, items + half, len - half);
+        }
+        blockchain_index_push(index, high, start + low->used, items[half]->block_num);
+    }
+    blockchain_index_copy(index, view, k + 1, view->spans, 1);
+    return next;
+}
+
+// Put `block` in the slot blockchain_view_make_room() left and publish the view.
+static void blockchain_view_fill(chain_view_t *next, chain_hole_t hole, block_t *block)
+{
+    // Either a shared slot past the old tip or the hole left in a new chunk.
+    hole.chunk->items[hole.slot] = block;
+    blockchain_block_ref(block);
+    if (hole.chunk->used <= hole.slot) {
+        hole.chunk->used = hole.slot + 1;
+    }
+    blockchain_publish(next);
+}
+
+// Build and publish a view with `block` in order. Caller holds blockchain_mutex.
+static bool blockchain_publish_with(chain_view_t *view, block_t *block)
+{
+    chain_hole_t hole;
+    chain_view_t *next = blockchain_view_make_room(view, block->block_num, &hole);
+    if (!next) {
+        return false;
+    }
+    blockchain_view_fill(next, hole, block);
+    return true;
+}
+
+// Blocks that conflict with the committed chain, or do not link to it yet. Each slot holds
+// one block reference. Branches rooted in the chain compete with it through
+// blockchain_fork_better(); the rest wait for their missing ancestors.
+static NODE_LOCAL block_t *fork_pool[BLOCKCHAIN_FORK_POOL];
+
+static block_t *blockchain_view_find(const chain_view_t *view, uint32_t block_num)
+{
+    if (!view) {
+        return NULL;
+    }
+    uint32_t off;
+    uint32_t k = blockchain_view_seek(view, block_num, &off);
+    if (off == blockchain_view_span_len(view, k)) {
+        return NULL;
+    }
+    block_t *block = view->index->spans[k].chunk->items[off];
+    return (block->block_num == block_num) ? block : NULL;
+}
+
+static bool blockchain_links(const block_t *parent, const block_t *child)
+{
+    return parent->block_num + 1 == child->block_num &&
+           memcmp(child->prev_hash, parent->hash, sizeof(parent->hash)) == 0;
+}
+
+static int fork_pool_find(uint32_t block_num, const uint8_t *hash)
+{
+    for (int i = 0; i < BLOCKCHAIN_FORK_POOL; i++) {
+        if (fork_pool[i] && fork_pool[i]->block_num == block_num &&
+            memcmp(fork_pool[i]->hash, hash, sizeof(fork_pool[i]->hash)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Pooled child of `parent`; the lowest hash wins if there are several.
+static int fork_pool_find_child(const block_t *parent)
+{
+    int best = -1;
+    for (int i = 0; i < BLOCKCHAIN_FORK_POOL; i++) {
+        if (fork_pool[i] && blockchain_links(parent, fork_pool[i]) &&
+            (best < 0 || memcmp(fork_pool[i]->hash, fork_pool[best]->hash, sizeof(fork_pool[i]->hash)) < 0)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static int fork_pool_find_parent(const block_t *child)
+{
+    if (child->block_num == 0) {
+        return -1;
+    }
+    return fork_pool_find(child->block_num - 1, child->prev_hash);
+}
+
+static void fork_pool_remove(int slot)
+{
+    block_t *block = fork_pool[slot];
+    fork_pool[slot] = NULL;
+    blockchain_block_unref(block);
+}
+
+// Pool `block`, evicting the lowest-numbered entry when full. Returns false if `block` itself
+// was the one left out.
+static bool fork_pool_add(block_t *block)
+{
+    int free_slot = -1;
+    int lowest = -1;
+    for (int i = 0; i < BLOCKCHAIN_FORK_POOL; i++) {
+        if (!fork_pool[i]) {
+            if (free_slot < 0) free_slot = i;
+        } else if (lowest < 0 || fork_pool[i]->block_num < fork_pool[lowest]->block_num) {
+            lowest = i;
+        }
+    }
+    if (free_slot < 0) {
+        if (fork_pool[lowest]->block_num >= block->block_num) {
+            return false;
+        }
+        fork_pool_remove(lowest);
+        free_slot = lowest;
+        stats.fork_evictions++;
+    }
+    blockchain_block_ref(block);
+    fork_pool[free_slot] = block;
+    return true;
+}
+
+static void fork_pool_clear(void)
+{
+    for (int i = 0; i < BLOCKCHAIN_FORK_POOL; i++) {
+        if (fork_pool[i]) {
+            fork_pool_remove(i);
+        }
+    }
+}
+
+// Pull pooled blocks that now extend the tip into the chain.
+static void blockchain_promote_children(void)
+{
+    while (current_view) {
+        block_t *tip = blockchain_view_at(current_view, current_view->count - 1);
+        int slot = fork_pool_find_child(tip);
+        if (slot < 0 || !blockchain_publish_with(current_view, fork_pool[slot])) {
+            return;
+        }
+        ESP_LOGI(TAG, "Block %" PRIu32 " promoted from the fork pool", fork_pool[slot]->block_num);
+        fork_pool_remove(slot);
+    }
+}
+
+// Pull pooled blocks that link to `block` into the empty slots next to it, and on from there
+// in both directions: gap blocks held until a linked neighbour was chained.
+static void blockchain_promote_neighbours(const block_t *block)
+{
+    const block_t *low = block;
+    int slot;
+    while (low->block_num > 0 && !blockchain_view_find(current_view, low->block_num - 1) &&
+           (slot = fork_pool_find_parent(low)) >= 0) {
+        block_t *parent = fork_pool[slot];
+        const block_t *below = (parent->block_num > 0) ? blockchain_view_find(current_view, parent->block_num - 1) : NULL;
+        if ((below && !blockchain_links(below, parent)) || !blockchain_publish_with(current_view, parent)) {
+            break;
+        }
+        ESP_LOGI(TAG, "Block %" PRIu32 " promoted from the fork pool", parent->block_num);
+        fork_pool_remove(slot);
+        low = parent;
+    }
+    const block_t *high = block;
+    while (high->block_num < blockchain_view_at(current_view, current_view->count - 1)->block_num &&
+           !blockchain_view_find(current_view, high->block_num + 1) &&
+           (slot = fork_pool_find_child(high)) >= 0) {
+        block_t *child = fork_pool[slot];
+        const block_t *above = blockchain_view_find(current_view, child->block_num + 1);
+        if ((above && !blockchain_links(child, above)) || !blockchain_publish_with(current_view, child)) {
+            break;
+        }
+        ESP_LOGI(TAG, "Block %" PRIu32 " promoted from the fork pool", child->block_num);
+        fork_pool_remove(slot);
+        high = child;
+    }
+    blockchain_promote_children();
+}
+
+// Fork choice: the higher tip wins, then the branch carrying more sensor readings, then the
+// lower tip hash, so every node settles on the same chain whatever order blocks arrive in.
+static bool blockchain_fork_better(block_t *const *branch, uint32_t len, const chain_view_t *view, uint32_t keep)
+{
+    const block_t *ours = blockchain_view_at(view, view->count - 1);
+    const block_t *theirs = branch[len - 1];
+    if (theirs->block_num != ours->block_num) {
+        return theirs->block_num > ours->block_num;
+    }
+    uint32_t ours_readings = 0;
+    uint32_t theirs_readings = 0;
+    for (uint32_t i = keep; i < view->count; i++) {
+        ours_readings += blockchain_view_at(view, i)->num_sensor_readings;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        theirs_readings += branch[i]->num_sensor_readings;
+    }
+    if (theirs_readings != ours_readings) {
+        return theirs_readings > ours_readings;
+    }
+    return memcmp(theirs->hash, ours->hash, sizeof(ours->hash)) < 0;
+}
+
+// Switch the chain to `branch`, keeping the first `keep` blocks. The displaced blocks move
+// to the fork pool so a later heal can switch back; the work is proportional to the fork
+// length apart from copying the chunk index.
+static bool blockchain_reorg(block_t *const *branch, uint32_t len, uint32_t keep)
+{
+    chain_view_t *view = current_view;
+    // The kept prefix shares its chunks, the last one cut short; the branch gets a chunk.
+    uint32_t spans = keep ? blockchain_view_span(view, keep - 1) + 1 : 0;
+    chain_index_t *index = blockchain_index_new(spans + 1);
+    chain_chunk_t *chunk = blockchain_chunk_new();
+    chain_view_t *next = (index && chunk) ? blockchain_view_new(index, spans + 1, keep + len) : NULL;
+    if (!next) {
+        mem_track_free(index);
+        mem_track_free(chunk);
+        return false;
+    }
+    blockchain_index_copy(index, view, 0, spans, 0);
+    blockchain_chunk_fill(chunk, branch, len);
+    blockchain_index_push(index, chunk, keep, branch[0]->block_num);
+    for (uint32_t i = 0; i < len; i++) {
+        int slot = fork_pool_find(branch[i]->block_num, branch[i]->hash);
+        if (slot >= 0) {
+            fork_pool_remove(slot);
+        }
+    }
+    ESP_LOGW(TAG, "Reorganizing: dropping %" PRIu32 " block(s) above index %" PRIu32 " for blocks %" PRIu32 "-%" PRIu32,
+             view->count - keep, keep, branch[0]->block_num, branch[len - 1]->block_num);
+    stats.reorgs++;
+    if (view->count - keep > stats.deepest_reorg) {
+        stats.deepest_reorg = view->count - keep;
+    }
+    for (uint32_t i = keep; i < view->count; i++) {
+        block_t *displaced = blockchain_view_at(view, i);
+        fork_pool_add(displaced);
+        block_cache_invalidate(displaced->block_num);
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        block_cache_invalidate(branch[i]->block_num);
+    }
+    blockchain_publish(next);
+    return true;
+}
+
+// Assemble the pooled branch through `block` and adopt it if it beats the chain.
+static blockchain_add_result_t blockchain_fork_choice(block_t *block)
+{
+    block_t *branch[BLOCKCHAIN_FORK_POOL];
+    uint32_t len = 0;
+    chain_view_t *view = current_view;
+
+    // Walk back to the block the branch forks from, filling the branch from the top.
+    block_t *root = block;
+    branch[BLOCKCHAIN_FORK_POOL - ++len] = root;
+    for (int parent = fork_pool_find_parent(root); parent >= 0 && len < BLOCKCHAIN_FORK_POOL;
+         parent = fork_pool_find_parent(root)) {
+        root = fork_pool[parent];
+        branch[BLOCKCHAIN_FORK_POOL - ++len] = root;
+    }
+    uint32_t keep = 0;
+    if (root->block_num != 0) {
+        const block_t *fork_point = blockchain_view_find(view, root->block_num - 1);
+        if (!fork_point || !blockchain_links(fork_point, root)) {
+            if (len == BLOCKCHAIN_FORK_POOL) {
+                // The pool is full of this branch and it still does not reach our chain.
+                ESP_LOGW(TAG, "Fork at block %" PRIu32 " is deeper than %d blocks; it cannot replace our chain",
+                         block->block_num, BLOCKCHAIN_FORK_POOL);
+            }
+            return BLOCKCHAIN_ADD_FORKED;           // Ancestors still missing
+        }
+        keep = blockchain_view_lower_bound(view, fork_point->block_num) + 1;
+    }
+    memmove(branch, branch + BLOCKCHAIN_FORK_POOL - len, len * sizeof(branch[0]));
+
+    // Then follow it up as far as the pool goes.
+    for (int child = fork_pool_find_child(block); child >= 0 && len < BLOCKCHAIN_FORK_POOL;
+         child = fork_pool_find_child(branch[len - 1])) {
+        branch[len++] = fork_pool[child];
+    }
+    if (!blockchain_fork_better(branch, len, view, keep) || !blockchain_reorg(branch, len, keep)) {
+        return BLOCKCHAIN_ADD_FORKED;
+    }
+    blockchain_promote_children();
+    return BLOCKCHAIN_ADD_REORGED;
+}
+
 uint32_t blockchain_init(void)
 {
-    blockchain_head = NULL;
-    blockchain_count = 0;
-    blockchain_mutex = xSemaphoreCreateMutex();
     if (!blockchain_mutex) {
-        ESP_LOGE(TAG, "Failed to create blockchain mutex");
-        return 1;
+        blockchain_mutex = xSemaphoreCreateMutex();
+        if (!blockchain_mutex) {
+            ESP_LOGE(TAG, "Failed to create blockchain mutex");
+            return 1;
+        }
     }
-    ESP_LOGI(TAG, "Blockchain initialized; count = %" PRIu32, blockchain_count);
+    xSemaphoreTake(blockchain_mutex, portMAX_DELAY);
+    blockchain_publish(NULL);
+    fork_pool_clear();
+    xSemaphoreGive(blockchain_mutex);
+    ESP_LOGI(TAG, "Blockchain initialized; count = 0");
     return 0;
 }
 
 void blockchain_deinit(void)
 {
+    // The writer lock stays; blocks go away once the last reader lets go of them.
     if (blockchain_mutex && xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
-        block_t *cur = blockchain_head;
-        while (cur) {
-            // Free sensor records for this block.
-            sensor_record_t *s_record = cur->node_data;
-            while (s_record) {
-                sensor_record_t *next_record = s_record->next;
-                free(s_record);
-                s_record = next_record;
-            }
-            block_t *next_block = cur->next;
-            free(cur);
-            cur = next_block;
-        }
-        blockchain_head = NULL;
-        blockchain_count = 0;
+        blockchain_publish(NULL);
+        fork_pool_clear();
         xSemaphoreGive(blockchain_mutex);
-        vSemaphoreDelete(blockchain_mutex);
-        blockchain_mutex = NULL;
     }
     ESP_LOGI(TAG, "Blockchain deinitialized");
 }
 
-bool blockchain_add_block(block_t *new_block)
+blockchain_add_result_t blockchain_add_block(block_t *new_block)
 {
-    bool result = false;
-    if (xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
-        new_block->next = NULL;
-        if (!blockchain_head) {
-            // For an empty chain, ensure block_num is 0 already.
-            new_block->block_num = 0;
-            blockchain_head = new_block;
+    blockchain_add_result_t result = BLOCKCHAIN_ADD_REJECTED;
+    if (!xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
+        return result;
+    }
+    chain_view_t *view = current_view;
+    uint32_t num = new_block->block_num;
+    new_block->refs = 0;
+    const block_t *same = blockchain_view_find(view, num);
+    const block_t *prev = (num > 0) ? blockchain_view_find(view, num - 1) : NULL;
+    const block_t *succ = blockchain_view_find(view, num + 1);
+    const block_t *tip = view ? blockchain_view_at(view, view->count - 1) : NULL;
+
+    if (same && memcmp(same->hash, new_block->hash, sizeof(same->hash)) == 0) {
+        // Already in the chain.
+    } else if (fork_pool_find(num, new_block->hash) >= 0) {
+        // Already in the fork pool.
+    } else if (!view ||
+               (!same && num > tip->block_num && prev && blockchain_links(prev, new_block)) ||
+               (!same && num < tip->block_num && (prev || succ) &&
+                (!prev || blockchain_links(prev, new_block)) && (!succ || blockchain_links(new_block, succ)))) {
+        // Anchors an empty chain, extends the tip, or fills a gap consistently with both
+        // neighbours, at least one of them present. Anything else that does not link to the
+        // chain waits in the pool: above the tip until its ancestors arrive, in a gap until
+        // a neighbour it links to is chained.
+        // The block is ours only once the view is built; a caller gets a REJECTED block
+        // back untouched. It is pruned before readers can see it.
+        chain_hole_t hole;
+        chain_view_t *next = blockchain_view_make_room(view, num, &hole);
+        if (next) {
+            blockchain_adopt(new_block);
+            light_node_prune(new_block);
+            blockchain_view_fill(next, hole, new_block);
+            blockchain_promote_neighbours(new_block);
+            result = BLOCKCHAIN_ADD_CHAINED;
         } else {
-            block_t *cur = blockchain_head;
-            while (cur->next) {
-                cur = cur->next;
-            }
-            // Set block_num based on the last block in the chain.
-            new_block->block_num = cur->block_num + 1;
-            cur->next = new_block;
+            ESP_LOGE(TAG, "No memory to add block %" PRIu32, num);
         }
-        blockchain_count++;
-        ESP_LOGI(TAG, "Block added; block number = %" PRIu32 ", total count = %" PRIu32, new_block->block_num, blockchain_count);
-        result = true;
-        xSemaphoreGive(blockchain_mutex);
+    } else if (fork_pool_add(new_block)) {
+        // Does not link to the chain; held as a fork candidate.
+        blockchain_adopt(new_block);
+        light_node_prune(new_block);
+        result = blockchain_fork_choice(new_block);
     }
+    xSemaphoreGive(blockchain_mutex);
+    EVENT_TRACE(EV_BLOCK_ADD, num, result);
     return result;
 }
 
-bool blockchain_insert_block(block_t *new_block)
+bool blockchain_replace_block(block_t *replacement)
 {
     bool result = false;
-    if (xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
-        block_t *prev = NULL;
-        block_t *cur = blockchain_head;
-        while (cur && cur->block_num < new_block->block_num) {
-            prev = cur;
-            cur = cur->next;
-        }
-        new_block->next = cur;
-        if (!prev) {
-            blockchain_head = new_block;
+    if (!xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
+        return false;
+    }
+    chain_view_t *view = current_view;
+    block_t *old = blockchain_view_find(view, replacement->block_num);
+    if (old && memcmp(old->hash, replacement->hash, sizeof(old->hash)) == 0) {
+        // Same block, different storage: publish a view whose chunk holding it is a copy
+        // with the one slot swapped.
+        uint32_t pos = blockchain_view_lower_bound(view, replacement->block_num);
+        uint32_t k = blockchain_view_span(view, pos);
+        const chain_span_t *span = &view->index->spans[k];
+        uint32_t len = blockchain_view_span_len(view, k);
+        chain_index_t *index = blockchain_index_new(view->spans);
+        chain_chunk_t *chunk = blockchain_chunk_new();
+        chain_view_t *next = (index && chunk) ? blockchain_view_new(index, view->spans, view->count) : NULL;
+        if (next) {
+            blockchain_adopt(replacement);
+            replacement->refs = 0;
+            blockchain_chunk_fill(chunk, span->chunk->items, pos - span->start);
+            blockchain_chunk_fill(chunk, &replacement, 1);
+            blockchain_chunk_fill(chunk, span->chunk->items + pos - span->start + 1, len - (pos - span->start) - 1);
+            blockchain_index_copy(index, view, 0, k, 0);
+            blockchain_index_push(index, chunk, span->start, span->first);
+            blockchain_index_copy(index, view, k + 1, view->spans, 0);
+            blockchain_publish(next);
+            result = true;
         } else {
-            prev->next = new_block;
+            mem_track_free(index);
+            mem_track_free(chunk);
         }
-        blockchain_count++;
-        result = true;
-        xSemaphoreGive(blockchain_mutex);
     }
+    xSemaphoreGive(blockchain_mutex);
     return result;
 }
 
-bool blockchain_get_last_block(block_t *block_out)
+bool blockchain_get_fork_gap(block_range_t *out)
 {
-    bool result = false;
-    if (xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
-        if (blockchain_head) {
-            block_t *cur = blockchain_head;
-            while (cur->next) {
-                cur = cur->next;
-            }
-            memcpy(block_out, cur, sizeof(block_t));
-            result = true;
+    bool found = false;
+    if (!blockchain_mutex || !xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
+        return false;
+    }
+    const chain_view_t *view = current_view;
+    uint32_t tip_num = view ? blockchain_view_at(view, view->count - 1)->block_num : 0;
+    for (int i = 0; i < BLOCKCHAIN_FORK_POOL; i++) {
+        const block_t *root = fork_pool[i];
+        // Roots above tip + 1 are plain gaps, which block_sync already fetches.
+        if (!root || root->block_num == 0 || root->block_num > tip_num + 1 || fork_pool_find_parent(root) >= 0) {
+            continue;
+        }
+        const block_t *parent = blockchain_view_find(view, root->block_num - 1);
+        if (parent && blockchain_links(parent, root)) {
+            continue;
+        }
+        // A block held in a gap: block_sync already fetches the gap around it.
+        if (!parent && root->block_num < tip_num && !blockchain_view_find(view, root->block_num)) {
+            continue;
+        }
+        if (!found || root->block_num > out->last + 1) {
+            out->last = root->block_num - 1;
+            out->first = (out->last >= BLOCKCHAIN_FORK_FETCH - 1) ? out->last - (BLOCKCHAIN_FORK_FETCH - 1) : 0;
+            found = true;
         }
-        xSemaphoreGive(blockchain_mutex);
     }
-    return result;
+    xSemaphoreGive(blockchain_mutex);
+    return found;
+}
+
+void blockchain_get_stats(blockchain_stats_t *out)
+{
+    if (!blockchain_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(blockchain_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(blockchain_mutex);
+}
+
+const block_t *blockchain_acquire_block(uint32_t block_num)
+{
+    chain_view_t *view = blockchain_view_acquire();
+    if (!view) {
+        return NULL;
+    }
+    block_t *block = blockchain_view_find(view, block_num);
+    if (block) {
+        blockchain_block_ref(block);
+    }
+    blockchain_view_unref(view);
+    return block;
+}
+
+const block_t *blockchain_acquire_tip(void)
+{
+    chain_view_t *view = blockchain_view_acquire();
+    if (!view) {
+        return NULL;
+    }
+    block_t *block = blockchain_view_at(view, view->count - 1);
+    blockchain_block_ref(block);
+    blockchain_view_unref(view);
+    return block;
+}
+
+bool blockchain_get_bounds(uint32_t *first, uint32_t *tip)
+{
+    chain_view_t *view = blockchain_view_acquire();
+    if (!view) {
+        return false;
+    }
+    *first = blockchain_view_at(view, 0)->block_num;
+    *tip = blockchain_view_at(view, view->count - 1)->block_num;
+    blockchain_view_unref(view);
+    return true;
+}
+
+size_t blockchain_acquire_range(uint32_t first, const block_t **out, size_t max_blocks)
+{
+    chain_view_t *view = blockchain_view_acquire();
+    if (!view) {
+        return 0;
+    }
+    size_t count = 0;
+    for (uint32_t i = blockchain_view_lower_bound(view, first); i < view->count && count < max_blocks; i++) {
+        block_t *block = blockchain_view_at(view, i);
+        blockchain_block_ref(block);
+        out[count++] = block;
+    }
+    blockchain_view_unref(view);
+    return count;
+}
+
+void blockchain_release_block(const block_t *block)
+{
+    if (block) {
+        blockchain_block_unref((block_t *)block);
+    }
+}
+
+bool blockchain_get_last_block(block_t *block_out)
+{
+    const block_t *tip = blockchain_acquire_tip();
+    if (!tip) {
+        return false;
+    }
+    blockchain_copy_header(tip, block_out);
+    blockchain_release_block(tip);
+    return true;
 }
 
 bool blockchain_get_block_by_number(uint32_t block_num, block_t *block_out)
 {
-    bool found = false;
-    if (xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
-        block_t *cur = blockchain_head;
-        while (cur) {
-            if (cur->block_num == block_num) {
-                memcpy(block_out, cur, sizeof(block_t));
-                found = true;
-                break;
-            }
-            cur = cur->next;
+    const block_t *block = blockchain_acquire_block(block_num);
+    if (!block) {
+        return false;
+    }
+    blockchain_copy_header(block, block_out);
+    blockchain_release_block(block);
+    return true;
+}
+
+/**
+ * Fill `out` with the runs of block numbers in [from, up_to] that are not in the local chain,
+ * lowest first. Returns the number of ranges written; stops early once `max_ranges` is reached.
+ */
+size_t blockchain_get_missing_ranges(uint32_t from, uint32_t up_to, block_range_t *out, size_t max_ranges)
+{
+    size_t count = 0;
+    if (max_ranges == 0) {
+        return 0;
+    }
+    chain_view_t *view = blockchain_view_acquire();
+    uint32_t next_expected = from;
+    for (uint32_t i = view ? blockchain_view_lower_bound(view, from) : 0; view && i < view->count && count < max_ranges; i++) {
+        uint32_t num = blockchain_view_at(view, i)->block_num;
+        if (num > up_to) {
+            break;
         }
-        xSemaphoreGive(blockchain_mutex);
+        if (num > next_expected) {
+            out[count].first = next_expected;
+            out[count].last = num - 1;
+            count++;
+        }
+        next_expected = num + 1;
     }
-    return found;
+    if (count < max_ranges && next_expected <= up_to) {
+        out[count].first = next_expected;
+        out[count].last = up_to;
+        count++;
+    }
+    blockchain_view_unref(view);
+    return count;
 }
 
 /**
@@ -351,45 +1183,45 @@ bool blockchain_get_block_by_number(uint32_t block_num, block_t *block_out)
  */
 void blockchain_print_history(void)
 {
-    if (xSemaphoreTake(blockchain_mutex, portMAX_DELAY)) {
-        ESP_LOGI(TAG, "===== Blockchain History (Count: %" PRIu32 ") =====", blockchain_count);
-        uint32_t count = 0;
-        block_t *cur = blockchain_head;
-        while (cur) {
-            ESP_LOGI(TAG, "Block %" PRIu32 " (global number: %" PRIu32 "):", count++, cur->block_num);
-            ESP_LOGI(TAG, "  Prev Hash:");
-            ESP_LOG_BUFFER_HEX_LEVEL(TAG, cur->prev_hash, 32, ESP_LOG_INFO);
-            ESP_LOGI(TAG, "  Block Hash:");
-            ESP_LOG_BUFFER_HEX_LEVEL(TAG, cur->hash, 32, ESP_LOG_INFO);
-            ESP_LOGI(TAG, "  Timestamp: 0x%" PRIx32, cur->timestamp);
-            ESP_LOGI(TAG, "  PoP Proof: %s", cur->pop_proof);
-            ESP_LOGI(TAG, "  Sensor Readings (Total: %" PRIu32 "):", cur->num_sensor_readings);
-            sensor_record_t *record = cur->node_data;
-            while (record) {
-                ESP_LOGI(TAG, "    Sensor " MACSTR ": Temp: %.2f°C, Humidity: %.2f%%",
-                         MAC2STR(record->mac), record->temperature, record->humidity);
-                record = record->next;
-            }
-            cur = cur->next;
+    // Walks a snapshot; blocks committed meanwhile show up in the next dump.
+    chain_view_t *view = blockchain_view_acquire();
+    uint32_t total = view ? view->count : 0;
+    ESP_LOGI(TAG, "===== Blockchain History (Count: %" PRIu32 ") =====", total);
+    for (uint32_t i = 0; i < total; i++) {
+        const block_t *cur = blockchain_view_at(view, i);
+        ESP_LOGI(TAG, "Block %" PRIu32 " (global number: %" PRIu32 "):", i, cur->block_num);
+        ESP_LOGI(TAG, "  Prev Hash:");
+        ESP_LOG_BUFFER_HEX_LEVEL(TAG, cur->prev_hash, 32, ESP_LOG_INFO);
+        ESP_LOGI(TAG, "  Block Hash:");
+        ESP_LOG_BUFFER_HEX_LEVEL(TAG, cur->hash, 32, ESP_LOG_INFO);
+        ESP_LOGI(TAG, "  Timestamp: 0x%" PRIx32, cur->timestamp);
+        ESP_LOGI(TAG, "  PoP Proof: %s", cur->pop_proof);
+        ESP_LOGI(TAG, "  Sensor Readings (Total: %" PRIu32 "%s):", cur->num_sensor_readings,
+                 cur->body_pruned ? ", only ours stored" : "");
+        const sensor_record_t *record = cur->node_data;
+        while (record) {
+            ESP_LOGI(TAG, "    Sensor " MACSTR ": Temp: %.2f°C, Humidity: %.2f%%",
+                     MAC2STR(record->mac), record->temperature, record->humidity);
+            record = record->next;
         }
-        ESP_LOGI(TAG, "========================================");
-        xSemaphoreGive(blockchain_mutex);
     }
+    ESP_LOGI(TAG, "========================================");
+    blockchain_view_unref(view);
 }
 
 void blockchain_print_block_struct(block_t *block)
 {
-    ESP_LOGI(TAG, "Block Number: %" PRIu32, block->block_num);
-    ESP_LOGI(TAG, "Timestamp: 0x%" PRIx32, block->timestamp);
-    ESP_LOGI(TAG, "Prev Hash:");
-    ESP_LOG_BUFFER_HEX_LEVEL(TAG, block->prev_hash, 32, ESP_LOG_INFO);
-    ESP_LOGI(TAG, "Block Hash:");
-    ESP_LOG_BUFFER_HEX_LEVEL(TAG, block->hash, 32, ESP_LOG_INFO);
-    ESP_LOGI(TAG, "PoP Proof: %s", block->pop_proof);
-    ESP_LOGI(TAG, "Sensor Readings (Total: %" PRIu32 "):", block->num_sensor_readings);
+    ESP_LOGD(TAG, "Block Number: %" PRIu32, block->block_num);
+    ESP_LOGD(TAG, "Timestamp: 0x%" PRIx32, block->timestamp);
+    ESP_LOGD(TAG, "Prev Hash:");
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, block->prev_hash, 32, ESP_LOG_DEBUG);
+    ESP_LOGD(TAG, "Block Hash:");
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, block->hash, 32, ESP_LOG_DEBUG);
+    ESP_LOGD(TAG, "PoP Proof: %s", block->pop_proof);
+    ESP_LOGD(TAG, "Sensor Readings (Total: %" PRIu32 "):", block->num_sensor_readings);
     sensor_record_t *record = block->node_data;
     while (record) {
-        ESP_LOGI(TAG, "  Sensor " MACSTR ": Temp: %.2f°C, Humidity: %.2f%%",
+        ESP_LOGD(TAG, "  Sensor " MACSTR ": Temp: %.2f°C, Humidity: %.2f%%",
                  MAC2STR(record->mac), record->temperature, record->humidity);
         record = record->next;
     }
@@ -423,12 +1255,21 @@ void blockchain_receive_block(const uint8_t *data, uint16_t len)
         ESP_LOGE(TAG, "Received block size mismatch: expected %d, got %d", (int)sizeof(block_t), len);
         return;
     }
-    block_t incoming_block;
-    memcpy(&incoming_block, data, len);
-    if (blockchain_add_block(&incoming_block)) {
-        ESP_LOGI(TAG, "Block with Timestamp 0x%" PRIx32 " received and added", incoming_block.timestamp);
+    // The chain takes ownership of what it is given, so the block has to live on the heap;
+    // the sensor record pointers in the raw bytes mean nothing here.
+    block_t *incoming_block = mem_track_malloc(MEM_TAG_RX, sizeof(block_t));
+    if (!incoming_block) {
+        ESP_LOGE(TAG, "Failed to allocate received block");
+        return;
+    }
+    memcpy(incoming_block, data, len);
+    incoming_block->node_data = NULL;
+    uint32_t timestamp = incoming_block->timestamp;
+    if (blockchain_add_block(incoming_block)) {
+        ESP_LOGI(TAG, "Block with Timestamp 0x%" PRIx32 " received and added", timestamp);
     } else {
-        ESP_LOGE(TAG, "Failed to add received block (Timestamp 0x%" PRIx32 ")", incoming_block.timestamp);
+        ESP_LOGE(TAG, "Failed to add received block (Timestamp 0x%" PRIx32 ")", timestamp);
+        mem_track_free(incoming_block);
     }
 }
 
@@ -437,7 +1278,7 @@ void blockchain_receive_block(const uint8_t *data, uint16_t len)
  */
 static void blockchain_append_sensor(block_t *block, const sensor_record_t *record)
 {
-    sensor_record_t *new_record = malloc(sizeof(sensor_record_t));
+    sensor_record_t *new_record = mem_track_malloc(MEM_TAG_LEDGER, sizeof(sensor_record_t));
     if (!new_record) {
         ESP_LOGE(TAG, "No memory to allocate sensor record");
         return;
@@ -455,8 +1296,17 @@ static void blockchain_append_sensor(block_t *block, const sensor_record_t *reco
         cur->next = new_record;
     }
     block->num_sensor_readings++;
-    ESP_LOGI(TAG, "Added sensor reading: Temp: %.2f, Humidity: %.2f (total: %" PRIu32 ")",
-             record->temperature, record->humidity, block->num_sensor_readings);
+    EVENT_TRACE(EV_SENSOR_APPEND, block->num_sensor_readings, event_trace_mac(record->mac));
+}
+
+static bool blockchain_block_has_sensor(const block_t *block, const uint8_t *mac)
+{
+    for (const sensor_record_t *cur = block->node_data; cur; cur = cur->next) {
+        if (memcmp(cur->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return true;
+        }
+    }
+    return false;
 }
 
 // Helper task to determine if mesh network is formed and we can activate the blockchain receiver task.
@@ -465,7 +1315,7 @@ void mesh_networking_task(void *pvParameters)
     ESP_LOGI(TAG, "Starting mesh_networking_task");
     while (1) {
         uint32_t node_count = 0;
-        const node_info_list_t *list = esp_mesh_lite_get_nodes_list(&node_count);
+        esp_mesh_lite_get_nodes_list(&node_count);
         if (node_count > 0) {
             ESP_LOGE(TAG, "Mesh network formed with %" PRIu32 " nodes", node_count);
             // Start the blockchain receiver task.
@@ -493,6 +1343,7 @@ void sensor_blockchain_task(void *pvParameters)
     
     ESP_LOGV(TAG, "Blockchain initialized");
     consensus_init();
+    heartbeat_init();
     
     // Register ESPNOW receive callback
     ESP_LOGI(TAG, "Registering ESPNOW receive callback");
@@ -503,7 +1354,6 @@ void sensor_blockchain_task(void *pvParameters)
     while (1) {
         uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
         esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
-        ESP_LOGI(TAG, "My MAC: " MACSTR, MAC2STR(my_mac));
 
         uint32_t solo_node_count = 0;
         node_info_list_t *solo_list = esp_mesh_lite_get_nodes_list(&solo_node_count);
@@ -516,18 +1366,19 @@ void sensor_blockchain_task(void *pvParameters)
         if (solo_node_count == 1) {
             ESP_LOGI(TAG, "Only one node in the network. Acting as leader.");
             memcpy(elected_leader_mac, solo_list->node->mac_addr, ESP_NOW_ETH_ALEN);
+            heartbeat_set_leader(elected_leader_mac);
         }
         
-        ESP_LOGW(TAG, "Elected Leader MAC: " MACSTR, MAC2STR(elected_leader_mac));
-        ESP_LOGW(TAG, "My MAC: " MACSTR, MAC2STR(my_mac));
-        if (consensus_am_i_leader(elected_leader_mac)) {
-            ESP_LOGI(TAG, "I am the leader. Initiating sensor data collection.");
-            uint8_t pulse_cmd = CMD_PULSE;
+        bool leading = consensus_am_i_leader(elected_leader_mac);
+        EVENT_TRACE(EV_LEADER, event_trace_mac(elected_leader_mac), leading);
+        if (leading) {
+            round_profile_t profile;
+            round_profile_begin(&profile);
             uint32_t node_count = 0;
             const node_info_list_t *list = esp_mesh_lite_get_nodes_list(&node_count);
             
             // Dynamically allocate a new block.
-            block_t *new_block = malloc(sizeof(block_t));
+            block_t *new_block = mem_track_malloc(MEM_TAG_LEDGER, sizeof(block_t));
             if (!new_block) {
                 ESP_LOGE(TAG, "Failed to allocate memory for new block");
                 vTaskDelay(pdMS_TO_TICKS(5000));
@@ -547,85 +1398,104 @@ void sensor_blockchain_task(void *pvParameters)
             }
             new_block->node_data = NULL;
             new_block->num_sensor_readings = 0;
-            
-            // Append leader's own sensor reading.
-            sensor_record_t my_sensor = {0};
-            memcpy(my_sensor.mac, my_mac, ESP_NOW_ETH_ALEN);
-            my_sensor.timestamp = (uint32_t)time(NULL);
-            my_sensor.temperature = temperature_probe_read_temperature();
-            my_sensor.humidity = temperature_probe_read_humidity();
-            my_sensor.next = NULL;
-            blockchain_append_sensor(new_block, &my_sensor); // count now = 1
-
-            // For each node (excluding leader), send a pulse and wait for response.
+            round_profile_mark(&profile, ROUND_STAGE_SETUP);
+
+            // One broadcast pulse per round. Readings come back aggregated along the mesh-lite
+            // tree, so we only hear from our direct children and the root-level nodes.
+            uint32_t expected = 0;
             while (list) {
-                // Skip this node if it is our own MAC address.
-                if (memcmp(list->node->mac_addr, my_mac, ESP_NOW_ETH_ALEN) == 0) {
-                    ESP_LOGI(TAG, "Skipping self node " MACSTR, MAC2STR(my_mac));
-                    list = list->next;
-                    continue;
+                if (memcmp(list->node->mac_addr, my_mac, ESP_NOW_ETH_ALEN) != 0) {
+                    expected++;
                 }
-                ESP_LOGI(TAG, "Sending pulse to " MACSTR, MAC2STR(list->node->mac_addr));
-                esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, list->node->mac_addr,
-                                                    &pulse_cmd, sizeof(pulse_cmd));
-                if (ret != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to send pulse to " MACSTR, MAC2STR(list->node->mac_addr));
+                list = list->next;
+            }
+            node_response_flush();
+            aggregation_begin_round(new_block->block_num, my_mac);
+            uint8_t pulse_msg[AGG_PULSE_LEN];
+            size_t pulse_len = aggregation_build_pulse(pulse_msg, new_block->block_num, my_mac);
+            uint8_t pulse_bcast[ESP_NOW_ETH_ALEN] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+            int64_t round_start_us = esp_timer_get_time();
+            EVENT_TRACE(EV_ROUND, new_block->block_num, expected);
+            esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, pulse_bcast, pulse_msg, pulse_len);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to broadcast pulse: %s", esp_err_to_name(ret));
+            }
+            round_profile_mark(&profile, ROUND_STAGE_PULSE);
+
+            // Leader's own reading: the sample nearest the pulse, the moment the nodes answer
+            // for. Skipped when the sensor has stopped producing samples.
+            sensor_sample_t sample;
+            if (sensor_sampler_at(round_start_us, &sample)) {
+                sensor_record_t my_sensor = {0};
+                memcpy(my_sensor.mac, my_mac, ESP_NOW_ETH_ALEN);
+                my_sensor.timestamp = (uint32_t)time(NULL);
+                my_sensor.temperature = sample.temperature;
+                my_sensor.humidity = sample.humidity;
+                my_sensor.next = NULL;
+                blockchain_append_sensor(new_block, &my_sensor);
+            }
+            round_profile_mark(&profile, ROUND_STAGE_SENSOR);
+            uint32_t collected = 0;
+            TickType_t collect_start = xTaskGetTickCount();
+            TickType_t collect_budget = pdMS_TO_TICKS(AGG_COLLECT_TIMEOUT_MS);
+            while (collected < expected) {
+                TickType_t elapsed = xTaskGetTickCount() - collect_start;
+                if (elapsed >= collect_budget) {
+                    break;
                 }
                 sensor_record_t response = {0};
-                if (waitForNodeResponse(list->node->mac_addr, &response, pdMS_TO_TICKS(5000))) {
-                    ESP_LOGI(TAG, "Received sensor data from " MACSTR ": Temp: %.2f°C, Humidity: %.2f%%",
-                             MAC2STR(list->node->mac_addr), response.temperature, response.humidity);
-                    blockchain_append_sensor(new_block, &response);
-                } else {
-                    ESP_LOGE(TAG, "No response from " MACSTR, MAC2STR(list->node->mac_addr));
+                int64_t received_us;
+                if (!node_response_wait_any(&response, &received_us, collect_budget - elapsed)) {
+                    break;
                 }
-                list = list->next;
+                if (blockchain_block_has_sensor(new_block, response.mac)) {
+                    continue;
+                }
+                round_profile_arrival(&profile, response.mac, received_us);
+                blockchain_append_sensor(new_block, &response);
+                collected++;
+            }
+            if (collected < expected) {
+                metrics_count_n(METRICS_ROUND_READINGS_MISSED, expected - collected);
+                ESP_LOGW(TAG, "Collected %" PRIu32 " of %" PRIu32 " readings before the deadline",
+                         collected, expected);
             }
-            ESP_LOGI(TAG, "All sensor responses processed: total sensors = %" PRIu32,
-                     new_block->num_sensor_readings);
+            EVENT_TRACE(EV_ROUND_COLLECTED, collected, expected);
+            round_profile_mark(&profile, ROUND_STAGE_COLLECT);
             
             // Generate Proof-of-participation.
             consensus_generate_pop_proof(new_block, my_mac);
+            round_profile_mark(&profile, ROUND_STAGE_POP);
             // Calculate new block hash.
             calculate_block_hash(new_block);
-            ESP_LOGI(TAG, "Prev Hash: ");
-            ESP_LOG_BUFFER_HEX_LEVEL(TAG, new_block->prev_hash, 32, ESP_LOG_INFO);
-            ESP_LOGI(TAG, "Block Hash: ");
-            ESP_LOG_BUFFER_HEX_LEVEL(TAG, new_block->hash, 32, ESP_LOG_INFO);
+            round_profile_mark(&profile, ROUND_STAGE_HASH);
             
+            // Cache the full serialized block before it is stored: a light node keeps only
+            // its own records, and the broadcast and any repairs are served from these bytes.
+            uint8_t *serialized = NULL;
+            size_t serialized_len = blockchain_serialize_block(new_block, &serialized);
+            if (serialized_len > 0) {
+                block_cache_put(new_block->block_num, serialized, serialized_len);
+                mem_track_free(serialized);
+            }
+            round_profile_mark(&profile, ROUND_STAGE_SERIALIZE);
+
             // Add block to blockchain.
+            uint32_t readings = new_block->num_sensor_readings;
+            uint32_t block_num = new_block->block_num;
             blockchain_add_block(new_block);
-            ESP_LOGI(TAG, "Block added to blockchain");
-            sensor_record_t *record = new_block->node_data;
-            while (record) {
-                ESP_LOGI(TAG, "    Sensor " MACSTR ": Temp: %.2f°C, Humidity: %.2f%%",
-                         MAC2STR(record->mac), record->temperature, record->humidity);
-                record = record->next;
-            }
+            round_profile_mark(&profile, ROUND_STAGE_COMMIT);
             
             // Broadcast the new block to all nodes.
-            uint8_t bcast_mac[ESP_NOW_ETH_ALEN] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-            uint8_t *serialized_block = NULL;
-            size_t block_size = blockchain_serialize_block(new_block, &serialized_block);
-            if (block_size == 0) {
-                ESP_LOGE(TAG, "Failed to serialize new block");
-            } else {
-                size_t send_buffer_size = 1 + block_size;
-                uint8_t *send_buffer = malloc(send_buffer_size);
-                if (send_buffer) {
-                    send_buffer[0] = CMD_NEW_BLOCK;
-                    memcpy(send_buffer + 1, serialized_block, block_size);
-                    esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, bcast_mac,
-                                                        send_buffer, send_buffer_size);
-                    if (ret != ESP_OK) {
-                        ESP_LOGE(TAG, "Failed to broadcast new block: %s", esp_err_to_name(ret));
-                    }
-                    free(send_buffer);
-                } else {
-                    ESP_LOGE(TAG, "Failed to allocate send buffer");
-                }
-                free(serialized_block);
+            // Sent as fragments; receivers that miss one NACK it and the nearest holder repairs.
+            esp_err_t bcast_ret = block_broadcast_send(new_block);
+            if (bcast_ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to broadcast new block: %s", esp_err_to_name(bcast_ret));
             }
+            round_profile_mark(&profile, ROUND_STAGE_BROADCAST);
+            round_profile_end(&profile, block_num, expected, collected);
+            metrics_observe_us(METRICS_HIST_ROUND, (uint32_t)(esp_timer_get_time() - round_start_us));
+            EVENT_TRACE(EV_ROUND_END, readings, 0);
             
             vTaskDelay(pdMS_TO_TICKS(500));
             
@@ -633,8 +1503,6 @@ void sensor_blockchain_task(void *pvParameters)
             // then broadcasts that node's MAC address as the next leader.
             node_count = 0;
             node_info_list_t *node_list = esp_mesh_lite_get_nodes_list(&node_count);
-            ESP_LOGI(TAG, "Election Process: Current leader broadcasts next leader selection");
-            ESP_LOGI(TAG, "Node count: %" PRIu32 ", node_list: %p", node_count, node_list);
             if (node_list != NULL && node_count > 0) 
             {
                 uint32_t index = rand() % node_count;
@@ -646,10 +1514,12 @@ void sensor_blockchain_task(void *pvParameters)
                 uint8_t election_msg[1 + ESP_NOW_ETH_ALEN];
                 election_msg[0] = CMD_ELECTION;
                 memcpy(election_msg + 1, selected->node->mac_addr, ESP_NOW_ETH_ALEN);
-                // Setting our own record of the elected node
+                // Setting our own record of the elected node. Elections heard during our
+                // round are older than this one.
+                election_response_flush();
                 memcpy(elected_leader_mac, selected->node->mac_addr, ESP_NOW_ETH_ALEN);
-                ESP_LOGI(TAG, "Selected next leader: " MACSTR, MAC2STR(selected->node->mac_addr));
-                ESP_LOGI(TAG, "My MAC: " MACSTR, MAC2STR(my_mac));
+                heartbeat_set_leader(elected_leader_mac);
+                EVENT_TRACE(EV_ELECTION_TX, event_trace_mac(elected_leader_mac), 0);
                 // Broadcast the election message using the broadcast MAC address.
                 uint8_t bcast_mac[ESP_NOW_ETH_ALEN] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
                 esp_err_t ret_e = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, bcast_mac,
@@ -665,33 +1535,36 @@ void sensor_blockchain_task(void *pvParameters)
         } 
         else 
         {
-            ESP_LOGI(TAG, "Not leader, waiting for election broadcast.");
             if (waitForElectionMessage(elected_leader_mac, pdMS_TO_TICKS(70000))) 
             {
-                ESP_LOGI(TAG, "Election message received: next leader MAC = " MACSTR, MAC2STR(elected_leader_mac));
+                heartbeat_set_leader(elected_leader_mac);
                 if (memcmp(elected_leader_mac, my_mac, ESP_NOW_ETH_ALEN) == 0) 
                 {
-                    ESP_LOGI(TAG, "I am elected as next leader. Preparing to lead next round.");
-                    // (Optionally trigger leader initialization.)
+                    if (heartbeat_consume_takeover()) {
+                        // Previous leader failed; start the round now instead of after the gap.
+                        ESP_LOGW(TAG, "Taking over from failed leader");
+                        continue;
+                    }
                 } 
                 else 
                 {
-                    ESP_LOGI(TAG, "Awaiting block broadcast from elected leader.");
                     // Block broadcast reception is handled elsewhere (e.g. via espnow_recv_cb -> blockchain_receive_block)
                 }
             } 
             else 
             {
                 ESP_LOGW(TAG, "No election message received within timeout. Initiating leader discovery.");
-                uint8_t zero_mac[ESP_NOW_ETH_ALEN] = {0};
-                if (memcmp(elected_leader_mac, zero_mac, ESP_NOW_ETH_ALEN) == 0) 
-                {
-                    memcpy(elected_leader_mac, my_mac, ESP_NOW_ETH_ALEN);
+                // Every node nominates the node the takeover rule picks, so the nominations
+                // agree without a leader to run the election; the lowest MAC named wins if
+                // they do not. The detector only watches a nominee another node confirmed.
+                uint8_t nominee[ESP_NOW_ETH_ALEN];
+                if (!heartbeat_pick_successor(nominee)) {
+                    memcpy(nominee, my_mac, ESP_NOW_ETH_ALEN);
                 }
-                // Build binary election message: [CMD_ELECTION][elected_leader_mac]
+                // Build binary election message: [CMD_ELECTION][nominee]
                 uint8_t election_msg[1 + ESP_NOW_ETH_ALEN];
                 election_msg[0] = CMD_ELECTION;
-                memcpy(election_msg + 1, elected_leader_mac, ESP_NOW_ETH_ALEN);
+                memcpy(election_msg + 1, nominee, ESP_NOW_ETH_ALEN);
                 uint8_t bcast_mac[ESP_NOW_ETH_ALEN] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
                 esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, bcast_mac, election_msg, sizeof(election_msg));
                 if (ret != ESP_OK) 
@@ -700,45 +1573,52 @@ void sensor_blockchain_task(void *pvParameters)
                 } 
                 else 
                 {
-                    ESP_LOGI(TAG, "Sent election message");
+                    EVENT_TRACE(EV_ELECTION_TX, event_trace_mac(nominee), 0);
                 }
-                // Wait additional time for potential leader acknowledgment.
-                vTaskDelay(pdMS_TO_TICKS(5000));
-                if (!waitForElectionMessage(elected_leader_mac, pdMS_TO_TICKS(5000))) 
+                // Collect the other nominations for the discovery window.
+                bool confirmed = false;
+                uint8_t heard[ESP_NOW_ETH_ALEN];
+                TickType_t discovery_start = xTaskGetTickCount();
+                TickType_t discovery_window = pdMS_TO_TICKS(10000);
+                TickType_t elapsed;
+                while ((elapsed = xTaskGetTickCount() - discovery_start) < discovery_window &&
+                       waitForElectionMessage(heard, discovery_window - elapsed)) {
+                    if (memcmp(heard, nominee, ESP_NOW_ETH_ALEN) < 0) {
+                        memcpy(nominee, heard, ESP_NOW_ETH_ALEN);
+                    }
+                    confirmed = true;
+                }
+                memcpy(elected_leader_mac, nominee, ESP_NOW_ETH_ALEN);
+                if (confirmed || memcmp(nominee, my_mac, ESP_NOW_ETH_ALEN) == 0) 
+                {
+                    ESP_LOGI(TAG, "Leader discovery agreed on " MACSTR, MAC2STR(nominee));
+                    heartbeat_set_leader(nominee);
+                } 
+                else if (esp_mesh_lite_get_level() <= 1) // Assuming root if level 0 or 1.
                 {
-                    if (esp_mesh_lite_get_level() <= 1) { // Assuming root if level 0 or 1.
-                        ESP_LOGW(TAG, "No leader discovered. Triggering election as root.");
-                        uint32_t node_count = 0;
-                        node_info_list_t *node_list = esp_mesh_lite_get_nodes_list(&node_count);
-                        if (node_list != NULL && node_count > 0) {
-                            uint32_t index = rand() % node_count;
-                            node_info_list_t *selected = node_list;
-                            for (uint32_t i = 0; i < index; i++) 
-                            {
-                                selected = selected->next;
-                            }
-                            // Build root election message: [CMD_ELECTION][selected node MAC]
-                            uint8_t election_msg_root[1 + ESP_NOW_ETH_ALEN];
-                            election_msg_root[0] = CMD_ELECTION;
-                            memcpy(election_msg_root + 1, selected->node->mac_addr, ESP_NOW_ETH_ALEN);
-                            ESP_LOGI(TAG, "Initiating root election with MAC " MACSTR, MAC2STR(selected->node->mac_addr));
-                            ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, bcast_mac, election_msg_root, sizeof(election_msg_root));
-                            if(ret != ESP_OK) 
-                            {
-                                ESP_LOGE(TAG, "Failed to broadcast election message, err: %s", esp_err_to_name(ret));
-                            }
-                        } 
-                        else 
-                        {
-                            ESP_LOGW(TAG, "No nodes available for election");
-                        }
+                    // Nobody answered; name the nominee again for nodes that missed it, but
+                    // leave the detector off until an election names a leader.
+                    ESP_LOGW(TAG, "No leader discovered. Triggering election as root.");
+                    memcpy(election_msg + 1, nominee, ESP_NOW_ETH_ALEN);
+                    EVENT_TRACE(EV_ELECTION_TX, event_trace_mac(nominee), 0);
+                    ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, bcast_mac, election_msg, sizeof(election_msg));
+                    if (ret != ESP_OK) 
+                    {
+                        ESP_LOGE(TAG, "Failed to broadcast election message, err: %s", esp_err_to_name(ret));
                     }
                 }
             }
         }
         // blockchain_print_history();
 
-        // Wait for 15 seconds before generating the next block.
-        vTaskDelay(pdMS_TO_TICKS(15000));
+        // Wait for 15 seconds before generating the next block. Followers keep listening so a
+        // takeover by the failure detector does not sit out the whole gap.
+        if (consensus_am_i_leader(elected_leader_mac)) {
+            vTaskDelay(pdMS_TO_TICKS(15000));
+        } else if (waitForElectionMessage(elected_leader_mac, pdMS_TO_TICKS(15000))) {
+            heartbeat_set_leader(elected_leader_mac);
+            heartbeat_consume_takeover();
+            ESP_LOGI(TAG, "Leader changed during round gap: " MACSTR, MAC2STR(elected_leader_mac));
+        }
     }
 }
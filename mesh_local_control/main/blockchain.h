@@ -9,6 +9,12 @@
 #define MAX_NEIGHBORS   5   // Maximum number of neighbor RSSI readings per sensor record
 #define HEATMAP_SIZE    3   // Dummy size for heatmap data
 
+// Largest mesh the firmware is sized for: buffers that hold one entry per node, and the
+// largest block, which carries one reading from every node.
+#ifndef MESH_MAX_NODES
+#define MESH_MAX_NODES  256
+#endif
+
 // Structure for a sensor record.
 typedef struct sensor_record {
     uint8_t mac[ESP_NOW_ETH_ALEN];     // Device MAC address
@@ -29,15 +35,46 @@ typedef struct block {
     uint8_t heatmap[HEATMAP_SIZE];     // Dummy heatmap data
     uint8_t hash[32];                  // Block’s hash (computed from contents)
     char pop_proof[64];                // Proof-of-Participation string
-    struct block *next;                // Pointer to the next block in the chain
+    uint8_t records_hash[32];          // Commitment to the sensor records; the block hash covers this
+    bool body_pruned;                  // Light mode: node_data holds only our own records
+    uint32_t refs;                     // Chain and reader references; owned by the chain once added
 } block_t;
 
+// A competing branch is only considered whole: all its blocks above the fork point must sit
+// in the pool together. A fork that left our chain more than BLOCKCHAIN_FORK_POOL blocks
+// below its tip can therefore never reorganize us, however long it grows; such a node stays
+// on its own chain until it is reset (CMD_RESET_BLOCKCHAIN).
+#define BLOCKCHAIN_FORK_POOL    16  // Competing or unlinked blocks held aside; also the deepest fork we can switch to
+#define BLOCKCHAIN_FORK_FETCH   4   // Ancestors asked for at a time when a fork does not reach our chain yet
+
+// Where blockchain_add_block() put a block. Anything but REJECTED means the store took
+// ownership; REJECTED (a duplicate, or no room) leaves the block with the caller.
+typedef enum {
+    BLOCKCHAIN_ADD_REJECTED = 0,
+    BLOCKCHAIN_ADD_CHAINED,     // Linked into the chain at its block number
+    BLOCKCHAIN_ADD_FORKED,      // Held in the fork pool; the chain is unchanged
+    BLOCKCHAIN_ADD_REORGED,     // Its branch won fork choice and replaced the chain's top
+} blockchain_add_result_t;
+
+// Chain store counters since boot.
+typedef struct {
+    uint32_t reorgs;
+    uint32_t deepest_reorg;             // Most blocks one reorganization dropped
+    uint32_t fork_evictions;            // Pooled blocks dropped to make room for another
+    uint32_t chunk_splits;              // Full chunks split to insert a block below the tip
+} blockchain_stats_t;
+
+// Inclusive run of block numbers, used to describe gaps in the local chain.
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} block_range_t;
+
 // Public blockchain API.
 uint32_t blockchain_init(void);
 void blockchain_deinit(void);
 void blockchain_create_block(block_t *new_block, sensor_record_t sensor_data[MAX_NODES]);
-bool blockchain_add_block(block_t *new_block);
-bool blockchain_insert_block(block_t *block);
+blockchain_add_result_t blockchain_add_block(block_t *new_block);
 bool blockchain_get_last_block(block_t *block_out);
 void blockchain_print_history(void);
 void blockchain_print_block_struct(block_t *block);
@@ -45,11 +82,40 @@ void blockchain_receive_block(const uint8_t *data, uint16_t len);
 void sensor_blockchain_task(void *pvParameters);
 void mesh_networking_task(void *pvParameters);
 void calculate_block_hash(block_t *block);
+void blockchain_hash_records(block_t *block);
 block_t *blockchain_parse_received_serialized_block(const uint8_t *serialized_data, int payload_len);
 size_t blockchain_serialize_block(const block_t *block, uint8_t **out_buffer);
+// Free a block the chain does not hold, with its sensor records. Blocks from
+// blockchain_parse_received_serialized_block() and buffers from blockchain_serialize_block()
+// come from mem_track and must not go to free().
+void blockchain_free_block(block_t *block);
 bool blockchain_get_block_by_number(uint32_t block_num, block_t *block_out);
+size_t blockchain_get_missing_ranges(uint32_t from, uint32_t up_to, block_range_t *out, size_t max_ranges);
+// Swap a stored block for another copy with the same number and hash, e.g. with its body
+// pruned or restored. Takes ownership on success.
+bool blockchain_replace_block(block_t *replacement);
+// Numbers of the lowest and highest blocks in the chain, from one snapshot; false if empty.
+bool blockchain_get_bounds(uint32_t *first, uint32_t *tip);
+// Blocks to fetch so a pooled fork reaches back to our chain; false if none is waiting.
+bool blockchain_get_fork_gap(block_range_t *out);
+void blockchain_get_stats(blockchain_stats_t *out);
+
+// Zero-copy access to committed blocks. The returned block is immutable and stays valid,
+// even across a chain reset, until released; readers never wait on the writer. NULL if absent.
+const block_t *blockchain_acquire_block(uint32_t block_num);
+const block_t *blockchain_acquire_tip(void);
+// Up to `max_blocks` consecutive chain entries from the first numbered >= `first`, all from
+// one snapshot. Each must be released.
+size_t blockchain_acquire_range(uint32_t first, const block_t **out, size_t max_blocks);
+void blockchain_release_block(const block_t *block);
 
 // Helper: size of a sensor record (excluding the pointer)
 static const size_t sensor_size = sizeof(uint8_t)*ESP_NOW_ETH_ALEN + sizeof(uint32_t) + sizeof(float)*2 + (MAX_NEIGHBORS*sizeof(int8_t));
 
+// Serialized sizes as constant expressions, for limits fixed at compile time: block_num,
+// timestamp and num_sensor_readings, both hashes, pop_proof and the heatmap, then the records.
+#define BLOCK_SERIALIZED_HEADER_LEN (3 * sizeof(uint32_t) + 2 * 32 + 64 + HEATMAP_SIZE)
+#define BLOCK_SERIALIZED_RECORD_LEN (ESP_NOW_ETH_ALEN + sizeof(uint32_t) + 2 * sizeof(float) + MAX_NEIGHBORS)
+#define BLOCK_SERIALIZED_MAX_LEN    (BLOCK_SERIALIZED_HEADER_LEN + MESH_MAX_NODES * BLOCK_SERIALIZED_RECORD_LEN)
+
 #endif // BLOCKCHAIN_H
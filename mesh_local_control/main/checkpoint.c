@@ -0,0 +1,395 @@
+#include "checkpoint.h"
+#include "node_local.h"
+#include "blockchain.h"
+#include "block_sync.h"
+#include "mesh_networking.h"
+#include "command_set.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mbedtls/sha256.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "checkpoint";
+
+// Accumulator over the contiguous chain from block 0, or from the anchor checkpoint.
+typedef struct {
+    bool valid;
+    uint32_t height;
+    uint8_t block_hash[32];     // Hash of block `height`, to notice reorgs
+    uint8_t accumulator[32];
+    uint32_t total_readings;
+} checkpoint_acc_t;
+
+static NODE_LOCAL SemaphoreHandle_t checkpoint_mutex = NULL;
+static NODE_LOCAL checkpoint_acc_t acc = {0};
+static NODE_LOCAL checkpoint_t history[CHECKPOINT_HISTORY];   // Oldest first
+static NODE_LOCAL int history_count = 0;
+static NODE_LOCAL checkpoint_t anchor;
+static NODE_LOCAL uint8_t leader[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL uint32_t last_tip = 0;
+static NODE_LOCAL int64_t bootstrap_requested_us = 0;          // 0 until we ask; one attempt per empty chain
+static NODE_LOCAL uint8_t bootstrap_peer[ESP_NOW_ETH_ALEN] = {0}; // The node asked; only its reply is taken
+static NODE_LOCAL checkpoint_stats_t stats = {0};
+
+static void checkpoint_commit(checkpoint_t *cp, uint8_t out[32])
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, (const uint8_t *)&cp->height, sizeof(cp->height));
+    mbedtls_sha256_update(&ctx, cp->tip_hash, sizeof(cp->tip_hash));
+    mbedtls_sha256_update(&ctx, cp->accumulator, sizeof(cp->accumulator));
+    mbedtls_sha256_update(&ctx, (const uint8_t *)&cp->total_readings, sizeof(cp->total_readings));
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+}
+
+static void checkpoint_fold(uint8_t accumulator[32], const uint8_t block_hash[32])
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, accumulator, 32);
+    mbedtls_sha256_update(&ctx, block_hash, 32);
+    mbedtls_sha256_finish(&ctx, accumulator);
+    mbedtls_sha256_free(&ctx);
+}
+
+// Caller holds checkpoint_mutex.
+static void checkpoint_acc_from_locked(const checkpoint_t *cp)
+{
+    acc.valid = true;
+    acc.height = cp->height;
+    memcpy(acc.block_hash, cp->tip_hash, sizeof(acc.block_hash));
+    memcpy(acc.accumulator, cp->accumulator, sizeof(acc.accumulator));
+    acc.total_readings = cp->total_readings;
+}
+
+static void checkpoint_push_locked(const checkpoint_t *cp)
+{
+    if (history_count == CHECKPOINT_HISTORY) {
+        memmove(history, history + 1, (CHECKPOINT_HISTORY - 1) * sizeof(checkpoint_t));
+        history_count--;
+    }
+    history[history_count++] = *cp;
+}
+
+static bool checkpoint_on_chain(const checkpoint_t *cp)
+{
+    const block_t *block = blockchain_acquire_block(cp->height);
+    bool match = block && memcmp(block->hash, cp->tip_hash, sizeof(cp->tip_hash)) == 0;
+    blockchain_release_block(block);
+    return match;
+}
+
+// The block the accumulator ends at is gone: rewind to the newest checkpoint still on the
+// chain, else start over from the anchor or block 0. Caller holds checkpoint_mutex.
+static void checkpoint_rollback_locked(void)
+{
+    stats.rollbacks++;
+    while (history_count > 0 && !checkpoint_on_chain(&history[history_count - 1])) {
+        history_count--;
+    }
+    if (history_count > 0) {
+        checkpoint_acc_from_locked(&history[history_count - 1]);
+    } else if (stats.anchored && checkpoint_on_chain(&anchor)) {
+        checkpoint_acc_from_locked(&anchor);
+        history[history_count++] = anchor;
+    } else {
+        acc.valid = false;
+    }
+    if (acc.valid) {
+        ESP_LOGW(TAG, "Chain changed; accumulator rewound to block %" PRIu32, acc.height);
+    } else {
+        ESP_LOGW(TAG, "Chain changed; accumulator restarts from the beginning");
+    }
+}
+
+void checkpoint_update(void)
+{
+    if (!checkpoint_mutex) {
+        return;
+    }
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    const block_t *tip = blockchain_acquire_tip();
+    if (!tip) {
+        // Chain reset: forget everything, including the anchor, and bootstrap again.
+        memset(&acc, 0, sizeof(acc));
+        history_count = 0;
+        stats.anchored = false;
+        stats.anchor_height = 0;
+        bootstrap_requested_us = 0;
+        xSemaphoreGive(checkpoint_mutex);
+        return;
+    }
+    blockchain_release_block(tip);
+
+    if (acc.valid) {
+        const block_t *last = blockchain_acquire_block(acc.height);
+        bool same = last && memcmp(last->hash, acc.block_hash, sizeof(acc.block_hash)) == 0;
+        blockchain_release_block(last);
+        if (!last && stats.anchored && acc.height == anchor.height) {
+            // The anchor block itself is not in yet.
+            xSemaphoreGive(checkpoint_mutex);
+            return;
+        }
+        if (!same) {
+            checkpoint_rollback_locked();
+        }
+    }
+    if (!acc.valid && stats.anchored) {
+        if (!checkpoint_on_chain(&anchor)) {
+            xSemaphoreGive(checkpoint_mutex);
+            return;
+        }
+        checkpoint_acc_from_locked(&anchor);
+        history[history_count++] = anchor;
+    }
+
+    // Fold in every block above the accumulator, up to the first gap.
+    const block_t *blocks[16];
+    uint32_t next = acc.valid ? acc.height + 1 : 0;
+    size_t count;
+    bool gap = false;
+    while (!gap && (count = blockchain_acquire_range(next, blocks, 16)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const block_t *block = blocks[i];
+            if (!gap && block->block_num == next &&
+                (!acc.valid || memcmp(block->prev_hash, acc.block_hash, sizeof(acc.block_hash)) == 0)) {
+                if (!acc.valid) {
+                    memset(acc.accumulator, 0, sizeof(acc.accumulator));    // H_-1
+                    acc.total_readings = 0;
+                    acc.valid = true;
+                }
+                checkpoint_fold(acc.accumulator, block->hash);
+                acc.height = block->block_num;
+                memcpy(acc.block_hash, block->hash, sizeof(acc.block_hash));
+                acc.total_readings += block->num_sensor_readings;
+                next++;
+                if (acc.height > 0 && acc.height % CHECKPOINT_INTERVAL == 0) {
+                    checkpoint_t cp;
+                    cp.height = acc.height;
+                    memcpy(cp.tip_hash, acc.block_hash, sizeof(cp.tip_hash));
+                    memcpy(cp.accumulator, acc.accumulator, sizeof(cp.accumulator));
+                    cp.total_readings = acc.total_readings;
+                    checkpoint_commit(&cp, cp.commit);
+                    checkpoint_push_locked(&cp);
+                    stats.created++;
+                    ESP_LOGI(TAG, "Checkpoint at block %" PRIu32 " (%" PRIu32 " readings)", cp.height, cp.total_readings);
+                }
+            } else {
+                gap = true;
+            }
+            blockchain_release_block(block);
+        }
+    }
+    xSemaphoreGive(checkpoint_mutex);
+}
+
+bool checkpoint_get_latest(checkpoint_t *out)
+{
+    bool found = false;
+    if (!checkpoint_mutex) {
+        return false;
+    }
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    if (history_count > 0) {
+        *out = history[history_count - 1];
+        found = true;
+    }
+    xSemaphoreGive(checkpoint_mutex);
+    return found;
+}
+
+void checkpoint_init(void)
+{
+    if (checkpoint_mutex) {
+        return;
+    }
+    checkpoint_mutex = xSemaphoreCreateMutex();
+    if (!checkpoint_mutex) {
+        ESP_LOGE(TAG, "Failed to create checkpoint mutex");
+    }
+}
+
+void checkpoint_note_tip(const uint8_t *leader_mac, uint32_t tip)
+{
+    if (!checkpoint_mutex) {
+        return;
+    }
+    const block_t *ours = blockchain_acquire_tip();
+    bool empty = (ours == NULL);
+    blockchain_release_block(ours);
+
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    memcpy(leader, leader_mac, ESP_NOW_ETH_ALEN);
+    last_tip = tip;
+    bool ask = empty && !stats.anchored && bootstrap_requested_us == 0 && tip >= CHECKPOINT_INTERVAL;
+    if (ask) {
+        bootstrap_requested_us = esp_timer_get_time();
+        memcpy(bootstrap_peer, leader_mac, ESP_NOW_ETH_ALEN);
+    }
+    xSemaphoreGive(checkpoint_mutex);
+
+    if (ask) {
+        uint8_t msg = CMD_CHECKPOINT_REQ;
+        ESP_LOGI(TAG, "Empty chain, leader at block %" PRIu32 "; asking " MACSTR " for a checkpoint", tip, MAC2STR(leader_mac));
+        esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, leader_mac, &msg, 1);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send checkpoint request: %s", esp_err_to_name(ret));
+        }
+    }
+}
+
+uint32_t checkpoint_history_floor(void)
+{
+    uint32_t floor = 0;
+    if (!checkpoint_mutex) {
+        return 0;
+    }
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    if (stats.anchored) {
+        floor = stats.anchor_height;
+    }
+    xSemaphoreGive(checkpoint_mutex);
+    return floor;
+}
+
+bool checkpoint_bootstrapping(void)
+{
+    bool waiting = false;
+    if (!checkpoint_mutex) {
+        return false;
+    }
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    waiting = !stats.anchored && bootstrap_requested_us != 0 &&
+              esp_timer_get_time() - bootstrap_requested_us < (int64_t)CHECKPOINT_WAIT_MS * 1000;
+    xSemaphoreGive(checkpoint_mutex);
+    return waiting;
+}
+
+void checkpoint_fetch_history(uint32_t block_num)
+{
+    if (!checkpoint_mutex) {
+        return;
+    }
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    bool below = stats.anchored && block_num < stats.anchor_height;
+    uint32_t floor = stats.anchor_height;
+    uint8_t peer[ESP_NOW_ETH_ALEN];
+    memcpy(peer, leader, sizeof(peer));
+    xSemaphoreGive(checkpoint_mutex);
+    if (!below) {
+        return;
+    }
+    block_range_t range = { .first = block_num, .last = block_num + CHECKPOINT_LAZY_FETCH - 1 };
+    if (range.last >= floor) {
+        range.last = floor - 1;
+    }
+    block_sync_request_range(peer, range);
+}
+
+void checkpoint_on_request(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    checkpoint_t cp;
+    if (!checkpoint_get_latest(&cp)) {
+        return;     // The joiner falls back to a full sync after CHECKPOINT_WAIT_MS
+    }
+    uint8_t msg[CHECKPOINT_MSG_LEN];
+    size_t offset = 0;
+    msg[offset++] = CMD_CHECKPOINT;
+    memcpy(msg + offset, &cp.height, sizeof(cp.height));
+    offset += sizeof(cp.height);
+    memcpy(msg + offset, cp.tip_hash, sizeof(cp.tip_hash));
+    offset += sizeof(cp.tip_hash);
+    memcpy(msg + offset, cp.accumulator, sizeof(cp.accumulator));
+    offset += sizeof(cp.accumulator);
+    memcpy(msg + offset, &cp.total_readings, sizeof(cp.total_readings));
+    offset += sizeof(cp.total_readings);
+    memcpy(msg + offset, cp.commit, sizeof(cp.commit));
+    offset += sizeof(cp.commit);
+    esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, src_mac, msg, offset);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send checkpoint to " MACSTR ": %s", MAC2STR(src_mac), esp_err_to_name(ret));
+        return;
+    }
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    stats.served++;
+    xSemaphoreGive(checkpoint_mutex);
+}
+
+void checkpoint_on_checkpoint(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!checkpoint_mutex || len != (int)CHECKPOINT_MSG_LEN) {
+        return;
+    }
+    checkpoint_t cp;
+    size_t offset = 1;
+    memcpy(&cp.height, data + offset, sizeof(cp.height));
+    offset += sizeof(cp.height);
+    memcpy(cp.tip_hash, data + offset, sizeof(cp.tip_hash));
+    offset += sizeof(cp.tip_hash);
+    memcpy(cp.accumulator, data + offset, sizeof(cp.accumulator));
+    offset += sizeof(cp.accumulator);
+    memcpy(&cp.total_readings, data + offset, sizeof(cp.total_readings));
+    offset += sizeof(cp.total_readings);
+    memcpy(cp.commit, data + offset, sizeof(cp.commit));
+
+    uint8_t expected[32];
+    checkpoint_commit(&cp, expected);
+    const block_t *ours = blockchain_acquire_tip();
+    bool empty = (ours == NULL);
+    blockchain_release_block(ours);
+
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    // The commit proves nothing about the sender, so only the reply to our own request counts:
+    // from the node we asked, while block sync is still waiting for it.
+    bool solicited = !stats.anchored && bootstrap_requested_us != 0 &&
+                     esp_timer_get_time() - bootstrap_requested_us < (int64_t)CHECKPOINT_WAIT_MS * 1000 &&
+                     memcmp(src_mac, bootstrap_peer, ESP_NOW_ETH_ALEN) == 0;
+    if (!solicited) {
+        stats.unsolicited++;
+        xSemaphoreGive(checkpoint_mutex);
+        ESP_LOGD(TAG, "Ignoring checkpoint from " MACSTR ": not the reply we are waiting for", MAC2STR(src_mac));
+        return;
+    }
+    if (memcmp(expected, cp.commit, sizeof(expected)) != 0) {
+        stats.rejected++;
+        xSemaphoreGive(checkpoint_mutex);
+        ESP_LOGW(TAG, "Checkpoint from " MACSTR " does not match its commit", MAC2STR(src_mac));
+        return;
+    }
+    if (!empty) {
+        xSemaphoreGive(checkpoint_mutex);
+        return;
+    }
+    // Anchor here: the accumulator resumes from the checkpoint once its block arrives, and
+    // block_sync fills gaps from this height up only.
+    anchor = cp;
+    stats.anchored = true;
+    stats.anchor_height = cp.height;
+    history_count = 0;
+    history[history_count++] = cp;
+    checkpoint_acc_from_locked(&cp);
+    uint32_t up_to = (last_tip > cp.height) ? last_tip : cp.height;
+    xSemaphoreGive(checkpoint_mutex);
+
+    ESP_LOGI(TAG, "Anchored at checkpoint %" PRIu32 " from " MACSTR "; fetching blocks %" PRIu32 "-%" PRIu32,
+             cp.height, MAC2STR(src_mac), cp.height, up_to);
+    block_sync_request_missing(src_mac, up_to);
+}
+
+void checkpoint_get_stats(checkpoint_stats_t *out)
+{
+    if (!checkpoint_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(checkpoint_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(checkpoint_mutex);
+}
@@ -0,0 +1,67 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Every node folds its chain into a running accumulator H_n = SHA256(H_{n-1} || hash_n) and
+// records a checkpoint every CHECKPOINT_INTERVAL blocks. A node joining with an empty chain
+// asks the leader for its latest checkpoint, anchors there and fetches only the blocks after
+// it; history below the anchor is fetched only if something asks for it.
+#define CHECKPOINT_INTERVAL     32
+#define CHECKPOINT_HISTORY      4       // Recent checkpoints kept, to fall back to after a reorg
+#define CHECKPOINT_WAIT_MS      3000    // Block sync waits this long for a checkpoint before syncing everything
+#define CHECKPOINT_LAZY_FETCH   8       // Blocks below the anchor fetched per lazy request
+
+// Checkpoint: [CMD_CHECKPOINT][u32 height][tip hash][accumulator][u32 total readings][commit]
+// The commit is SHA256 over the fields before it. It is an integrity check against corruption,
+// not a signature: anyone can build a valid one. A joiner therefore takes only the reply from
+// the leader it asked, within CHECKPOINT_WAIT_MS, and trusts that leader as it trusts its blocks.
+#define CHECKPOINT_MSG_LEN      (1 + 2 * sizeof(uint32_t) + 3 * 32)
+
+typedef struct {
+    uint32_t height;            // Number of the block the checkpoint ends at
+    uint8_t tip_hash[32];       // That block's hash
+    uint8_t accumulator[32];    // H_height
+    uint32_t total_readings;    // Sensor readings in blocks [0, height]
+    uint8_t commit[32];
+} checkpoint_t;
+
+typedef struct {
+    uint32_t created;
+    uint32_t served;
+    uint32_t rejected;          // Received checkpoints whose commit did not match
+    uint32_t unsolicited;       // Received checkpoints not from the node asked, or with no request outstanding
+    uint32_t rollbacks;         // Accumulator rewound because the chain changed under it
+    bool anchored;              // We joined from a checkpoint
+    uint32_t anchor_height;
+} checkpoint_stats_t;
+
+void checkpoint_init(void);
+
+// Fold newly committed blocks into the accumulator; called after each verifier run.
+void checkpoint_update(void);
+
+// Latest checkpoint we hold; false if none.
+bool checkpoint_get_latest(checkpoint_t *out);
+
+// Called with the tip advertised in the leader's heartbeat; asks for a checkpoint when we
+// have no chain yet.
+void checkpoint_note_tip(const uint8_t *leader_mac, uint32_t tip);
+
+// Lowest block number block_sync should fill gaps from: the anchor, or 0.
+uint32_t checkpoint_history_floor(void);
+
+// True while we wait for a checkpoint reply, so block_sync does not start a full sync.
+bool checkpoint_bootstrapping(void);
+
+// Fetch history below our anchor that something asked us for.
+void checkpoint_fetch_history(uint32_t block_num);
+
+// Called from the receive path.
+void checkpoint_on_request(const uint8_t *src_mac, const uint8_t *data, int len);
+void checkpoint_on_checkpoint(const uint8_t *src_mac, const uint8_t *data, int len);
+
+void checkpoint_get_stats(checkpoint_stats_t *out);
+
+#endif // CHECKPOINT_H
@@ -12,5 +12,13 @@
 #define CMD_RESET_BLOCKCHAIN        0x08
 #define CMD_REQUEST_SPECIFIC_BLOCK  0x09
 #define CMD_HISTORICAL_BLOCK        0x0A 
+#define CMD_HEARTBEAT               0x0B
+#define CMD_AGG_DATA                0x0C
+#define CMD_REQUEST_BLOCK_SET       0x0D
+#define CMD_BLOCK_FRAGMENT          0x0E
+#define CMD_BLOCK_NACK              0x0F
+#define CMD_CHECKPOINT_REQ          0x10
+#define CMD_CHECKPOINT              0x11
+#define CMD_BLOCK_REPLY_FRAGMENT    0x12
 
 #endif
\ No newline at end of file
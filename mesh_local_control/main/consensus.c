@@ -1,4 +1,5 @@
 #include "consensus.h"
+#include "node_local.h"
 #include "mesh_networking.h"
 #include "esp_log.h"
 #include <stdio.h>
@@ -9,10 +10,11 @@
 #include <inttypes.h>
 #include "esp_mesh_lite.h"
 #include "election_response.h"
+#include "event_trace.h"
 
 static const char *TAG = "CONSENSUS";
 // Removed my_node_id; instead store the local MAC.
-static uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
 
 void consensus_init(void)
 {
@@ -34,7 +36,7 @@ void consensus_generate_pop_proof(block_t *block, const uint8_t *leader_mac)
     snprintf(block->pop_proof, sizeof(block->pop_proof),
              "Leader:" MACSTR ";Time:%" PRIu32 ";Nonce:%" PRIu32,
              MAC2STR(leader_mac), block->timestamp, nonce);
-    ESP_LOGI(TAG, "Generated PoP proof for block (Time: %" PRIu32 "): %s", block->timestamp, block->pop_proof);
+    EVENT_TRACE(EV_POP, block->timestamp, nonce);
 }
 
 bool consensus_verify_block(block_t *block, sensor_record_t *my_sensor_data)
@@ -0,0 +1,80 @@
+#include "deferred_log.h"
+#include "node_local.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <string.h>
+
+static const char *TAG = "deferred_log";
+
+static NODE_LOCAL QueueHandle_t log_queue = NULL;
+static NODE_LOCAL deferred_log_stats_t stats;
+
+static void deferred_log_write(const deferred_log_record_t *r)
+{
+#define DEFERRED_LOG_UNPACK(...) __VA_ARGS__
+#define DEFERRED_LOG_CASE(id, level, tag, format, args) \
+    case id: ESP_LOG_LEVEL_LOCAL(level, tag, format, DEFERRED_LOG_UNPACK args); break;
+    switch ((deferred_log_id_t)r->id) {
+        DEFERRED_LOG_MESSAGES(DEFERRED_LOG_CASE)
+        default:
+            ESP_LOGW(TAG, "Unknown deferred message %u", r->id);
+            break;
+    }
+#undef DEFERRED_LOG_CASE
+#undef DEFERRED_LOG_UNPACK
+}
+
+static void deferred_log_task(void *arg)
+{
+    uint32_t dropped_reported = 0;
+    deferred_log_record_t r;
+    while (1) {
+        if (xQueueReceive(log_queue, &r, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        uint32_t dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+        if (dropped != dropped_reported) {
+            ESP_LOGW(TAG, "%" PRIu32 " deferred log line(s) dropped", dropped - dropped_reported);
+            dropped_reported = dropped;
+        }
+        deferred_log_write(&r);
+    }
+}
+
+void deferred_log_init(void)
+{
+    if (log_queue) {
+        return;
+    }
+    log_queue = xQueueCreate(DEFERRED_LOG_QUEUE_LENGTH, sizeof(deferred_log_record_t));
+    if (!log_queue) {
+        ESP_LOGE(TAG, "Failed to create deferred log queue");
+        return;
+    }
+    // Below every protocol task: lines are written when nothing else wants the CPU.
+    xTaskCreate(deferred_log_task, "deferred_log_task", 3072, NULL, 1, NULL);
+}
+
+void deferred_log_push(deferred_log_id_t id, const uint8_t *mac, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    deferred_log_record_t r = {
+        .id = (uint8_t)id,
+        .a = {a0, a1, a2},
+    };
+    if (mac) {
+        memcpy(r.mac, mac, sizeof(r.mac));
+    }
+    if (!log_queue || xQueueSend(log_queue, &r, 0) != pdPASS) {
+        __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_fetch_add(&stats.queued, 1, __ATOMIC_RELAXED);
+}
+
+void deferred_log_get_stats(deferred_log_stats_t *out)
+{
+    out->queued = __atomic_load_n(&stats.queued, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+}
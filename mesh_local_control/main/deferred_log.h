@@ -0,0 +1,107 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+
+// Deferred log formatting for the receive and transmit paths. A call site queues a message id,
+// an optional MAC and three integer arguments; a low-priority task formats and writes the line
+// later, so the radio callback never runs vsnprintf or waits on the console. If the queue is
+// full the line is dropped and counted, and the drop count is logged with the next line out.
+//
+// The call site's LOG_LOCAL_LEVEL (see log_level.h) still applies, so a message above its
+// module's compile-time level costs nothing. The tag's run-time level is checked when the
+// line is formatted.
+#ifndef DEFERRED_LOG_QUEUE_LENGTH
+#define DEFERRED_LOG_QUEUE_LENGTH   32
+#endif
+
+// X(id, level, tag, format, arguments). Arguments are expressions over the queued record `r`:
+// r->mac and r->a[0..2]. Error codes travel as integers and are named when formatted.
+#define DEFERRED_LOG_MESSAGES(X) \
+    X(DLOG_BLOCK_HASH_MISMATCH, ESP_LOG_ERROR, "mesh_networking", \
+      "Block %" PRIu32 " from " MACSTR " failed hash validation", (r->a[0], MAC2STR(r->mac))) \
+    X(DLOG_HISTORICAL_HASH_MISMATCH, ESP_LOG_ERROR, "mesh_networking", \
+      "Historical block %" PRIu32 " from " MACSTR " failed hash validation", (r->a[0], MAC2STR(r->mac))) \
+    X(DLOG_BLOCK_AHEAD, ESP_LOG_WARN, "mesh_networking", \
+      "Block number mismatch. Expected: %" PRIu32 ", got: %" PRIu32, (r->a[0], r->a[1])) \
+    X(DLOG_CHAIN_RESP_FAILED, ESP_LOG_ERROR, "mesh_networking", \
+      "Failed to send blockchain sync response to " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_ELECTION_SHORT, ESP_LOG_ERROR, "mesh_networking", \
+      "Election message too short from " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_SENSOR_BAD_LENGTH, ESP_LOG_ERROR, "mesh_networking", \
+      "Invalid sensor data length from " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_REQUEST_BAD_LENGTH, ESP_LOG_ERROR, "mesh_networking", \
+      "Invalid block request length from " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_PULSE_INVALID, ESP_LOG_ERROR, "aggregation", \
+      "Invalid pulse from " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_AGG_SHORT, ESP_LOG_ERROR, "aggregation", \
+      "Aggregate too short from " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_AGG_SIZE_MISMATCH, ESP_LOG_ERROR, "aggregation", \
+      "Aggregate size mismatch from " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_AGG_STALE, ESP_LOG_WARN, "aggregation", \
+      "Dropping aggregate for stale round %" PRIu32, (r->a[0])) \
+    X(DLOG_AGG_FORWARDED, ESP_LOG_INFO, "aggregation", \
+      "Round %" PRIu32 ": forwarded %" PRIu32 " readings to " MACSTR, (r->a[0], r->a[1], MAC2STR(r->mac))) \
+    X(DLOG_AGG_SEND_FAILED, ESP_LOG_ERROR, "aggregation", \
+      "Failed to send aggregate to " MACSTR ": %s", (MAC2STR(r->mac), esp_err_to_name((esp_err_t)r->a[0]))) \
+    X(DLOG_TX_PEER_READDED, ESP_LOG_INFO, "espnow_tx", \
+      "Peer not found, re-adding peer: " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_TX_RESEND_FAILED, ESP_LOG_ERROR, "espnow_tx", \
+      "Failed to re-send ESPNOW msg to " MACSTR ": %s", (MAC2STR(r->mac), esp_err_to_name((esp_err_t)r->a[0]))) \
+    X(DLOG_TX_GAVE_UP, ESP_LOG_WARN, "espnow_tx", \
+      "Giving up on frame 0x%02" PRIx32 " to " MACSTR " after %" PRIu32 " attempts", \
+      (r->a[0], MAC2STR(r->mac), r->a[1])) \
+    X(DLOG_FRAGMENT_MALFORMED, ESP_LOG_ERROR, "block_broadcast", \
+      "Malformed fragment from " MACSTR, (MAC2STR(r->mac))) \
+    X(DLOG_NACK_SENT, ESP_LOG_INFO, "block_broadcast", \
+      "NACK block %" PRIu32 " for %" PRIu32 " fragment(s)", (r->a[0], r->a[1])) \
+    X(DLOG_NACK_FAILED, ESP_LOG_ERROR, "block_broadcast", \
+      "Failed to send NACK: %s", (esp_err_to_name((esp_err_t)r->a[0]))) \
+    X(DLOG_BLOCK_REPAIRED, ESP_LOG_INFO, "block_broadcast", \
+      "Repaired block %" PRIu32 " (%" PRIu32 " fragments)", (r->a[0], r->a[1]))
+
+#define DEFERRED_LOG_ID(id, level, tag, format, args) id,
+typedef enum {
+    DEFERRED_LOG_MESSAGES(DEFERRED_LOG_ID)
+    DEFERRED_LOG_MESSAGE_COUNT,
+} deferred_log_id_t;
+#undef DEFERRED_LOG_ID
+
+// Each message's level as a constant, so DEFERRED_LOG() can test it against LOG_LOCAL_LEVEL.
+#define DEFERRED_LOG_LEVEL(id, level, tag, format, args) id##_LEVEL = level,
+enum {
+    DEFERRED_LOG_MESSAGES(DEFERRED_LOG_LEVEL)
+};
+#undef DEFERRED_LOG_LEVEL
+
+typedef struct {
+    uint8_t id;
+    uint8_t mac[ESP_NOW_ETH_ALEN];      // Zeros when the message has none
+    uint8_t reserved;
+    uint32_t a[3];
+} deferred_log_record_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t dropped;                   // Queue full, or logged before deferred_log_init()
+} deferred_log_stats_t;
+
+#define DEFERRED_LOG(id, mac, a0, a1, a2) do {                                         \
+        if (LOG_LOCAL_LEVEL >= id##_LEVEL) {                                            \
+            deferred_log_push((id), (mac), (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2)); \
+        }                                                                               \
+    } while (0)
+
+void deferred_log_init(void);
+
+// Never blocks; safe from any task and the Wi-Fi callbacks. Use DEFERRED_LOG() instead.
+void deferred_log_push(deferred_log_id_t id, const uint8_t *mac, uint32_t a0, uint32_t a1, uint32_t a2);
+
+void deferred_log_get_stats(deferred_log_stats_t *out);
+
+#endif // DEFERRED_LOG_H
@@ -1,13 +1,20 @@
 #include "election_response.h"
+#include "node_local.h"
+#include "metrics.h"
+#include "mem_track.h"
 #include <string.h>
 
-static QueueHandle_t electionQueue = NULL;
+static NODE_LOCAL QueueHandle_t electionQueue = NULL;
 
 void election_response_push(const uint8_t *src_mac, const uint8_t *leader_mac) {
     if (!electionQueue) return;
     election_message_t msg;
     memcpy(msg.leader_mac, leader_mac, sizeof(msg.leader_mac));
-    xQueueSend(electionQueue, &msg, 0);
+    if (xQueueSend(electionQueue, &msg, 0) != pdPASS) {
+        metrics_count(METRICS_ELECTION_QUEUE_FULL);
+        return;
+    }
+    metrics_high_water(METRICS_GAUGE_ELECTION_QUEUE_HWM, uxQueueMessagesWaiting(electionQueue));
 }
 
 bool waitForElectionMessage(uint8_t *leader_mac, TickType_t timeout) {
@@ -20,8 +27,17 @@ bool waitForElectionMessage(uint8_t *leader_mac, TickType_t timeout) {
     return false;
 }
 
+void election_response_flush(void) {
+    if (electionQueue) {
+        xQueueReset(electionQueue);
+    }
+}
+
 void election_response_init(void) {
     if (!electionQueue) {
         electionQueue = xQueueCreate(ELECTION_QUEUE_LENGTH, sizeof(election_message_t));
+        if (electionQueue) {
+            mem_track_note(MEM_TAG_QUEUES, ELECTION_QUEUE_LENGTH * sizeof(election_message_t));
+        }
     }
 }
@@ -18,5 +18,7 @@ typedef struct {
 bool waitForElectionMessage(uint8_t *leader_mac, TickType_t timeout);
 void election_response_push(const uint8_t *src_mac, const uint8_t *leader_mac);
 void election_response_init(void);
+// Drop queued elections; a leader calls this before naming its successor.
+void election_response_flush(void);
 
 #endif // ELECTION_RESPONSE_H
@@ -0,0 +1,505 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_ESPNOW_TX
+#include "espnow_tx.h"
+#include "node_local.h"
+#include "peer_cache.h"
+#include "command_set.h"
+#include "mesh_frame.h"
+#include "frame_trace.h"
+#include "metrics.h"
+#include "deferred_log.h"
+#include "mem_track.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_mesh_lite.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdbool.h>
+
+static const char *TAG = "espnow_tx";
+
+typedef struct {
+    uint8_t type;
+    uint8_t dest[ESP_NOW_ETH_ALEN];
+    uint16_t len;
+    uint8_t data[ESPNOW_TX_MAX_FRAME];
+} tx_frame_t;
+
+// An unacknowledged unicast waiting out its backoff. It competes with its class queue
+// again once due, so the backoff never holds up other frames.
+typedef struct {
+    tx_frame_t frame;
+    espnow_tx_class_t cls;
+    uint8_t attempts;       // Sends so far
+    int64_t due_us;
+    bool in_use;
+} tx_retry_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int64_t last_tx_us;
+    bool in_use;
+} pacing_slot_t;
+
+static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// Token bucket, counting bytes for a class budget or frames for a broadcast budget.
+typedef struct {
+    float tokens;           // What the class may still send right now
+    int64_t refill_us;
+    uint32_t per_sec;
+    uint32_t burst;
+} class_budget_t;
+
+static NODE_LOCAL QueueHandle_t tx_queues[ESPNOW_TX_CLASS_COUNT] = {NULL};
+static NODE_LOCAL SemaphoreHandle_t tx_pending = NULL;    // Counts frames across all class queues
+static NODE_LOCAL QueueHandle_t tx_status_queue = NULL;   // Send callback -> transmit task
+static NODE_LOCAL SemaphoreHandle_t stats_mutex = NULL;
+static NODE_LOCAL espnow_tx_stats_t stats = {0};
+
+// Only touched by the transmit task (and the send callback for inflight_dest).
+static NODE_LOCAL uint8_t inflight_dest[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL pacing_slot_t pacing[ESPNOW_TX_PACING_SLOTS];
+static NODE_LOCAL tx_retry_t retry_slots[ESPNOW_TX_RETRY_SLOTS];
+static NODE_LOCAL class_budget_t budgets[ESPNOW_TX_CLASS_COUNT] = {
+    [ESPNOW_TX_CLASS_CONTROL] = {ESPNOW_TX_CONTROL_BURST_BYTES, 0,
+                                 ESPNOW_TX_CONTROL_BYTES_PER_SEC, ESPNOW_TX_CONTROL_BURST_BYTES},
+    [ESPNOW_TX_CLASS_BULK]    = {ESPNOW_TX_BULK_BURST_BYTES, 0,
+                                 ESPNOW_TX_BULK_BYTES_PER_SEC, ESPNOW_TX_BULK_BURST_BYTES},
+};
+static NODE_LOCAL class_budget_t bcast_budgets[ESPNOW_TX_CLASS_COUNT] = {
+    [ESPNOW_TX_CLASS_CONTROL] = {ESPNOW_TX_CONTROL_BCAST_BURST, 0,
+                                 ESPNOW_TX_CONTROL_BCAST_PER_SEC, ESPNOW_TX_CONTROL_BCAST_BURST},
+    [ESPNOW_TX_CLASS_BULK]    = {ESPNOW_TX_BULK_BCAST_BURST, 0,
+                                 ESPNOW_TX_BULK_BCAST_PER_SEC, ESPNOW_TX_BULK_BCAST_BURST},
+};
+static NODE_LOCAL bool bcast_wait_counted[ESPNOW_TX_CLASS_COUNT];  // The current wait for a token is in broadcast_waits
+static NODE_LOCAL uint32_t control_streak = 0;            // Control frames sent since the last bulk frame
+
+#define STATS_UPDATE(expr) do { \
+        xSemaphoreTake(stats_mutex, portMAX_DELAY); \
+        expr; \
+        xSemaphoreGive(stats_mutex); \
+    } while (0)
+
+static TickType_t espnow_tx_us_to_ticks(int64_t us)
+{
+    int64_t tick_us = (int64_t)portTICK_PERIOD_MS * 1000;
+    return (TickType_t)((us + tick_us - 1) / tick_us);
+}
+
+static void espnow_tx_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    if (!tx_status_queue || !mac_addr) return;
+    // Frames sent by mesh-lite itself also land here; only report the one we are waiting on.
+    if (memcmp(mac_addr, inflight_dest, ESP_NOW_ETH_ALEN) != 0) return;
+    uint8_t st = (uint8_t)status;
+    xQueueSend(tx_status_queue, &st, 0);
+}
+
+// Hand an already framed buffer to mesh-lite, registering the peer first if needed.
+static esp_err_t espnow_tx_transmit(uint8_t type, const uint8_t *dest_addr, const uint8_t *data, size_t len)
+{
+    bool unicast = memcmp(dest_addr, broadcast_mac, ESP_NOW_ETH_ALEN) != 0;
+    if (unicast) {
+        esp_err_t err = peer_cache_ensure(dest_addr);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    esp_err_t ret = esp_mesh_lite_espnow_send(type, (uint8_t *)dest_addr, data, len);
+    if (ret == ESP_ERR_ESPNOW_NOT_FOUND && unicast) {
+        // Removed behind the cache's back; register it again and retry once.
+        DEFERRED_LOG(DLOG_TX_PEER_READDED, dest_addr, 0, 0, 0);
+        peer_cache_forget(dest_addr);
+        if ((ret = peer_cache_ensure(dest_addr)) == ESP_OK) {
+            ret = esp_mesh_lite_espnow_send(type, (uint8_t *)dest_addr, data, len);
+            if (ret != ESP_OK) {
+                DEFERRED_LOG(DLOG_TX_RESEND_FAILED, dest_addr, ret, 0, 0);
+            }
+        }
+    }
+    return ret;
+}
+
+// Keep a minimum gap between frames to the same unicast peer: how long until `dest` may
+// be sent to again (0 = now).
+static int64_t espnow_tx_pace_wait_us(const uint8_t *dest)
+{
+    for (int i = 0; i < ESPNOW_TX_PACING_SLOTS; i++) {
+        if (pacing[i].in_use && memcmp(pacing[i].mac, dest, ESP_NOW_ETH_ALEN) == 0) {
+            int64_t wait_us = pacing[i].last_tx_us + ESPNOW_TX_DEST_GAP_MS * 1000 - esp_timer_get_time();
+            return wait_us > 0 ? wait_us : 0;
+        }
+    }
+    return 0;
+}
+
+// The pacing slot for `dest`, taking over the least recently used one if it has none.
+static pacing_slot_t *espnow_tx_pace_slot(const uint8_t *dest)
+{
+    pacing_slot_t *oldest = &pacing[0];
+    for (int i = 0; i < ESPNOW_TX_PACING_SLOTS; i++) {
+        if (pacing[i].in_use && memcmp(pacing[i].mac, dest, ESP_NOW_ETH_ALEN) == 0) {
+            return &pacing[i];
+        }
+        if (!pacing[i].in_use || (oldest->in_use && pacing[i].last_tx_us < oldest->last_tx_us)) {
+            oldest = &pacing[i];
+        }
+    }
+    memcpy(oldest->mac, dest, ESP_NOW_ETH_ALEN);
+    oldest->in_use = true;
+    return oldest;
+}
+
+// Refill a budget and report how long until it can pay `len` tokens (0 = now).
+static int64_t espnow_tx_budget_wait_us(class_budget_t *b, uint16_t len)
+{
+    int64_t now = esp_timer_get_time();
+    b->tokens += (float)(now - b->refill_us) * b->per_sec / 1000000.0f;
+    if (b->tokens > b->burst) {
+        b->tokens = b->burst;
+    }
+    b->refill_us = now;
+    if (b->tokens >= len) {
+        return 0;
+    }
+    return (int64_t)((len - b->tokens) * 1000000.0f / b->per_sec);
+}
+
+// How long until the frame at the head of a class can go out: its byte budget, and the
+// class's broadcast rate or the gap to its peer. 0 = now.
+static int64_t espnow_tx_head_wait_us(espnow_tx_class_t cls, const tx_frame_t *head)
+{
+    int64_t w = espnow_tx_budget_wait_us(&budgets[cls], head->len);
+    int64_t link;
+    if (memcmp(head->dest, broadcast_mac, ESP_NOW_ETH_ALEN) == 0) {
+        link = espnow_tx_budget_wait_us(&bcast_budgets[cls], 1);
+        if (link > 0 && !bcast_wait_counted[cls]) {
+            STATS_UPDATE(stats.broadcast_waits++);
+            bcast_wait_counted[cls] = true;
+        }
+    } else {
+        link = espnow_tx_pace_wait_us(head->dest);
+    }
+    return link > w ? link : w;
+}
+
+// The retry of class `cls` that is due soonest, if it is due now. Otherwise NULL, with
+// *due_wait_us set to how long until the earliest one is (0 if there is none).
+static tx_retry_t *espnow_tx_due_retry(espnow_tx_class_t cls, int64_t *due_wait_us)
+{
+    tx_retry_t *first = NULL;
+    for (int i = 0; i < ESPNOW_TX_RETRY_SLOTS; i++) {
+        if (retry_slots[i].in_use && retry_slots[i].cls == cls &&
+            (!first || retry_slots[i].due_us < first->due_us)) {
+            first = &retry_slots[i];
+        }
+    }
+    *due_wait_us = 0;
+    if (!first) {
+        return NULL;
+    }
+    int64_t wait = first->due_us - esp_timer_get_time();
+    if (wait > 0) {
+        *due_wait_us = wait;
+        return NULL;
+    }
+    return first;
+}
+
+static bool espnow_tx_retries_waiting(void)
+{
+    for (int i = 0; i < ESPNOW_TX_RETRY_SLOTS; i++) {
+        if (retry_slots[i].in_use) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Park an unacknowledged unicast until its backoff ends. False if every slot is busy.
+static bool espnow_tx_schedule_retry(const tx_frame_t *frame, espnow_tx_class_t cls, uint8_t attempts)
+{
+    for (int i = 0; i < ESPNOW_TX_RETRY_SLOTS; i++) {
+        tx_retry_t *r = &retry_slots[i];
+        if (!r->in_use) {
+            r->frame = *frame;
+            r->cls = cls;
+            r->attempts = attempts;
+            r->due_us = esp_timer_get_time() + (int64_t)(ESPNOW_TX_RETRY_BACKOFF_MS << (attempts - 1)) * 1000;
+            r->in_use = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Choose the class to serve next among those whose head frame can go out now, so a bulk
+// frame held back by its budget, the broadcast limit or peer pacing never blocks control.
+// A class's head is its due retry if it has one, else the front of its queue.
+// Control wins while its streak is below the weight so round traffic never sits behind
+// block transfers, but bulk is never starved outright. Returns false with *wait_us set when
+// no class is ready; on true *retry is the slot to send from, or NULL for the queue.
+static bool espnow_tx_pick_class(espnow_tx_class_t *out, tx_retry_t **retry, int64_t *wait_us)
+{
+    static NODE_LOCAL tx_frame_t peeked;
+    bool ready[ESPNOW_TX_CLASS_COUNT] = {false};
+    bool waiting[ESPNOW_TX_CLASS_COUNT] = {false};
+    tx_retry_t *due[ESPNOW_TX_CLASS_COUNT] = {NULL};
+    *wait_us = ESPNOW_TX_CB_TIMEOUT_MS * 1000;
+    for (int c = 0; c < ESPNOW_TX_CLASS_COUNT; c++) {
+        int64_t due_wait;
+        due[c] = espnow_tx_due_retry((espnow_tx_class_t)c, &due_wait);
+        if (due_wait > 0 && due_wait < *wait_us) {
+            *wait_us = due_wait;
+        }
+        const tx_frame_t *head;
+        if (due[c]) {
+            head = &due[c]->frame;
+        } else if (xQueuePeek(tx_queues[c], &peeked, 0) == pdPASS) {
+            head = &peeked;
+        } else {
+            continue;
+        }
+        int64_t w = espnow_tx_head_wait_us((espnow_tx_class_t)c, head);
+        if (w == 0) {
+            ready[c] = true;
+        } else {
+            waiting[c] = true;
+            if (w < *wait_us) {
+                *wait_us = w;
+            }
+        }
+    }
+    if (ready[ESPNOW_TX_CLASS_CONTROL] &&
+        (!ready[ESPNOW_TX_CLASS_BULK] || control_streak < ESPNOW_TX_CONTROL_WEIGHT)) {
+        *out = ESPNOW_TX_CLASS_CONTROL;
+        *retry = due[*out];
+        return true;
+    }
+    if (ready[ESPNOW_TX_CLASS_BULK]) {
+        *out = ESPNOW_TX_CLASS_BULK;
+        *retry = due[*out];
+        return true;
+    }
+    STATS_UPDATE({
+        for (int c = 0; c < ESPNOW_TX_CLASS_COUNT; c++) {
+            if (waiting[c]) stats.classes[c].throttled++;
+        }
+    });
+    return false;
+}
+
+// Send `frame` once and wait for its callback, but never sleep out a backoff here: an
+// unacknowledged unicast is parked in a retry slot and the task moves on, so one failing
+// peer holds the radio for at most one callback wait per turn.
+static void espnow_tx_attempt(const tx_frame_t *frame, espnow_tx_class_t cls, uint8_t attempt)
+{
+    bool unicast = memcmp(frame->dest, broadcast_mac, ESP_NOW_ETH_ALEN) != 0;
+    uint8_t status = ESP_NOW_SEND_FAIL;
+    xQueueReset(tx_status_queue);
+    memcpy(inflight_dest, frame->dest, ESP_NOW_ETH_ALEN);
+    int64_t sent_us = esp_timer_get_time();
+    esp_err_t ret = espnow_tx_transmit(frame->type, frame->dest, frame->data, frame->len);
+    bool confirmed = (ret == ESP_OK) &&
+                     xQueueReceive(tx_status_queue, &status, pdMS_TO_TICKS(ESPNOW_TX_CB_TIMEOUT_MS)) == pdPASS;
+    if (attempt == 0) {
+        STATS_UPDATE(stats.sent++);
+    } else {
+        STATS_UPDATE(stats.retries++);
+    }
+    if (!unicast) {
+        // Broadcasts are never acknowledged; the callback only paces us.
+        return;
+    }
+    espnow_tx_pace_slot(frame->dest)->last_tx_us = esp_timer_get_time();
+    if (ret == ESP_OK && !confirmed) {
+        STATS_UPDATE(stats.unconfirmed++);
+        metrics_count(METRICS_TX_UNCONFIRMED);
+        return;
+    }
+    if (ret == ESP_OK && status == ESP_NOW_SEND_SUCCESS) {
+        STATS_UPDATE(stats.delivered++);
+        metrics_peer_rtt(frame->dest, (uint32_t)(esp_timer_get_time() - sent_us));
+        return;
+    }
+    if (attempt < ESPNOW_TX_MAX_RETRIES && espnow_tx_schedule_retry(frame, cls, attempt + 1)) {
+        return;
+    }
+    if (attempt < ESPNOW_TX_MAX_RETRIES) {
+        STATS_UPDATE(stats.retry_dropped++);
+    }
+    STATS_UPDATE(stats.failed++);
+    metrics_count(METRICS_TX_FAILED);
+    DEFERRED_LOG(DLOG_TX_GAVE_UP, frame->dest, frame->data[MESH_FRAME_HEADER_LEN], attempt + 1, 0);
+}
+
+static void espnow_tx_task(void *arg)
+{
+    static NODE_LOCAL tx_frame_t frame;
+    uint32_t pending = 0;
+    while (1) {
+        if (pending == 0 && !espnow_tx_retries_waiting()) {
+            xSemaphoreTake(tx_pending, portMAX_DELAY);
+            pending++;
+        }
+        while (xSemaphoreTake(tx_pending, 0) == pdTRUE) {
+            pending++;
+        }
+        espnow_tx_class_t cls;
+        tx_retry_t *retry;
+        int64_t wait_us;
+        if (!espnow_tx_pick_class(&cls, &retry, &wait_us)) {
+            // Everything waiting is over budget or backing off; sleep until it is not, or a
+            // new frame arrives.
+            if (xSemaphoreTake(tx_pending, espnow_tx_us_to_ticks(wait_us)) == pdTRUE) {
+                pending++;
+            }
+            continue;
+        }
+        uint8_t attempt = 0;
+        if (retry) {
+            frame = retry->frame;
+            attempt = retry->attempts;
+            retry->in_use = false;
+        } else {
+            if (xQueueReceive(tx_queues[cls], &frame, 0) != pdPASS) {
+                continue;
+            }
+            pending--;
+            STATS_UPDATE(stats.classes[cls].sent++);
+        }
+        budgets[cls].tokens -= frame.len;
+        control_streak = (cls == ESPNOW_TX_CLASS_CONTROL) ? control_streak + 1 : 0;
+        // The pick checked this frame's broadcast token; claim it. Retries are all unicast.
+        if (memcmp(frame.dest, broadcast_mac, ESP_NOW_ETH_ALEN) == 0) {
+            bcast_budgets[cls].tokens -= 1.0f;
+            bcast_wait_counted[cls] = false;
+        }
+        espnow_tx_attempt(&frame, cls, attempt);
+    }
+}
+
+void espnow_tx_init(void)
+{
+    if (tx_pending) {
+        return;
+    }
+    stats_mutex = xSemaphoreCreateMutex();
+    tx_status_queue = xQueueCreate(1, sizeof(uint8_t));
+    tx_queues[ESPNOW_TX_CLASS_CONTROL] = xQueueCreate(ESPNOW_TX_CONTROL_QUEUE_LENGTH, sizeof(tx_frame_t));
+    tx_queues[ESPNOW_TX_CLASS_BULK] = xQueueCreate(ESPNOW_TX_BULK_QUEUE_LENGTH, sizeof(tx_frame_t));
+    SemaphoreHandle_t pending = xSemaphoreCreateCounting(
+        ESPNOW_TX_CONTROL_QUEUE_LENGTH + ESPNOW_TX_BULK_QUEUE_LENGTH, 0);
+    if (!stats_mutex || !tx_status_queue || !tx_queues[ESPNOW_TX_CLASS_CONTROL] ||
+        !tx_queues[ESPNOW_TX_CLASS_BULK] || !pending) {
+        ESP_LOGE(TAG, "Failed to create transmit queues");
+        return;
+    }
+    mem_track_note(MEM_TAG_QUEUES, (ESPNOW_TX_CONTROL_QUEUE_LENGTH + ESPNOW_TX_BULK_QUEUE_LENGTH) * sizeof(tx_frame_t));
+    int64_t now = esp_timer_get_time();
+    for (int c = 0; c < ESPNOW_TX_CLASS_COUNT; c++) {
+        budgets[c].refill_us = now;
+        bcast_budgets[c].refill_us = now;
+    }
+    esp_err_t err = esp_now_register_send_cb(espnow_tx_send_cb);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Could not register send callback (%s); deliveries will be unconfirmed",
+                 esp_err_to_name(err));
+    }
+    // Enqueue falls back to direct sends until this is set.
+    tx_pending = pending;
+    xTaskCreate(espnow_tx_task, "espnow_tx_task", 3072, NULL, 6, NULL);
+    ESP_LOGI(TAG, "Transmit queues started (control %d, bulk %d frames)",
+             ESPNOW_TX_CONTROL_QUEUE_LENGTH, ESPNOW_TX_BULK_QUEUE_LENGTH);
+}
+
+espnow_tx_class_t espnow_tx_classify(const uint8_t *data, size_t len)
+{
+    if (!data || len == 0) {
+        return ESPNOW_TX_CLASS_CONTROL;
+    }
+    switch (data[0]) {
+        case CMD_CHAIN_REQ:
+        case CMD_CHAIN_RESP:
+        case CMD_NEW_BLOCK:
+        case CMD_REQUEST_SPECIFIC_BLOCK:
+        case CMD_HISTORICAL_BLOCK:
+        case CMD_REQUEST_BLOCK_SET:
+        case CMD_BLOCK_FRAGMENT:
+        case CMD_BLOCK_REPLY_FRAGMENT:
+        case CMD_CHECKPOINT_REQ:
+        case CMD_CHECKPOINT:
+            return ESPNOW_TX_CLASS_BULK;
+        default:
+            return ESPNOW_TX_CLASS_CONTROL;
+    }
+}
+
+esp_err_t espnow_tx_enqueue(uint8_t type, const uint8_t *dest_addr, const uint8_t *data, size_t len,
+                            espnow_tx_prio_t prio)
+{
+    if (!tx_pending) {
+        return espnow_tx_send_now(type, dest_addr, data, len);
+    }
+    espnow_tx_class_t cls = espnow_tx_classify(data, len);
+    tx_frame_t frame;
+    size_t frame_len = mesh_frame_encode(data, len, frame.data, sizeof(frame.data));
+    if (frame_len == 0) {
+        ESP_LOGE(TAG, "Message of %d bytes cannot be sent", (int)len);
+        STATS_UPDATE(stats.classes[cls].dropped++);
+        metrics_count(METRICS_TX_DROPPED);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    frame_trace_record(FRAME_TRACE_TX, dest_addr, frame.data, frame_len);
+    frame.type = type;
+    memcpy(frame.dest, dest_addr, ESP_NOW_ETH_ALEN);
+    frame.len = (uint16_t)frame_len;
+
+    QueueHandle_t q = tx_queues[cls];
+    BaseType_t ok = (prio == ESPNOW_TX_PRIO_HIGH) ? xQueueSendToFront(q, &frame, 0)
+                                                  : xQueueSend(q, &frame, 0);
+    if (ok != pdPASS) {
+        STATS_UPDATE(stats.classes[cls].dropped++);
+        metrics_count(METRICS_TX_DROPPED);
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(tx_pending);
+    metrics_tx(data[0], frame_len);
+    uint32_t depth = uxQueueMessagesWaiting(q);
+    STATS_UPDATE({
+        stats.classes[cls].queued++;
+        if (depth > stats.classes[cls].queue_high_water) stats.classes[cls].queue_high_water = depth;
+    });
+    return ESP_OK;
+}
+
+esp_err_t espnow_tx_send_now(uint8_t type, const uint8_t *dest_addr, const uint8_t *data, size_t len)
+{
+    uint8_t frame[ESPNOW_TX_MAX_FRAME];
+    size_t frame_len = mesh_frame_encode(data, len, frame, sizeof(frame));
+    if (frame_len == 0) {
+        ESP_LOGE(TAG, "Message of %d bytes cannot be framed", (int)len);
+        metrics_count(METRICS_TX_DROPPED);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    frame_trace_record(FRAME_TRACE_TX, dest_addr, frame, frame_len);
+    metrics_tx(data[0], frame_len);
+    return espnow_tx_transmit(type, dest_addr, frame, frame_len);
+}
+
+void espnow_tx_get_stats(espnow_tx_stats_t *out)
+{
+    if (!stats_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(stats_mutex);
+}
@@ -0,0 +1,80 @@
+#ifndef ESPNOW_TX_H
+#define ESPNOW_TX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+#define ESPNOW_TX_CONTROL_QUEUE_LENGTH  24
+#define ESPNOW_TX_BULK_QUEUE_LENGTH     16
+#define ESPNOW_TX_MAX_FRAME         ESP_NOW_MAX_DATA_LEN    // Including the mesh_frame header
+#define ESPNOW_TX_MAX_RETRIES       3       // Extra attempts for an unacknowledged unicast
+#define ESPNOW_TX_RETRY_BACKOFF_MS  10      // Doubles with every retry
+#define ESPNOW_TX_RETRY_SLOTS       4       // Unicast frames waiting out a backoff at once
+#define ESPNOW_TX_CB_TIMEOUT_MS     100     // How long to wait for the send callback
+#define ESPNOW_TX_DEST_GAP_MS       4       // Minimum spacing between frames to one peer
+#define ESPNOW_TX_PACING_SLOTS      16      // Peers remembered for pacing
+
+// Class scheduling: while both classes have frames waiting, up to CONTROL_WEIGHT control
+// frames are sent for every bulk frame. Each class is also capped in bytes per second, and
+// has its own broadcast rate so a burst of fragment repairs cannot delay pulses, elections
+// or heartbeats. The two broadcast rates add up to 40 a second.
+#define ESPNOW_TX_CONTROL_WEIGHT    4
+#define ESPNOW_TX_CONTROL_BYTES_PER_SEC 12000
+#define ESPNOW_TX_CONTROL_BURST_BYTES   (4 * ESPNOW_TX_MAX_FRAME)
+#define ESPNOW_TX_CONTROL_BCAST_PER_SEC 16
+#define ESPNOW_TX_CONTROL_BCAST_BURST   8   // Broadcasts allowed back to back
+#define ESPNOW_TX_BULK_BYTES_PER_SEC    6000
+#define ESPNOW_TX_BULK_BURST_BYTES      (2 * ESPNOW_TX_MAX_FRAME)
+#define ESPNOW_TX_BULK_BCAST_PER_SEC    24
+#define ESPNOW_TX_BULK_BCAST_BURST      4
+
+typedef enum {
+    ESPNOW_TX_PRIO_NORMAL = 0,
+    ESPNOW_TX_PRIO_HIGH,                    // Jumps to the front of the queue
+} espnow_tx_prio_t;
+
+typedef enum {
+    ESPNOW_TX_CLASS_CONTROL = 0,            // Round traffic: pulses, sensor data, elections, beacons
+    ESPNOW_TX_CLASS_BULK,                   // Block transfers and chain sync
+    ESPNOW_TX_CLASS_COUNT,
+} espnow_tx_class_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;           // Queue full or frame too large
+    uint32_t throttled;         // Head frame not ready: byte budget, broadcast rate or peer gap
+    uint32_t queue_high_water;
+} espnow_tx_class_stats_t;
+
+typedef struct {
+    uint32_t sent;              // Frames handed to the radio (first attempts)
+    uint32_t delivered;         // Unicast frames acknowledged by the peer
+    uint32_t failed;            // Unicast frames still unacknowledged after all retries
+    uint32_t retries;
+    uint32_t retry_dropped;     // Unacknowledged frames given up early: every retry slot was busy
+    uint32_t unconfirmed;       // No send callback arrived in time
+    uint32_t broadcast_waits;   // Broadcasts delayed by the rate limiter
+    espnow_tx_class_stats_t classes[ESPNOW_TX_CLASS_COUNT];
+} espnow_tx_stats_t;
+
+// Start the transmit task and register the ESP-NOW send callback.
+void espnow_tx_init(void);
+
+// Traffic class of a frame, decided by its command byte.
+espnow_tx_class_t espnow_tx_classify(const uint8_t *data, size_t len);
+
+// Frame a message (see mesh_frame.h) and copy it into its class queue.
+// Returns once queued, not once sent.
+// HIGH priority puts the frame at the front of its class queue.
+esp_err_t espnow_tx_enqueue(uint8_t type, const uint8_t *dest_addr, const uint8_t *data, size_t len,
+                            espnow_tx_prio_t prio);
+
+// Frame and send a message immediately on the calling task, bypassing the queue.
+esp_err_t espnow_tx_send_now(uint8_t type, const uint8_t *dest_addr, const uint8_t *data, size_t len);
+
+void espnow_tx_get_stats(espnow_tx_stats_t *out);
+
+#endif // ESPNOW_TX_H
@@ -0,0 +1,87 @@
+#include "event_trace.h"
+#include "mem_track.h"
+#include "node_local.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "event_trace";
+
+// One ring per core. A writer claims a slot with an atomic increment of `next` and fills it in
+// place, so recording never waits, even when a task on the same core preempts another halfway.
+typedef struct {
+    uint32_t next;                      // Events recorded since boot; next slot is next % size
+    event_trace_record_t events[EVENT_TRACE_RING_EVENTS];
+} event_trace_ring_t;
+
+static NODE_LOCAL event_trace_ring_t rings[portNUM_PROCESSORS];
+
+void event_trace_init(void)
+{
+    ESP_LOGI(TAG, "Event tracing %s (%d events per core)", EVENT_TRACE_ENABLED ? "on" : "compiled out",
+             EVENT_TRACE_RING_EVENTS);
+}
+
+void event_trace_record(event_trace_id_t id, uint32_t a, uint32_t b)
+{
+    event_trace_ring_t *ring = &rings[xPortGetCoreID() % portNUM_PROCESSORS];
+    uint32_t slot = __atomic_fetch_add(&ring->next, 1, __ATOMIC_RELAXED) % EVENT_TRACE_RING_EVENTS;
+    uintptr_t task = (uintptr_t)xTaskGetCurrentTaskHandle();
+    event_trace_record_t *e = &ring->events[slot];
+    e->time_us = (uint32_t)esp_timer_get_time();
+    e->id = (uint8_t)id;
+    e->reserved = 0;
+    e->task = (uint16_t)((task >> 4) ^ (task >> 20));
+    e->a = a;
+    e->b = b;
+}
+
+bool event_trace_dump(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx)
+{
+    event_trace_record_t *snapshot = mem_track_malloc(MEM_TAG_COMM, sizeof(rings[0].events));
+    if (!snapshot) {
+        ESP_LOGE(TAG, "No memory for an event snapshot");
+        return false;
+    }
+    uint8_t hdr[EVENT_TRACE_HEADER_LEN];
+    uint16_t per_core = EVENT_TRACE_RING_EVENTS;
+    int64_t now = esp_timer_get_time();
+    memcpy(hdr, EVENT_TRACE_MAGIC, 4);
+    hdr[4] = EVENT_TRACE_VERSION;
+    hdr[5] = portNUM_PROCESSORS;
+    memcpy(hdr + 6, &per_core, sizeof(per_core));
+    memcpy(hdr + 6 + sizeof(per_core), &now, sizeof(now));
+    bool ok = write(ctx, hdr, sizeof(hdr));
+    uint32_t total = 0;
+    for (int core = 0; core < portNUM_PROCESSORS && ok; core++) {
+        const event_trace_ring_t *ring = &rings[core];
+        uint32_t next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+        uint32_t count = next < EVENT_TRACE_RING_EVENTS ? next : EVENT_TRACE_RING_EVENTS;
+        uint32_t first = (next - count) % EVENT_TRACE_RING_EVENTS;
+        for (uint32_t i = 0; i < count; i++) {
+            snapshot[i] = ring->events[(first + i) % EVENT_TRACE_RING_EVENTS];
+        }
+        ok = write(ctx, (const uint8_t *)&next, sizeof(next)) &&
+             (count == 0 || write(ctx, (const uint8_t *)snapshot, count * sizeof(*snapshot)));
+        total += count;
+    }
+    mem_track_free(snapshot);
+    if (ok) {
+        ESP_LOGI(TAG, "Dumped %" PRIu32 " event(s)", total);
+    }
+    return ok;
+}
+
+void event_trace_get_stats(event_trace_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t next = __atomic_load_n(&rings[core].next, __ATOMIC_RELAXED);
+        out->recorded += next;
+        out->overwritten += next > EVENT_TRACE_RING_EVENTS ? next - EVENT_TRACE_RING_EVENTS : 0;
+    }
+}
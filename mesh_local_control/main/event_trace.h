@@ -0,0 +1,106 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Hot-path event tracing. Code records a compile-time event id and two integer arguments into a
+// fixed ring per core; nothing is formatted on the device. Dump a snapshot with TCP
+// "EVENTS_DUMP" and turn it into Chrome trace JSON (chrome://tracing, Perfetto) with the host
+// tool host_sim/tools/event_trace_json.
+//
+// Dump format, little-endian and unpadded:
+//   header: "MEVT" [u8 version][u8 cores][u16 events per core][i64 esp_timer us at the dump]
+//   then per core: [u32 events recorded since boot] followed by min(recorded, events per core)
+//   records, oldest first, each [u32 us][u8 event id][u8 reserved][u16 task][u32 a][u32 b].
+// Timestamps are esp_timer microseconds truncated to 32 bits; the decoder unwraps them against
+// the dump time.
+#ifndef EVENT_TRACE_ENABLED
+#define EVENT_TRACE_ENABLED     1       // 0 compiles every EVENT_TRACE() away
+#endif
+#ifndef EVENT_TRACE_RING_EVENTS
+#define EVENT_TRACE_RING_EVENTS 256     // Per core; 16 bytes each
+#endif
+#define EVENT_TRACE_MAGIC       "MEVT"
+#define EVENT_TRACE_VERSION     1
+#define EVENT_TRACE_HEADER_LEN  (4 + 1 + 1 + sizeof(uint16_t) + sizeof(int64_t))
+
+typedef enum {
+    EVENT_TRACE_INSTANT = 0,
+    EVENT_TRACE_BEGIN,                  // Opens a span on the recording task
+    EVENT_TRACE_END,                    // Closes the task's innermost open span
+} event_trace_phase_t;
+
+// X(id, name, phase, name of a, name of b). A span's BEGIN and END share a name. Ids are the
+// order here; append new events so older dumps still decode.
+#define EVENT_TRACE_EVENTS(X) \
+    X(EV_RX,                "rx",               EVENT_TRACE_BEGIN,   "len",       "from")      \
+    X(EV_RX_END,            "rx",               EVENT_TRACE_END,     "cmd",       NULL)        \
+    X(EV_RX_DROP,           "rx_drop",          EVENT_TRACE_INSTANT, "len",       "from")      \
+    X(EV_RX_UNKNOWN,        "rx_unknown",       EVENT_TRACE_INSTANT, "cmd",       "from")      \
+    X(EV_ELECTION_RX,       "election_rx",      EVENT_TRACE_INSTANT, "leader",    "from")      \
+    X(EV_SENSOR_RX,         "sensor_rx",        EVENT_TRACE_INSTANT, "from",      NULL)        \
+    X(EV_BLOCK_REQUEST_RX,  "block_request_rx", EVENT_TRACE_INSTANT, "block",     "from")      \
+    X(EV_BLOCK_RX,          "block_rx",         EVENT_TRACE_INSTANT, "block",     "readings")  \
+    X(EV_BLOCK_VALID,       "block_valid",      EVENT_TRACE_INSTANT, "block",     "from")      \
+    X(EV_HASH,              "block_hash",       EVENT_TRACE_BEGIN,   "block",     "readings")  \
+    X(EV_HASH_END,          "block_hash",       EVENT_TRACE_END,     NULL,        NULL)        \
+    X(EV_SERIALIZE,         "serialize",        EVENT_TRACE_BEGIN,   "block",     "readings")  \
+    X(EV_SERIALIZE_END,     "serialize",        EVENT_TRACE_END,     "bytes",     NULL)        \
+    X(EV_PARSE,             "parse",            EVENT_TRACE_BEGIN,   "bytes",     NULL)        \
+    X(EV_PARSE_END,         "parse",            EVENT_TRACE_END,     "block",     "readings")  \
+    X(EV_BLOCK_ADD,         "block_add",        EVENT_TRACE_INSTANT, "block",     "result")    \
+    X(EV_SENSOR_APPEND,     "sensor_append",    EVENT_TRACE_INSTANT, "readings",  "from")      \
+    X(EV_ROUND,             "round",            EVENT_TRACE_BEGIN,   "block",     "expected")  \
+    X(EV_ROUND_END,         "round",            EVENT_TRACE_END,     "readings",  NULL)        \
+    X(EV_ROUND_COLLECTED,   "round_collected",  EVENT_TRACE_INSTANT, "collected", "expected")  \
+    X(EV_LEADER,            "leader",           EVENT_TRACE_INSTANT, "leader",    "am_leader") \
+    X(EV_ELECTION_TX,       "election_tx",      EVENT_TRACE_INSTANT, "leader",    NULL)        \
+    X(EV_POP,               "pop_proof",        EVENT_TRACE_INSTANT, "timestamp", "nonce")
+
+#define EVENT_TRACE_ID(id, name, phase, a, b) id,
+typedef enum {
+    EVENT_TRACE_EVENTS(EVENT_TRACE_ID)
+    EVENT_TRACE_EVENT_COUNT,
+} event_trace_id_t;
+#undef EVENT_TRACE_ID
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t id;
+    uint8_t reserved;
+    uint16_t task;                      // Folded task handle, to tell tasks on a core apart
+    uint32_t a;
+    uint32_t b;
+} event_trace_record_t;
+
+typedef struct {
+    uint32_t recorded;                  // All cores, since boot
+    uint32_t overwritten;               // Pushed out of a full ring
+} event_trace_stats_t;
+
+// Last four bytes of a MAC, which tell the nodes of one mesh apart, as an event argument.
+static inline uint32_t event_trace_mac(const uint8_t *mac)
+{
+    return ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+}
+
+#if EVENT_TRACE_ENABLED
+#define EVENT_TRACE(id, a, b)   event_trace_record((id), (uint32_t)(a), (uint32_t)(b))
+#else
+#define EVENT_TRACE(id, a, b)   ((void)0)
+#endif
+
+void event_trace_init(void);
+
+// Lock-free; safe from any task and the Wi-Fi callbacks. Use EVENT_TRACE() instead.
+void event_trace_record(event_trace_id_t id, uint32_t a, uint32_t b);
+
+// Write a snapshot of every core's ring through `write` (as frame_trace_dump). Recording
+// carries on meanwhile, so events written during the copy may show up torn.
+bool event_trace_dump(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx);
+
+void event_trace_get_stats(event_trace_stats_t *out);
+
+#endif // EVENT_TRACE_H
@@ -0,0 +1,145 @@
+#include "frame_trace.h"
+#include "mem_track.h"
+#include "node_local.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "frame_trace";
+
+// Records are stored back to back in their dump layout and may wrap around the end of the
+// ring. `head` is the offset of the oldest record.
+static NODE_LOCAL uint8_t ring[FRAME_TRACE_RING_BYTES];
+static NODE_LOCAL uint32_t head = 0;
+static NODE_LOCAL uint32_t used = 0;
+static NODE_LOCAL uint32_t records = 0;
+static NODE_LOCAL uint32_t overwritten = 0;
+static NODE_LOCAL bool enabled = FRAME_TRACE_DEFAULT;
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void frame_trace_init(void)
+{
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+    ESP_LOGI(TAG, "Frame capture %s (%d byte ring)", enabled ? "on" : "off", FRAME_TRACE_RING_BYTES);
+}
+
+void frame_trace_set_enabled(bool on)
+{
+    enabled = on;
+    ESP_LOGI(TAG, "Frame capture %s", on ? "started" : "stopped");
+}
+
+bool frame_trace_enabled(void)
+{
+    return enabled;
+}
+
+void frame_trace_clear(void)
+{
+    portENTER_CRITICAL(&trace_lock);
+    head = 0;
+    used = 0;
+    records = 0;
+    overwritten = 0;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+// Caller holds trace_lock.
+static void frame_trace_put(uint32_t offset, const void *src, size_t len)
+{
+    uint32_t at = offset % FRAME_TRACE_RING_BYTES;
+    size_t first = FRAME_TRACE_RING_BYTES - at;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(ring + at, src, first);
+    memcpy(ring, (const uint8_t *)src + first, len - first);
+}
+
+// Size of the oldest record. Caller holds trace_lock.
+static uint32_t frame_trace_oldest_len(void)
+{
+    uint32_t at = head + FRAME_TRACE_RECORD_LEN - sizeof(uint16_t);
+    uint16_t len = ring[at % FRAME_TRACE_RING_BYTES] | (ring[(at + 1) % FRAME_TRACE_RING_BYTES] << 8);
+    return FRAME_TRACE_RECORD_LEN + len;
+}
+
+void frame_trace_record(frame_trace_dir_t dir, const uint8_t *peer, const uint8_t *frame, size_t len)
+{
+    if (!enabled || len > UINT16_MAX || FRAME_TRACE_RECORD_LEN + len > FRAME_TRACE_RING_BYTES) {
+        return;
+    }
+    uint8_t hdr[FRAME_TRACE_RECORD_LEN];
+    int64_t now = esp_timer_get_time();
+    uint16_t len16 = (uint16_t)len;
+    memcpy(hdr, &now, sizeof(now));
+    hdr[sizeof(now)] = (uint8_t)dir;
+    memcpy(hdr + sizeof(now) + 1, peer, ESP_NOW_ETH_ALEN);
+    memcpy(hdr + sizeof(now) + 1 + ESP_NOW_ETH_ALEN, &len16, sizeof(len16));
+    uint32_t need = FRAME_TRACE_RECORD_LEN + (uint32_t)len;
+
+    portENTER_CRITICAL(&trace_lock);
+    while (used + need > FRAME_TRACE_RING_BYTES) {
+        uint32_t oldest = frame_trace_oldest_len();
+        head = (head + oldest) % FRAME_TRACE_RING_BYTES;
+        used -= oldest;
+        records--;
+        overwritten++;
+    }
+    uint32_t tail = head + used;
+    frame_trace_put(tail, hdr, sizeof(hdr));
+    frame_trace_put(tail + sizeof(hdr), frame, len);
+    used += need;
+    records++;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+bool frame_trace_dump(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx)
+{
+    uint8_t *snapshot = mem_track_malloc(MEM_TAG_COMM, FRAME_TRACE_RING_BYTES);
+    if (!snapshot) {
+        ESP_LOGE(TAG, "No memory for a trace snapshot");
+        return false;
+    }
+    uint8_t hdr[FRAME_TRACE_HEADER_LEN];
+    portENTER_CRITICAL(&trace_lock);
+    uint32_t count = records;
+    uint32_t lost = overwritten;
+    uint32_t len = used;
+    size_t first = FRAME_TRACE_RING_BYTES - head;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(snapshot, ring + head, first);
+    memcpy(snapshot + first, ring, len - first);
+    portEXIT_CRITICAL(&trace_lock);
+
+    memcpy(hdr, FRAME_TRACE_MAGIC, 4);
+    hdr[4] = FRAME_TRACE_VERSION;
+    hdr[5] = 0;
+    memcpy(hdr + 6, my_mac, ESP_NOW_ETH_ALEN);
+    memcpy(hdr + 6 + ESP_NOW_ETH_ALEN, &count, sizeof(count));
+    memcpy(hdr + 6 + ESP_NOW_ETH_ALEN + sizeof(count), &lost, sizeof(lost));
+    bool ok = write(ctx, hdr, sizeof(hdr)) && (len == 0 || write(ctx, snapshot, len));
+    mem_track_free(snapshot);
+    if (ok) {
+        ESP_LOGI(TAG, "Dumped %" PRIu32 " frame(s), %" PRIu32 " bytes", count, len);
+    }
+    return ok;
+}
+
+void frame_trace_get_stats(frame_trace_stats_t *out)
+{
+    portENTER_CRITICAL(&trace_lock);
+    out->enabled = enabled;
+    out->records = records;
+    out->bytes = used;
+    out->overwritten = overwritten;
+    portEXIT_CRITICAL(&trace_lock);
+}
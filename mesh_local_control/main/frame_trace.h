@@ -0,0 +1,53 @@
+#ifndef FRAME_TRACE_H
+#define FRAME_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_now.h"
+
+// Capture of ESP-NOW traffic for offline replay. While enabled, every frame espnow_recv_cb is
+// handed and every frame queued for transmission is appended to a RAM ring, which overwrites
+// its oldest records when full. Frames are kept as on the air, mesh_frame header included.
+//
+// Dump format (TCP "TRACE_DUMP"), little-endian and unpadded, records oldest first:
+//   header: "MTRC" [u8 version][u8 reserved][own MAC][u32 records][u32 records overwritten]
+//   record: [i64 esp_timer us][u8 direction][peer MAC][u16 len][len bytes of frame]
+#ifndef FRAME_TRACE_DEFAULT
+#define FRAME_TRACE_DEFAULT     0       // Build with -DFRAME_TRACE_DEFAULT=1 to capture from boot
+#endif
+#ifndef FRAME_TRACE_RING_BYTES
+#define FRAME_TRACE_RING_BYTES  (16 * 1024)
+#endif
+#define FRAME_TRACE_MAGIC       "MTRC"
+#define FRAME_TRACE_VERSION     1
+#define FRAME_TRACE_HEADER_LEN  (4 + 1 + 1 + ESP_NOW_ETH_ALEN + sizeof(uint32_t) * 2)
+#define FRAME_TRACE_RECORD_LEN  (sizeof(int64_t) + 1 + ESP_NOW_ETH_ALEN + sizeof(uint16_t))  // Before the frame
+
+typedef enum {
+    FRAME_TRACE_RX = 0,             // Peer is the sender
+    FRAME_TRACE_TX = 1,             // Peer is the destination (FF:FF:FF:FF:FF:FF for broadcasts)
+} frame_trace_dir_t;
+
+typedef struct {
+    bool enabled;
+    uint32_t records;               // Held in the ring now
+    uint32_t bytes;
+    uint32_t overwritten;           // Oldest records dropped to make room since the last clear
+} frame_trace_stats_t;
+
+void frame_trace_init(void);
+void frame_trace_set_enabled(bool enabled);
+bool frame_trace_enabled(void);
+void frame_trace_clear(void);
+
+// Append one frame. Cheap no-op while capture is off; safe from the Wi-Fi task.
+void frame_trace_record(frame_trace_dir_t dir, const uint8_t *peer, const uint8_t *frame, size_t len);
+
+// Write a snapshot of the ring through `write` (header first), which returns false to abort.
+// Capture carries on while the snapshot is written. Returns false on abort or no memory.
+bool frame_trace_dump(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx);
+
+void frame_trace_get_stats(frame_trace_stats_t *out);
+
+#endif // FRAME_TRACE_H
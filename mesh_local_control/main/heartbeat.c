@@ -0,0 +1,331 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_HEARTBEAT
+#include "heartbeat.h"
+#include "node_local.h"
+#include "blockchain.h"
+#include "election_response.h"
+#include "mesh_networking.h"
+#include "espnow_tx.h"
+#include "block_broadcast.h"
+#include "checkpoint.h"
+#include "light_node.h"
+#include "command_set.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "heartbeat";
+
+static uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static NODE_LOCAL SemaphoreHandle_t hb_mutex = NULL;
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+
+// Monitored leader, as named by the latest election, and its beacon arrival history.
+static NODE_LOCAL uint8_t leader_mac[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL bool leader_known = false;
+static NODE_LOCAL int64_t last_arrival_us = 0;
+static NODE_LOCAL float intervals_ms[HEARTBEAT_WINDOW];
+static NODE_LOCAL uint32_t interval_count = 0;
+static NODE_LOCAL uint32_t interval_next = 0;
+
+// Most recent beacon heard from a node other than the monitored leader.
+static NODE_LOCAL uint8_t foreign_mac[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL int64_t foreign_arrival_us = 0;
+
+// Leaders we gave up on; skipped when choosing a successor.
+static NODE_LOCAL uint8_t suspects[HEARTBEAT_MAX_SUSPECTS][ESP_NOW_ETH_ALEN];
+static NODE_LOCAL uint32_t suspect_count = 0;
+static NODE_LOCAL uint32_t suspect_next = 0;
+
+static NODE_LOCAL int64_t last_beacon_sent_us = 0;
+static NODE_LOCAL bool takeover_pending = false;
+static NODE_LOCAL heartbeat_stats_t stats = {0};
+
+static void heartbeat_record_interval(float interval_ms)
+{
+    intervals_ms[interval_next] = interval_ms;
+    interval_next = (interval_next + 1) % HEARTBEAT_WINDOW;
+    if (interval_count < HEARTBEAT_WINDOW) {
+        interval_count++;
+    }
+}
+
+// Start monitoring a new leader. The window is seeded with the nominal period so the
+// detector has a sane estimate before the first beacon arrives.
+static void heartbeat_reset_leader(const uint8_t *mac, int64_t now_us)
+{
+    memcpy(leader_mac, mac, ESP_NOW_ETH_ALEN);
+    leader_known = true;
+    last_arrival_us = now_us;
+    interval_count = 0;
+    interval_next = 0;
+    heartbeat_record_interval(HEARTBEAT_INTERVAL_MS);
+    heartbeat_record_interval(HEARTBEAT_INTERVAL_MS);
+}
+
+static bool heartbeat_is_suspect(const uint8_t *mac)
+{
+    for (uint32_t i = 0; i < suspect_count; i++) {
+        if (memcmp(suspects[i], mac, ESP_NOW_ETH_ALEN) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void heartbeat_add_suspect(const uint8_t *mac)
+{
+    if (heartbeat_is_suspect(mac)) {
+        return;
+    }
+    memcpy(suspects[suspect_next], mac, ESP_NOW_ETH_ALEN);
+    suspect_next = (suspect_next + 1) % HEARTBEAT_MAX_SUSPECTS;
+    if (suspect_count < HEARTBEAT_MAX_SUSPECTS) {
+        suspect_count++;
+    }
+}
+
+static void heartbeat_clear_suspect(const uint8_t *mac)
+{
+    for (uint32_t i = 0; i < suspect_count; i++) {
+        if (memcmp(suspects[i], mac, ESP_NOW_ETH_ALEN) == 0) {
+            // Order does not matter; move the last entry into the hole.
+            memcpy(suspects[i], suspects[suspect_count - 1], ESP_NOW_ETH_ALEN);
+            suspect_count--;
+            suspect_next = suspect_count % HEARTBEAT_MAX_SUSPECTS;
+            return;
+        }
+    }
+}
+
+// Logistic approximation of the normal tail used by the phi-accrual detector:
+// phi = -log10(P(next beacon arrives later than now)).
+static float heartbeat_compute_phi(float elapsed_ms, float mean_ms, float stddev_ms)
+{
+    float y = (elapsed_ms - mean_ms) / stddev_ms;
+    float e = expf(-y * (1.5976f + 0.070566f * y * y));
+    float p_later = (elapsed_ms > mean_ms) ? e / (1.0f + e) : 1.0f - 1.0f / (1.0f + e);
+    return -log10f(p_later);
+}
+
+static float heartbeat_phi_locked(int64_t now_us)
+{
+    if (!leader_known || interval_count == 0) {
+        return 0.0f;
+    }
+    float mean = 0.0f;
+    for (uint32_t i = 0; i < interval_count; i++) {
+        mean += intervals_ms[i];
+    }
+    mean /= interval_count;
+    float var = 0.0f;
+    for (uint32_t i = 0; i < interval_count; i++) {
+        float d = intervals_ms[i] - mean;
+        var += d * d;
+    }
+    var /= interval_count;
+    float stddev = sqrtf(var);
+    if (stddev < HEARTBEAT_MIN_STDDEV_MS) {
+        stddev = HEARTBEAT_MIN_STDDEV_MS;
+    }
+    float elapsed_ms = (float)(now_us - last_arrival_us) / 1000.0f;
+    return heartbeat_compute_phi(elapsed_ms, mean + HEARTBEAT_ACCEPTABLE_PAUSE_MS, stddev);
+}
+
+// Every follower evaluates the same rule, so only one of them promotes itself.
+bool heartbeat_pick_successor(uint8_t *out)
+{
+    uint32_t node_count = 0;
+    node_info_list_t *list = esp_mesh_lite_get_nodes_list(&node_count);
+    bool found = false;
+    while (list) {
+        const uint8_t *mac = list->node->mac_addr;
+        if (!heartbeat_is_suspect(mac) && (!found || memcmp(mac, out, ESP_NOW_ETH_ALEN) < 0)) {
+            memcpy(out, mac, ESP_NOW_ETH_ALEN);
+            found = true;
+        }
+        list = list->next;
+    }
+    return found;
+}
+
+static void heartbeat_send_beacon(void)
+{
+    uint32_t tip = HEARTBEAT_NO_TIP;
+    block_t last;
+    if (blockchain_get_last_block(&last)) {
+        tip = last.block_num;
+    }
+    uint8_t msg[HEARTBEAT_MSG_LEN];
+    msg[0] = CMD_HEARTBEAT;
+    memcpy(msg + 1, &tip, sizeof(tip));
+    // Beacons jump the transmit queue so bulk traffic cannot delay them into a false suspicion.
+    esp_err_t ret = espnow_tx_enqueue(ESPNOW_DATA_TYPE_RESERVE, broadcast_mac, msg, sizeof(msg),
+                                      ESPNOW_TX_PRIO_HIGH);
+    if (ret != ESP_OK) {
+        ESP_LOGD(TAG, "Failed to send heartbeat: %s", esp_err_to_name(ret));
+    }
+}
+
+static void heartbeat_announce_takeover(void)
+{
+    // Wake our own round loop, then tell everyone else.
+    election_response_push(my_mac, my_mac);
+    uint8_t election_msg[1 + ESP_NOW_ETH_ALEN];
+    election_msg[0] = CMD_ELECTION;
+    memcpy(election_msg + 1, my_mac, ESP_NOW_ETH_ALEN);
+    esp_err_t ret = espnow_tx_enqueue(ESPNOW_DATA_TYPE_RESERVE, broadcast_mac,
+                                      election_msg, sizeof(election_msg), ESPNOW_TX_PRIO_HIGH);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to broadcast takeover: %s", esp_err_to_name(ret));
+    }
+}
+
+static void heartbeat_task(void *arg)
+{
+    while (1) {
+        bool send_beacon = false;
+        bool promote = false;
+        int64_t now = esp_timer_get_time();
+
+        xSemaphoreTake(hb_mutex, portMAX_DELAY);
+        if (leader_known && memcmp(leader_mac, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+            if (now - last_beacon_sent_us >= (int64_t)HEARTBEAT_INTERVAL_MS * 1000) {
+                last_beacon_sent_us = now;
+                stats.beacons_sent++;
+                send_beacon = true;
+            }
+        } else if (leader_known && heartbeat_phi_locked(now) > HEARTBEAT_PHI_THRESHOLD) {
+            uint32_t silence_ms = (uint32_t)((now - last_arrival_us) / 1000);
+            stats.suspicions++;
+            stats.last_detection_ms = silence_ms;
+            stats.total_detection_ms += silence_ms;
+            ESP_LOGW(TAG, "Leader " MACSTR " suspected after %" PRIu32 " ms of silence",
+                     MAC2STR(leader_mac), silence_ms);
+            heartbeat_add_suspect(leader_mac);
+
+            // Only an election names the next node to monitor. The one exception is our own
+            // takeover, which the announcement below turns into the next election.
+            leader_known = false;
+            uint8_t successor[ESP_NOW_ETH_ALEN];
+            if (now - foreign_arrival_us < (int64_t)HEARTBEAT_INTERVAL_MS * 2000 &&
+                !heartbeat_is_suspect(foreign_mac)) {
+                // Someone else is already beaconing as leader; we likely missed an election.
+                ESP_LOGW(TAG, MACSTR " is beaconing; waiting for the next election", MAC2STR(foreign_mac));
+            } else if (heartbeat_pick_successor(successor) &&
+                       memcmp(successor, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+                heartbeat_reset_leader(successor, now);
+                stats.takeovers++;
+                takeover_pending = true;
+                last_beacon_sent_us = 0;
+                promote = true;
+            }
+        }
+        xSemaphoreGive(hb_mutex);
+
+        if (send_beacon) {
+            heartbeat_send_beacon();
+        }
+        if (promote) {
+            ESP_LOGW(TAG, "Taking over as leader");
+            heartbeat_announce_takeover();
+        }
+        vTaskDelay(pdMS_TO_TICKS(HEARTBEAT_CHECK_MS));
+    }
+}
+
+void heartbeat_init(void)
+{
+    if (hb_mutex) {
+        return;
+    }
+    hb_mutex = xSemaphoreCreateMutex();
+    if (!hb_mutex) {
+        ESP_LOGE(TAG, "Failed to create heartbeat mutex");
+        return;
+    }
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+    xTaskCreate(heartbeat_task, "heartbeat_task", 3072, NULL, 5, NULL);
+    ESP_LOGI(TAG, "Heartbeat started: period %d ms, phi threshold %.1f",
+             HEARTBEAT_INTERVAL_MS, HEARTBEAT_PHI_THRESHOLD);
+}
+
+void heartbeat_set_leader(const uint8_t *mac)
+{
+    if (!hb_mutex) return;
+    xSemaphoreTake(hb_mutex, portMAX_DELAY);
+    if (!leader_known || memcmp(leader_mac, mac, ESP_NOW_ETH_ALEN) != 0) {
+        heartbeat_reset_leader(mac, esp_timer_get_time());
+        heartbeat_clear_suspect(mac);
+        if (memcmp(mac, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+            last_beacon_sent_us = 0;
+        }
+    }
+    xSemaphoreGive(hb_mutex);
+}
+
+void heartbeat_on_beacon(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!hb_mutex || len < (int)HEARTBEAT_MSG_LEN) return;
+    if (memcmp(src_mac, my_mac, ESP_NOW_ETH_ALEN) == 0) return;
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(hb_mutex, portMAX_DELAY);
+    stats.beacons_received++;
+    if (heartbeat_is_suspect(src_mac)) {
+        stats.suspects_revived++;
+        heartbeat_clear_suspect(src_mac);
+        ESP_LOGW(TAG, "Suspected leader " MACSTR " is alive", MAC2STR(src_mac));
+    }
+    if (leader_known && memcmp(src_mac, leader_mac, ESP_NOW_ETH_ALEN) == 0) {
+        heartbeat_record_interval((float)(now - last_arrival_us) / 1000.0f);
+        last_arrival_us = now;
+    } else {
+        memcpy(foreign_mac, src_mac, ESP_NOW_ETH_ALEN);
+        foreign_arrival_us = now;
+    }
+    xSemaphoreGive(hb_mutex);
+
+    // The beacon carries the leader's tip, which tells us about a block we never heard.
+    uint32_t tip;
+    memcpy(&tip, data + 1, sizeof(tip));
+    if (tip != HEARTBEAT_NO_TIP) {
+        // A joiner asks for a checkpoint first, so block sync does not start from block 0.
+        checkpoint_note_tip(src_mac, tip);
+        light_node_note_leader(src_mac);
+        block_broadcast_note_tip(src_mac, tip);
+    }
+}
+
+bool heartbeat_consume_takeover(void)
+{
+    if (!hb_mutex) return false;
+    xSemaphoreTake(hb_mutex, portMAX_DELAY);
+    bool pending = takeover_pending;
+    takeover_pending = false;
+    xSemaphoreGive(hb_mutex);
+    return pending;
+}
+
+float heartbeat_get_phi(void)
+{
+    if (!hb_mutex) return 0.0f;
+    xSemaphoreTake(hb_mutex, portMAX_DELAY);
+    float phi = heartbeat_phi_locked(esp_timer_get_time());
+    xSemaphoreGive(hb_mutex);
+    return phi;
+}
+
+void heartbeat_get_stats(heartbeat_stats_t *out)
+{
+    if (!hb_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(hb_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(hb_mutex);
+}
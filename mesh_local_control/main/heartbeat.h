@@ -0,0 +1,53 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_mesh_lite.h"
+
+#define HEARTBEAT_INTERVAL_MS           500     // Leader beacon period
+#define HEARTBEAT_CHECK_MS              250     // Failure detector evaluation period
+#define HEARTBEAT_WINDOW                16      // Inter-arrival samples kept per leader
+#define HEARTBEAT_ACCEPTABLE_PAUSE_MS   1000    // Tolerated beacon loss before phi starts rising
+#define HEARTBEAT_MIN_STDDEV_MS         100     // Floor on the estimated arrival jitter
+#define HEARTBEAT_PHI_THRESHOLD         8.0f    // Leader is suspected once phi exceeds this
+#define HEARTBEAT_MAX_SUSPECTS          4       // Recently failed leaders skipped during takeover
+
+// Beacon payload: [CMD_HEARTBEAT][uint32_t tip block number]
+#define HEARTBEAT_MSG_LEN               (1 + sizeof(uint32_t))
+#define HEARTBEAT_NO_TIP                UINT32_MAX
+
+typedef struct {
+    uint32_t beacons_sent;
+    uint32_t beacons_received;
+    uint32_t suspicions;                // Leaders declared failed
+    uint32_t suspects_revived;          // Suspected leaders heard from again; a lower bound on
+                                        // false positives, since a leader that handed over stays quiet
+    uint32_t takeovers;                 // Times this node promoted itself
+    uint32_t last_detection_ms;         // Silence before the most recent suspicion
+    uint64_t total_detection_ms;        // Sum over all suspicions, for averaging
+} heartbeat_stats_t;
+
+// Start the beacon / failure detector task. Call once after consensus_init().
+void heartbeat_init(void);
+
+// Record the leader named by the current round's election; the round loop is the only
+// caller. The detector monitors that node alone, and beacons are sent while it is us.
+void heartbeat_set_leader(const uint8_t *leader_mac);
+
+// Called from the receive path for every CMD_HEARTBEAT frame.
+void heartbeat_on_beacon(const uint8_t *src_mac, const uint8_t *data, int len);
+
+// Deterministic leader choice: the lowest MAC in the mesh that is not a recent suspect.
+// Takeover and leader discovery both use it, so every node lands on the same one.
+bool heartbeat_pick_successor(uint8_t *out);
+
+// Returns true (once) if the failure detector promoted this node to leader.
+bool heartbeat_consume_takeover(void);
+
+// Current suspicion level for the monitored leader.
+float heartbeat_get_phi(void);
+
+void heartbeat_get_stats(heartbeat_stats_t *out);
+
+#endif // HEARTBEAT_H
@@ -0,0 +1,147 @@
+#include "light_node.h"
+#include "mem_track.h"
+#include "node_local.h"
+#include "block_sync.h"
+#include "shard.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "mesh_networking.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "light_node";
+
+static NODE_LOCAL SemaphoreHandle_t light_mutex = NULL;
+static NODE_LOCAL bool enabled = LIGHT_NODE_DEFAULT;
+static NODE_LOCAL bool have_leader = false;
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL uint8_t leader[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL light_node_stats_t stats = {0};
+
+void light_node_init(void)
+{
+    if (light_mutex) {
+        return;
+    }
+    light_mutex = xSemaphoreCreateMutex();
+    if (!light_mutex) {
+        ESP_LOGE(TAG, "Failed to create light node mutex");
+        return;
+    }
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+    ESP_LOGI(TAG, "Running as a %s node", enabled ? "light" : "full");
+}
+
+void light_node_set_enabled(bool on)
+{
+    // Blocks already stored keep their bodies; only blocks stored from now on are pruned.
+    enabled = on;
+    ESP_LOGI(TAG, "Light mode %s", on ? "enabled" : "disabled");
+}
+
+bool light_node_enabled(void)
+{
+    return enabled;
+}
+
+void light_node_prune(block_t *block)
+{
+    if (!enabled || !light_mutex || block->body_pruned) {
+        return;
+    }
+    uint32_t dropped = 0;
+    sensor_record_t **link = &block->node_data;
+    while (*link) {
+        sensor_record_t *cur = *link;
+        if (memcmp(cur->mac, my_mac, ESP_NOW_ETH_ALEN) == 0) {
+            link = &cur->next;
+        } else {
+            *link = cur->next;
+            mem_track_free(cur);
+            dropped++;
+        }
+    }
+    block->body_pruned = true;
+    xSemaphoreTake(light_mutex, portMAX_DELAY);
+    stats.blocks_pruned++;
+    stats.records_dropped += dropped;
+    stats.bytes_saved += dropped * sizeof(sensor_record_t);
+    xSemaphoreGive(light_mutex);
+}
+
+block_t *light_node_pruned_copy(const block_t *block)
+{
+    block_t *copy = mem_track_malloc(MEM_TAG_LEDGER, sizeof(block_t));
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, block, sizeof(block_t));
+    copy->node_data = NULL;
+    copy->body_pruned = true;
+    sensor_record_t **tail = &copy->node_data;
+    for (const sensor_record_t *cur = block->node_data; cur; cur = cur->next) {
+        if (memcmp(cur->mac, my_mac, ESP_NOW_ETH_ALEN) != 0) {
+            continue;
+        }
+        sensor_record_t *rec = mem_track_malloc(MEM_TAG_LEDGER, sizeof(sensor_record_t));
+        if (!rec) {
+            break;      // Our own reading is a convenience; the header is what matters
+        }
+        memcpy(rec, cur, sizeof(sensor_record_t));
+        rec->next = NULL;
+        *tail = rec;
+        tail = &rec->next;
+    }
+    return copy;
+}
+
+void light_node_note_leader(const uint8_t *leader_mac)
+{
+    if (!light_mutex) {
+        return;
+    }
+    xSemaphoreTake(light_mutex, portMAX_DELAY);
+    memcpy(leader, leader_mac, ESP_NOW_ETH_ALEN);
+    have_leader = true;
+    xSemaphoreGive(light_mutex);
+}
+
+void light_node_fetch_body(uint32_t block_num)
+{
+    if (!light_mutex) {
+        return;
+    }
+    // Prefer a node that keeps the body under sharding, else the leader.
+    uint8_t peer[ESP_NOW_ETH_ALEN];
+    bool known = shard_pick_holder(block_num, peer);
+    xSemaphoreTake(light_mutex, portMAX_DELAY);
+    if (!known && have_leader) {
+        memcpy(peer, leader, sizeof(peer));
+        known = true;
+    }
+    if (known) {
+        stats.bodies_fetched++;
+    }
+    xSemaphoreGive(light_mutex);
+    if (!known) {
+        ESP_LOGW(TAG, "No node known to fetch block %" PRIu32 " from", block_num);
+        return;
+    }
+    // Repeats of the same request are suppressed by block_sync.
+    block_range_t range = { .first = block_num, .last = block_num };
+    block_sync_request_range(peer, range);
+}
+
+void light_node_get_stats(light_node_stats_t *out)
+{
+    if (!light_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(light_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(light_mutex);
+}
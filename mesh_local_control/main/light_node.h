@@ -0,0 +1,42 @@
+#ifndef LIGHT_NODE_H
+#define LIGHT_NODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blockchain.h"
+
+// Light mode: committed blocks keep their header (number, timestamp, prev_hash, hash and the
+// records commitment) and this node's own readings only. The hash chain still verifies from
+// headers alone; full bodies are fetched from the leader into the block cache when a request
+// needs one.
+#ifndef LIGHT_NODE_DEFAULT
+#define LIGHT_NODE_DEFAULT      0       // Build with -DLIGHT_NODE_DEFAULT=1 for battery nodes
+#endif
+
+typedef struct {
+    uint32_t blocks_pruned;
+    uint32_t records_dropped;
+    uint32_t bytes_saved;           // Sensor record memory released
+    uint32_t bodies_fetched;        // Body requests sent to the leader
+} light_node_stats_t;
+
+void light_node_init(void);
+void light_node_set_enabled(bool enabled);
+bool light_node_enabled(void);
+
+// Drop every sensor record but our own from a block about to be stored. No-op on full nodes.
+void light_node_prune(block_t *block);
+
+// Header-only copy of a stored block, keeping our own records; NULL if out of memory.
+block_t *light_node_pruned_copy(const block_t *block);
+
+// Remember the current leader, as the full node to fetch bodies from.
+void light_node_note_leader(const uint8_t *leader_mac);
+
+// Ask a shard holder, else the leader, for the full body of `block_num`; it lands in the
+// block cache.
+void light_node_fetch_body(uint32_t block_num);
+
+void light_node_get_stats(light_node_stats_t *out);
+
+#endif // LIGHT_NODE_H
@@ -0,0 +1,72 @@
+#ifndef LOG_LEVEL_H
+#define LOG_LEVEL_H
+
+// Compile-time log levels per module. A hot-path module includes this header first and sets
+// LOG_LOCAL_LEVEL from its entry before anything pulls in esp_log.h:
+//
+//     #include "log_level.h"
+//     #define LOG_LOCAL_LEVEL LOG_LEVEL_MESH_FRAME
+//     #include "mesh_frame.h"
+//
+// ESP_LOGx calls above that level then compile away, arguments and all, instead of being
+// checked at run time. Hot-path modules default to the configured default log level, so
+// anything a release build would filter out anyway costs nothing; a debug build (default level
+// Debug or Verbose) keeps every line. Override one module with e.g. -DLOG_LEVEL_MESH_FRAME=5.
+//
+// Values match esp_log_level_t, which this header cannot include.
+#define LOG_LEVEL_NONE      0
+#define LOG_LEVEL_ERROR     1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_INFO      3
+#define LOG_LEVEL_DEBUG     4
+#define LOG_LEVEL_VERBOSE   5
+
+#if defined(__has_include)
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+#endif
+
+#ifndef LOG_LEVEL_HOT_PATH
+#ifdef CONFIG_LOG_DEFAULT_LEVEL
+#define LOG_LEVEL_HOT_PATH  CONFIG_LOG_DEFAULT_LEVEL
+#else
+#define LOG_LEVEL_HOT_PATH  LOG_LEVEL_INFO
+#endif
+#endif
+
+#ifndef LOG_LEVEL_MESH_NETWORKING
+#define LOG_LEVEL_MESH_NETWORKING   LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_MESH_FRAME
+#define LOG_LEVEL_MESH_FRAME        LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_ESPNOW_TX
+#define LOG_LEVEL_ESPNOW_TX         LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_AGGREGATION
+#define LOG_LEVEL_AGGREGATION       LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_NODE_RESPONSE
+#define LOG_LEVEL_NODE_RESPONSE     LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_HEARTBEAT
+#define LOG_LEVEL_HEARTBEAT         LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_BLOCK_BROADCAST
+#define LOG_LEVEL_BLOCK_BROADCAST   LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_PEER_CACHE
+#define LOG_LEVEL_PEER_CACHE        LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_BLOCKCHAIN
+#define LOG_LEVEL_BLOCKCHAIN        LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_BLOCK_SYNC
+#define LOG_LEVEL_BLOCK_SYNC        LOG_LEVEL_HOT_PATH
+#endif
+#ifndef LOG_LEVEL_BLOCK_CACHE
+#define LOG_LEVEL_BLOCK_CACHE       LOG_LEVEL_HOT_PATH
+#endif
+
+#endif // LOG_LEVEL_H
@@ -1,4 +1,11 @@
 #include "logger.h"
+#include "mesh_frame.h"
+#include "verifier.h"
+#include "light_node.h"
+#include "shard.h"
+#include "deferred_log.h"
+#include "mem_track.h"
+#include "sensor_sampler.h"
 
 static const char *TAG = "logger";
 
@@ -25,6 +32,49 @@ void print_system_info_timercb(TimerHandle_t timer)
 #if CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER
     ESP_LOGW(TAG, "child node number: %lu", esp_mesh_lite_get_child_node_number());
 #endif /* MESH_LITE_NODE_INFO_REPORT */
+    mesh_frame_stats_t frame_stats;
+    mesh_frame_get_stats(&frame_stats);
+    ESP_LOGW(TAG, "Frames accepted: %"PRIu32", duplicates dropped: %"PRIu32" seq / %"PRIu32" msg (%"PRIu32" bytes), bad header: %"PRIu32,
+             frame_stats.accepted, frame_stats.dup_seq, frame_stats.dup_msg, frame_stats.dup_bytes, frame_stats.bad_header);
+    if (light_node_enabled()) {
+        light_node_stats_t light_stats;
+        light_node_get_stats(&light_stats);
+        ESP_LOGW(TAG, "Light node: %"PRIu32" blocks pruned, %"PRIu32" records (%"PRIu32" bytes) dropped, %"PRIu32" bodies fetched",
+                 light_stats.blocks_pruned, light_stats.records_dropped, light_stats.bytes_saved, light_stats.bodies_fetched);
+    }
+    shard_stats_t shard_stats;
+    shard_get_stats(&shard_stats);
+    if (shard_stats.members > SHARD_REPLICAS) {
+        ESP_LOGW(TAG, "Shards: %"PRIu32" members, %"PRIu32" bodies pruned, %"PRIu32" restored, %"PRIu32" pushed",
+                 shard_stats.members, shard_stats.blocks_pruned, shard_stats.bodies_restored, shard_stats.replicas_pushed);
+    }
+    deferred_log_stats_t log_stats;
+    deferred_log_get_stats(&log_stats);
+    if (log_stats.dropped) {
+        ESP_LOGW(TAG, "Deferred log: %"PRIu32" lines queued, %"PRIu32" dropped", log_stats.queued, log_stats.dropped);
+    }
+    sensor_sampler_stats_t sensor_stats;
+    sensor_sampler_get_stats(&sensor_stats);
+    if (sensor_stats.failures || sensor_stats.misses) {
+        ESP_LOGW(TAG, "Sensor: %"PRIu32" samples, %"PRIu32" failed measurements, %"PRIu32" reads without a recent sample",
+                 sensor_stats.samples, sensor_stats.failures, sensor_stats.misses);
+    }
+    mem_track_snapshot_t mem;
+    mem_track_snapshot(&mem);
+    char mem_line[160];
+    int mem_len = 0;
+    for (int tag = 0; tag < MEM_TAG_COUNT && mem_len < (int)sizeof(mem_line); tag++) {
+        mem_len += snprintf(mem_line + mem_len, sizeof(mem_line) - mem_len, "%s%s %"PRIu32"/%"PRIu32,
+                            tag ? ", " : "", mem_track_tag_name(tag), mem.tags[tag].live_bytes, mem.tags[tag].peak_bytes);
+    }
+    ESP_LOGW(TAG, "Heap live/peak bytes: %s; largest free block: %"PRIu32", min free: %"PRIu32", failed allocs: %"PRIu32,
+             mem_line, mem.heap_largest_free, mem.heap_min_free, mem.failed);
+    verifier_stats_t verify_stats;
+    verifier_get_stats(&verify_stats);
+    if (verify_stats.valid) {
+        ESP_LOGW(TAG, "Chain verified up to block %"PRIu32" (%"PRIu32" runs, %"PRIu32" failures, last run %"PRIu32" ms)",
+                 verify_stats.verified_up_to, verify_stats.runs, verify_stats.failures, verify_stats.last_run_ms);
+    }
     for (int i = 0; i < wifi_sta_list.num; i++) {
         ESP_LOGW(TAG, "Child mac: " MACSTR, MAC2STR(wifi_sta_list.sta[i].mac));
     }
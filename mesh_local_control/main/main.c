@@ -5,6 +5,7 @@
 #include "my_utility.h"
 #include "blockchain.h"
 #include "temperature_probe.h"
+#include "sensor_sampler.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/i2c.h"
@@ -12,6 +13,22 @@
 #include "esp_log.h"
 #include "node_response.h"
 #include "election_response.h"
+#include "aggregation.h"
+#include "peer_cache.h"
+#include "espnow_tx.h"
+#include "frame_trace.h"
+#include "metrics.h"
+#include "event_trace.h"
+#include "deferred_log.h"
+#include "round_profile.h"
+#include "mesh_frame.h"
+#include "block_cache.h"
+#include "block_sync.h"
+#include "block_broadcast.h"
+#include "verifier.h"
+#include "checkpoint.h"
+#include "light_node.h"
+#include "shard.h"
 #include "external_comm.h"
 #include "ws_comm.h"
 #include "secrets.h" // Include your secrets header for SSID and password
@@ -110,10 +127,27 @@ void app_main()
     // esp_mesh_lite_report_info();
     // ESP_LOGW(TAG, "-----");
 
+    deferred_log_init();
     i2c_master_init();
     temperature_probe_init();
+    sensor_sampler_init();
     node_response_init();
     election_response_init();
+    aggregation_init();
+    peer_cache_init();
+    mesh_frame_init();
+    espnow_tx_init();
+    frame_trace_init();
+    metrics_init();
+    event_trace_init();
+    round_profile_init();
+    block_cache_init();
+    light_node_init();
+    block_sync_init();
+    block_broadcast_init();
+    checkpoint_init();
+    verifier_init();
+    shard_init();
 
     vTaskDelay(3000/portTICK_PERIOD_MS);    
 
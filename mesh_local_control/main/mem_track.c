@@ -0,0 +1,183 @@
+#include "mem_track.h"
+#include "node_local.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "mem_track";
+
+// Sits in front of every tracked allocation. Eight bytes keep the payload as aligned as
+// anything the firmware stores on the heap needs.
+typedef struct {
+    uint32_t size;
+    uint8_t tag;
+    uint8_t reserved[3];
+} mem_header_t;
+
+_Static_assert(sizeof(mem_header_t) == 8, "mem_header_t must stay 8 bytes");
+
+static NODE_LOCAL mem_tag_stats_t tag_stats[MEM_TAG_COUNT];
+static NODE_LOCAL uint32_t failed = 0;
+
+static const char *const tag_names[MEM_TAG_COUNT] = {
+    "ledger", "rx", "block_cache", "queues", "comm",
+};
+
+static void mem_track_add(mem_tag_t tag, uint32_t bytes)
+{
+    mem_tag_stats_t *s = &tag_stats[tag];
+    uint32_t live = __atomic_add_fetch(&s->live_bytes, bytes, __ATOMIC_RELAXED);
+    uint32_t peak = __atomic_load_n(&s->peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&s->peak_bytes, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void mem_track_sub(mem_tag_t tag, uint32_t bytes)
+{
+    __atomic_sub_fetch(&tag_stats[tag].live_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static void *mem_track_wrap(mem_tag_t tag, mem_header_t *h, size_t size)
+{
+    if (!h) {
+        __atomic_add_fetch(&failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    h->size = (uint32_t)size;
+    h->tag = (uint8_t)tag;
+    mem_track_add(tag, (uint32_t)size);
+    __atomic_add_fetch(&tag_stats[tag].allocs, 1, __ATOMIC_RELAXED);
+    return h + 1;
+}
+
+void *mem_track_malloc(mem_tag_t tag, size_t size)
+{
+    if (size > UINT32_MAX - sizeof(mem_header_t)) {
+        return NULL;
+    }
+    return mem_track_wrap(tag, malloc(sizeof(mem_header_t) + size), size);
+}
+
+void *mem_track_calloc(mem_tag_t tag, size_t count, size_t size)
+{
+    if (size && count > (UINT32_MAX - sizeof(mem_header_t)) / size) {
+        return NULL;
+    }
+    return mem_track_wrap(tag, calloc(1, sizeof(mem_header_t) + count * size), count * size);
+}
+
+void *mem_track_realloc(mem_tag_t tag, void *ptr, size_t size)
+{
+    if (!ptr) {
+        return mem_track_malloc(tag, size);
+    }
+    if (size > UINT32_MAX - sizeof(mem_header_t)) {
+        return NULL;
+    }
+    mem_header_t *old = (mem_header_t *)ptr - 1;
+    mem_tag_t old_tag = (mem_tag_t)old->tag;
+    uint32_t old_size = old->size;
+    mem_header_t *h = realloc(old, sizeof(mem_header_t) + size);
+    if (!h) {
+        __atomic_add_fetch(&failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    mem_track_sub(old_tag, old_size);
+    if (old_tag != tag) {
+        __atomic_add_fetch(&tag_stats[old_tag].frees, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&tag_stats[tag].allocs, 1, __ATOMIC_RELAXED);
+    }
+    h->size = (uint32_t)size;
+    h->tag = (uint8_t)tag;
+    mem_track_add(tag, (uint32_t)size);
+    return h + 1;
+}
+
+void mem_track_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    mem_header_t *h = (mem_header_t *)ptr - 1;
+    mem_track_sub((mem_tag_t)h->tag, h->size);
+    __atomic_add_fetch(&tag_stats[h->tag].frees, 1, __ATOMIC_RELAXED);
+    free(h);
+}
+
+void mem_track_retag(void *ptr, mem_tag_t tag)
+{
+    if (!ptr) {
+        return;
+    }
+    mem_header_t *h = (mem_header_t *)ptr - 1;
+    if (h->tag == tag) {
+        return;
+    }
+    // Counted as a free under the old tag and an allocation under the new one, so each tag's
+    // allocs - frees stays its number of live blocks.
+    mem_track_sub((mem_tag_t)h->tag, h->size);
+    __atomic_add_fetch(&tag_stats[h->tag].frees, 1, __ATOMIC_RELAXED);
+    h->tag = (uint8_t)tag;
+    mem_track_add(tag, h->size);
+    __atomic_add_fetch(&tag_stats[tag].allocs, 1, __ATOMIC_RELAXED);
+}
+
+void mem_track_note(mem_tag_t tag, int32_t bytes)
+{
+    if (bytes >= 0) {
+        mem_track_add(tag, (uint32_t)bytes);
+        __atomic_add_fetch(&tag_stats[tag].allocs, 1, __ATOMIC_RELAXED);
+    } else {
+        mem_track_sub(tag, (uint32_t)-bytes);
+        __atomic_add_fetch(&tag_stats[tag].frees, 1, __ATOMIC_RELAXED);
+    }
+}
+
+const char *mem_track_tag_name(mem_tag_t tag)
+{
+    return tag < MEM_TAG_COUNT ? tag_names[tag] : "unknown";
+}
+
+void mem_track_snapshot(mem_track_snapshot_t *out)
+{
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        mem_tag_stats_t *s = &tag_stats[tag];
+        out->tags[tag].live_bytes = __atomic_load_n(&s->live_bytes, __ATOMIC_RELAXED);
+        out->tags[tag].peak_bytes = __atomic_load_n(&s->peak_bytes, __ATOMIC_RELAXED);
+        out->tags[tag].allocs = __atomic_load_n(&s->allocs, __ATOMIC_RELAXED);
+        out->tags[tag].frees = __atomic_load_n(&s->frees, __ATOMIC_RELAXED);
+    }
+    out->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    out->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    out->heap_largest_free = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    out->failed = __atomic_load_n(&failed, __ATOMIC_RELAXED);
+}
+
+bool mem_track_write_text(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx)
+{
+    mem_track_snapshot_t snap;
+    mem_track_snapshot(&snap);
+    char line[128];
+    int n = snprintf(line, sizeof(line), "%-12s %10s %10s %10s %10s\n", "tag", "live", "peak", "allocs", "frees");
+    bool ok = write(ctx, (const uint8_t *)line, (size_t)n);
+    for (int tag = 0; tag < MEM_TAG_COUNT && ok; tag++) {
+        const mem_tag_stats_t *s = &snap.tags[tag];
+        n = snprintf(line, sizeof(line), "%-12s %10" PRIu32 " %10" PRIu32 " %10" PRIu32 " %10" PRIu32 "\n",
+                     tag_names[tag], s->live_bytes, s->peak_bytes, s->allocs, s->frees);
+        ok = write(ctx, (const uint8_t *)line, (size_t)n);
+    }
+    if (ok) {
+        n = snprintf(line, sizeof(line), "heap free %" PRIu32 ", min %" PRIu32 ", largest block %" PRIu32
+                     ", failed allocs %" PRIu32 "\n",
+                     snap.heap_free, snap.heap_min_free, snap.heap_largest_free, snap.failed);
+        ok = write(ctx, (const uint8_t *)line, (size_t)n);
+    }
+    if (!ok) {
+        ESP_LOGW(TAG, "Memory report cut short");
+    }
+    return ok;
+}
@@ -0,0 +1,57 @@
+#ifndef MEM_TRACK_H
+#define MEM_TRACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Heap accounting per subsystem. Allocations made through mem_track_malloc() and friends carry
+// an 8-byte header with their size and tag, so the matching mem_track_free() keeps live bytes,
+// peak bytes and allocation counts per tag without a lookup table. Memory handed out by
+// FreeRTOS (queues) is declared with mem_track_note(). Read it with TCP "MEM", in the metrics
+// snapshot, or in the system-info log.
+//
+// A pointer from these wrappers must go back through mem_track_free(), never free().
+typedef enum {
+    MEM_TAG_LEDGER = 0,         // Chained and fork-pool blocks, their records, chain views
+    MEM_TAG_RX,                 // Blocks parsed off the air and not (yet) taken by the chain; reassembly
+    MEM_TAG_BLOCK_CACHE,        // Serialized blocks kept for serving
+    MEM_TAG_QUEUES,             // Response, election and transmit queues
+    MEM_TAG_COMM,               // TCP/WebSocket replies and diagnostic dump buffers
+    MEM_TAG_COUNT,
+} mem_tag_t;
+
+typedef struct {
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    uint32_t allocs;            // Since boot
+    uint32_t frees;
+} mem_tag_stats_t;
+
+typedef struct {
+    mem_tag_stats_t tags[MEM_TAG_COUNT];
+    uint32_t heap_free;
+    uint32_t heap_min_free;     // Low-water mark since boot
+    uint32_t heap_largest_free; // Largest block malloc can still return; far below heap_free means fragmentation
+    uint32_t failed;            // Wrapper allocations that returned NULL
+} mem_track_snapshot_t;
+
+void *mem_track_malloc(mem_tag_t tag, size_t size);
+void *mem_track_calloc(mem_tag_t tag, size_t count, size_t size);
+void *mem_track_realloc(mem_tag_t tag, void *ptr, size_t size);
+void mem_track_free(void *ptr);
+
+// Move an allocation's bytes to another tag, e.g. a received block the chain has taken.
+void mem_track_retag(void *ptr, mem_tag_t tag);
+
+// Account `bytes` (negative to release) allocated outside the wrappers.
+void mem_track_note(mem_tag_t tag, int32_t bytes);
+
+const char *mem_track_tag_name(mem_tag_t tag);
+
+void mem_track_snapshot(mem_track_snapshot_t *out);
+
+// Text table of the snapshot through `write` (as frame_trace_dump).
+bool mem_track_write_text(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx);
+
+#endif // MEM_TRACK_H
@@ -0,0 +1,260 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_MESH_FRAME
+#include "mesh_frame.h"
+#include "node_local.h"
+#include "command_set.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "mesh_frame";
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t top;           // Highest sequence number heard
+    uint64_t seen;          // Bit i set: top - i was heard
+    uint32_t last_heard;    // Value of frame_clock when last heard, for replacement
+    bool in_use;
+} sender_window_t;
+
+typedef struct {
+    uint32_t id;
+    int64_t heard_us;
+} msg_id_entry_t;
+
+static NODE_LOCAL SemaphoreHandle_t frame_mutex = NULL;
+static NODE_LOCAL uint16_t next_seq = 0;
+static NODE_LOCAL sender_window_t senders[MESH_FRAME_MAX_SENDERS];
+static NODE_LOCAL uint32_t frame_clock = 0;
+static NODE_LOCAL msg_id_entry_t msg_ids[MESH_FRAME_MSG_ID_SLOTS];
+static NODE_LOCAL uint32_t msg_id_next = 0;
+static NODE_LOCAL mesh_frame_stats_t stats = {0};
+
+// FNV-1a; cheap enough to run on every outgoing frame and stable across nodes, so two
+// nodes sending the same block produce the same id.
+static uint32_t mesh_frame_fnv(uint32_t h, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t mesh_frame_msg_id(const uint8_t *msg, size_t len)
+{
+    return mesh_frame_fnv(2166136261u, msg, len);
+}
+
+// Messages whose second copy carries nothing new, whoever sends it. A fragment's header
+// names the block and its index, so copies from different holders share an id too.
+static bool mesh_frame_is_idempotent(uint8_t cmd)
+{
+    switch (cmd) {
+        case CMD_NEW_BLOCK:
+        case CMD_HISTORICAL_BLOCK:
+        case CMD_REQUEST_SPECIFIC_BLOCK:
+        case CMD_REQUEST_BLOCK_SET:
+        case CMD_CHAIN_RESP:
+        case CMD_BLOCK_FRAGMENT:
+        case CMD_BLOCK_REPLY_FRAGMENT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Requests are only repeats when the same node asks again: an identical request from another
+// node still needs its own (unicast) answer.
+static bool mesh_frame_is_request(uint8_t cmd)
+{
+    return cmd == CMD_REQUEST_SPECIFIC_BLOCK || cmd == CMD_REQUEST_BLOCK_SET;
+}
+
+// Fragments and block-set requests are also resent on purpose, after a NACK or a sync stall,
+// so only copies heard close together count as duplicates.
+static uint32_t mesh_frame_msg_ttl_ms(uint8_t cmd)
+{
+    switch (cmd) {
+        case CMD_REQUEST_BLOCK_SET:
+        case CMD_BLOCK_FRAGMENT:
+        case CMD_BLOCK_REPLY_FRAGMENT:
+            return MESH_FRAME_RESEND_TTL_MS;
+        default:
+            return MESH_FRAME_MSG_ID_TTL_MS;
+    }
+}
+
+static sender_window_t *mesh_frame_sender_locked(const uint8_t *mac, bool *fresh)
+{
+    sender_window_t *victim = &senders[0];
+    for (int i = 0; i < MESH_FRAME_MAX_SENDERS; i++) {
+        if (senders[i].in_use && memcmp(senders[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            *fresh = false;
+            return &senders[i];
+        }
+        if (!senders[i].in_use ||
+            (victim->in_use && (int32_t)(senders[i].last_heard - victim->last_heard) < 0)) {
+            victim = &senders[i];
+        }
+    }
+    memset(victim, 0, sizeof(*victim));
+    memcpy(victim->mac, mac, ESP_NOW_ETH_ALEN);
+    victim->in_use = true;
+    *fresh = true;
+    return victim;
+}
+
+// Returns false if `seq` was already heard from this sender.
+static bool mesh_frame_check_seq_locked(const uint8_t *mac, uint16_t seq)
+{
+    bool fresh;
+    sender_window_t *w = mesh_frame_sender_locked(mac, &fresh);
+    w->last_heard = ++frame_clock;
+    int16_t diff = (int16_t)(seq - w->top);
+    if (fresh) {
+        w->top = seq;
+        w->seen = 1;
+        return true;
+    }
+    if (diff > 0) {
+        w->seen = (diff >= MESH_FRAME_SEQ_WINDOW) ? 0 : (w->seen << diff);
+        w->seen |= 1;
+        w->top = seq;
+        return true;
+    }
+    uint32_t back = (uint32_t)(-diff);
+    if (back >= MESH_FRAME_SEQ_WINDOW) {
+        // Far behind the window: the sender restarted its counter.
+        stats.sender_resets++;
+        w->top = seq;
+        w->seen = 1;
+        return true;
+    }
+    uint64_t bit = 1ULL << back;
+    if (w->seen & bit) {
+        return false;
+    }
+    w->seen |= bit;
+    return true;
+}
+
+// Returns false if the same message id was heard within `ttl_ms`.
+static bool mesh_frame_check_msg_id_locked(uint32_t id, uint32_t ttl_ms)
+{
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < MESH_FRAME_MSG_ID_SLOTS; i++) {
+        if (msg_ids[i].heard_us != 0 && msg_ids[i].id == id &&
+            now - msg_ids[i].heard_us < (int64_t)ttl_ms * 1000) {
+            return false;
+        }
+    }
+    msg_ids[msg_id_next].id = id;
+    msg_ids[msg_id_next].heard_us = now;
+    msg_id_next = (msg_id_next + 1) % MESH_FRAME_MSG_ID_SLOTS;
+    return true;
+}
+
+void mesh_frame_init(void)
+{
+    if (frame_mutex) {
+        return;
+    }
+    frame_mutex = xSemaphoreCreateMutex();
+    if (!frame_mutex) {
+        ESP_LOGE(TAG, "Failed to create frame mutex");
+        return;
+    }
+    memset(senders, 0, sizeof(senders));
+    memset(msg_ids, 0, sizeof(msg_ids));
+    // Start somewhere other than zero so a quick reboot does not replay the old window.
+    next_seq = (uint16_t)esp_random();
+}
+
+size_t mesh_frame_encode(const uint8_t *msg, size_t msg_len, uint8_t *out, size_t out_cap)
+{
+    size_t total = MESH_FRAME_HEADER_LEN + msg_len;
+    if (msg_len == 0 || total > out_cap || msg_len > MESH_FRAME_MAX_MESSAGE) {
+        return 0;
+    }
+    uint16_t seq;
+    if (frame_mutex) {
+        xSemaphoreTake(frame_mutex, portMAX_DELAY);
+        seq = next_seq++;
+        xSemaphoreGive(frame_mutex);
+    } else {
+        seq = next_seq++;
+    }
+    uint32_t id = mesh_frame_msg_id(msg, msg_len);
+    out[0] = MESH_FRAME_VERSION;
+    memcpy(out + 1, &seq, sizeof(seq));
+    memcpy(out + 1 + sizeof(seq), &id, sizeof(id));
+    memcpy(out + MESH_FRAME_HEADER_LEN, msg, msg_len);
+    return total;
+}
+
+bool mesh_frame_accept(const uint8_t *src_mac, const uint8_t *frame, size_t len,
+                       const uint8_t **msg, size_t *msg_len)
+{
+    if (!frame_mutex) {
+        return false;
+    }
+    if (len <= MESH_FRAME_HEADER_LEN || frame[0] != MESH_FRAME_VERSION) {
+        xSemaphoreTake(frame_mutex, portMAX_DELAY);
+        stats.bad_header++;
+        xSemaphoreGive(frame_mutex);
+        metrics_count(METRICS_RX_BAD_FRAME);
+        ESP_LOGD(TAG, "Dropping unframed or foreign-version frame from " MACSTR, MAC2STR(src_mac));
+        return false;
+    }
+    uint16_t seq;
+    uint32_t id;
+    memcpy(&seq, frame + 1, sizeof(seq));
+    memcpy(&id, frame + 1 + sizeof(seq), sizeof(id));
+    uint8_t cmd = frame[MESH_FRAME_HEADER_LEN];
+
+    bool keep;
+    xSemaphoreTake(frame_mutex, portMAX_DELAY);
+    if (!mesh_frame_check_seq_locked(src_mac, seq)) {
+        stats.dup_seq++;
+        keep = false;
+    } else if (mesh_frame_is_idempotent(cmd) &&
+               !mesh_frame_check_msg_id_locked(mesh_frame_is_request(cmd) ?
+                                               mesh_frame_fnv(id, src_mac, ESP_NOW_ETH_ALEN) : id,
+                                               mesh_frame_msg_ttl_ms(cmd))) {
+        stats.dup_msg++;
+        keep = false;
+    } else {
+        stats.accepted++;
+        keep = true;
+    }
+    if (!keep) {
+        stats.dup_bytes += len;
+    }
+    xSemaphoreGive(frame_mutex);
+
+    if (!keep) {
+        metrics_count(METRICS_RX_DUPLICATE);
+        ESP_LOGD(TAG, "Duplicate 0x%02x (seq %u) from " MACSTR " dropped", cmd, seq, MAC2STR(src_mac));
+        return false;
+    }
+    *msg = frame + MESH_FRAME_HEADER_LEN;
+    *msg_len = len - MESH_FRAME_HEADER_LEN;
+    return true;
+}
+
+void mesh_frame_get_stats(mesh_frame_stats_t *out)
+{
+    if (!frame_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(frame_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(frame_mutex);
+}
@@ -0,0 +1,43 @@
+#ifndef MESH_FRAME_H
+#define MESH_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_now.h"
+
+// Every ESP-NOW frame starts with this header, followed by the message itself:
+//   [version][u16 sender seq][u32 msg id][cmd][payload...]
+// The message (cmd onwards) is what the rest of the firmware builds and parses.
+#define MESH_FRAME_VERSION          1
+#define MESH_FRAME_HEADER_LEN       (1 + sizeof(uint16_t) + sizeof(uint32_t))
+#define MESH_FRAME_MAX_MESSAGE      (ESP_NOW_MAX_DATA_LEN - MESH_FRAME_HEADER_LEN)
+
+#define MESH_FRAME_SEQ_WINDOW       64      // Sequence numbers remembered per sender
+#define MESH_FRAME_MAX_SENDERS      16      // Senders tracked at once (least recently heard is replaced)
+#define MESH_FRAME_MSG_ID_SLOTS     64      // Recent message ids kept for content dedup; fragment bursts share them
+#define MESH_FRAME_MSG_ID_TTL_MS    3000    // A repeated message older than this is accepted again
+#define MESH_FRAME_RESEND_TTL_MS    1000    // The same for fragments and block-set requests, which are resent on purpose
+
+typedef struct {
+    uint32_t accepted;
+    uint32_t bad_header;        // Too short or wrong version
+    uint32_t dup_seq;           // Same frame heard twice (retransmit or multipath)
+    uint32_t dup_msg;           // Same block or fragment from any sender, or same request from one sender
+    uint32_t dup_bytes;         // Bytes dropped before parsing
+    uint32_t sender_resets;     // Sequence jumped backwards past the window (sender rebooted)
+} mesh_frame_stats_t;
+
+void mesh_frame_init(void);
+
+// Wrap `msg` in a frame header. Returns the frame length, or 0 if it does not fit.
+size_t mesh_frame_encode(const uint8_t *msg, size_t msg_len, uint8_t *out, size_t out_cap);
+
+// Validate and de-duplicate a received frame. On acceptance *msg/*msg_len describe the
+// message inside it; on false the frame must be dropped without further processing.
+bool mesh_frame_accept(const uint8_t *src_mac, const uint8_t *frame, size_t len,
+                       const uint8_t **msg, size_t *msg_len);
+
+void mesh_frame_get_stats(mesh_frame_stats_t *out);
+
+#endif // MESH_FRAME_H
@@ -1,46 +1,159 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_MESH_NETWORKING
 #include "mesh_networking.h"
 #include "node_response.h"
 #include "election_response.h"
+#include "heartbeat.h"
+#include "aggregation.h"
+#include "espnow_tx.h"
+#include "mesh_frame.h"
+#include "block_sync.h"
+#include "block_broadcast.h"
+#include "block_cache.h"
+#include "checkpoint.h"
+#include "shard.h"
+#include "frame_trace.h"
+#include "metrics.h"
+#include "event_trace.h"
+#include "deferred_log.h"
 #include "command_set.h"
 
 static const char *TAG = "mesh_networking";
 
 uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
-void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
+// After placing block `block_num` from `mac_addr`: fetch every gap below it in one request
+// when we missed rounds, and walk a fork that does not reach our chain yet back to it.
+static void mesh_networking_request_gaps(const uint8_t *mac_addr, uint32_t block_num, bool behind)
 {
-    ESP_LOGW(TAG, "Received data from " MACSTR, MAC2STR(mac_addr));
+    if (behind) {
+        block_sync_request_missing(mac_addr, block_num);
+    }
+    block_range_t fork_gap;
+    if (blockchain_get_fork_gap(&fork_gap)) {
+        block_sync_request_range(mac_addr, fork_gap);
+    }
+}
+
+// Validate a serialized block announced by `mac_addr` and hand it to the chain store, then
+// fetch whatever it showed us to be missing.
+void mesh_networking_accept_block(const uint8_t *mac_addr, const uint8_t *serialized_data, int payload_len)
+{
+    block_t *received_block = blockchain_parse_received_serialized_block(serialized_data, payload_len);
+    if (!received_block) {
+        return;
+    }               
+    
+    EVENT_TRACE(EV_BLOCK_RX, received_block->block_num, received_block->num_sensor_readings);
+
+    // Create a temporary copy of the block to validate hash.
+    block_t temp_block = *received_block;
+    memset(temp_block.hash, 0, sizeof(temp_block.hash));
+
+    // Compute and validate the block hash.
+    calculate_block_hash(&temp_block);
+    if (memcmp(temp_block.hash, received_block->hash, 32) != 0) {
+        metrics_count(METRICS_BLOCK_HASH_MISMATCH);
+        DEFERRED_LOG(DLOG_BLOCK_HASH_MISMATCH, mac_addr, received_block->block_num, 0, 0);
+        blockchain_free_block(received_block);
+        return;
+    }
+    EVENT_TRACE(EV_BLOCK_VALID, received_block->block_num, event_trace_mac(mac_addr));
+
+    // Track previous block
+    block_t last_block;
+    uint32_t expected_num = 0;
+    if (blockchain_get_last_block(&last_block)) {
+        expected_num = last_block.block_num + 1;
+    }
+    uint32_t announced_num = received_block->block_num;
+    if (announced_num > expected_num) {
+        DEFERRED_LOG(DLOG_BLOCK_AHEAD, NULL, expected_num, announced_num, 0);
+    }
+    // The store links the block by number and prev_hash: appended, parked in the fork pool,
+    // or adopted through a reorganization if its branch wins.
+    blockchain_add_result_t added = blockchain_add_block(received_block);
+    if (added == BLOCKCHAIN_ADD_REJECTED) {
+        blockchain_free_block(received_block);
+    } else if (added != BLOCKCHAIN_ADD_FORKED) {
+        // Keep the bytes we were sent; we are likely to be asked for this block soon.
+        block_cache_put(announced_num, serialized_data, payload_len);
+    }
+    mesh_networking_request_gaps(mac_addr, announced_num, announced_num > expected_num);
+}
+
+// Validate a block sent in answer to a request (one frame, or reassembled reply fragments)
+// and insert it in the correct place; a light node may be getting the body it asked for.
+void mesh_networking_accept_historical_block(const uint8_t *mac_addr, const uint8_t *serialized_data, int payload_len)
+{
+    block_t *received_block = blockchain_parse_received_serialized_block(serialized_data, payload_len);
+    if (!received_block) {
+        return;
+    }
 
-    if (len < 1) return; // must have at least the command byte
+    // Create a temporary copy of the block to validate hash.
+    block_t temp_block = *received_block;
+    memset(temp_block.hash, 0, sizeof(temp_block.hash));
+    calculate_block_hash(&temp_block);
+
+    if (memcmp(temp_block.hash, received_block->hash, 32) != 0) {
+        metrics_count(METRICS_BLOCK_HASH_MISMATCH);
+        DEFERRED_LOG(DLOG_HISTORICAL_HASH_MISMATCH, mac_addr, received_block->block_num, 0, 0);
+        blockchain_free_block(received_block);
+        return;
+    }
+    uint32_t block_num = received_block->block_num;
+    EVENT_TRACE(EV_BLOCK_VALID, block_num, event_trace_mac(mac_addr));
+    blockchain_add_result_t added = blockchain_add_block(received_block);
+    if (added == BLOCKCHAIN_ADD_REJECTED) {
+        // A light node keeps only the header; this may be the body it asked for.
+        block_t local_copy;
+        if (blockchain_get_block_by_number(block_num, &local_copy) &&
+            memcmp(local_copy.hash, received_block->hash, 32) == 0) {
+            block_cache_put(block_num, serialized_data, payload_len);
+            // A shard we now hold gets its body back for good.
+            if (shard_offer_body(received_block)) {
+                return;
+            }
+        }
+        blockchain_free_block(received_block);
+        return;
+    }
+    if (added != BLOCKCHAIN_ADD_FORKED) {
+        block_cache_put(block_num, serialized_data, payload_len);
+    }
+    // Any gaps left are asked for in one request, and only once the
+    // current one stops delivering.
+    block_sync_note_progress();
+    mesh_networking_request_gaps(mac_addr, block_num, true);
+}
+
+void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *frame, int frame_len)
+{
+    if (frame_len > 0) {
+        frame_trace_record(FRAME_TRACE_RX, mac_addr, frame, (size_t)frame_len);
+    }
+
+    // Drop duplicates before anything below parses or hashes them.
+    const uint8_t *data;
+    size_t msg_len;
+    if (frame_len < 1 || !mesh_frame_accept(mac_addr, frame, (size_t)frame_len, &data, &msg_len)) {
+        EVENT_TRACE(EV_RX_DROP, frame_len, event_trace_mac(mac_addr));
+        return;
+    }
+    EVENT_TRACE(EV_RX, frame_len, event_trace_mac(mac_addr));
+    int len = (int)msg_len;
     uint8_t cmd = data[0];
+    metrics_rx(cmd, msg_len);
     switch (cmd) {
         case CMD_ACK:
-            ESP_LOGI(TAG, "Got ACK from " MACSTR, MAC2STR(mac_addr));
             break;
         case CMD_PULSE:
-            {
-                // Received pulse from leader: take a sensor reading.
-                float temp = temperature_probe_read_temperature();
-                float humidity = temperature_probe_read_humidity();
-                uint32_t now = (uint32_t)time(NULL);
-                // Build binary sensor message: [CMD_SENSOR_DATA][temp][humidity][timestamp]
-                uint8_t sensor_msg[1 + sizeof(float)*2 + sizeof(uint32_t)];
-                sensor_msg[0] = CMD_SENSOR_DATA;
-                size_t offset = 1;
-                memcpy(sensor_msg + offset, &temp, sizeof(float));
-                offset += sizeof(float);
-                memcpy(sensor_msg + offset, &humidity, sizeof(float));
-                offset += sizeof(float);
-                memcpy(sensor_msg + offset, &now, sizeof(uint32_t));
-                // Broadcast sensor data.
-                esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, broadcast_mac,
-                                                    sensor_msg, sizeof(sensor_msg));
-                if(ret != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to broadcast sensor data: " MACSTR, MAC2STR(broadcast_mac));
-                } else {
-                    ESP_LOGI(TAG, "Sensor data broadcasted");
-                }
-            }
+            // Received pulse from leader: take a reading and report it through our parent.
+            aggregation_on_pulse(mac_addr, data, len);
+            break;
+        case CMD_AGG_DATA:
+            aggregation_on_data(mac_addr, data, len);
             break;
         case CMD_CHAIN_REQ:
             {
@@ -53,7 +166,7 @@ void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
                     esp_err_t ret = espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, mac_addr,
                                                         reply, sizeof(reply));
                     if(ret != ESP_OK) {
-                        ESP_LOGE(TAG, "Failed to send blockchain sync response to " MACSTR, MAC2STR(mac_addr));
+                        DEFERRED_LOG(DLOG_CHAIN_RESP_FAILED, mac_addr, 0, 0, 0);
                     }
                 }
             }
@@ -62,89 +175,28 @@ void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
             {
                 // Payload (after first byte) should be 6 bytes MAC.
                 if (len < 1 + ESP_NOW_ETH_ALEN) {
-                    ESP_LOGE(TAG, "Election message too short from " MACSTR, MAC2STR(mac_addr));
+                    metrics_count(METRICS_RX_MALFORMED);
+                    DEFERRED_LOG(DLOG_ELECTION_SHORT, mac_addr, 0, 0, 0);
                     break;
                 }
                 uint8_t leader_mac[ESP_NOW_ETH_ALEN];
                 memcpy(leader_mac, data + 1, ESP_NOW_ETH_ALEN);
+                // The round loop takes it from here, and only it tells the heartbeat whom to
+                // monitor: a stale or duplicate election must not move the detector.
                 election_response_push(mac_addr, leader_mac);
-                ESP_LOGE(TAG, "Election message from " MACSTR ": next leader MAC = " MACSTR,
-                         MAC2STR(mac_addr), MAC2STR(leader_mac));
+                EVENT_TRACE(EV_ELECTION_RX, event_trace_mac(leader_mac), event_trace_mac(mac_addr));
             }
             break;
         case CMD_NEW_BLOCK:
-            {
-                // Data after first byte is the serialized block.
-                const uint8_t *serialized_data = data + 1;
-                int payload_len = len - 1;
-
-                block_t *received_block = blockchain_parse_received_serialized_block(serialized_data, payload_len);
-                if (!received_block) {
-                    return;
-                }               
-                
-                // Create a temporary copy of the block to validate hash.
-                block_t temp_block = *received_block;
-                memset(temp_block.hash, 0, sizeof(temp_block.hash));
-                ESP_LOGW(TAG, "Temp Block:");
-                blockchain_print_block_struct(&temp_block);
-                
-                ESP_LOGW(TAG, "Recv Block:");
-                blockchain_print_block_struct(received_block);
-            
-                // Compute and validate the block hash.
-                calculate_block_hash(&temp_block);
-                ESP_LOGW(TAG, "Hash computed for temp block:");
-                ESP_LOG_BUFFER_HEX_LEVEL(TAG, temp_block.hash, 32, ESP_LOG_INFO);
-                
-                if (memcmp(temp_block.hash, received_block->hash, 32) != 0) {
-                    ESP_LOGE(TAG, "Block hash validation failed!");
-                    ESP_LOG_BUFFER_HEX_LEVEL(TAG, temp_block.hash, 32, ESP_LOG_INFO);
-                    ESP_LOG_BUFFER_HEX_LEVEL(TAG, received_block->hash, 32, ESP_LOG_INFO);
-                    // Free allocated sensor records and block before returning.
-                    sensor_record_t *cur = received_block->node_data;
-                    while (cur) {
-                        sensor_record_t *next = cur->next;
-                        free(cur);
-                        cur = next;
-                    }
-                    free(received_block);
-                    return;
-                } else {
-                    ESP_LOGI(TAG, "Block hash validated successfully.");
-                }
-                
-                ESP_LOGI(TAG, "Adding new block:");
-                blockchain_print_block_struct(received_block);
-                
-                // Track previous block
-                block_t last_block;
-                blockchain_get_last_block(&last_block);
-
-                // Add the block to the blockchain (which now expects a pointer).
-                blockchain_add_block(received_block);
-
-                uint32_t expected_num = last_block.block_num + 1;
-                ESP_LOGI(TAG, "Expected block number: %" PRIu32, expected_num);
-                if (received_block->block_num == expected_num) {
-                    ESP_LOGI(TAG, "Block number matches expected.");
-                } else {
-                    ESP_LOGW(TAG, "Block number mismatch. Expected: %" PRIu32 ", got: %" PRIu32, expected_num, received_block->block_num);
-                    if (received_block->block_num > expected_num) {
-                        uint8_t send_buffer[1 + sizeof(uint32_t)];
-                        send_buffer[0] = CMD_REQUEST_SPECIFIC_BLOCK;
-                        uint32_t missing_block_num = expected_num;
-                        memcpy(send_buffer + 1, &missing_block_num, sizeof(uint32_t));
-                        espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, broadcast_mac, send_buffer, sizeof(send_buffer));
-                    }
-                }
-            }
+            // Data after first byte is the serialized block.
+            mesh_networking_accept_block(mac_addr, data + 1, len - 1);
             break;
         case CMD_SENSOR_DATA:
             {
                 // Expect payload: [CMD_SENSOR_DATA][float temp][float humidity][uint32_t timestamp]
                 if (len != 1 + sizeof(float)*2 + sizeof(uint32_t)) {
-                    ESP_LOGE(TAG, "Invalid sensor data length from " MACSTR, MAC2STR(mac_addr));
+                    metrics_count(METRICS_RX_MALFORMED);
+                    DEFERRED_LOG(DLOG_SENSOR_BAD_LENGTH, mac_addr, 0, 0, 0);
                     break;
                 }
                 sensor_record_t sensorData = {0};
@@ -156,102 +208,63 @@ void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
                 offset += sizeof(float);
                 memcpy(&sensorData.timestamp, data + offset, sizeof(uint32_t));
                 node_response_push(mac_addr, &sensorData);
-                ESP_LOGI(TAG, "Received sensor data from " MACSTR, MAC2STR(mac_addr));
+                EVENT_TRACE(EV_SENSOR_RX, event_trace_mac(mac_addr), 0);
             }
             break;
         case CMD_RESET_BLOCKCHAIN:
             ESP_LOGI(TAG, "Received reset command from " MACSTR, MAC2STR(mac_addr));
             blockchain_deinit();
             blockchain_init();
+            block_cache_clear();
             break;
         case CMD_REQUEST_SPECIFIC_BLOCK:
             {
-                ESP_LOGI(TAG, "Received request for specific block from " MACSTR, MAC2STR(mac_addr));
-                if (len < 1 + sizeof(uint32_t)) {
-                    ESP_LOGE(TAG, "Invalid request length");
+                if (len < 1 + (int)sizeof(uint32_t)) {
+                    metrics_count(METRICS_RX_MALFORMED);
+                    DEFERRED_LOG(DLOG_REQUEST_BAD_LENGTH, mac_addr, 0, 0, 0);
                     break;
                 }
                 uint32_t requested_block_num;
                 memcpy(&requested_block_num, data + 1, sizeof(requested_block_num));
-                ESP_LOGI(TAG, "Missing block requested: %" PRIu32, requested_block_num);
+                EVENT_TRACE(EV_BLOCK_REQUEST_RX, requested_block_num, event_trace_mac(mac_addr));
 
-                // If current node is root, get the block and broadcast it
+                // If current node is root, broadcast the block. Sending may wait on the bulk
+                // queue and fragment it, so the block_sync task does it; a block below our
+                // checkpoint anchor is fetched from there now that it is wanted.
                 if (esp_mesh_lite_get_level() <= 1) {
-                    block_t missing_block;
-                    if (blockchain_get_block_by_number(requested_block_num, &missing_block)) {
-                        // Serialize and broadcast as CMD_HISTORICAL_BLOCK
-                        uint8_t *serialized_block = NULL;
-                        size_t block_size = blockchain_serialize_block(&missing_block, &serialized_block);
-                        if (block_size > 0) {
-                            uint8_t send_buffer[1 + block_size];
-                            send_buffer[0] = CMD_HISTORICAL_BLOCK;
-                            memcpy(send_buffer + 1, serialized_block, block_size);
-                            espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, broadcast_mac, send_buffer, sizeof(send_buffer));
-                            free(serialized_block);
-                        }
-                    } else {
-                        ESP_LOGW(TAG, "Requested block not found");
-                    }
+                    block_range_t range = { .first = requested_block_num, .last = requested_block_num };
+                    block_sync_serve_range(broadcast_mac, range);
                 }
                 break;
             }
         case CMD_HISTORICAL_BLOCK:
-            {
-                // Parse the received block, validate hash, then insert in correct place
-                const uint8_t *serialized_data = data + 1;
-                int payload_len = len - 1;
-                block_t *received_block = blockchain_parse_received_serialized_block(serialized_data, payload_len);
-                if (!received_block) { break; }
-                
-                // Create a temporary copy of the block to validate hash.
-                block_t temp_block = *received_block;
-                memset(temp_block.hash, 0, sizeof(temp_block.hash));
-                calculate_block_hash(&temp_block);
-                
-                if (memcmp(temp_block.hash, received_block->hash, 32) != 0) {
-                    ESP_LOGE(TAG, "Historical block hash validation failed!");
-                    free(received_block);
-                    break;
-                } else {
-                    ESP_LOGI(TAG, "Historical block hash validated successfully.");
-                    block_t local_copy;
-                    if (blockchain_get_block_by_number(received_block->block_num, &local_copy)) {
-                        if (memcmp(local_copy.hash, received_block->hash, 32) != 0) {
-                            ESP_LOGW(TAG, "Local block %u differs from broadcasted block!", received_block->block_num);
-                        } else {
-                            ESP_LOGI(TAG, "We already have the same block %u, skipping insert.", received_block->block_num);
-                        }
-                        free(received_block);
-                    } else {
-                        ESP_LOGI(TAG, "Adding new block:");
-                        blockchain_print_block_struct(received_block);
-
-                        if (!blockchain_insert_block(received_block)) {
-                            ESP_LOGE(TAG, "Failed to insert historical block");
-                            free(received_block);
-                        } else {
-                            uint32_t inserted_num = received_block->block_num;
-                            while (inserted_num > 0) {
-                                block_t check_block;
-                                if (blockchain_get_block_by_number(inserted_num - 1, &check_block)) {
-                                    break; // No gap at this level
-                                }
-                                uint8_t req_buf[1 + sizeof(uint32_t)];
-                                req_buf[0] = CMD_REQUEST_SPECIFIC_BLOCK;
-                                uint32_t needed_num = inserted_num - 1;
-                                memcpy(req_buf + 1, &needed_num, sizeof(uint32_t));
-                                espnow_send_wrapper(ESPNOW_DATA_TYPE_RESERVE, broadcast_mac, req_buf, sizeof(req_buf));
-                                inserted_num--;
-                            }
-                        }
-                    }
-                }
-                break;
-            }
+            mesh_networking_accept_historical_block(mac_addr, data + 1, len - 1);
+            break;
+        case CMD_CHECKPOINT_REQ:
+            checkpoint_on_request(mac_addr, data, len);
+            break;
+        case CMD_CHECKPOINT:
+            checkpoint_on_checkpoint(mac_addr, data, len);
+            break;
+        case CMD_BLOCK_FRAGMENT:
+        case CMD_BLOCK_REPLY_FRAGMENT:
+            block_broadcast_on_fragment(mac_addr, data, len);
+            break;
+        case CMD_BLOCK_NACK:
+            block_broadcast_on_nack(mac_addr, data, len);
+            break;
+        case CMD_REQUEST_BLOCK_SET:
+            block_sync_on_request(mac_addr, data, len);
+            break;
+        case CMD_HEARTBEAT:
+            heartbeat_on_beacon(mac_addr, data, len);
+            break;
         default:
-            ESP_LOGI(TAG, "Received unknown command 0x%02x from " MACSTR, cmd, MAC2STR(mac_addr));
+            metrics_count(METRICS_RX_UNKNOWN_CMD);
+            EVENT_TRACE(EV_RX_UNKNOWN, cmd, event_trace_mac(mac_addr));
             break;
     }
+    EVENT_TRACE(EV_RX_END, cmd, 0);
 }
 
 void add_self_broadcast_peer(void)
@@ -318,24 +331,8 @@ void espnow_ledger_check_task(void *arg)
     }
 }
 
+// Frames go through the asynchronous transmit queue; ESP_OK means queued, not delivered.
 esp_err_t espnow_send_wrapper(uint8_t type, const uint8_t *dest_addr, const uint8_t *data, size_t len)
 {
-    esp_err_t ret = esp_mesh_lite_espnow_send(type, dest_addr, data, len);
-    if (ret == ESP_ERR_ESPNOW_NOT_FOUND) {
-        ESP_LOGI(TAG, "Peer not found, adding new peer: " MACSTR, MAC2STR(dest_addr));
-        esp_now_peer_info_t peerInfo = {0};
-        peerInfo.ifidx = WIFI_IF_STA;
-        peerInfo.encrypt = false;
-        memcpy(peerInfo.peer_addr, dest_addr, ESP_NOW_ETH_ALEN);
-        if ((ret = esp_now_add_peer(&peerInfo)) == ESP_OK) {
-            ret = esp_mesh_lite_espnow_send(type, dest_addr, data, len);
-            if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to re-send ESPNOW msg to " MACSTR ", err=0x%x:%s",
-                         MAC2STR(dest_addr), ret, esp_err_to_name(ret));
-            }
-        } else {
-            ESP_LOGE(TAG, "Failed adding peer: %s", esp_err_to_name(ret));
-        }
-    }
-    return ret;
+    return espnow_tx_enqueue(type, dest_addr, data, len, ESPNOW_TX_PRIO_NORMAL);
 }
\ No newline at end of file
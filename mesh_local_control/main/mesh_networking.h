@@ -7,9 +7,11 @@
 #include "node_id.h"
 #include "consensus.h"
 
-void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len);
+void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *frame, int frame_len);
 void add_self_broadcast_peer(void);
 void espnow_periodic_send_task(void *arg);
+void mesh_networking_accept_block(const uint8_t *mac_addr, const uint8_t *serialized_data, int payload_len);
+void mesh_networking_accept_historical_block(const uint8_t *mac_addr, const uint8_t *serialized_data, int payload_len);
 esp_err_t espnow_send_wrapper(uint8_t type, const uint8_t *dest_addr, const uint8_t *data, size_t len);
 
 #endif
@@ -0,0 +1,395 @@
+#include "metrics.h"
+#include "mem_track.h"
+#include "node_local.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "metrics";
+
+// Everything a core adds to. Each slot is only written from its own core, so the atomics never
+// contend across cores; they only keep a preempted read-modify-write from losing an update.
+// The 64-bit sums fall back to the IDF's critical-section atomics on the 32-bit targets.
+typedef struct {
+    uint32_t rx_frames[METRICS_CMD_SLOTS];
+    uint32_t rx_bytes[METRICS_CMD_SLOTS];
+    uint32_t tx_frames[METRICS_CMD_SLOTS];
+    uint32_t tx_bytes[METRICS_CMD_SLOTS];
+    uint32_t counters[METRICS_COUNTER_COUNT];
+    metrics_histogram_t hists[METRICS_HIST_COUNT];
+} metrics_core_t;
+
+static NODE_LOCAL metrics_core_t cores[portNUM_PROCESSORS];
+static NODE_LOCAL uint32_t gauges[METRICS_GAUGE_COUNT];
+
+// Written by the transmit task only; snapshots may see one entry mid-update.
+static NODE_LOCAL metrics_peer_rtt_t peers[METRICS_RTT_PEERS];
+static NODE_LOCAL uint32_t peer_next = 0;      // Slot to recycle once the table is full
+
+static const char *const cmd_names[METRICS_CMD_SLOTS] = {
+    "other", "ack", "pulse", "chain_req", "chain_resp", "election", "new_block", "sensor_data",
+    "reset_blockchain", "request_specific_block", "historical_block", "heartbeat", "agg_data",
+    "request_block_set", "block_fragment", "block_nack", "checkpoint_req", "checkpoint",
+    "block_reply_fragment",
+};
+
+static const char *const counter_names[METRICS_COUNTER_COUNT] = {
+    [METRICS_RX_BAD_FRAME] = "rx_bad_frame",
+    [METRICS_RX_DUPLICATE] = "rx_duplicate",
+    [METRICS_RX_MALFORMED] = "rx_malformed",
+    [METRICS_RX_UNKNOWN_CMD] = "rx_unknown_cmd",
+    [METRICS_TX_DROPPED] = "tx_dropped",
+    [METRICS_TX_FAILED] = "tx_failed",
+    [METRICS_TX_UNCONFIRMED] = "tx_unconfirmed",
+    [METRICS_BLOCK_HASH_MISMATCH] = "block_hash_mismatch",
+    [METRICS_SENSOR_QUEUE_FULL] = "sensor_queue_full",
+    [METRICS_ELECTION_QUEUE_FULL] = "election_queue_full",
+    [METRICS_ROUND_READINGS_MISSED] = "round_readings_missed",
+};
+
+static const char *const gauge_names[METRICS_GAUGE_COUNT] = {
+    [METRICS_GAUGE_SENSOR_QUEUE_HWM] = "sensor",
+    [METRICS_GAUGE_ELECTION_QUEUE_HWM] = "election",
+};
+
+static const char *const hist_names[METRICS_HIST_COUNT] = {
+    [METRICS_HIST_HASH] = "hash",
+    [METRICS_HIST_SERIALIZE] = "serialize",
+    [METRICS_HIST_PARSE] = "parse",
+    [METRICS_HIST_ROUND] = "round",
+    [METRICS_HIST_RTT] = "rtt",
+};
+
+static inline metrics_core_t *metrics_core(void)
+{
+    return &cores[xPortGetCoreID() % portNUM_PROCESSORS];
+}
+
+static inline void metrics_add(uint32_t *counter, uint32_t n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t metrics_cmd_slot(uint8_t cmd)
+{
+    return cmd < METRICS_CMD_SLOTS ? cmd : 0;
+}
+
+void metrics_init(void)
+{
+    ESP_LOGI(TAG, "Metrics registry ready (%d command slots, %d histograms)",
+             METRICS_CMD_SLOTS, METRICS_HIST_COUNT);
+}
+
+void metrics_rx(uint8_t cmd, size_t len)
+{
+    metrics_core_t *c = metrics_core();
+    uint32_t slot = metrics_cmd_slot(cmd);
+    metrics_add(&c->rx_frames[slot], 1);
+    metrics_add(&c->rx_bytes[slot], (uint32_t)len);
+}
+
+void metrics_tx(uint8_t cmd, size_t len)
+{
+    metrics_core_t *c = metrics_core();
+    uint32_t slot = metrics_cmd_slot(cmd);
+    metrics_add(&c->tx_frames[slot], 1);
+    metrics_add(&c->tx_bytes[slot], (uint32_t)len);
+}
+
+void metrics_count(metrics_counter_t counter)
+{
+    metrics_add(&metrics_core()->counters[counter], 1);
+}
+
+void metrics_count_n(metrics_counter_t counter, uint32_t n)
+{
+    metrics_add(&metrics_core()->counters[counter], n);
+}
+
+void metrics_high_water(metrics_gauge_t gauge, uint32_t value)
+{
+    uint32_t seen = __atomic_load_n(&gauges[gauge], __ATOMIC_RELAXED);
+    while (value > seen &&
+           !__atomic_compare_exchange_n(&gauges[gauge], &seen, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static inline uint32_t metrics_bucket(uint32_t us)
+{
+    uint32_t b = (us <= 1) ? 0 : 32 - __builtin_clz(us - 1);
+    return b < METRICS_HIST_BUCKETS ? b : METRICS_HIST_BUCKETS - 1;
+}
+
+void metrics_observe_us(metrics_hist_t hist, uint32_t us)
+{
+    metrics_histogram_t *h = &metrics_core()->hists[hist];
+    metrics_add(&h->buckets[metrics_bucket(us)], 1);
+    __atomic_fetch_add(&h->sum_us, (uint64_t)us, __ATOMIC_RELAXED);
+}
+
+void metrics_peer_rtt(const uint8_t *peer, uint32_t us)
+{
+    metrics_observe_us(METRICS_HIST_RTT, us);
+    metrics_peer_rtt_t *slot = NULL;
+    for (int i = 0; i < METRICS_RTT_PEERS && !slot; i++) {
+        if (peers[i].samples > 0 && memcmp(peers[i].mac, peer, ESP_NOW_ETH_ALEN) == 0) {
+            slot = &peers[i];
+        }
+    }
+    for (int i = 0; i < METRICS_RTT_PEERS && !slot; i++) {
+        if (peers[i].samples == 0) {
+            slot = &peers[i];
+        }
+    }
+    if (!slot) {
+        slot = &peers[peer_next];
+        peer_next = (peer_next + 1) % METRICS_RTT_PEERS;
+        slot->samples = 0;
+    }
+    if (slot->samples == 0) {
+        memcpy(slot->mac, peer, ESP_NOW_ETH_ALEN);
+        slot->sum_us = 0;
+        slot->max_us = 0;
+    }
+    slot->sum_us += us;
+    if (us > slot->max_us) {
+        slot->max_us = us;
+    }
+    slot->samples++;
+}
+
+static void metrics_sum(uint32_t *out, const uint32_t *in, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] += __atomic_load_n(&in[i], __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_snapshot(metrics_snapshot_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->uptime_us = esp_timer_get_time();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const metrics_core_t *c = &cores[core];
+        metrics_sum(out->rx_frames, c->rx_frames, METRICS_CMD_SLOTS);
+        metrics_sum(out->rx_bytes, c->rx_bytes, METRICS_CMD_SLOTS);
+        metrics_sum(out->tx_frames, c->tx_frames, METRICS_CMD_SLOTS);
+        metrics_sum(out->tx_bytes, c->tx_bytes, METRICS_CMD_SLOTS);
+        metrics_sum(out->counters, c->counters, METRICS_COUNTER_COUNT);
+        for (int h = 0; h < METRICS_HIST_COUNT; h++) {
+            metrics_sum(out->hists[h].buckets, c->hists[h].buckets, METRICS_HIST_BUCKETS);
+            out->hists[h].sum_us += __atomic_load_n(&c->hists[h].sum_us, __ATOMIC_RELAXED);
+        }
+    }
+    metrics_sum(out->gauges, gauges, METRICS_GAUGE_COUNT);
+    memcpy(out->peers, peers, sizeof(out->peers));
+    mem_track_snapshot(&out->mem);
+}
+
+// Appends to a fixed buffer; `ok` goes false once it would overflow.
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool ok;
+} metrics_buf_t;
+
+static void metrics_put(metrics_buf_t *b, const void *src, size_t len)
+{
+    if (b->len + len > b->cap) {
+        b->ok = false;
+        return;
+    }
+    memcpy(b->buf + b->len, src, len);
+    b->len += len;
+}
+
+#define METRICS_BINARY_MAX_LEN  (24 + sizeof(metrics_snapshot_t))  // Header, then at most the snapshot
+
+bool metrics_write_binary(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx)
+{
+    metrics_snapshot_t *snap = mem_track_malloc(MEM_TAG_COMM, sizeof(*snap));
+    uint8_t *buf = mem_track_malloc(MEM_TAG_COMM, METRICS_BINARY_MAX_LEN);
+    if (!snap || !buf) {
+        ESP_LOGE(TAG, "No memory for a metrics snapshot");
+        mem_track_free(snap);
+        mem_track_free(buf);
+        return false;
+    }
+    metrics_snapshot(snap);
+    metrics_buf_t b = {buf, METRICS_BINARY_MAX_LEN, 0, true};
+    const uint8_t hdr[] = {
+        METRICS_MAGIC[0], METRICS_MAGIC[1], METRICS_MAGIC[2], METRICS_MAGIC[3], METRICS_VERSION,
+        METRICS_CMD_SLOTS, METRICS_COUNTER_COUNT, METRICS_GAUGE_COUNT, METRICS_HIST_COUNT,
+        METRICS_HIST_BUCKETS, METRICS_RTT_PEERS, MEM_TAG_COUNT,
+    };
+    metrics_put(&b, hdr, sizeof(hdr));
+    metrics_put(&b, &snap->uptime_us, sizeof(snap->uptime_us));
+    metrics_put(&b, snap->rx_frames, sizeof(snap->rx_frames));
+    metrics_put(&b, snap->rx_bytes, sizeof(snap->rx_bytes));
+    metrics_put(&b, snap->tx_frames, sizeof(snap->tx_frames));
+    metrics_put(&b, snap->tx_bytes, sizeof(snap->tx_bytes));
+    metrics_put(&b, snap->counters, sizeof(snap->counters));
+    metrics_put(&b, snap->gauges, sizeof(snap->gauges));
+    for (int h = 0; h < METRICS_HIST_COUNT; h++) {
+        metrics_put(&b, snap->hists[h].buckets, sizeof(snap->hists[h].buckets));
+        metrics_put(&b, &snap->hists[h].sum_us, sizeof(snap->hists[h].sum_us));
+    }
+    for (int i = 0; i < METRICS_RTT_PEERS; i++) {
+        const metrics_peer_rtt_t *p = &snap->peers[i];
+        metrics_put(&b, p->mac, sizeof(p->mac));
+        metrics_put(&b, &p->samples, sizeof(p->samples));
+        metrics_put(&b, &p->sum_us, sizeof(p->sum_us));
+        metrics_put(&b, &p->max_us, sizeof(p->max_us));
+    }
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        const mem_tag_stats_t *m = &snap->mem.tags[tag];
+        metrics_put(&b, &m->live_bytes, sizeof(m->live_bytes));
+        metrics_put(&b, &m->peak_bytes, sizeof(m->peak_bytes));
+        metrics_put(&b, &m->allocs, sizeof(m->allocs));
+        metrics_put(&b, &m->frees, sizeof(m->frees));
+    }
+    metrics_put(&b, &snap->mem.heap_free, sizeof(snap->mem.heap_free));
+    metrics_put(&b, &snap->mem.heap_min_free, sizeof(snap->mem.heap_min_free));
+    metrics_put(&b, &snap->mem.heap_largest_free, sizeof(snap->mem.heap_largest_free));
+    metrics_put(&b, &snap->mem.failed, sizeof(snap->mem.failed));
+    bool ok = b.ok && write(ctx, buf, b.len);
+    mem_track_free(buf);
+    mem_track_free(snap);
+    return ok;
+}
+
+typedef struct {
+    bool (*write)(void *ctx, const uint8_t *data, size_t len);
+    void *ctx;
+    bool ok;
+} metrics_text_t;
+
+static void metrics_line(metrics_text_t *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void metrics_line(metrics_text_t *t, const char *fmt, ...)
+{
+    if (!t->ok) {
+        return;
+    }
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= sizeof(line)) {
+        return;
+    }
+    t->ok = t->write(t->ctx, (const uint8_t *)line, (size_t)n);
+}
+
+static void metrics_text_frames(metrics_text_t *t, const char *name, const char *help, const uint32_t *values)
+{
+    metrics_line(t, "# HELP mesh_%s %s\n# TYPE mesh_%s counter\n", name, help, name);
+    for (int cmd = 0; cmd < METRICS_CMD_SLOTS; cmd++) {
+        metrics_line(t, "mesh_%s{cmd=\"%s\"} %" PRIu32 "\n", name, cmd_names[cmd], values[cmd]);
+    }
+}
+
+bool metrics_write_text(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx)
+{
+    metrics_snapshot_t *snap = mem_track_malloc(MEM_TAG_COMM, sizeof(*snap));
+    if (!snap) {
+        ESP_LOGE(TAG, "No memory for a metrics snapshot");
+        return false;
+    }
+    metrics_snapshot(snap);
+    metrics_text_t t = {write, ctx, true};
+
+    metrics_line(&t, "# TYPE mesh_uptime_seconds gauge\nmesh_uptime_seconds %.3f\n", snap->uptime_us / 1e6);
+    metrics_text_frames(&t, "rx_frames_total", "ESP-NOW frames accepted, by command.", snap->rx_frames);
+    metrics_text_frames(&t, "rx_bytes_total", "Message bytes accepted, by command.", snap->rx_bytes);
+    metrics_text_frames(&t, "tx_frames_total", "ESP-NOW frames queued or sent, by command.", snap->tx_frames);
+    metrics_text_frames(&t, "tx_bytes_total", "Framed bytes queued or sent, by command.", snap->tx_bytes);
+
+    metrics_line(&t, "# HELP mesh_errors_total Frames and readings dropped, by cause.\n"
+                     "# TYPE mesh_errors_total counter\n");
+    for (int i = 0; i < METRICS_COUNTER_COUNT; i++) {
+        metrics_line(&t, "mesh_errors_total{kind=\"%s\"} %" PRIu32 "\n", counter_names[i], snap->counters[i]);
+    }
+    metrics_line(&t, "# HELP mesh_queue_high_water Deepest a receive queue has been.\n"
+                     "# TYPE mesh_queue_high_water gauge\n");
+    for (int i = 0; i < METRICS_GAUGE_COUNT; i++) {
+        metrics_line(&t, "mesh_queue_high_water{queue=\"%s\"} %" PRIu32 "\n", gauge_names[i], snap->gauges[i]);
+    }
+
+    metrics_line(&t, "# HELP mesh_latency_seconds Time spent, by operation.\n"
+                     "# TYPE mesh_latency_seconds histogram\n");
+    for (int h = 0; h < METRICS_HIST_COUNT; h++) {
+        const metrics_histogram_t *hist = &snap->hists[h];
+        uint64_t cumulative = 0;
+        for (int i = 0; i < METRICS_HIST_BUCKETS - 1; i++) {
+            cumulative += hist->buckets[i];
+            metrics_line(&t, "mesh_latency_seconds_bucket{op=\"%s\",le=\"%.6f\"} %" PRIu64 "\n",
+                         hist_names[h], (double)(1UL << i) / 1e6, cumulative);
+        }
+        cumulative += hist->buckets[METRICS_HIST_BUCKETS - 1];
+        metrics_line(&t, "mesh_latency_seconds_bucket{op=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+                     hist_names[h], cumulative);
+        metrics_line(&t, "mesh_latency_seconds_sum{op=\"%s\"} %.6f\n", hist_names[h], hist->sum_us / 1e6);
+        metrics_line(&t, "mesh_latency_seconds_count{op=\"%s\"} %" PRIu64 "\n", hist_names[h], cumulative);
+    }
+
+    metrics_line(&t, "# HELP mesh_peer_rtt_seconds Unicast round trip to each peer.\n"
+                     "# TYPE mesh_peer_rtt_seconds summary\n");
+    for (int i = 0; i < METRICS_RTT_PEERS; i++) {
+        const metrics_peer_rtt_t *p = &snap->peers[i];
+        if (p->samples == 0) {
+            continue;
+        }
+        metrics_line(&t, "mesh_peer_rtt_seconds_sum{peer=\"" MACSTR "\"} %.6f\n", MAC2STR(p->mac), p->sum_us / 1e6);
+        metrics_line(&t, "mesh_peer_rtt_seconds_count{peer=\"" MACSTR "\"} %" PRIu32 "\n", MAC2STR(p->mac), p->samples);
+    }
+    metrics_line(&t, "# TYPE mesh_peer_rtt_max_seconds gauge\n");
+    for (int i = 0; i < METRICS_RTT_PEERS; i++) {
+        const metrics_peer_rtt_t *p = &snap->peers[i];
+        if (p->samples > 0) {
+            metrics_line(&t, "mesh_peer_rtt_max_seconds{peer=\"" MACSTR "\"} %.6f\n", MAC2STR(p->mac), p->max_us / 1e6);
+        }
+    }
+
+    const mem_track_snapshot_t *mem = &snap->mem;
+    metrics_line(&t, "# HELP mesh_mem_live_bytes Heap in use, by subsystem.\n"
+                     "# TYPE mesh_mem_live_bytes gauge\n");
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        metrics_line(&t, "mesh_mem_live_bytes{tag=\"%s\"} %" PRIu32 "\n", mem_track_tag_name(tag),
+                     mem->tags[tag].live_bytes);
+    }
+    metrics_line(&t, "# TYPE mesh_mem_peak_bytes gauge\n");
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        metrics_line(&t, "mesh_mem_peak_bytes{tag=\"%s\"} %" PRIu32 "\n", mem_track_tag_name(tag),
+                     mem->tags[tag].peak_bytes);
+    }
+    metrics_line(&t, "# TYPE mesh_mem_allocs_total counter\n");
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        metrics_line(&t, "mesh_mem_allocs_total{tag=\"%s\"} %" PRIu32 "\n", mem_track_tag_name(tag),
+                     mem->tags[tag].allocs);
+    }
+    metrics_line(&t, "# TYPE mesh_mem_frees_total counter\n");
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        metrics_line(&t, "mesh_mem_frees_total{tag=\"%s\"} %" PRIu32 "\n", mem_track_tag_name(tag),
+                     mem->tags[tag].frees);
+    }
+    metrics_line(&t, "# TYPE mesh_heap_free_bytes gauge\nmesh_heap_free_bytes %" PRIu32 "\n", mem->heap_free);
+    metrics_line(&t, "# TYPE mesh_heap_min_free_bytes gauge\nmesh_heap_min_free_bytes %" PRIu32 "\n",
+                 mem->heap_min_free);
+    metrics_line(&t, "# HELP mesh_heap_largest_free_block_bytes Largest single allocation still possible.\n");
+    metrics_line(&t, "# TYPE mesh_heap_largest_free_block_bytes gauge\nmesh_heap_largest_free_block_bytes %" PRIu32 "\n",
+                 mem->heap_largest_free);
+    metrics_line(&t, "# TYPE mesh_mem_alloc_failures_total counter\nmesh_mem_alloc_failures_total %" PRIu32 "\n",
+                 mem->failed);
+    mem_track_free(snap);
+    return t.ok;
+}
@@ -0,0 +1,110 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_now.h"
+#include "mem_track.h"
+
+// Runtime metrics registry: per-command frame counters, drop/error counters, queue high-water
+// marks and latency histograms. Counters live in one slot per core and are bumped with relaxed
+// atomic adds, so hot paths (the receive callback, the transmit task) never take a lock; a
+// snapshot sums the slots.
+//
+// Histograms have power-of-two microsecond buckets: bucket i counts samples <= 2^i us, the last
+// bucket everything larger.
+//
+// Binary snapshot (TCP "METRICS_BIN"), little-endian and unpadded:
+//   header:  "MMET" [u8 version][u8 cmd slots][u8 counters][u8 gauges][u8 histograms]
+//            [u8 buckets][u8 peers][u8 memory tags][i64 esp_timer us]
+//   body:    u32 rx_frames[cmd slots], rx_bytes[...], tx_frames[...], tx_bytes[...]
+//            u32 counters[], u32 gauges[]
+//            per histogram: u32 buckets[], u64 sum_us
+//            per peer:      [MAC][u32 samples][u64 sum_us][u32 max_us]
+//            per memory tag: [u32 live bytes][u32 peak bytes][u32 allocs][u32 frees]
+//            u32 heap free, heap min free, largest free block, failed allocs (see mem_track.h)
+// Command slot 0 collects commands outside 1..METRICS_CMD_SLOTS-1. Text snapshot ("METRICS")
+// is the Prometheus exposition format.
+#define METRICS_MAGIC           "MMET"
+#define METRICS_VERSION         2
+#define METRICS_CMD_SLOTS       0x13    // One past the highest command in command_set.h
+#define METRICS_HIST_BUCKETS    27      // 1 us .. 33.5 s, then overflow
+#define METRICS_RTT_PEERS       16      // Peers with their own RTT figures; the rest share the histogram
+
+typedef enum {
+    METRICS_RX_BAD_FRAME = 0,       // Unframed or foreign protocol version
+    METRICS_RX_DUPLICATE,           // Dropped by sequence or message-id dedup
+    METRICS_RX_MALFORMED,           // Wrong length for its command
+    METRICS_RX_UNKNOWN_CMD,
+    METRICS_TX_DROPPED,             // Queue full or frame too large
+    METRICS_TX_FAILED,              // Unicast still unacknowledged after all retries
+    METRICS_TX_UNCONFIRMED,         // No send callback in time
+    METRICS_BLOCK_HASH_MISMATCH,
+    METRICS_SENSOR_QUEUE_FULL,
+    METRICS_ELECTION_QUEUE_FULL,
+    METRICS_ROUND_READINGS_MISSED,  // Readings still outstanding at the collection deadline
+    METRICS_COUNTER_COUNT,
+} metrics_counter_t;
+
+typedef enum {
+    METRICS_GAUGE_SENSOR_QUEUE_HWM = 0,
+    METRICS_GAUGE_ELECTION_QUEUE_HWM,
+    METRICS_GAUGE_COUNT,
+} metrics_gauge_t;
+
+typedef enum {
+    METRICS_HIST_HASH = 0,          // calculate_block_hash
+    METRICS_HIST_SERIALIZE,         // blockchain_serialize_block
+    METRICS_HIST_PARSE,             // blockchain_parse_received_serialized_block
+    METRICS_HIST_ROUND,             // Leader round, pulse to block broadcast
+    METRICS_HIST_RTT,               // Unicast send to MAC-layer acknowledgement
+    METRICS_HIST_COUNT,
+} metrics_hist_t;
+
+typedef struct {
+    uint32_t buckets[METRICS_HIST_BUCKETS];
+    uint64_t sum_us;
+} metrics_histogram_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t samples;
+    uint64_t sum_us;
+    uint32_t max_us;
+} metrics_peer_rtt_t;
+
+typedef struct {
+    int64_t uptime_us;
+    uint32_t rx_frames[METRICS_CMD_SLOTS];
+    uint32_t rx_bytes[METRICS_CMD_SLOTS];
+    uint32_t tx_frames[METRICS_CMD_SLOTS];
+    uint32_t tx_bytes[METRICS_CMD_SLOTS];
+    uint32_t counters[METRICS_COUNTER_COUNT];
+    uint32_t gauges[METRICS_GAUGE_COUNT];
+    metrics_histogram_t hists[METRICS_HIST_COUNT];
+    metrics_peer_rtt_t peers[METRICS_RTT_PEERS];   // Unused slots have samples == 0
+    mem_track_snapshot_t mem;
+} metrics_snapshot_t;
+
+void metrics_init(void);
+
+// Hot-path updates; lock-free and safe from any task or the Wi-Fi callbacks.
+void metrics_rx(uint8_t cmd, size_t len);
+void metrics_tx(uint8_t cmd, size_t len);
+void metrics_count(metrics_counter_t counter);
+void metrics_count_n(metrics_counter_t counter, uint32_t n);
+void metrics_high_water(metrics_gauge_t gauge, uint32_t value);
+void metrics_observe_us(metrics_hist_t hist, uint32_t us);
+
+// Record one unicast round trip to `peer`. Only the transmit task calls this, which is what
+// keeps the per-peer table lock-free.
+void metrics_peer_rtt(const uint8_t *peer, uint32_t us);
+
+void metrics_snapshot(metrics_snapshot_t *out);
+
+// Write a snapshot through `write` (as frame_trace_dump), which returns false to abort.
+bool metrics_write_binary(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx);
+bool metrics_write_text(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx);
+
+#endif // METRICS_H
@@ -0,0 +1,13 @@
+#ifndef NODE_LOCAL_H
+#define NODE_LOCAL_H
+
+// Marks mutable module state that belongs to one node. On the device it is plain static
+// storage. The host simulator (../host_sim) runs every virtual node on its own thread, so
+// there it becomes thread-local and each node gets its own copy of every module.
+#ifdef MESH_HOST_SIM
+#define NODE_LOCAL __thread
+#else
+#define NODE_LOCAL
+#endif
+
+#endif // NODE_LOCAL_H
@@ -1,18 +1,28 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_NODE_RESPONSE
 #include "node_response.h"
+#include "node_local.h"
+#include "metrics.h"
+#include "mem_track.h"
+#include "esp_timer.h"
 #include "string.h"
 #include "esp_mac.h"
 #include "inttypes.h"
 
-#define SENSOR_RESPONSE_QUEUE_LENGTH 10
+// Sized for a full aggregated round: every node's reading can land at once.
+#define SENSOR_RESPONSE_QUEUE_LENGTH MESH_MAX_NODES
 
 static const char *TAG = "node_response";
 
 // Static queue to hold sensor responses.
-static QueueHandle_t sensorResponseQueue = NULL;
+static NODE_LOCAL QueueHandle_t sensorResponseQueue = NULL;
 
 void node_response_init(void) {
     if (!sensorResponseQueue) {
         sensorResponseQueue = xQueueCreate(SENSOR_RESPONSE_QUEUE_LENGTH, sizeof(sensor_response_t));
+        if (sensorResponseQueue) {
+            mem_track_note(MEM_TAG_QUEUES, SENSOR_RESPONSE_QUEUE_LENGTH * sizeof(sensor_response_t));
+        }
     }
 }
 
@@ -21,9 +31,14 @@ void node_response_push(const uint8_t *src_mac, const sensor_record_t *data) {
     sensor_response_t resp;
     memcpy(resp.mac, src_mac, sizeof(resp.mac));
     resp.sensor_data = *data;
+    resp.received_us = esp_timer_get_time();
     // Post without blocking.
-    ESP_LOGW("PUSH", "Pushing response from " MACSTR, MAC2STR(resp.mac));
-    xQueueSend(sensorResponseQueue, &resp, 0);
+    ESP_LOGD(TAG, "Pushing response from " MACSTR, MAC2STR(resp.mac));
+    if (xQueueSend(sensorResponseQueue, &resp, 0) != pdPASS) {
+        metrics_count(METRICS_SENSOR_QUEUE_FULL);
+        return;
+    }
+    metrics_high_water(METRICS_GAUGE_SENSOR_QUEUE_HWM, uxQueueMessagesWaiting(sensorResponseQueue));
 }
 
 // Corrected version of waitForNodeResponse
@@ -33,7 +48,7 @@ bool waitForNodeResponse(const uint8_t *remote_mac, sensor_record_t *response, T
     TickType_t start = xTaskGetTickCount();
     while ((xTaskGetTickCount() - start) < timeout) {
         if (xQueueReceive(sensorResponseQueue, &recvResp, pdMS_TO_TICKS(10)) == pdPASS) {
-            ESP_LOGI(TAG, "Received response from " MACSTR, MAC2STR(recvResp.mac));
+            ESP_LOGD(TAG, "Received response from " MACSTR, MAC2STR(recvResp.mac));
             // Check if this is the expected sender.
             if (memcmp(recvResp.mac, remote_mac, sizeof(recvResp.mac)) == 0) {
                 *response = recvResp.sensor_data;
@@ -43,3 +58,21 @@ bool waitForNodeResponse(const uint8_t *remote_mac, sensor_record_t *response, T
     }
     return false;
 }
+
+bool node_response_wait_any(sensor_record_t *response, int64_t *received_us, TickType_t timeout) {
+    if (!sensorResponseQueue) return false;
+    sensor_response_t recvResp;
+    if (xQueueReceive(sensorResponseQueue, &recvResp, timeout) == pdPASS) {
+        *response = recvResp.sensor_data;
+        if (received_us) {
+            *received_us = recvResp.received_us;
+        }
+        return true;
+    }
+    return false;
+}
+
+void node_response_flush(void) {
+    if (!sensorResponseQueue) return;
+    xQueueReset(sensorResponseQueue);
+}
\ No newline at end of file
@@ -11,6 +11,7 @@
 typedef struct {
     uint8_t mac[6];
     sensor_record_t sensor_data;
+    int64_t received_us;            // esp_timer time it was queued
 } sensor_response_t;
 
 // Must be called once at startup.
@@ -22,4 +23,11 @@ void node_response_push(const uint8_t *src_mac, const sensor_record_t *data);
 // Waits for a sensor response from a given device within timeout (in ticks).
 bool waitForNodeResponse(const uint8_t *remote_mac, sensor_record_t *response, TickType_t timeout);
 
+// Waits for the next sensor response from any device within timeout (in ticks). If
+// `received_us` is not NULL it gets the esp_timer time the response was queued.
+bool node_response_wait_any(sensor_record_t *response, int64_t *received_us, TickType_t timeout);
+
+// Drops any responses left over from an earlier round.
+void node_response_flush(void);
+
 #endif // NODE_RESPONSE_H
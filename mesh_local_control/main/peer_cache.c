@@ -0,0 +1,189 @@
+#include "log_level.h"
+#define LOG_LOCAL_LEVEL LOG_LEVEL_PEER_CACHE
+#include "peer_cache.h"
+#include "node_local.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdbool.h>
+
+static const char *TAG = "peer_cache";
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t last_used;     // Value of use_clock at the last send
+    bool in_use;
+} peer_entry_t;
+
+static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+
+static NODE_LOCAL SemaphoreHandle_t cache_mutex = NULL;
+static NODE_LOCAL peer_entry_t entries[PEER_CACHE_CAPACITY];
+static NODE_LOCAL uint32_t use_clock = 0;
+static NODE_LOCAL peer_cache_stats_t stats = {0};
+
+static bool peer_cache_is_pinned(const uint8_t *mac)
+{
+    return memcmp(mac, broadcast_mac, ESP_NOW_ETH_ALEN) == 0 ||
+           memcmp(mac, my_mac, ESP_NOW_ETH_ALEN) == 0;
+}
+
+static peer_entry_t *peer_cache_find_locked(const uint8_t *mac)
+{
+    for (int i = 0; i < PEER_CACHE_CAPACITY; i++) {
+        if (entries[i].in_use && memcmp(entries[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static peer_entry_t *peer_cache_lru_locked(void)
+{
+    peer_entry_t *victim = NULL;
+    for (int i = 0; i < PEER_CACHE_CAPACITY; i++) {
+        if (entries[i].in_use &&
+            (!victim || (int32_t)(entries[i].last_used - victim->last_used) < 0)) {
+            victim = &entries[i];
+        }
+    }
+    return victim;
+}
+
+static void peer_cache_evict_locked(peer_entry_t *victim)
+{
+    esp_err_t err = esp_now_del_peer(victim->mac);
+    if (err != ESP_OK && err != ESP_ERR_ESPNOW_NOT_FOUND) {
+        ESP_LOGW(TAG, "Failed to remove peer " MACSTR ": %s", MAC2STR(victim->mac), esp_err_to_name(err));
+    }
+    ESP_LOGD(TAG, "Evicted peer " MACSTR, MAC2STR(victim->mac));
+    victim->in_use = false;
+    stats.evictions++;
+    stats.active--;
+}
+
+static esp_err_t peer_cache_add_locked(const uint8_t *mac)
+{
+    esp_now_peer_info_t peerInfo = {0};
+    peerInfo.ifidx = WIFI_IF_STA;
+    peerInfo.encrypt = false;
+    memcpy(peerInfo.peer_addr, mac, ESP_NOW_ETH_ALEN);
+
+    peer_entry_t *slot = NULL;
+    for (int i = 0; i < PEER_CACHE_CAPACITY && !slot; i++) {
+        if (!entries[i].in_use) {
+            slot = &entries[i];
+        }
+    }
+    if (!slot) {
+        slot = peer_cache_lru_locked();
+        peer_cache_evict_locked(slot);
+    }
+
+    esp_err_t err = esp_now_add_peer(&peerInfo);
+    if (err == ESP_ERR_ESPNOW_FULL) {
+        // Peers registered outside the cache ate into our share; give up one more of ours.
+        peer_entry_t *victim = peer_cache_lru_locked();
+        if (victim) {
+            peer_cache_evict_locked(victim);
+            err = esp_now_add_peer(&peerInfo);
+        }
+    }
+    if (err != ESP_OK && err != ESP_ERR_ESPNOW_EXIST) {
+        stats.add_failures++;
+        ESP_LOGE(TAG, "Failed adding peer " MACSTR ": %s", MAC2STR(mac), esp_err_to_name(err));
+        return err;
+    }
+    memcpy(slot->mac, mac, ESP_NOW_ETH_ALEN);
+    slot->last_used = ++use_clock;
+    slot->in_use = true;
+    stats.active++;
+    return ESP_OK;
+}
+
+void peer_cache_init(void)
+{
+    if (cache_mutex) {
+        return;
+    }
+    cache_mutex = xSemaphoreCreateMutex();
+    if (!cache_mutex) {
+        ESP_LOGE(TAG, "Failed to create peer cache mutex");
+        return;
+    }
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+    memset(entries, 0, sizeof(entries));
+    ESP_LOGI(TAG, "Peer cache initialized with %d slots", PEER_CACHE_CAPACITY);
+}
+
+esp_err_t peer_cache_ensure(const uint8_t *mac)
+{
+    if (!cache_mutex || peer_cache_is_pinned(mac)) {
+        return ESP_OK;
+    }
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    peer_entry_t *entry = peer_cache_find_locked(mac);
+    if (entry) {
+        entry->last_used = ++use_clock;
+        stats.hits++;
+    } else {
+        stats.misses++;
+        err = peer_cache_add_locked(mac);
+    }
+    xSemaphoreGive(cache_mutex);
+    return err;
+}
+
+void peer_cache_prefetch(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], size_t count)
+{
+    if (!cache_mutex) {
+        return;
+    }
+    if (count > PEER_CACHE_CAPACITY) {
+        count = PEER_CACHE_CAPACITY;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    // Walk backwards so the first (most important) entry ends up most recently used.
+    for (size_t i = count; i-- > 0;) {
+        if (peer_cache_is_pinned(macs[i])) {
+            continue;
+        }
+        peer_entry_t *entry = peer_cache_find_locked(macs[i]);
+        if (entry) {
+            entry->last_used = ++use_clock;
+        } else if (peer_cache_add_locked(macs[i]) == ESP_OK) {
+            stats.prefetches++;
+        }
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+void peer_cache_forget(const uint8_t *mac)
+{
+    if (!cache_mutex) {
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    peer_entry_t *entry = peer_cache_find_locked(mac);
+    if (entry) {
+        entry->in_use = false;
+        stats.active--;
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+void peer_cache_get_stats(peer_cache_stats_t *out)
+{
+    if (!cache_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(cache_mutex);
+}
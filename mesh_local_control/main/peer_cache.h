@@ -0,0 +1,37 @@
+#ifndef PEER_CACHE_H
+#define PEER_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+// ESP-NOW holds at most ESP_NOW_MAX_TOTAL_PEER_NUM peers. The broadcast and self peers are
+// pinned outside the cache and mesh-lite registers a few of its own, so keep some headroom.
+#define PEER_CACHE_RESERVED     4
+#define PEER_CACHE_CAPACITY     (ESP_NOW_MAX_TOTAL_PEER_NUM - PEER_CACHE_RESERVED)
+
+typedef struct {
+    uint32_t hits;          // Peer was already registered
+    uint32_t misses;        // Peer had to be added
+    uint32_t evictions;     // Least recently used peer removed to make room
+    uint32_t prefetches;    // Peers added ahead of use for the current round
+    uint32_t add_failures;  // esp_now_add_peer failed even after evicting
+    uint32_t active;        // Peers currently tracked
+} peer_cache_stats_t;
+
+// Must be called once after ESP-NOW is up.
+void peer_cache_init(void);
+
+// Make sure the peer is registered with ESP-NOW, evicting the LRU entry if the table is full.
+esp_err_t peer_cache_ensure(const uint8_t *mac);
+
+// Register peers we are about to talk to, most important first.
+void peer_cache_prefetch(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], size_t count);
+
+// Drop our entry after ESP-NOW reported the peer missing.
+void peer_cache_forget(const uint8_t *mac);
+
+void peer_cache_get_stats(peer_cache_stats_t *out);
+
+#endif // PEER_CACHE_H
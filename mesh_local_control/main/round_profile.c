@@ -0,0 +1,268 @@
+#include "round_profile.h"
+#include "mem_track.h"
+#include "node_local.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "round_profile";
+
+typedef struct {
+    bool in_use;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t count;                 // Arrivals since the slot was taken
+    uint32_t peak_us;               // Slowest arrival in the window, for choosing whom to drop
+    uint32_t arrival_us[ROUND_PROFILE_WINDOW];
+} round_profile_node_t;
+
+static NODE_LOCAL SemaphoreHandle_t profile_mutex = NULL;
+static NODE_LOCAL round_profile_record_t window[ROUND_PROFILE_WINDOW];
+static NODE_LOCAL uint32_t rounds_total = 0;
+static NODE_LOCAL round_profile_node_t nodes[ROUND_PROFILE_NODES];
+
+static const char *const stage_names[ROUND_STAGE_COUNT] = {
+    "setup", "pulse", "sensor", "collect", "pop", "hash", "serialize", "commit", "broadcast",
+};
+
+static inline uint32_t round_profile_clamp(int64_t us)
+{
+    return us < 0 ? 0 : (us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+}
+
+void round_profile_init(void)
+{
+    if (!profile_mutex) {
+        profile_mutex = xSemaphoreCreateMutex();
+        if (!profile_mutex) {
+            ESP_LOGE(TAG, "Failed to create round profile mutex");
+        }
+    }
+}
+
+void round_profile_begin(round_profile_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->start_us = esp_timer_get_time();
+    p->mark_us = p->start_us;
+}
+
+void round_profile_mark(round_profile_t *p, round_stage_t stage)
+{
+    int64_t now = esp_timer_get_time();
+    p->rec.stage_us[stage] += round_profile_clamp(now - p->mark_us);
+    p->mark_us = now;
+    if (stage == ROUND_STAGE_PULSE) {
+        p->pulse_us = now;
+    }
+}
+
+// Caller holds profile_mutex. The entry for `mac`, taking a free one or the one with the
+// fastest peak if this arrival is slower still (ties go to the lower MAC); NULL if not kept.
+static round_profile_node_t *round_profile_node(const uint8_t *mac, uint32_t us)
+{
+    round_profile_node_t *victim = NULL;
+    for (int i = 0; i < ROUND_PROFILE_NODES; i++) {
+        round_profile_node_t *node = &nodes[i];
+        if (node->in_use && memcmp(node->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return node;
+        }
+        if (victim && !victim->in_use) {
+            continue;
+        }
+        if (!victim || !node->in_use || node->peak_us < victim->peak_us ||
+            (node->peak_us == victim->peak_us && memcmp(node->mac, victim->mac, ESP_NOW_ETH_ALEN) > 0)) {
+            victim = node;
+        }
+    }
+    if (victim->in_use && (us < victim->peak_us ||
+                           (us == victim->peak_us && memcmp(mac, victim->mac, ESP_NOW_ETH_ALEN) > 0))) {
+        return NULL;
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->in_use = true;
+    memcpy(victim->mac, mac, ESP_NOW_ETH_ALEN);
+    return victim;
+}
+
+void round_profile_arrival(round_profile_t *p, const uint8_t *mac, int64_t received_us)
+{
+    // Measured from the end of the pulse stage; a reading queued while the send was still
+    // returning counts as zero.
+    uint32_t us = round_profile_clamp(received_us - (p->pulse_us ? p->pulse_us : p->start_us));
+    if (us >= p->rec.slowest_us) {
+        p->rec.slowest_us = us;
+        memcpy(p->rec.slowest_mac, mac, ESP_NOW_ETH_ALEN);
+    }
+    if (!profile_mutex) {
+        return;
+    }
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    round_profile_node_t *node = round_profile_node(mac, us);
+    if (node) {
+        uint32_t *slot = &node->arrival_us[node->count % ROUND_PROFILE_WINDOW];
+        bool was_peak = node->count >= ROUND_PROFILE_WINDOW && *slot == node->peak_us;
+        *slot = us;
+        node->count++;
+        if (was_peak) {
+            uint32_t held = node->count < ROUND_PROFILE_WINDOW ? node->count : ROUND_PROFILE_WINDOW;
+            node->peak_us = 0;
+            for (uint32_t i = 0; i < held; i++) {
+                node->peak_us = node->arrival_us[i] > node->peak_us ? node->arrival_us[i] : node->peak_us;
+            }
+        } else if (us > node->peak_us) {
+            node->peak_us = us;
+        }
+    }
+    xSemaphoreGive(profile_mutex);
+}
+
+void round_profile_end(round_profile_t *p, uint32_t block_num, uint32_t expected, uint32_t collected)
+{
+    p->rec.block_num = block_num;
+    p->rec.expected = expected > UINT16_MAX ? UINT16_MAX : (uint16_t)expected;
+    p->rec.collected = collected > UINT16_MAX ? UINT16_MAX : (uint16_t)collected;
+    p->rec.total_us = round_profile_clamp(esp_timer_get_time() - p->start_us);
+    if (!profile_mutex) {
+        return;
+    }
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    window[rounds_total % ROUND_PROFILE_WINDOW] = p->rec;
+    rounds_total++;
+    xSemaphoreGive(profile_mutex);
+}
+
+static int round_profile_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentiles; sorts `values` in place.
+static round_profile_pct_t round_profile_pct(uint32_t *values, uint32_t n)
+{
+    round_profile_pct_t pct = {0};
+    if (n == 0) {
+        return pct;
+    }
+    qsort(values, n, sizeof(values[0]), round_profile_cmp);
+    pct.p50_us = values[(n * 50 + 99) / 100 - 1];
+    pct.p99_us = values[(n * 99 + 99) / 100 - 1];
+    pct.max_us = values[n - 1];
+    return pct;
+}
+
+void round_profile_summary(round_profile_summary_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!profile_mutex) {
+        return;
+    }
+    uint32_t values[ROUND_PROFILE_WINDOW];
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    uint32_t n = rounds_total < ROUND_PROFILE_WINDOW ? rounds_total : ROUND_PROFILE_WINDOW;
+    out->rounds = n;
+    out->rounds_total = rounds_total;
+    for (int stage = 0; stage < ROUND_STAGE_COUNT; stage++) {
+        for (uint32_t i = 0; i < n; i++) {
+            values[i] = window[i].stage_us[stage];
+        }
+        out->stages[stage] = round_profile_pct(values, n);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        values[i] = window[i].total_us;
+        out->readings_missed += window[i].expected - window[i].collected;
+    }
+    out->total = round_profile_pct(values, n);
+    for (int i = 0; i < ROUND_PROFILE_NODES; i++) {
+        if (!nodes[i].in_use) {
+            continue;
+        }
+        round_profile_node_summary_t *s = &out->node[out->nodes++];
+        memcpy(s->mac, nodes[i].mac, ESP_NOW_ETH_ALEN);
+        s->samples = nodes[i].count < ROUND_PROFILE_WINDOW ? nodes[i].count : ROUND_PROFILE_WINDOW;
+        memcpy(values, nodes[i].arrival_us, s->samples * sizeof(values[0]));
+        s->arrival = round_profile_pct(values, s->samples);
+        for (uint32_t r = 0; r < n; r++) {
+            if (window[r].collected && memcmp(window[r].slowest_mac, s->mac, ESP_NOW_ETH_ALEN) == 0) {
+                s->slowest++;
+            }
+        }
+    }
+    xSemaphoreGive(profile_mutex);
+}
+
+bool round_profile_last(round_profile_record_t *out)
+{
+    if (!profile_mutex) {
+        return false;
+    }
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    bool have = rounds_total > 0;
+    if (have) {
+        *out = window[(rounds_total - 1) % ROUND_PROFILE_WINDOW];
+    }
+    xSemaphoreGive(profile_mutex);
+    return have;
+}
+
+typedef struct {
+    bool (*write)(void *ctx, const uint8_t *data, size_t len);
+    void *ctx;
+    bool ok;
+} round_profile_text_t;
+
+static void round_profile_line(round_profile_text_t *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void round_profile_line(round_profile_text_t *t, const char *fmt, ...)
+{
+    if (!t->ok) {
+        return;
+    }
+    char line[128];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= sizeof(line)) {
+        return;
+    }
+    t->ok = t->write(t->ctx, (const uint8_t *)line, (size_t)n);
+}
+
+bool round_profile_write_text(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx)
+{
+    round_profile_summary_t *s = mem_track_malloc(MEM_TAG_COMM, sizeof(*s));
+    if (!s) {
+        ESP_LOGE(TAG, "No memory for a round profile summary");
+        return false;
+    }
+    round_profile_summary(s);
+    round_profile_text_t t = {write, ctx, true};
+    round_profile_line(&t, "rounds: %" PRIu32 " in window, %" PRIu32 " since boot, %" PRIu32 " readings missed\n",
+                       s->rounds, s->rounds_total, s->readings_missed);
+    round_profile_line(&t, "%-10s %10s %10s %10s\n", "stage", "p50_us", "p99_us", "max_us");
+    for (int stage = 0; stage < ROUND_STAGE_COUNT; stage++) {
+        const round_profile_pct_t *p = &s->stages[stage];
+        round_profile_line(&t, "%-10s %10" PRIu32 " %10" PRIu32 " %10" PRIu32 "\n",
+                           stage_names[stage], p->p50_us, p->p99_us, p->max_us);
+    }
+    round_profile_line(&t, "%-10s %10" PRIu32 " %10" PRIu32 " %10" PRIu32 "\n",
+                       "total", s->total.p50_us, s->total.p99_us, s->total.max_us);
+    round_profile_line(&t, "%-17s %10s %10s %10s %7s %7s\n", "node", "p50_us", "p99_us", "max_us", "samples", "last");
+    for (uint32_t i = 0; i < s->nodes; i++) {
+        const round_profile_node_summary_t *n = &s->node[i];
+        round_profile_line(&t, MACSTR " %10" PRIu32 " %10" PRIu32 " %10" PRIu32 " %7" PRIu32 " %7" PRIu32 "\n",
+                           MAC2STR(n->mac), n->arrival.p50_us, n->arrival.p99_us, n->arrival.max_us,
+                           n->samples, n->slowest);
+    }
+    mem_track_free(s);
+    return t.ok;
+}
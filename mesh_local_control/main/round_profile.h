@@ -0,0 +1,95 @@
+#ifndef ROUND_PROFILE_H
+#define ROUND_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_now.h"
+
+// Where a leader round spends its time. sensor_blockchain_task stamps each stage of a round
+// with esp_timer and notes when every node's reading reached the response queue; the finished
+// round is kept as a compact record in a rolling window. A summary gives p50/p99 per stage and
+// per node over that window (TCP "ROUND_PROFILE", or mesh_sim --profile-node N). A mesh has
+// more nodes than per-node entries, so those go to the ROUND_PROFILE_NODES nodes with the
+// slowest arrival in their window: a node only displaces one whose worst arrival is faster,
+// so the set depends on the arrivals, not on the order readings happened to come in.
+#ifndef ROUND_PROFILE_WINDOW
+#define ROUND_PROFILE_WINDOW    32      // Rounds kept, and arrivals kept per node
+#endif
+#ifndef ROUND_PROFILE_NODES
+#define ROUND_PROFILE_NODES     16      // Nodes with their own arrival figures: the slowest seen
+#endif
+
+typedef enum {
+    ROUND_STAGE_SETUP = 0,          // Block number, prev_hash and allocation
+    ROUND_STAGE_PULSE,              // Building and broadcasting the pulse
+    ROUND_STAGE_SENSOR,             // Leader's own reading, from the sample ring
+    ROUND_STAGE_COLLECT,            // Waiting for readings, until the last one or the deadline
+    ROUND_STAGE_POP,                // consensus_generate_pop_proof
+    ROUND_STAGE_HASH,               // calculate_block_hash
+    ROUND_STAGE_SERIALIZE,          // Serializing into the block cache
+    ROUND_STAGE_COMMIT,             // blockchain_add_block
+    ROUND_STAGE_BROADCAST,          // block_broadcast_send
+    ROUND_STAGE_COUNT,
+} round_stage_t;
+
+// One finished round.
+typedef struct {
+    uint32_t block_num;
+    uint16_t expected;              // Readings asked for
+    uint16_t collected;             // Readings in by the deadline
+    uint32_t stage_us[ROUND_STAGE_COUNT];
+    uint32_t total_us;
+    uint8_t slowest_mac[ESP_NOW_ETH_ALEN];  // Last reading in, zeros when none came
+    uint32_t slowest_us;            // Its arrival, from the pulse
+} round_profile_record_t;
+
+// A round in progress, on the leader task's stack.
+typedef struct {
+    int64_t start_us;
+    int64_t mark_us;                // End of the last stage marked
+    int64_t pulse_us;               // Arrivals are measured from here
+    round_profile_record_t rec;
+} round_profile_t;
+
+typedef struct {
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} round_profile_pct_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t samples;               // Arrivals in the window
+    uint32_t slowest;               // Rounds in the window this node came in last
+    round_profile_pct_t arrival;
+} round_profile_node_summary_t;
+
+typedef struct {
+    uint32_t rounds;                // Rounds in the window
+    uint32_t rounds_total;          // Since boot
+    uint32_t readings_missed;       // Over the window
+    round_profile_pct_t stages[ROUND_STAGE_COUNT];
+    round_profile_pct_t total;
+    uint32_t nodes;                 // Valid entries of node[]
+    round_profile_node_summary_t node[ROUND_PROFILE_NODES];
+} round_profile_summary_t;
+
+void round_profile_init(void);
+
+// Leader task only: open a round, close the stage running since the last mark, note one node's
+// reading (queued at `received_us`), and file the finished record.
+void round_profile_begin(round_profile_t *p);
+void round_profile_mark(round_profile_t *p, round_stage_t stage);
+void round_profile_arrival(round_profile_t *p, const uint8_t *mac, int64_t received_us);
+void round_profile_end(round_profile_t *p, uint32_t block_num, uint32_t expected, uint32_t collected);
+
+void round_profile_summary(round_profile_summary_t *out);
+
+// The most recent round, false before the first.
+bool round_profile_last(round_profile_record_t *out);
+
+// Text table of the summary through `write` (as frame_trace_dump).
+bool round_profile_write_text(bool (*write)(void *ctx, const uint8_t *data, size_t len), void *ctx);
+
+#endif // ROUND_PROFILE_H
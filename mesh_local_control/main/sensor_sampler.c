@@ -0,0 +1,152 @@
+#include "sensor_sampler.h"
+#include "temperature_probe.h"
+#include "node_local.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <time.h>
+
+_Static_assert((SENSOR_SAMPLE_RING & (SENSOR_SAMPLE_RING - 1)) == 0, "SENSOR_SAMPLE_RING must be a power of two");
+
+static const char *TAG = "sensor_sampler";
+
+typedef struct {
+    uint32_t seq;               // Odd while the writer is in the slot
+    sensor_sample_t sample;
+} sensor_slot_t;
+
+static NODE_LOCAL sensor_slot_t ring[SENSOR_SAMPLE_RING];
+static NODE_LOCAL uint32_t published = 0;  // Samples written; the newest is in ring[(published - 1) % RING]
+static NODE_LOCAL bool started = false;
+static NODE_LOCAL sensor_sampler_stats_t stats;
+
+// Sampling task only.
+static void sensor_sampler_publish(const sensor_sample_t *sample)
+{
+    sensor_slot_t *slot = &ring[published & (SENSOR_SAMPLE_RING - 1)];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->sample = *sample;
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&published, published + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&stats.samples, 1, __ATOMIC_RELAXED);
+}
+
+// Copy sample number `n` (0-based since boot). False when the writer has reused its slot.
+static bool sensor_sampler_read(uint32_t n, sensor_sample_t *out)
+{
+    const sensor_slot_t *slot = &ring[n & (SENSOR_SAMPLE_RING - 1)];
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue;
+        }
+        *out = slot->sample;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == before) {
+            // Each pass over the ring adds 2 to a slot's sequence.
+            return before == 2 * (n / SENSOR_SAMPLE_RING + 1);
+        }
+    }
+    return false;
+}
+
+static bool sensor_sampler_fresh(const sensor_sample_t *sample, int64_t time_us)
+{
+    int64_t skew = sample->time_us - time_us;
+    if (skew < 0) {
+        skew = -skew;
+    }
+    if (skew > (int64_t)SENSOR_SAMPLE_MAX_AGE_MS * 1000) {
+        __atomic_add_fetch(&stats.misses, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+static void sensor_sampler_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1) {
+        sensor_sample_t sample;
+        if (temperature_probe_measure(&sample.temperature, &sample.humidity)) {
+            sample.time_us = esp_timer_get_time();
+            sample.timestamp = (uint32_t)time(NULL);
+            sensor_sampler_publish(&sample);
+        } else {
+            __atomic_add_fetch(&stats.failures, 1, __ATOMIC_RELAXED);
+        }
+        xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SENSOR_SAMPLE_PERIOD_MS));
+    }
+}
+
+void sensor_sampler_init(void)
+{
+    if (started) {
+        return;
+    }
+    // Above the ledger's background work so the schedule holds, below the protocol tasks; the
+    // task sleeps except for the measurement itself.
+    if (xTaskCreate(sensor_sampler_task, "sensor_sampler", 3072, NULL, 4, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create sensor sampling task");
+        return;
+    }
+    started = true;
+}
+
+bool sensor_sampler_latest(sensor_sample_t *out)
+{
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint32_t n = __atomic_load_n(&published, __ATOMIC_ACQUIRE);
+        if (n == 0) {
+            break;
+        }
+        if (sensor_sampler_read(n - 1, out)) {
+            return sensor_sampler_fresh(out, esp_timer_get_time());
+        }
+    }
+    __atomic_add_fetch(&stats.misses, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+bool sensor_sampler_at(int64_t time_us, sensor_sample_t *out)
+{
+    uint32_t n = __atomic_load_n(&published, __ATOMIC_ACQUIRE);
+    uint32_t oldest = n > SENSOR_SAMPLE_RING ? n - SENSOR_SAMPLE_RING : 0;
+    bool found = false;
+    int64_t best_skew = 0;
+    // Newest first; once a sample is at or before time_us every older one is further away.
+    for (uint32_t i = n; i-- > oldest;) {
+        sensor_sample_t sample;
+        if (!sensor_sampler_read(i, &sample)) {
+            continue;
+        }
+        int64_t skew = sample.time_us - time_us;
+        if (skew < 0) {
+            skew = -skew;
+        }
+        if (!found || skew < best_skew) {
+            *out = sample;
+            best_skew = skew;
+            found = true;
+        }
+        if (sample.time_us <= time_us) {
+            break;
+        }
+    }
+    if (!found) {
+        __atomic_add_fetch(&stats.misses, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    return sensor_sampler_fresh(out, time_us);
+}
+
+void sensor_sampler_get_stats(sensor_sampler_stats_t *out)
+{
+    out->samples = __atomic_load_n(&stats.samples, __ATOMIC_RELAXED);
+    out->failures = __atomic_load_n(&stats.failures, __ATOMIC_RELAXED);
+    out->misses = __atomic_load_n(&stats.misses, __ATOMIC_RELAXED);
+}
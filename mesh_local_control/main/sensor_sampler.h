@@ -0,0 +1,47 @@
+#ifndef SENSOR_SAMPLER_H
+#define SENSOR_SAMPLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Background SHT45 sampling. One task measures on a fixed schedule and publishes each result
+// into a ring of timestamped samples; readers never touch I2C and never block, so the pulse
+// handler in the radio path and the leader loop answer from the ring. Single writer, any
+// number of readers: each slot carries a sequence number that is odd while it is written,
+// and a reader that sees it change retries.
+#ifndef SENSOR_SAMPLE_PERIOD_MS
+#define SENSOR_SAMPLE_PERIOD_MS     1000    // SHT45 high-precision measurement every second
+#endif
+#ifndef SENSOR_SAMPLE_RING
+#define SENSOR_SAMPLE_RING          32      // Samples kept; power of two
+#endif
+#ifndef SENSOR_SAMPLE_MAX_AGE_MS
+#define SENSOR_SAMPLE_MAX_AGE_MS    (3 * SENSOR_SAMPLE_PERIOD_MS)   // Older than this is no reading
+#endif
+
+typedef struct {
+    int64_t time_us;            // esp_timer when the measurement finished
+    uint32_t timestamp;         // time(NULL) at that point
+    float temperature;
+    float humidity;
+} sensor_sample_t;
+
+typedef struct {
+    uint32_t samples;           // Published since boot
+    uint32_t failures;          // Measurements the probe rejected (I2C or CRC)
+    uint32_t misses;            // Reads with no sample within SENSOR_SAMPLE_MAX_AGE_MS
+} sensor_sampler_stats_t;
+
+// Start the sampling task. Call after temperature_probe_init().
+void sensor_sampler_init(void);
+
+// Newest sample. False when there is none recent enough.
+bool sensor_sampler_latest(sensor_sample_t *out);
+
+// The sample nearest `time_us` (esp_timer), e.g. the moment a pulse went out. False when the
+// nearest one is further than SENSOR_SAMPLE_MAX_AGE_MS from it.
+bool sensor_sampler_at(int64_t time_us, sensor_sample_t *out);
+
+void sensor_sampler_get_stats(sensor_sampler_stats_t *out);
+
+#endif // SENSOR_SAMPLER_H
@@ -0,0 +1,329 @@
+#include "shard.h"
+#include "node_local.h"
+#include "blockchain.h"
+#include "block_cache.h"
+#include "block_broadcast.h"
+#include "checkpoint.h"
+#include "light_node.h"
+#include "mesh_networking.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "shard";
+
+// Membership lists hold the whole mesh, so the task keeps its copies in statics rather than
+// on its stack.
+typedef struct {
+    uint16_t count;
+    uint8_t macs[SHARD_MAX_MEMBERS][ESP_NOW_ETH_ALEN];   // Sorted, so every node agrees
+} shard_members_t;
+
+static NODE_LOCAL SemaphoreHandle_t shard_mutex = NULL;
+static NODE_LOCAL shard_members_t members = {0};
+static NODE_LOCAL uint8_t my_mac[ESP_NOW_ETH_ALEN] = {0};
+static NODE_LOCAL shard_stats_t stats = {0};
+
+// Rendezvous weight of `mac` for `block_num`: FNV-1a over both, then a finalizer so nearby
+// block numbers spread over different nodes.
+static uint32_t shard_score(uint32_t block_num, const uint8_t *mac)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 4; i++) {
+        h = (h ^ ((block_num >> (8 * i)) & 0xFF)) * 16777619u;
+    }
+    for (int i = 0; i < ESP_NOW_ETH_ALEN; i++) {
+        h = (h ^ mac[i]) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Indexes into `set` of the holders of `block_num`, highest weight first.
+static int shard_holders(const shard_members_t *set, uint32_t block_num, int *out)
+{
+    int n = 0;
+    uint32_t scores[SHARD_REPLICAS];
+    for (int m = 0; m < set->count; m++) {
+        uint32_t score = shard_score(block_num, set->macs[m]);
+        int pos = n;
+        while (pos > 0 && scores[pos - 1] < score) {
+            pos--;
+        }
+        if (pos >= SHARD_REPLICAS) {
+            continue;
+        }
+        int last = (n < SHARD_REPLICAS) ? n : SHARD_REPLICAS - 1;
+        for (int i = last; i > pos; i--) {
+            scores[i] = scores[i - 1];
+            out[i] = out[i - 1];
+        }
+        scores[pos] = score;
+        out[pos] = m;
+        if (n < SHARD_REPLICAS) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static bool shard_is_holder_in(const shard_members_t *set, uint32_t block_num, const uint8_t *mac)
+{
+    if (set->count <= SHARD_REPLICAS) {
+        return true;
+    }
+    int holders[SHARD_REPLICAS];
+    int n = shard_holders(set, block_num, holders);
+    for (int i = 0; i < n; i++) {
+        if (memcmp(set->macs[holders[i]], mac, ESP_NOW_ETH_ALEN) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void shard_add_member(shard_members_t *set, const uint8_t *mac)
+{
+    int pos = 0;
+    while (pos < set->count && memcmp(set->macs[pos], mac, ESP_NOW_ETH_ALEN) < 0) {
+        pos++;
+    }
+    if ((pos < set->count && memcmp(set->macs[pos], mac, ESP_NOW_ETH_ALEN) == 0) || set->count == SHARD_MAX_MEMBERS) {
+        return;
+    }
+    memmove(set->macs[pos + 1], set->macs[pos], (size_t)(set->count - pos) * ESP_NOW_ETH_ALEN);
+    memcpy(set->macs[pos], mac, ESP_NOW_ETH_ALEN);
+    set->count++;
+}
+
+// Rebuild the membership from the mesh node list. Returns true if it changed; the previous
+// list is left in `old`.
+static bool shard_refresh_members(shard_members_t *old)
+{
+    static NODE_LOCAL shard_members_t fresh;
+    fresh.count = 0;
+    shard_add_member(&fresh, my_mac);
+    uint32_t node_count = 0;
+    const node_info_list_t *list = esp_mesh_lite_get_nodes_list(&node_count);
+    for (; list; list = list->next) {
+        shard_add_member(&fresh, list->node->mac_addr);
+    }
+    xSemaphoreTake(shard_mutex, portMAX_DELAY);
+    *old = members;
+    bool changed = fresh.count != members.count ||
+                   memcmp(fresh.macs, members.macs, (size_t)fresh.count * ESP_NOW_ETH_ALEN) != 0;
+    if (changed) {
+        members = fresh;
+        stats.members = fresh.count;
+        stats.membership_changes++;
+    }
+    xSemaphoreGive(shard_mutex);
+    if (changed) {
+        ESP_LOGI(TAG, "Membership now %d node(s); rebalancing", fresh.count);
+    }
+    return changed;
+}
+
+// Send our copy of a block to the nodes that hold it under `now` but did not under `before`.
+static uint32_t shard_push_replicas(const shard_members_t *before, const shard_members_t *now, uint32_t block_num)
+{
+    int holders[SHARD_REPLICAS];
+    int n = shard_holders(now, block_num, holders);
+    uint32_t pushed = 0;
+    for (int i = 0; i < n; i++) {
+        const uint8_t *mac = now->macs[holders[i]];
+        if (memcmp(mac, my_mac, ESP_NOW_ETH_ALEN) == 0 || shard_is_holder_in(before, block_num, mac)) {
+            continue;
+        }
+        // A body rarely fits one frame; this fragments it and the new holder NACKs any gaps.
+        esp_err_t ret = block_broadcast_send_reply(mac, block_num);
+        if (ret == ESP_ERR_NOT_FOUND) {
+            break;
+        }
+        if (ret == ESP_OK) {
+            pushed++;
+        }
+    }
+    return pushed;
+}
+
+// Walk stored blocks older than the recent window from `*cursor`, pruning bodies we no longer
+// hold, re-fetching ones we now hold and, while `push` is set, sending ours to new holders.
+// Returns true once the walk has reached the recent window; `*cursor` is where to resume.
+static bool shard_rebalance(uint32_t *cursor, bool push, const shard_members_t *before)
+{
+    static NODE_LOCAL shard_members_t now;
+    xSemaphoreTake(shard_mutex, portMAX_DELAY);
+    now = members;
+    xSemaphoreGive(shard_mutex);
+
+    const block_t *tip = blockchain_acquire_tip();
+    if (!tip) {
+        return true;
+    }
+    uint32_t tip_num = tip->block_num;
+    blockchain_release_block(tip);
+    if (tip_num < SHARD_RECENT_BLOCKS) {
+        return true;
+    }
+    uint32_t limit = tip_num - SHARD_RECENT_BLOCKS;
+    if (*cursor < checkpoint_history_floor()) {
+        *cursor = checkpoint_history_floor();
+    }
+
+    uint32_t budget = SHARD_BATCH;
+    uint32_t pruned = 0, requested = 0, pushed = 0;
+    const block_t *blocks[16];
+    size_t count;
+    while (budget > 0 && *cursor <= limit && (count = blockchain_acquire_range(*cursor, blocks, 16)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const block_t *block = blocks[i];
+            uint32_t num = block->block_num;
+            if (budget > 0 && num <= limit) {
+                *cursor = num + 1;
+                bool holder = shard_is_holder_in(&now, num, my_mac);
+                if (!block->body_pruned) {
+                    uint32_t sent = push ? shard_push_replicas(before, &now, num) : 0;
+                    pushed += sent;
+                    if (!holder) {
+                        block_t *header = light_node_pruned_copy(block);
+                        if (header && blockchain_replace_block(header)) {
+                            block_cache_invalidate(num);
+                            pruned++;
+                        } else if (header) {
+                            blockchain_free_block(header);
+                        }
+                    }
+                    if (sent > 0 || !holder) {
+                        budget--;
+                    }
+                } else if (holder && !light_node_enabled()) {
+                    // Ours to keep now; the body comes back through shard_offer_body().
+                    light_node_fetch_body(num);
+                    requested++;
+                    budget--;
+                }
+            }
+            blockchain_release_block(block);
+        }
+        if (count < 16) {
+            break;
+        }
+    }
+    if (pruned || requested || pushed) {
+        ESP_LOGI(TAG, "Rebalanced: %" PRIu32 " pruned, %" PRIu32 " requested, %" PRIu32 " pushed", pruned, requested, pushed);
+    }
+    xSemaphoreTake(shard_mutex, portMAX_DELAY);
+    stats.blocks_pruned += pruned;
+    stats.bodies_requested += requested;
+    stats.replicas_pushed += pushed;
+    xSemaphoreGive(shard_mutex);
+    return budget > 0;
+}
+
+static void shard_task(void *arg)
+{
+    static NODE_LOCAL shard_members_t before;      // Membership when the pending pushes started
+    static NODE_LOCAL shard_members_t old;
+    bool push = false;
+    uint32_t cursor = 0;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(SHARD_CHECK_MS));
+        if (shard_refresh_members(&old)) {
+            // Restart the walk; if pushes from an earlier change are still pending, keep
+            // comparing against the list from before that change.
+            if (!push) {
+                before = old;
+            }
+            push = true;
+            cursor = 0;
+        }
+        if (shard_rebalance(&cursor, push, &before)) {
+            push = false;
+            cursor = 0;
+        }
+    }
+}
+
+void shard_init(void)
+{
+    if (shard_mutex) {
+        return;
+    }
+    shard_mutex = xSemaphoreCreateMutex();
+    if (!shard_mutex) {
+        ESP_LOGE(TAG, "Failed to create shard mutex");
+        return;
+    }
+    esp_wifi_get_mac(ESP_IF_WIFI_STA, my_mac);
+    shard_add_member(&members, my_mac);
+    stats.members = 1;
+    xTaskCreate(shard_task, "shard_task", 4096, NULL, 2, NULL);
+}
+
+bool shard_is_holder(uint32_t block_num)
+{
+    if (!shard_mutex) {
+        return true;
+    }
+    xSemaphoreTake(shard_mutex, portMAX_DELAY);
+    bool holder = shard_is_holder_in(&members, block_num, my_mac);
+    xSemaphoreGive(shard_mutex);
+    return holder;
+}
+
+bool shard_pick_holder(uint32_t block_num, uint8_t *mac_out)
+{
+    if (!shard_mutex) {
+        return false;
+    }
+    bool found = false;
+    int holders[SHARD_REPLICAS];
+    xSemaphoreTake(shard_mutex, portMAX_DELAY);
+    int n = shard_holders(&members, block_num, holders);
+    for (int i = 0; i < n && !found; i++) {
+        if (memcmp(members.macs[holders[i]], my_mac, ESP_NOW_ETH_ALEN) != 0) {
+            memcpy(mac_out, members.macs[holders[i]], ESP_NOW_ETH_ALEN);
+            found = true;
+        }
+    }
+    xSemaphoreGive(shard_mutex);
+    return found;
+}
+
+bool shard_offer_body(block_t *block)
+{
+    if (!shard_mutex || light_node_enabled() || !shard_is_holder(block->block_num)) {
+        return false;
+    }
+    const block_t *local = blockchain_acquire_block(block->block_num);
+    bool wanted = local && local->body_pruned && memcmp(local->hash, block->hash, sizeof(block->hash)) == 0;
+    blockchain_release_block(local);
+    if (!wanted || !blockchain_replace_block(block)) {
+        return false;
+    }
+    xSemaphoreTake(shard_mutex, portMAX_DELAY);
+    stats.bodies_restored++;
+    xSemaphoreGive(shard_mutex);
+    return true;
+}
+
+void shard_get_stats(shard_stats_t *out)
+{
+    if (!shard_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(shard_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(shard_mutex);
+}
@@ -0,0 +1,44 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blockchain.h"
+
+// History is sharded across the mesh: each block's body is kept by SHARD_REPLICAS nodes,
+// chosen by rendezvous hashing of the block number over the membership list. Everyone keeps
+// every header, and the newest SHARD_RECENT_BLOCKS in full, since those are still being
+// broadcast and repaired. When membership changes, holders push bodies to the nodes that
+// became holders and nodes that stopped being one prune theirs.
+#define SHARD_REPLICAS          3
+#define SHARD_MAX_MEMBERS       MESH_MAX_NODES  // Every node must hash over the whole mesh to agree on holders
+#define SHARD_RECENT_BLOCKS     8
+#define SHARD_CHECK_MS          5000    // Membership poll and rebalance period
+#define SHARD_BATCH             16      // Blocks pruned, fetched or pushed per period
+
+typedef struct {
+    uint32_t members;
+    uint32_t membership_changes;
+    uint32_t blocks_pruned;         // Bodies dropped because we are not a holder
+    uint32_t bodies_restored;       // Bodies taken back in because we became a holder
+    uint32_t replicas_pushed;       // Bodies sent to new holders
+    uint32_t bodies_requested;
+} shard_stats_t;
+
+// Start the rebalance task.
+void shard_init(void);
+
+// True if this node should keep the body of `block_num`; always true while sharding is off
+// or the mesh is no larger than SHARD_REPLICAS.
+bool shard_is_holder(uint32_t block_num);
+
+// The first holder of `block_num` that is not us; false if we know none.
+bool shard_pick_holder(uint32_t block_num, uint8_t *mac_out);
+
+// A full body arrived for a block we store header-only; keep it if we hold that shard.
+// Takes ownership of `block` and returns true if it was kept.
+bool shard_offer_body(block_t *block);
+
+void shard_get_stats(shard_stats_t *out);
+
+#endif // SHARD_H
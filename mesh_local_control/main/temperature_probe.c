@@ -23,18 +23,8 @@ static uint8_t crc8(const uint8_t *data, int len)
     return crc;
 }
 
-// Cached sensor measurement values and timestamp
-static float cached_temperature = 0.0f;
-static float cached_humidity = 0.0f;
-static TickType_t last_measurement_ticks = 0;
-
-// Internal function to update sensor measurements if needed
-static void update_sensor_measurement(void)
+bool temperature_probe_measure(float *temperature, float *humidity)
 {
-    TickType_t now = xTaskGetTickCount();
-    if(now - last_measurement_ticks < pdMS_TO_TICKS(100))
-        return; // use cached values
-
     uint8_t cmd = 0xFD; // No-heater high precision command
     esp_err_t err;
 
@@ -48,7 +38,7 @@ static void update_sensor_measurement(void)
     i2c_cmd_link_delete(i2c_cmd);
     if(err != ESP_OK) {
         ESP_LOGE(TAG, "I2C write failed");
-        return;
+        return false;
     }
 
     // Wait for measurement (10 ms for high precision)
@@ -64,7 +54,7 @@ static void update_sensor_measurement(void)
     i2c_cmd_link_delete(i2c_cmd);
     if(err != ESP_OK) {
         ESP_LOGE(TAG, "I2C read failed");
-        return;
+        return false;
     }
 
     // Verify CRC for temperature (first two bytes) and humidity (bytes 3-4)
@@ -72,43 +62,20 @@ static void update_sensor_measurement(void)
        crc8(readbuffer + 3, 2) != readbuffer[5])
     {
         ESP_LOGE(TAG, "CRC mismatch");
-        return;
+        return false;
     }
 
     uint16_t temp_ticks = ((uint16_t)readbuffer[0] << 8) | readbuffer[1];
     uint16_t hum_ticks  = ((uint16_t)readbuffer[3] << 8) | readbuffer[4];
 
-    cached_temperature = -45 + 175 * ((float)temp_ticks / 65535);
-    cached_humidity = -6 + 125 * ((float)hum_ticks / 65535);
-    if(cached_humidity < 0.0f) cached_humidity = 0.0f;
-    if(cached_humidity > 100.0f) cached_humidity = 100.0f;
-
-    last_measurement_ticks = now;
+    *temperature = -45 + 175 * ((float)temp_ticks / 65535);
+    *humidity = -6 + 125 * ((float)hum_ticks / 65535);
+    if(*humidity < 0.0f) *humidity = 0.0f;
+    if(*humidity > 100.0f) *humidity = 100.0f;
+    return true;
 }
 
 void temperature_probe_init()
 {
     ;
 }
-
-float temperature_probe_read_temperature()
-{
-    update_sensor_measurement();
-    return cached_temperature;
-}
-
-float temperature_probe_read_humidity()
-{
-    update_sensor_measurement();
-    return cached_humidity;
-}
-
-void temperature_task(void *arg)
-{
-    while (true) {
-        float temp = temperature_probe_read_temperature();
-        float hum = temperature_probe_read_humidity();
-        ESP_LOGI(TAG, "Temperature: %.2f C, Humidity: %.2f %%", temp, hum);
-        vTaskDelay(pdMS_TO_TICKS(10000));
-    }
-}
\ No newline at end of file
@@ -4,8 +4,9 @@
 #include "my_includes.h"
 
 void temperature_probe_init();
-float temperature_probe_read_temperature();
-float temperature_probe_read_humidity();
-void temperature_task(void *arg);
+
+// One SHT45 high-precision measurement: blocks ~10 ms on I2C. Only sensor_sampler calls this;
+// everyone else reads its sample ring.
+bool temperature_probe_measure(float *temperature, float *humidity);
 
 #endif // TEMPERATURE_PROBE_H
@@ -0,0 +1,294 @@
+#include "verifier.h"
+#include "node_local.h"
+#include "blockchain.h"
+#include "checkpoint.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <inttypes.h>
+#if CONFIG_IDF_TARGET_LINUX
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+static const char *TAG = "verifier";
+
+// One contiguous slice of a batch. `prev` is the block just below blocks[0], or NULL if
+// blocks[0] is the first block we hold.
+typedef struct {
+    const block_t *prev;
+    const block_t *const *blocks;
+    size_t count;
+    size_t first_bad;           // Index of the first failing block; `count` if all pass
+} verifier_job_t;
+
+static NODE_LOCAL SemaphoreHandle_t verifier_mutex = NULL;    // One run at a time; guards watermark_hash
+static NODE_LOCAL SemaphoreHandle_t stats_mutex = NULL;       // Held only briefly, so stats never wait on a run
+static NODE_LOCAL TaskHandle_t verifier_task_handle = NULL;
+static NODE_LOCAL verifier_stats_t stats = {0};               // Also holds the watermark itself
+static NODE_LOCAL uint8_t watermark_hash[32];                 // Hash of the watermark block, to notice reorgs
+static NODE_LOCAL int worker_count = 1;
+
+#if !CONFIG_IDF_TARGET_LINUX
+static NODE_LOCAL TaskHandle_t workers[portNUM_PROCESSORS];
+static NODE_LOCAL verifier_job_t *worker_jobs[portNUM_PROCESSORS];
+static NODE_LOCAL SemaphoreHandle_t jobs_done = NULL;
+#endif
+
+static bool verifier_check_block(const block_t *prev, const block_t *block)
+{
+    if (prev && (block->block_num != prev->block_num + 1 ||
+                 memcmp(block->prev_hash, prev->hash, sizeof(prev->hash)) != 0)) {
+        return false;
+    }
+    // Hash a header copy; the committed block is immutable. Sensor records are only read.
+    block_t tmp = *block;
+    memset(tmp.hash, 0, sizeof(tmp.hash));
+    calculate_block_hash(&tmp);
+    return memcmp(tmp.hash, block->hash, sizeof(block->hash)) == 0;
+}
+
+static void verifier_run_job(verifier_job_t *job)
+{
+    const block_t *prev = job->prev;
+    job->first_bad = job->count;
+    for (size_t i = 0; i < job->count; i++) {
+        if (!verifier_check_block(prev, job->blocks[i])) {
+            job->first_bad = i;
+            return;
+        }
+        prev = job->blocks[i];
+    }
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+
+static void *verifier_thread(void *arg)
+{
+    verifier_run_job(arg);
+    return NULL;
+}
+
+static void verifier_dispatch(verifier_job_t *jobs, int count)
+{
+    pthread_t threads[VERIFIER_MAX_WORKERS];
+    bool started[VERIFIER_MAX_WORKERS] = {false};
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, verifier_thread, &jobs[i]) == 0;
+        if (!started[i]) {
+            verifier_run_job(&jobs[i]);
+        }
+    }
+    verifier_run_job(&jobs[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+#else
+
+static void verifier_worker_task(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        verifier_run_job(worker_jobs[index]);
+        xSemaphoreGive(jobs_done);
+    }
+}
+
+static void verifier_dispatch(verifier_job_t *jobs, int count)
+{
+    for (int i = 0; i < count; i++) {
+        worker_jobs[i] = &jobs[i];
+        xTaskNotifyGive(workers[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        xSemaphoreTake(jobs_done, portMAX_DELAY);
+    }
+}
+
+#endif
+
+// Verify `count` blocks, split into one slice per worker. Returns the index of the first
+// failing block, or `count`.
+static size_t verifier_check_batch(const block_t *prev, const block_t **blocks, size_t count)
+{
+    verifier_job_t jobs[VERIFIER_MAX_WORKERS];
+    int slices = worker_count;
+    if (count < (size_t)slices * VERIFIER_MIN_CHUNK) {
+        slices = 1;
+    }
+    size_t offset = 0;
+    for (int i = 0; i < slices; i++) {
+        size_t len = count / slices + ((size_t)i < count % slices ? 1 : 0);
+        jobs[i].prev = (offset == 0) ? prev : blocks[offset - 1];
+        jobs[i].blocks = blocks + offset;
+        jobs[i].count = len;
+        offset += len;
+    }
+    if (slices == 1) {
+        verifier_run_job(&jobs[0]);
+    } else {
+        verifier_dispatch(jobs, slices);
+    }
+    offset = 0;
+    for (int i = 0; i < slices; i++) {
+        if (jobs[i].first_bad < jobs[i].count) {
+            return offset + jobs[i].first_bad;
+        }
+        offset += jobs[i].count;
+    }
+    return count;
+}
+
+// Caller holds verifier_mutex.
+static void verifier_reset_locked(void)
+{
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    stats.resets++;
+    stats.valid = false;
+    stats.verified_up_to = 0;
+    xSemaphoreGive(stats_mutex);
+}
+
+bool verifier_run(void)
+{
+    if (!verifier_mutex) {
+        return false;
+    }
+    xSemaphoreTake(verifier_mutex, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+    bool ok = true;
+    uint32_t checked = 0;
+
+    // Continue from the watermark if the block there is still the one we verified.
+    const block_t *prev = NULL;
+    if (stats.valid) {
+        prev = blockchain_acquire_block(stats.verified_up_to);
+        if (!prev || memcmp(prev->hash, watermark_hash, sizeof(watermark_hash)) != 0) {
+            ESP_LOGW(TAG, "Chain changed below block %" PRIu32 "; verifying from the start", stats.verified_up_to);
+            blockchain_release_block(prev);
+            prev = NULL;
+            verifier_reset_locked();
+        }
+    }
+    uint32_t next = stats.valid ? stats.verified_up_to + 1 : 0;
+
+    const block_t *blocks[VERIFIER_BATCH];
+    while (1) {
+        size_t count = blockchain_acquire_range(next, blocks, VERIFIER_BATCH);
+        if (count == 0) {
+            break;
+        }
+        size_t good = verifier_check_batch(prev, blocks, count);
+        uint32_t bad_num = (good < count) ? blocks[good]->block_num : 0;
+        if (good > 0) {
+            blockchain_release_block(prev);
+            prev = blocks[good - 1];
+            memcpy(watermark_hash, prev->hash, sizeof(watermark_hash));
+            checked += good;
+            xSemaphoreTake(stats_mutex, portMAX_DELAY);
+            stats.valid = true;
+            stats.verified_up_to = prev->block_num;
+            stats.blocks_verified += good;
+            xSemaphoreGive(stats_mutex);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (blocks[i] != prev) {
+                blockchain_release_block(blocks[i]);
+            }
+        }
+        if (good < count) {
+            ESP_LOGE(TAG, "Block %" PRIu32 " failed verification (hash, linkage or gap below it)",
+                     bad_num);
+            ok = false;
+            break;
+        }
+        next = prev->block_num + 1;
+    }
+    uint32_t prev_num = prev ? prev->block_num : 0;
+    blockchain_release_block(prev);
+
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    stats.runs++;
+    stats.failures += ok ? 0 : 1;
+    stats.last_run_ms = elapsed_ms;
+    xSemaphoreGive(stats_mutex);
+    if (checked > 0) {
+        ESP_LOGI(TAG, "Verified %" PRIu32 " new block(s) in %" PRIu32 " ms; chain good up to %" PRIu32,
+                 checked, elapsed_ms, prev_num);
+    }
+    xSemaphoreGive(verifier_mutex);
+    // Checkpoints only ever cover blocks that passed.
+    checkpoint_update();
+    return ok;
+}
+
+static void verifier_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(VERIFIER_INTERVAL_MS));
+        verifier_run();
+    }
+}
+
+void verifier_init(void)
+{
+    if (verifier_mutex) {
+        return;
+    }
+    verifier_mutex = xSemaphoreCreateMutex();
+    stats_mutex = xSemaphoreCreateMutex();
+    if (!verifier_mutex || !stats_mutex) {
+        ESP_LOGE(TAG, "Failed to create verifier mutex");
+        return;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = (cores < 1) ? 1 : (cores > VERIFIER_MAX_WORKERS ? VERIFIER_MAX_WORKERS : (int)cores);
+#else
+    jobs_done = xSemaphoreCreateCounting(portNUM_PROCESSORS, 0);
+    if (!jobs_done) {
+        ESP_LOGE(TAG, "Failed to create verifier semaphore");
+        return;
+    }
+    worker_count = 0;
+    for (int core = 0; core < portNUM_PROCESSORS && core < VERIFIER_MAX_WORKERS; core++) {
+        if (xTaskCreatePinnedToCore(verifier_worker_task, "verify_worker", 4096, (void *)(intptr_t)core,
+                                    3, &workers[core], core) != pdPASS) {
+            break;
+        }
+        worker_count++;
+    }
+    if (worker_count == 0) {
+        worker_count = 1;       // Batches then run on the verifier task itself
+    }
+#endif
+    xTaskCreate(verifier_task, "verifier_task", 4096, NULL, 3, &verifier_task_handle);
+    ESP_LOGI(TAG, "Chain verifier started with %d worker(s)", worker_count);
+}
+
+void verifier_request(void)
+{
+    if (verifier_task_handle) {
+        xTaskNotifyGive(verifier_task_handle);
+    }
+}
+
+void verifier_get_stats(verifier_stats_t *out)
+{
+    if (!stats_mutex) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(stats_mutex);
+}
@@ -0,0 +1,37 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Whole-chain verification: every block's hash is recomputed and its prev_hash checked against
+// the block below it. Progress is kept as a watermark, so each run only looks at blocks
+// committed since the last one. Batches are split across one worker per core.
+#define VERIFIER_INTERVAL_MS    30000   // Periodic run; verifier_request() runs one sooner
+#define VERIFIER_BATCH          64      // Blocks taken from the chain per pass
+#define VERIFIER_MIN_CHUNK      8       // Below this a batch is checked on the calling task alone
+#define VERIFIER_MAX_WORKERS    8       // Upper bound on host threads; the ESP32 uses one per core
+
+typedef struct {
+    bool valid;                 // A watermark is set
+    uint32_t verified_up_to;    // Every block from the chain's first up to here checks out
+    uint32_t runs;
+    uint32_t blocks_verified;
+    uint32_t failures;          // Runs stopped by a bad hash, broken linkage or gap
+    uint32_t resets;            // Watermark dropped because the chain below it changed
+    uint32_t last_run_ms;
+} verifier_stats_t;
+
+// Start the workers and the periodic verification task.
+void verifier_init(void);
+
+// Ask for a run soon, e.g. after a sync or a restore.
+void verifier_request(void);
+
+// Verify from the watermark to the current tip on the calling task. Returns true if the
+// whole chain checks out.
+bool verifier_run(void);
+
+void verifier_get_stats(verifier_stats_t *out);
+
+#endif // VERIFIER_H
@@ -1,6 +1,11 @@
 #include "wifi_networking.h"
 #include "blockchain.h"
 #include "mesh_networking.h"
+#include "frame_trace.h"
+#include "metrics.h"
+#include "event_trace.h"
+#include "round_profile.h"
+#include "mem_track.h"
 #include "secrets.h"
 
 static const char *TAG = "wifi_networking";
@@ -51,6 +56,22 @@ ERR_EXIT:
     return -1;
 }
 
+// Send all of `data` on the socket in *ctx; writer for the trace, event and metrics dumps.
+static bool tcp_server_write(void *ctx, const uint8_t *data, size_t len)
+{
+    int sock = *(int *)ctx;
+    while (len > 0) {
+        int sent = send(sock, data, len, 0);
+        if (sent <= 0) {
+            ESP_LOGE(TAG, "Send to client failed");
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
 void tcp_server_task(void *arg)
 {
     int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -108,6 +129,37 @@ void tcp_server_task(void *arg)
                 blockchain_deinit();
                 blockchain_init();
             }
+            else if (!strcmp((char *)buffer, "TRACE_START")) {
+                frame_trace_clear();
+                frame_trace_set_enabled(true);
+            }
+            else if (!strcmp((char *)buffer, "TRACE_STOP")) {
+                frame_trace_set_enabled(false);
+            }
+            else if (!strcmp((char *)buffer, "TRACE_DUMP")) {
+                // Binary reply: the trace as described in frame_trace.h, then the connection closes.
+                frame_trace_dump(tcp_server_write, &client_sock);
+            }
+            else if (!strcmp((char *)buffer, "METRICS")) {
+                // Prometheus text exposition of the metrics registry.
+                metrics_write_text(tcp_server_write, &client_sock);
+            }
+            else if (!strcmp((char *)buffer, "METRICS_BIN")) {
+                // Compact binary snapshot, layout in metrics.h.
+                metrics_write_binary(tcp_server_write, &client_sock);
+            }
+            else if (!strcmp((char *)buffer, "EVENTS_DUMP")) {
+                // Binary event rings as described in event_trace.h; decode with event_trace_json.
+                event_trace_dump(tcp_server_write, &client_sock);
+            }
+            else if (!strcmp((char *)buffer, "ROUND_PROFILE")) {
+                // p50/p99 per round stage and per node over the recent leader rounds.
+                round_profile_write_text(tcp_server_write, &client_sock);
+            }
+            else if (!strcmp((char *)buffer, "MEM")) {
+                // Live and peak heap per subsystem, plus free heap and its largest block.
+                mem_track_write_text(tcp_server_write, &client_sock);
+            }
             else {
                 ESP_LOGW(TAG, "Unknown command: %s", buffer);
             }
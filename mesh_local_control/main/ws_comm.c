@@ -1,13 +1,61 @@
 #include "ws_comm.h"
+#include "mem_track.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "mesh_networking.h"
 #include "blockchain.h"
 #include "esp_mesh_lite.h"
+#include "metrics.h"
 #include <string.h>
+#include <stdlib.h>
 
 static const char *TAG = "WS_COMM";
 
+// Growable buffer a metrics snapshot is written into, so it goes out as a single frame.
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} ws_reply_t;
+
+static bool ws_reply_append(void *ctx, const uint8_t *data, size_t len)
+{
+    ws_reply_t *reply = ctx;
+    if (reply->len + len > reply->cap) {
+        size_t cap = reply->cap ? reply->cap * 2 : 1024;
+        while (cap < reply->len + len) {
+            cap *= 2;
+        }
+        uint8_t *grown = mem_track_realloc(MEM_TAG_COMM, reply->data, cap);
+        if (!grown) {
+            return false;
+        }
+        reply->data = grown;
+        reply->cap = cap;
+    }
+    memcpy(reply->data + reply->len, data, len);
+    reply->len += len;
+    return true;
+}
+
+static void ws_send_metrics(httpd_req_t *req, bool binary)
+{
+    ws_reply_t reply = {0};
+    bool ok = binary ? metrics_write_binary(ws_reply_append, &reply)
+                     : metrics_write_text(ws_reply_append, &reply);
+    if (ok) {
+        httpd_ws_frame_t out_pkt;
+        memset(&out_pkt, 0, sizeof(httpd_ws_frame_t));
+        out_pkt.payload = reply.data;
+        out_pkt.len = reply.len;
+        out_pkt.type = binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT;
+        httpd_ws_send_frame(req, &out_pkt);
+    } else {
+        ESP_LOGE(TAG, "Failed to build metrics snapshot");
+    }
+    mem_track_free(reply.data);
+}
+
 /**
  * @brief WebSocket event handler.
  *
@@ -67,6 +115,12 @@ static esp_err_t ws_handler(httpd_req_t *req)
             out_pkt.type = HTTPD_WS_TYPE_TEXT;
             httpd_ws_send_frame(req, &out_pkt);
         }
+        else if (!strcmp((char *)buf, "METRICS")) {
+            ws_send_metrics(req, false);
+        }
+        else if (!strcmp((char *)buf, "METRICS_BIN")) {
+            ws_send_metrics(req, true);
+        }
         else {
             const char *resp = "Unknown command";
             httpd_ws_frame_t out_pkt;